@@ -0,0 +1,18 @@
+include(FindPackageHandleStandardArgs)
+
+find_path(ZSTD_INCLUDE_DIR "zstd.h")
+
+find_library(ZSTD_LIBRARY NAMES zstd)
+
+find_package_handle_standard_args(Zstd
+    FOUND_VAR
+    ZSTD_FOUND
+    REQUIRED_VARS
+    ZSTD_LIBRARY
+    ZSTD_INCLUDE_DIR
+    FAIL_MESSAGE
+    "Could NOT find Zstd"
+)
+
+set(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
@@ -63,6 +63,7 @@ set(CMAKE_MODULE_PATH "${CMAKE_CURRENT_SOURCE_DIR}/cmake;${CMAKE_MODULE_PATH}")
 
 SET(ENABLE_GZIP OFF)
 SET(ENABLE_BROTLI OFF)
+option(ENABLE_ZSTD "Enable zstd Content-Encoding" OFF)
 
 if (ENABLE_SSL)
 	add_definitions(-DCINATRA_ENABLE_SSL)
@@ -83,6 +84,8 @@ if(ENABLE_SIMD STREQUAL "SSE42" OR ENABLE_SIMD STREQUAL "AVX2" OR ENABLE_SIMD ST
 			add_definitions(-DCINATRA_AVX2)
 		endif ()
 	endif ()
+elseif (CMAKE_HOST_SYSTEM_PROCESSOR MATCHES "x86_64")
+	message(STATUS "Choose the simd kernel of http parser at runtime")
 endif()
 
 add_definitions(-DASIO_STANDALONE)
@@ -110,5 +113,13 @@ if (ENABLE_BROTLI)
 	endif (Brotli_FOUND)
 endif(ENABLE_BROTLI)
 
+if (ENABLE_ZSTD)
+	find_package(Zstd REQUIRED)
+	if (Zstd_FOUND)
+		message(STATUS "Zstd found")
+		add_definitions(-DCINATRA_ENABLE_ZSTD)
+	endif (Zstd_FOUND)
+endif(ENABLE_ZSTD)
+
 
 add_definitions(-DCORO_HTTP_PRINT_REQ_HEAD)
\ No newline at end of file
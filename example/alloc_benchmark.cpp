@@ -0,0 +1,107 @@
+#include <cinatra.hpp>
+#include <cstdlib>
+#include <new>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Heap allocations per request of a typical json api response, first only
+// building the response, then through the server with keep-alive requests.
+// usage: alloc_benchmark [iterations]
+static std::atomic<size_t> g_alloc_count = 0;
+
+void *operator new(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1); ptr) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+constexpr std::string_view json_body =
+    R"({"id":42,"name":"cinatra","tags":["http","coroutine"]})";
+
+void json_handler(coro_http_response &resp) {
+  resp.need_date_head(false);
+  resp.add_header("Content-Type", "application/json");
+  resp.add_header("Cache-Control", "no-cache, no-store, must-revalidate");
+  resp.add_header("X-Request-Id", "6f9619ff-8b86-d011-b42d-00cf4fc964ff");
+  static const cookie token("token", "8b86d011b42d00cf4fc964ff");
+  resp.add_cookie(token);
+  resp.set_status_and_content_view(status_type::ok, json_body);
+}
+
+void bench_build(size_t iterations) {
+  coro_http_response resp(nullptr);
+  std::vector<asio::const_buffer> buffers;
+  std::string size_str;
+  std::string resp_str;
+  auto run = [&](size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      json_handler(resp);
+      resp.to_buffers(buffers, size_str);
+      buffers.clear();
+      json_handler(resp);
+      resp.build_resp_str(resp_str);
+      resp_str.clear();
+      resp.clear();
+    }
+  };
+  // the first request of a connection fills the arena.
+  run(1);
+
+  size_t allocs = g_alloc_count;
+  auto start = std::chrono::steady_clock::now();
+  run(iterations);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "build response: "
+            << (g_alloc_count - allocs) / (double)iterations / 2
+            << " allocs/response, " << elapsed.count() / iterations / 2
+            << " ns/response\n";
+}
+
+void bench_server(size_t iterations) {
+  coro_http_server server(1, 0);
+  server.set_http_handler<GET>(
+      "/json", [](coro_http_request &req, coro_http_response &resp) {
+        json_handler(resp);
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  asio::io_context ioc;
+  asio::ip::tcp::socket socket(ioc);
+  asio::connect(socket, asio::ip::tcp::resolver(ioc).resolve(
+                            "127.0.0.1", std::to_string(server.port())));
+  std::string req = "GET /json HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  std::string resp(4096, '\0');
+  auto request = [&] {
+    asio::write(socket, asio::buffer(req));
+    size_t size = 0;
+    while (std::string_view(resp.data(), size).find(json_body) ==
+           std::string_view::npos) {
+      size += socket.read_some(asio::buffer(resp.data() + size, 4096 - size));
+    }
+  };
+  request();
+
+  size_t allocs = g_alloc_count;
+  for (size_t i = 0; i < iterations; i++) {
+    request();
+  }
+  std::cout << "through the server: "
+            << (g_alloc_count - allocs) / (double)iterations
+            << " allocs/request\n";
+  server.stop();
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = argc > 1 ? std::stoul(argv[1]) : 100000;
+  bench_build(iterations);
+  bench_server(iterations / 10);
+}
@@ -0,0 +1,145 @@
+#include <cinatra.hpp>
+#ifdef CINATRA_ENABLE_ZSTD
+#include <zdict.h>
+#endif
+
+using namespace cinatra;
+
+// Ratio and throughput of the content codings on json payloads of 1KB, 16KB
+// and 256KB: gzip, brotli and zstd, and zstd with a dictionary trained on
+// other payloads of the same shape. brotli and zstd are measured if they are
+// enabled by CINATRA_ENABLE_BROTLI and CINATRA_ENABLE_ZSTD.
+// usage: codec_benchmark [total MB per case]
+std::string make_json(size_t size, size_t seed) {
+  std::string body = "[";
+  for (size_t i = seed; body.size() < size; i++) {
+    body.append("{\"id\":")
+        .append(std::to_string(i * 2654435761 % 1000003))
+        .append(",\"name\":\"user")
+        .append(std::to_string(i * 7919 % 10007))
+        .append("\",\"email\":\"user")
+        .append(std::to_string(i % 977))
+        .append("@example.com\",\"score\":")
+        .append(std::to_string(i * 31 % 100))
+        .append(".")
+        .append(std::to_string(i % 10))
+        .append(",\"active\":")
+        .append(i % 3 ? "true" : "false")
+        .append(",\"tags\":[\"t")
+        .append(std::to_string(i % 17))
+        .append("\",\"t")
+        .append(std::to_string(i % 5))
+        .append("\"]},");
+  }
+  body.resize(size - 1);
+  body.append("]");
+  return body;
+}
+
+struct codec {
+  std::string name;
+  std::function<bool(std::string_view, std::string &)> compress;
+  std::function<bool(std::string_view, std::string &)> decompress;
+};
+
+template <typename Fn>
+double bench_mbs(size_t size, size_t total, Fn &&fn) {
+  size_t count = (std::max)(total / size, (size_t)1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    fn();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return size * count / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+  size_t total = (argc > 1 ? std::stoul(argv[1]) : 32) * 1024 * 1024;
+
+  std::vector<codec> codecs;
+  codecs.push_back(
+      {"gzip -6",
+       [](auto in, auto &out) {
+         return gzip_codec::compress(in, out);
+       },
+       [](auto in, auto &out) {
+         return gzip_codec::uncompress(in, out);
+       }});
+#ifdef CINATRA_ENABLE_BROTLI
+  codecs.push_back(
+      {"br q" + std::to_string(CINATRA_BROTLI_STREAM_QUALITY),
+       [](auto in, auto &out) {
+         return compress_data(content_encoding::br, in, out);
+       },
+       [](auto in, auto &out) {
+         return decompress_data(content_encoding::br, in, out);
+       }});
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+  codecs.push_back(
+      {"zstd -" + std::to_string(CINATRA_ZSTD_LEVEL),
+       [](auto in, auto &out) {
+         return zstd_codec::compress(in, out, CINATRA_ZSTD_LEVEL, nullptr);
+       },
+       [](auto in, auto &out) {
+         return zstd_codec::decompress(in, out);
+       }});
+
+  // train the dictionary on the other payloads of 1KB.
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (size_t i = 0; i < 1000; i++) {
+    auto sample = make_json(1024, 100000 + i * 13);
+    samples.append(sample);
+    sample_sizes.push_back(sample.size());
+  }
+  std::string dict_buf(16 * 1024, '\0');
+  size_t dict_size =
+      ZDICT_trainFromBuffer(dict_buf.data(), dict_buf.size(), samples.data(),
+                            sample_sizes.data(), (unsigned)sample_sizes.size());
+  if (!ZDICT_isError(dict_size)) {
+    dict_buf.resize(dict_size);
+    zstd_codec::set_shared_dictionary(
+        std::make_shared<zstd_codec::dictionary>(dict_buf));
+    codecs.push_back(
+        {"zstd -" + std::to_string(CINATRA_ZSTD_LEVEL) + " dict",
+         [](auto in, auto &out) {
+           return zstd_codec::compress(in, out);
+         },
+         [](auto in, auto &out) {
+           return zstd_codec::decompress(in, out);
+         }});
+  }
+#endif
+
+  for (size_t size : {1024, 16 * 1024, 256 * 1024}) {
+    auto body = make_json(size, 0);
+    for (auto &c : codecs) {
+      std::string compressed, decompressed;
+      if (!c.compress(body, compressed) ||
+          !c.decompress(compressed, decompressed) || decompressed != body) {
+        std::cout << c.name << " failed\n";
+        continue;
+      }
+      double ratio = (double)body.size() / compressed.size();
+      std::string out;
+      double compress_mbs = 0, decompress_mbs = 0;
+      // the best of 3 rounds, to be fair with the noise of the machine.
+      for (int round = 0; round < 3; round++) {
+        compress_mbs = (std::max)(compress_mbs, bench_mbs(size, total / 3, [&] {
+                                    out.clear();
+                                    c.compress(body, out);
+                                  }));
+        decompress_mbs =
+            (std::max)(decompress_mbs, bench_mbs(size, total / 3, [&] {
+                         out.clear();
+                         c.decompress(compressed, out);
+                       }));
+      }
+      std::cout << size << " bytes " << c.name << ": ratio " << ratio
+                << ", compress " << compress_mbs << " MB/s, decompress "
+                << decompress_mbs << " MB/s\n";
+    }
+  }
+}
@@ -0,0 +1,113 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+
+// Compression throughput of gzip: the one-shot path which creates a zlib
+// state for every call, the pooled gzip_codec::compress, and a streamed body
+// compressed piece by piece by stream_compressor, compared with buffering
+// the whole body and compressing it once.
+// usage: compression_benchmark [total MB per case]
+std::string make_body(size_t size) {
+  // json like text, compressible as the real responses.
+  std::string body;
+  for (size_t i = 0; body.size() < size; i++) {
+    body.append("{\"id\":")
+        .append(std::to_string(i))
+        .append(",\"name\":\"user")
+        .append(std::to_string(i * 7919 % 10007))
+        .append("\",\"active\":true},");
+  }
+  body.resize(size);
+  return body;
+}
+
+// the one-shot path without the pooled state, as gzip_codec::compress was.
+bool fresh_compress(std::string_view data, std::string &compressed_data) {
+  unsigned char out[CHUNK];
+  z_stream strm{};
+  if (deflateInit2(&strm, -1, Z_DEFLATED, windowBits | GZIP_ENCODING, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  strm.next_in = (unsigned char *)data.data();
+  strm.avail_in = (uInt)data.length();
+  do {
+    strm.avail_out = CHUNK;
+    strm.next_out = out;
+    if (deflate(&strm, Z_FINISH) == Z_STREAM_ERROR) {
+      return false;
+    }
+    compressed_data.append((char *)out, CHUNK - strm.avail_out);
+  } while (strm.avail_out == 0);
+  return deflateEnd(&strm) == Z_OK;
+}
+
+template <typename Fn>
+double bench_mbs(size_t body_size, size_t total, Fn &&fn) {
+  size_t count = (std::max)(total / body_size, (size_t)1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    fn();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return body_size * count / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+  size_t total = (argc > 1 ? std::stoul(argv[1]) : 64) * 1024 * 1024;
+  std::string compressed;
+
+  for (size_t size : {512, 4 * 1024, 64 * 1024, 1024 * 1024}) {
+    auto body = make_body(size);
+    // the cases run in turns and the best round is taken.
+    double fresh = 0, pooled = 0;
+    for (int round = 0; round < 3; round++) {
+      fresh = (std::max)(fresh, bench_mbs(size, total / 3, [&] {
+                           compressed.clear();
+                           fresh_compress(body, compressed);
+                         }));
+      pooled = (std::max)(pooled, bench_mbs(size, total / 3, [&] {
+                            compressed.clear();
+                            gzip_codec::compress(body, compressed);
+                          }));
+    }
+    std::cout << size << " bytes one-shot: fresh state " << fresh
+              << " MB/s, pooled state " << pooled << " MB/s\n";
+  }
+
+  // a 1MB chunked response written in 16KB pieces.
+  size_t size = 1024 * 1024;
+  size_t piece = 16 * 1024;
+  auto body = make_body(size);
+  double buffered = 0, streamed = 0;
+  size_t streamed_size = 0;
+  for (int round = 0; round < 3; round++) {
+    buffered = (std::max)(buffered, bench_mbs(size, total / 3, [&] {
+                            // the pieces are buffered before compression.
+                            std::string whole;
+                            for (size_t pos = 0; pos < size; pos += piece) {
+                              whole.append(body, pos, piece);
+                            }
+                            compressed.clear();
+                            fresh_compress(whole, compressed);
+                          }));
+    streamed = (std::max)(streamed, bench_mbs(size, total / 3, [&] {
+                            stream_compressor compressor;
+                            compressor.init(content_encoding::gzip);
+                            compressed.clear();
+                            for (size_t pos = 0; pos < size; pos += piece) {
+                              compressor.compress(
+                                  std::string_view(body).substr(pos, piece),
+                                  compressed, false);
+                            }
+                            compressor.compress("", compressed, true);
+                            streamed_size = compressed.size();
+                          }));
+  }
+  compressed.clear();
+  fresh_compress(body, compressed);
+  std::cout << "1MB in 16KB pieces: buffered one-shot " << buffered
+            << " MB/s (" << compressed.size() << " bytes), streamed "
+            << streamed << " MB/s (" << streamed_size << " bytes)\n";
+}
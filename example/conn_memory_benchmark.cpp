@@ -0,0 +1,131 @@
+#include <cinatra.hpp>
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace cinatra;
+
+// the bytes allocated by the process, or the resident size if malloc can't
+// tell.
+size_t memory_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#elif defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * 4096;
+#else
+  return 0;
+#endif
+}
+
+// The memory held by the server for an idle keep-alive connection after one
+// request, and for an idle websocket after the handshake. The client sockets
+// are opened before the baseline, so the growth is the server's.
+// usage: conn_memory_benchmark [http connections] [websocket connections]
+int main(int argc, char **argv) {
+  size_t http_count = argc > 1 ? std::stoul(argv[1]) : 8000;
+  size_t ws_count = argc > 2 ? std::stoul(argv[2]) : 1000;
+#ifdef __unix__
+  // both ends of the connections are in this process.
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+
+  coro_http_server server(1, 9001);
+  server.set_http_handler<GET>(
+      "/plaintext", [](coro_http_request &req, coro_http_response &resp) {
+        resp.set_status_and_content(status_type::ok, "Hello, World!");
+      });
+  server.set_http_handler<GET>(
+      "/ws",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        while (true) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec) {
+            break;
+          }
+        }
+      });
+  server.async_start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  asio::io_context ctx;
+  std::vector<asio::ip::tcp::socket> socks;
+  socks.reserve(http_count + ws_count);
+  for (size_t i = 0; i < http_count + ws_count; i++) {
+    socks.emplace_back(ctx).open(asio::ip::tcp::v4());
+  }
+  std::array<char, 4096> buf;
+  auto connect = [&](asio::ip::tcp::socket &sock, std::string_view request,
+                     std::string_view end) {
+    std::error_code ec;
+    sock.connect({asio::ip::make_address("127.0.0.1"), 9001}, ec);
+    if (ec) {
+      std::cout << "connect failed: " << ec.message() << "\n";
+      return false;
+    }
+    asio::write(sock, asio::buffer(request));
+    std::string response;
+    while (response.find(end) == std::string::npos) {
+      size_t n = sock.read_some(asio::buffer(buf), ec);
+      if (ec) {
+        std::cout << "read failed: " << ec.message() << "\n";
+        return false;
+      }
+      response.append(buf.data(), n);
+    }
+    return true;
+  };
+  auto wait_count = [&](size_t count) {
+    while (server.connection_count() < count) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // let the connections reach their idle wait.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  };
+
+  size_t baseline = memory_in_use();
+  for (size_t i = 0; i < http_count; i++) {
+    if (!connect(socks[i],
+                 "GET /plaintext HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n",
+                 "Hello, World!")) {
+      return 1;
+    }
+  }
+  wait_count(http_count);
+  size_t http_used = memory_in_use();
+  if (http_count > 0) {
+    std::cout << "idle http connection: "
+              << (http_used - baseline) / http_count << " bytes\n";
+  }
+
+  std::string_view handshake =
+      "GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+      "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+      "Sec-WebSocket-Version: 13\r\n\r\n";
+  for (size_t i = http_count; i < http_count + ws_count; i++) {
+    if (!connect(socks[i], handshake, "\r\n\r\n")) {
+      return 1;
+    }
+  }
+  wait_count(http_count + ws_count);
+  if (ws_count > 0) {
+    std::cout << "idle websocket connection: "
+              << (memory_in_use() - http_used) / ws_count << " bytes\n";
+  }
+
+  for (auto &sock : socks) {
+    std::error_code ec;
+    sock.close(ec);
+  }
+  server.stop();
+}
@@ -0,0 +1,76 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Compare the new connection rate of the single acceptor and the reuse port
+// acceptors, every connection sends one request and then closes.
+// usage: connection_rate_benchmark [server_threads] [client_threads] [seconds]
+double bench(bool reuse_port, size_t server_threads, size_t client_threads,
+             std::chrono::seconds duration) {
+  coro_http_server server(server_threads, 0);
+  server.set_reuse_port(reuse_port);
+  server.set_http_handler<GET>(
+      "/plaintext", [](coro_http_request &req, coro_http_response &resp) {
+        resp.need_date_head(false);
+        resp.set_status_and_content(status_type::ok, "Hello, world!");
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  std::string port = std::to_string(server.port());
+  std::string req = "GET /plaintext HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  std::atomic<size_t> total = 0;
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < client_threads; i++) {
+    threads.emplace_back([&] {
+      asio::io_context ioc;
+      asio::ip::tcp::resolver resolver(ioc);
+      auto endpoints = resolver.resolve("127.0.0.1", port);
+      size_t count = 0;
+      while (!stop) {
+        asio::ip::tcp::socket socket(ioc);
+        std::error_code ec;
+        asio::connect(socket, endpoints, ec);
+        if (ec) {
+          continue;
+        }
+        asio::write(socket, asio::buffer(req), ec);
+        asio::streambuf buf;
+        asio::read_until(socket, buf, TWO_CRCF, ec);
+        if (!ec) {
+          count++;
+        }
+        // avoid TIME_WAIT on the client side running out of ports.
+        socket.set_option(asio::socket_base::linger(true, 0), ec);
+        socket.close(ec);
+      }
+      total += count;
+    });
+  }
+
+  std::this_thread::sleep_for(duration);
+  stop = true;
+  for (auto &thd : threads) {
+    thd.join();
+  }
+  server.stop();
+
+  double rate = total / (double)duration.count();
+  std::cout << (reuse_port ? "reuse port acceptors" : "single acceptor")
+            << ": " << total << " connections, " << rate
+            << " connections/sec\n";
+  return rate;
+}
+
+int main(int argc, char **argv) {
+  size_t server_threads =
+      argc > 1 ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+  size_t client_threads = argc > 2 ? std::stoul(argv[2]) : server_threads;
+  std::chrono::seconds duration(argc > 3 ? std::stoul(argv[3]) : 10);
+
+  double single = bench(false, server_threads, client_threads, duration);
+  double multi = bench(true, server_threads, client_threads, duration);
+  std::cout << "speedup: " << multi / single << "x\n";
+}
@@ -0,0 +1,83 @@
+#include <cinatra.hpp>
+#include <cstdlib>
+#include <new>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Heap allocations per plaintext request through the server, the coroutine
+// frames of the request path are counted only when they miss the frame pool.
+// usage: frame_alloc_benchmark [iterations]
+static std::atomic<size_t> g_alloc_count = 0;
+
+void *operator new(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1); ptr) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+constexpr std::string_view body = "Hello, World!";
+
+void bench(std::string_view name, std::string_view path, size_t iterations) {
+  asio::io_context ioc;
+  asio::ip::tcp::socket socket(ioc);
+  asio::connect(socket,
+                asio::ip::tcp::resolver(ioc).resolve("127.0.0.1", "9001"));
+  std::string req = "GET ";
+  req.append(path).append(" HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+  std::string resp(4096, '\0');
+  auto request = [&] {
+    asio::write(socket, asio::buffer(req));
+    size_t size = 0;
+    while (std::string_view(resp.data(), size).find(body) ==
+           std::string_view::npos) {
+      size += socket.read_some(asio::buffer(resp.data() + size, 4096 - size));
+    }
+  };
+  // the first requests fill the pools of the io thread.
+  for (int i = 0; i < 10; i++) {
+    request();
+  }
+
+  size_t allocs = g_alloc_count;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    request();
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << (g_alloc_count - allocs) / (double)iterations
+            << " allocs/request, " << elapsed.count() / iterations
+            << " us/request\n";
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = argc > 1 ? std::stoul(argv[1]) : 20000;
+
+  coro_http_server server(1, 9001);
+  server.set_http_handler<GET>(
+      "/plaintext", [](coro_http_request &req, coro_http_response &resp) {
+        resp.need_date_head(false);
+        resp.set_status_and_content_view(status_type::ok, body);
+      });
+  server.set_http_handler<GET>(
+      "/coro_plaintext",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        resp.need_date_head(false);
+        resp.set_status_and_content_view(status_type::ok, body);
+        co_return;
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  bench("plaintext", "/plaintext", iterations);
+  bench("coroutine plaintext", "/coro_plaintext", iterations);
+  server.stop();
+}
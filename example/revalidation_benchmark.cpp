@@ -0,0 +1,95 @@
+#include <cinatra.hpp>
+#include <fstream>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Revalidation requests per second of the static files of 4KB and 1MB, the
+// client sends If-None-Match with the ETag of the first response, with and
+// without the static cache. A server without conditional requests answers
+// them with the whole file.
+// usage: revalidation_benchmark [requests]
+struct response_info {
+  int status = 0;
+  std::string etag;
+};
+
+response_info get_file(asio::ip::tcp::socket &socket, const std::string &req,
+                       std::vector<char> &buf) {
+  asio::write(socket, asio::buffer(req));
+  size_t size = 0;
+  size_t head_end = std::string_view::npos;
+  while (head_end == std::string_view::npos) {
+    size += socket.read_some(asio::buffer(buf.data() + size, 4096));
+    head_end = std::string_view(buf.data(), size).find("\r\n\r\n");
+  }
+  std::string_view head(buf.data(), head_end);
+  response_info info;
+  info.status = std::stoi(std::string(head.substr(9, 3)));
+  size_t content_length = 0;
+  for (auto line : split_sv(head, "\r\n")) {
+    if (auto pos = line.find(": "); pos != std::string_view::npos) {
+      auto name = line.substr(0, pos);
+      auto value = line.substr(pos + 2);
+      if (name == "ETag") {
+        info.etag = value;
+      }
+      else if (name == "Content-Length") {
+        content_length = std::stoull(std::string(value));
+      }
+    }
+  }
+  size_t left = content_length - (size - head_end - 4);
+  while (left > 0) {
+    left -= socket.read_some(
+        asio::buffer(buf.data(), (std::min)(left, buf.size())));
+  }
+  return info;
+}
+
+int main(int argc, char **argv) {
+  size_t requests = argc > 1 ? std::stoul(argv[1]) : 20000;
+  std::string dir = "revalidation_bench";
+  fs::create_directories(dir);
+  std::vector<std::pair<std::string, size_t>> files{{"4k.bin", 4 * 1024},
+                                                    {"1m.bin", 1024 * 1024}};
+  for (auto &[name, size] : files) {
+    std::ofstream(dir + "/" + name, std::ios::binary) << std::string(size, 'a');
+  }
+
+  for (bool cached : {false, true}) {
+    coro_http_server server(1, 0);
+    server.set_static_res_dir("", dir);
+    if (!cached) {
+      server.set_static_cache_budget(0);
+    }
+    server.async_start();
+    std::this_thread::sleep_for(200ms);
+
+    asio::io_context ioc;
+    asio::ip::tcp::socket socket(ioc);
+    asio::connect(socket, asio::ip::tcp::resolver(ioc).resolve(
+                              "127.0.0.1", std::to_string(server.port())));
+    std::vector<char> buf(256 * 1024);
+    for (auto &[name, size] : files) {
+      std::string req = "GET /" + name + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+      auto info = get_file(socket, req + "\r\n", buf);
+      req.append("If-None-Match: ")
+          .append(info.etag.empty() ? "\"none\"" : info.etag)
+          .append("\r\n\r\n");
+
+      size_t count = name == "1m.bin" ? requests / 10 : requests;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < count; i++) {
+        info = get_file(socket, req, buf);
+      }
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::cout << name << (cached ? " cache on" : " cache off") << ": "
+                << count / elapsed.count() << " requests/s, status "
+                << info.status << "\n";
+    }
+    server.stop();
+  }
+  fs::remove_all(dir);
+}
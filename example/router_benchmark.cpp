@@ -0,0 +1,124 @@
+#include <cinatra.hpp>
+#include <cstdlib>
+#include <new>
+
+using namespace cinatra;
+
+// count the heap allocations of the lookups.
+static std::atomic<size_t> g_alloc_count = 0;
+
+void *operator new(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1); ptr) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+// Lookup cost of the compiled router with 10, 100 and 1000 routes, compared
+// with matching every "{}" route by std::regex one by one, and the heap
+// allocations of a ":param" lookup.
+// usage: router_benchmark [iterations]
+template <typename F>
+double bench_ns(size_t iterations, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    f();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+void bench_routes(size_t route_count, size_t iterations) {
+  coro_http_router router;
+  std::vector<std::regex> regexes;
+  auto handler = [](coro_http_request &req, coro_http_response &resp) {
+  };
+  for (size_t i = 0; i < route_count; i++) {
+    std::string n = std::to_string(i);
+    // one third of each kind: ":param", "{}" and regex routes.
+    switch (i % 3) {
+      case 0:
+        router.set_http_handler<GET>("/api/v" + n + "/users/:id", handler);
+        break;
+      case 1: {
+        std::string route = "/files" + n + "/{}/detail/{}";
+        router.set_http_handler<GET>(route, handler);
+        std::string pattern = "GET " + route;
+        replace_all(pattern, "{}", "([^/]+)");
+        regexes.emplace_back(pattern);
+      } break;
+      default:
+        router.set_http_handler<GET>("/numbers" + n + R"(/(\d+))", handler);
+        break;
+    }
+  }
+
+  size_t last = route_count - 1;
+  while (last % 3 != 1) {
+    last--;
+  }
+  std::string key =
+      "GET /files" + std::to_string(last) + "/cinatra/detail/readme";
+
+  route_params params;
+  route_matches matches;
+  double tree_ns = bench_ns(iterations, [&] {
+    auto route = router.match(key, params, matches);
+    if (route == nullptr) [[unlikely]] {
+      std::abort();
+    }
+  });
+
+  std::smatch smatches;
+  double linear_ns = bench_ns(iterations, [&] {
+    for (auto &regex : regexes) {
+      std::string regex_key{key};
+      if (std::regex_match(regex_key, smatches, regex)) {
+        break;
+      }
+    }
+  });
+
+  std::string param_key = "GET /api/v0/users/42";
+  size_t allocs = g_alloc_count;
+  double param_ns = bench_ns(iterations, [&] {
+    auto route = router.match(param_key, params, matches);
+    if (route == nullptr || params["id"] != "42") [[unlikely]] {
+      std::abort();
+    }
+  });
+  double param_allocs = (g_alloc_count - allocs) / (double)iterations;
+
+  // what the lookup used to do: copy the params into a map of strings.
+  allocs = g_alloc_count;
+  double map_ns = bench_ns(iterations, [&] {
+    auto route = router.match(param_key, params, matches);
+    std::unordered_map<std::string, std::string> map;
+    for (size_t i = 0; i < params.size; i++) {
+      map[route->param_names[i]] = params.values[i];
+    }
+    if (map["id"] != "42") [[unlikely]] {
+      std::abort();
+    }
+  });
+  double map_allocs = (g_alloc_count - allocs) / (double)iterations;
+
+  std::cout << route_count << " routes: compiled router " << tree_ns
+            << " ns, linear regex " << linear_ns << " ns, :param route "
+            << param_ns << " ns " << param_allocs
+            << " allocs, :param copied to map " << map_ns << " ns "
+            << map_allocs << " allocs\n";
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = argc > 1 ? std::stoul(argv[1]) : 20000;
+  for (size_t route_count : {10, 100, 1000}) {
+    bench_routes(route_count, iterations);
+  }
+}
@@ -0,0 +1,81 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Compare full tls handshakes with resumed handshakes(session ticket or
+// session cache), every connection sends one request and then closes.
+// usage: ssl_handshake_benchmark [connections] [ticket|cache]
+double bench(unsigned short port, size_t count, bool resume) {
+  asio::io_context ioc;
+  asio::ssl::context ctx(asio::ssl::context::sslv23);
+  ctx.set_verify_mode(asio::ssl::verify_none);
+  asio::ip::tcp::resolver resolver(ioc);
+  auto endpoints = resolver.resolve("127.0.0.1", std::to_string(port));
+  std::string req = "GET /plaintext HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+  SSL_SESSION *session = nullptr;
+  size_t reused = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    asio::ssl::stream<asio::ip::tcp::socket> stream(ioc, ctx);
+    asio::connect(stream.next_layer(), endpoints);
+    if (resume && session) {
+      SSL_set_session(stream.native_handle(), session);
+    }
+    stream.handshake(asio::ssl::stream_base::client);
+    reused += SSL_session_reused(stream.native_handle());
+
+    asio::write(stream, asio::buffer(req));
+    asio::streambuf buf;
+    asio::read_until(stream, buf, TWO_CRCF);
+    // the session is not resumable if the ssl stream is not shutdown.
+    std::error_code ec;
+    stream.shutdown(ec);
+
+    if (resume) {
+      if (session) {
+        SSL_SESSION_free(session);
+      }
+      session = SSL_get1_session(stream.native_handle());
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  if (session) {
+    SSL_SESSION_free(session);
+  }
+
+  std::cout << (resume ? "resumed" : "full") << " handshakes: " << count
+            << ", reused: " << reused << ", " << count / elapsed
+            << " handshakes/sec\n";
+  return count / elapsed;
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 2000;
+  bool use_ticket = argc > 2 ? std::string_view(argv[2]) != "cache" : true;
+
+  coro_http_server server(std::thread::hardware_concurrency(), 8091);
+  server.init_ssl("../../include/cinatra/server.crt",
+                  "../../include/cinatra/server.key", "test");
+  if (!use_ticket) {
+    server.set_ssl_ticket_key_rotation(0s);
+  }
+  server.set_http_handler<GET>(
+      "/plaintext", [](coro_http_request &req, coro_http_response &resp) {
+        resp.need_date_head(false);
+        resp.set_status_and_content(status_type::ok, "Hello, world!");
+      });
+  auto ec = server.async_start();
+  std::this_thread::sleep_for(200ms);
+  if (ec.hasResult()) {
+    std::cout << "server start failed: " << ec.value().message() << "\n";
+    return 1;
+  }
+
+  double full = bench(server.port(), count, false);
+  double resumed = bench(server.port(), count, true);
+  std::cout << "speedup: " << resumed / full << "x\n";
+}
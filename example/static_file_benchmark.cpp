@@ -0,0 +1,99 @@
+#include <cinatra.hpp>
+#include <fstream>
+
+using namespace cinatra;
+using namespace std::chrono_literals;
+
+// Download throughput of the static files of 4KB, 1MB and 1GB through one
+// keep-alive connection, with and without the static cache, the body is
+// discarded by the client.
+// usage: static_file_benchmark [dir under the current path] [max file size]
+struct bench_file {
+  std::string name;
+  size_t size;
+  size_t requests;
+};
+
+void create_file(const std::string &path, size_t size) {
+  if (std::error_code ec; fs::file_size(path, ec) == size) {
+    return;
+  }
+  std::ofstream file(path, std::ios::binary);
+  std::string block(1024 * 1024, 'a');
+  while (size > 0) {
+    size_t n = (std::min)(size, block.size());
+    file.write(block.data(), n);
+    size -= n;
+  }
+}
+
+double bench_file_mbs(asio::ip::tcp::socket &socket, const bench_file &f) {
+  std::string req = "GET /" + f.name + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  std::vector<char> buf(256 * 1024);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < f.requests; i++) {
+    asio::write(socket, asio::buffer(req));
+    // read the header, then skip the body.
+    size_t size = 0;
+    size_t head_end = std::string_view::npos;
+    while (head_end == std::string_view::npos) {
+      size += socket.read_some(asio::buffer(buf.data() + size, 4096));
+      head_end = std::string_view(buf.data(), size).find("\r\n\r\n");
+    }
+    size_t left = f.size - (size - head_end - 4);
+    while (left > 0) {
+      left -= socket.read_some(
+          asio::buffer(buf.data(), (std::min)(left, buf.size())));
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return f.size * f.requests / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+  std::string dir = argc > 1 ? argv[1] : "static_bench";
+  size_t max_size = argc > 2 ? std::stoull(argv[2]) : 1024 * 1024 * 1024;
+  fs::create_directories(dir);
+
+  std::vector<bench_file> files{{"4k.bin", 4 * 1024, 20000},
+                                {"1m.bin", 1024 * 1024, 1000},
+                                {"1g.bin", 1024 * 1024 * 1024, 3}};
+  std::erase_if(files, [&](auto &f) {
+    return f.size > max_size;
+  });
+  for (auto &f : files) {
+    create_file(dir + "/" + f.name, f.size);
+  }
+
+  // the files up to 3MB are cached by default, the cache is disabled at
+  // first to send every file by sendfile.
+  for (bool cached : {false, true}) {
+    coro_http_server server(1, 0);
+    server.set_static_res_dir("", dir);
+    server.set_file_resp_format_type(file_resp_format_type::range);
+    if (!cached) {
+      server.set_static_cache_budget(0);
+    }
+    server.async_start();
+    std::this_thread::sleep_for(200ms);
+
+    asio::io_context ioc;
+    asio::ip::tcp::socket socket(ioc);
+    asio::connect(socket, asio::ip::tcp::resolver(ioc).resolve(
+                              "127.0.0.1", std::to_string(server.port())));
+    for (auto &f : files) {
+      // warm up the page cache and the static cache.
+      bench_file_mbs(socket, {f.name, f.size, 1});
+      double mbs = bench_file_mbs(socket, f);
+      std::cout << f.name << (cached ? " cache on" : " cache off") << ": "
+                << mbs << " MB/s, "
+                << f.requests / (f.size * f.requests / (mbs * 1024 * 1024))
+                << " requests/s\n";
+    }
+    auto stats = server.get_static_cache_stats();
+    std::cout << "cache hits " << stats.hits << ", misses " << stats.misses
+              << ", bytes " << stats.bytes << "\n";
+    server.stop();
+  }
+}
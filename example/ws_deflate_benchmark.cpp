@@ -0,0 +1,77 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+
+// Ratio and messages per second of permessage-deflate on a stream of json
+// messages of one schema: every message compressed alone, as the websocket
+// did before, and the streams of a connection kept with context takeover.
+// usage: ws_deflate_benchmark [messages]
+std::string make_message(size_t i) {
+  return std::string(R"({"type":"trade","symbol":"SYM)")
+      .append(std::to_string(i % 50))
+      .append(R"(","price":)")
+      .append(std::to_string(100 + i * 7919 % 1000))
+      .append(".")
+      .append(std::to_string(i % 100))
+      .append(R"(,"volume":)")
+      .append(std::to_string(i * 31 % 10000))
+      .append(R"(,"side":")")
+      .append(i % 2 ? "buy" : "sell")
+      .append(R"(","exchange":"cinatra","ts":)")
+      .append(std::to_string(1700000000000 + i * 13))
+      .append("}");
+}
+
+template <typename Fn>
+void bench(std::string_view name, const std::vector<std::string> &messages,
+           Fn &&fn) {
+  size_t raw = 0, compressed = 0;
+  std::string out;
+  auto start = std::chrono::steady_clock::now();
+  for (auto &msg : messages) {
+    out.clear();
+    if (!fn(msg, out)) {
+      std::cout << name << " failed\n";
+      return;
+    }
+    raw += msg.size();
+    compressed += out.size();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << ": ratio " << (double)raw / compressed << ", "
+            << messages.size() / elapsed.count() << " msgs/s\n";
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 200000;
+  std::vector<std::string> messages;
+  for (size_t i = 0; i < count; i++) {
+    messages.push_back(make_message(i));
+  }
+
+  // the messages are compressed and decompressed in every case.
+  std::string decompressed;
+  bench("no context takeover, fresh state", messages,
+        [&](std::string_view msg, std::string &out) {
+          decompressed.clear();
+          return gzip_codec::deflate(msg, out) &&
+                 gzip_codec::inflate(out, decompressed) && decompressed == msg;
+        });
+
+  for (bool takeover : {false, true}) {
+    ws_deflate_options params{};
+    params.server_no_context_takeover = !takeover;
+    ws_deflate sender, receiver;
+    if (!sender.init(params, true) || !receiver.init(params, false)) {
+      return 1;
+    }
+    bench(takeover ? "context takeover" : "no context takeover, kept state",
+          messages, [&](std::string_view msg, std::string &out) {
+            decompressed.clear();
+            return sender.compress(msg, out) &&
+                   receiver.decompress(out, decompressed) &&
+                   decompressed == msg;
+          });
+  }
+}
@@ -0,0 +1,115 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+
+// Throughput of small websocket frames: a raw socket sends batches of 64B
+// frames which the server reads by read_websocket(), then the server sends
+// 64B frames which coro_http_client reads by read_websocket(), awaiting every
+// write_websocket() or posting all of them by post_websocket().
+// usage: ws_frame_benchmark [frames]
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+  std::string msg(64, 'x');
+
+  coro_http_server server(1, 9001);
+  server.set_http_handler<GET>(
+      "/recv",
+      [count](coro_http_request &req,
+              coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        size_t frames = 0;
+        while (frames < count) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec) {
+            co_return;
+          }
+          frames++;
+        }
+        co_await req.get_conn()->write_websocket("done");
+      });
+  server.set_http_handler<GET>(
+      "/send",
+      [count, &msg](coro_http_request &req, coro_http_response &resp)
+          -> async_simple::coro::Lazy<void> {
+        for (size_t i = 0; i < count; i++) {
+          if (co_await req.get_conn()->write_websocket(msg)) {
+            co_return;
+          }
+        }
+      });
+  server.set_http_handler<GET>(
+      "/post",
+      [count, &msg](coro_http_request &req, coro_http_response &resp)
+          -> async_simple::coro::Lazy<void> {
+        auto conn = req.get_conn();
+        for (size_t i = 0; i < count; i++) {
+          if (!conn->post_websocket(msg)) {
+            co_return;
+          }
+          // the backpressure point, at most 1MB waits in the queue.
+          if (conn->outbound_bytes() > 1024 * 1024 &&
+              co_await conn->flush_outbound(1024 * 1024)) {
+            co_return;
+          }
+        }
+        co_await conn->flush_outbound();
+      });
+  server.async_start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  {
+    asio::io_context ctx;
+    asio::ip::tcp::socket sock(ctx);
+    sock.connect({asio::ip::make_address("127.0.0.1"), 9001});
+    std::string handshake =
+        "GET /recv HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+        "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    asio::write(sock, asio::buffer(handshake));
+    asio::streambuf head;
+    asio::read_until(sock, head, "\r\n\r\n");
+
+    // the frames are masked once, a batch is sent by one write.
+    std::string batch;
+    size_t batch_frames = 1024;
+    for (size_t i = 0; i < batch_frames; i++) {
+      websocket ws{};
+      std::string payload = msg;
+      std::span<char> span(payload);
+      auto header = ws.encode_frame(span, opcode::binary, true);
+      batch.append(header).append(payload);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t sent = 0; sent < count; sent += batch_frames) {
+      size_t n = (std::min)(batch_frames, count - sent);
+      asio::write(sock,
+                  asio::buffer(batch.data(), batch.size() / batch_frames * n));
+    }
+    char done[16];
+    asio::read(sock, asio::buffer(done, 6));
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "server read: " << count / elapsed.count() << " msgs/s, "
+              << count * msg.size() / elapsed.count() / 1e6 << " MB/s\n";
+  }
+
+  for (std::string_view path : {"/send", "/post"}) {
+    coro_http_client client{};
+    async_simple::coro::syncAwait(
+        client.connect("ws://127.0.0.1:9001" + std::string(path)));
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+      auto data = async_simple::coro::syncAwait(client.read_websocket());
+      if (data.net_err) {
+        std::cout << "client read failed: " << data.net_err.message() << "\n";
+        return 1;
+      }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "client read " << path << ": " << count / elapsed.count()
+              << " msgs/s, " << count * msg.size() / elapsed.count() / 1e6
+              << " MB/s\n";
+  }
+  server.stop();
+}
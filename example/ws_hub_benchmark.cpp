@@ -0,0 +1,108 @@
+#include <cinatra.hpp>
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+using namespace cinatra;
+
+// Fan out of websocket_hub: every publish of a 64B message is queued to all
+// the subscribers of the topic, the benchmark ends when every raw socket
+// client has read all the frames.
+// usage: ws_hub_benchmark [subscribers] [publishes]
+int main(int argc, char **argv) {
+  size_t subs = argc > 1 ? std::stoul(argv[1]) : 10000;
+  size_t count = argc > 2 ? std::stoul(argv[2]) : 100;
+  std::string msg(64, 'x');
+#ifdef __unix__
+  // both ends of the connections are in this process.
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+
+  websocket_hub hub(count);
+  coro_http_server server(1, 9001);
+  server.set_http_handler<GET>(
+      "/hub",
+      [&hub](coro_http_request &req,
+             coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        auto conn = req.get_conn();
+        hub.subscribe("ticks", conn);
+        while (true) {
+          auto result = co_await conn->read_websocket();
+          if (result.ec) {
+            break;
+          }
+        }
+        hub.unsubscribe_all(conn);
+      });
+  server.async_start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  asio::io_context ctx;
+  std::vector<asio::ip::tcp::socket> socks;
+  socks.reserve(subs);
+  std::string handshake =
+      "GET /hub HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+      "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+      "Sec-WebSocket-Version: 13\r\n\r\n";
+  for (size_t i = 0; i < subs; i++) {
+    auto &sock = socks.emplace_back(ctx);
+    std::error_code ec;
+    sock.connect({asio::ip::make_address("127.0.0.1"), 9001}, ec);
+    if (ec) {
+      std::cout << "connect failed: " << ec.message() << "\n";
+      return 1;
+    }
+    asio::write(sock, asio::buffer(handshake));
+    asio::streambuf head;
+    size_t n = asio::read_until(sock, head, "\r\n\r\n");
+    if (head.size() != n) {
+      std::cout << "unexpected data after the handshake\n";
+      return 1;
+    }
+  }
+  while (hub.subscriber_count("ticks") < subs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // a server frame of a short message has a 2 bytes header and no mask.
+  size_t expected = count * (2 + msg.size());
+  std::vector<size_t> received(subs);
+  std::vector<std::array<char, 8192>> bufs(subs);
+  std::function<void(size_t)> read_some = [&](size_t i) {
+    socks[i].async_read_some(
+        asio::buffer(bufs[i]), [&, i](std::error_code ec, size_t n) {
+          received[i] += n;
+          if (!ec && received[i] < expected) {
+            read_some(i);
+          }
+        });
+  };
+  for (size_t i = 0; i < subs; i++) {
+    read_some(i);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    hub.publish("ticks", msg);
+  }
+  std::chrono::duration<double> publish_elapsed =
+      std::chrono::steady_clock::now() - start;
+  ctx.run();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t complete = std::count(received.begin(), received.end(), expected);
+  std::cout << "publish: " << count / publish_elapsed.count()
+            << " publishes/s\n";
+  std::cout << "delivered: " << complete << "/" << subs << " subscribers, "
+            << count * complete / elapsed.count() << " frames/s\n";
+  for (auto &sock : socks) {
+    std::error_code ec;
+    sock.close(ec);
+  }
+  server.stop();
+}
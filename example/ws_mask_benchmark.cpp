@@ -0,0 +1,74 @@
+#include <cinatra.hpp>
+
+using namespace cinatra;
+
+// Masking speed of websocket payloads of 64B, 4KB and 4MB, the byte by byte
+// loop of the old parse_payload and every kernel the cpu supports.
+// usage: ws_mask_benchmark [total MB]
+void mask_bytewise(char *data, size_t len, const uint8_t key[4]) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = data[i] ^ key[i % 4];
+  }
+}
+
+template <typename Fn>
+double bench_gbps(std::span<char> buf, size_t total, Fn &&fn) {
+  size_t rounds = (std::max)(total / buf.size(), (size_t)1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds; i++) {
+    fn(buf.data(), buf.size());
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return (double)rounds * buf.size() / elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  size_t total = (argc > 1 ? std::stoul(argv[1]) : 2048) * 1024 * 1024;
+  const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+#ifdef CINATRA_WS_MASK_DISPATCH
+  using detail::mask_kernel;
+  std::pair<mask_kernel, const char *> kernels[] = {
+      {mask_kernel::scalar, "scalar"},
+      {mask_kernel::sse2, "sse2"},
+      {mask_kernel::avx2, "avx2"},
+      {mask_kernel::avx512, "avx512"}};
+  auto origin = detail::current_mask_kernel();
+#endif
+
+  for (size_t size : {(size_t)64, (size_t)4096, (size_t)4 * 1024 * 1024}) {
+    // the payload of a frame starts after a header of 2 to 14 bytes, so it's
+    // rarely aligned.
+    std::string storage(size + 7, 'a');
+    std::span<char> buf(storage.data() + 7, size);
+
+    std::cout << size << " bytes bytewise: "
+              << bench_gbps(buf, total,
+                            [&](char *data, size_t len) {
+                              mask_bytewise(data, len, key);
+                            })
+              << " GB/s\n";
+#ifdef CINATRA_WS_MASK_DISPATCH
+    for (auto &[kernel, name] : kernels) {
+      if (!detail::set_mask_kernel(kernel)) {
+        continue;
+      }
+      std::cout << size << " bytes " << name << ": "
+                << bench_gbps(buf, total,
+                              [&](char *data, size_t len) {
+                                detail::mask_payload(data, len, key);
+                              })
+                << " GB/s\n";
+    }
+    detail::set_mask_kernel(origin);
+#else
+    std::cout << size << " bytes mask_payload: "
+              << bench_gbps(buf, total,
+                            [&](char *data, size_t len) {
+                              detail::mask_payload(data, len, key);
+                            })
+              << " GB/s\n";
+#endif
+  }
+}
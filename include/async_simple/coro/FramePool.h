@@ -0,0 +1,111 @@
+#ifndef ASYNC_SIMPLE_CORO_FRAMEPOOL_H
+#define ASYNC_SIMPLE_CORO_FRAMEPOOL_H
+
+#include <cstddef>
+#include <new>
+
+#ifndef ASYNC_SIMPLE_FRAME_POOL_MAX_CACHED
+// The most bytes of free frames a thread keeps.
+#define ASYNC_SIMPLE_FRAME_POOL_MAX_CACHED (256 * 1024)
+#endif
+
+namespace async_simple::coro::detail {
+
+// The free coroutine frames of a thread. The sizes are rounded up to
+// multiples of Granularity and every size class keeps a free list, so the
+// frames of the coroutines created again and again, such as the ones of a
+// request of a server, are taken from the free lists instead of operator new.
+//
+// A frame freed on another thread goes to the pool of that thread. A frame
+// larger than MaxFrameSize, or freed while the thread is exiting, goes to
+// operator delete. The allocation is nothrow, nullptr if it fails.
+class FramePool {
+public:
+    static constexpr std::size_t Granularity = 64;
+    static constexpr std::size_t MaxFrameSize = 4096;
+
+    static void* allocate(std::size_t size) noexcept {
+        if (auto pool = local(); pool != nullptr && size <= MaxFrameSize) {
+            return pool->take(size);
+        }
+        return ::operator new(size, std::nothrow);
+    }
+
+    // size is the size passed to allocate().
+    static void deallocate(void* ptr, std::size_t size) noexcept {
+        if (auto pool = local(); pool != nullptr && size <= MaxFrameSize) {
+            pool->give(ptr, size);
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+    // The bytes in the free lists of the current thread.
+    static std::size_t cachedBytes() {
+        auto pool = local();
+        return pool != nullptr ? pool->_cached : 0;
+    }
+
+    ~FramePool() {
+        alive() = false;
+        for (auto head : _free) {
+            while (head != nullptr) {
+                auto next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static constexpr std::size_t ClassNum = MaxFrameSize / Granularity;
+
+    static bool& alive() {
+        thread_local bool alive = true;
+        return alive;
+    }
+
+    // nullptr while the thread is exiting.
+    static FramePool* local() {
+        thread_local FramePool pool;
+        return alive() ? &pool : nullptr;
+    }
+
+    static std::size_t classIndex(std::size_t size) {
+        return size == 0 ? 0 : (size - 1) / Granularity;
+    }
+
+    void* take(std::size_t size) noexcept {
+        std::size_t i = classIndex(size);
+        if (auto node = _free[i]; node != nullptr) {
+            _free[i] = node->next;
+            _cached -= (i + 1) * Granularity;
+            return node;
+        }
+        return ::operator new((i + 1) * Granularity, std::nothrow);
+    }
+
+    void give(void* ptr, std::size_t size) noexcept {
+        std::size_t i = classIndex(size);
+        std::size_t bytes = (i + 1) * Granularity;
+        if (_cached + bytes > ASYNC_SIMPLE_FRAME_POOL_MAX_CACHED) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto node = static_cast<FreeNode*>(ptr);
+        node->next = _free[i];
+        _free[i] = node;
+        _cached += bytes;
+    }
+
+    FreeNode* _free[ClassNum] = {};
+    std::size_t _cached = 0;
+};
+
+}  // namespace async_simple::coro::detail
+
+#endif
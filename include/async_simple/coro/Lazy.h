@@ -25,6 +25,7 @@
 #include "async_simple/Common.h"
 #include "async_simple/Try.h"
 #include "async_simple/coro/DetachedCoroutine.h"
+#include "async_simple/coro/FramePool.h"
 #include "async_simple/coro/ViaCoroutine.h"
 #include "async_simple/experimental/coroutine.h"
 
@@ -73,6 +74,15 @@ namespace detail {
 
 class LazyPromiseBase {
 public:
+    // The frames are taken from the frame pool of the thread. The allocation
+    // is nothrow, see get_return_object_on_allocation_failure().
+    static void* operator new(std::size_t size) noexcept {
+        return FramePool::allocate(size);
+    }
+    static void operator delete(void* ptr, std::size_t size) noexcept {
+        FramePool::deallocate(ptr, size);
+    }
+
     // Resume the caller waiting to the current coroutine. Note that we need
     // destroy the frame for the current coroutine explicitly. Since after
     // FinalAwaiter, The current coroutine should be suspended and never to
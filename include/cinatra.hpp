@@ -7,6 +7,7 @@
 
 #include "cinatra/coro_http_client.hpp"
 #include "cinatra/coro_http_server.hpp"
+#include "cinatra/websocket_hub.hpp"
 // #include "cinatra/smtp_client.hpp"
 
 #endif  // CINATRA_CINATRA_HPP
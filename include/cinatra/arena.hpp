@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "buffer_pool.hpp"
+
+#ifndef CINATRA_ARENA_BLOCK_SIZE
+#define CINATRA_ARENA_BLOCK_SIZE 4096
+#endif
+
+namespace cinatra {
+// A bump allocator for the data which only lives during one request, such as
+// the response headers and cookies. reset() rewinds it and keeps the blocks,
+// so after the first request of a connection it doesn't allocate anymore.
+class arena {
+ public:
+  arena(size_t block_size = CINATRA_ARENA_BLOCK_SIZE)
+      : block_size_(block_size) {}
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  char *allocate(size_t size) {
+    while (index_ < blocks_.size()) {
+      auto &block = blocks_[index_];
+      if (block.size - offset_ >= size) {
+        char *ptr = block.data.get() + offset_;
+        offset_ += size;
+        return ptr;
+      }
+      index_++;
+      offset_ = 0;
+    }
+
+    size_t block_size = (std::max)(size, block_size_);
+    auto data = static_cast<char *>(buffer_pool::allocate(block_size));
+    auto &block = blocks_.emplace_back(
+        block_t{block_ptr(data, pool_deleter{block_size}), block_size});
+    index_ = blocks_.size() - 1;
+    offset_ = size;
+    return block.data.get();
+  }
+
+  std::string_view copy(std::string_view str) {
+    if (str.empty()) {
+      return {};
+    }
+    char *ptr = allocate(str.size());
+    std::memcpy(ptr, str.data(), str.size());
+    return {ptr, str.size()};
+  }
+
+  // the blocks larger than block size are made by a huge header, don't keep
+  // them for the next request.
+  void reset() {
+    std::erase_if(blocks_, [this](const block_t &block) {
+      return block.size > block_size_;
+    });
+    index_ = 0;
+    offset_ = 0;
+  }
+
+  // give all the blocks back to the buffer pool, for an idle connection.
+  void release() {
+    std::vector<block_t>{}.swap(blocks_);
+    index_ = 0;
+    offset_ = 0;
+  }
+
+  size_t capacity() const {
+    size_t total = 0;
+    for (auto &block : blocks_) {
+      total += block.size;
+    }
+    return total;
+  }
+
+ private:
+  struct pool_deleter {
+    size_t size;
+    void operator()(char *ptr) const { buffer_pool::deallocate(ptr, size); }
+  };
+  using block_ptr = std::unique_ptr<char[], pool_deleter>;
+
+  struct block_t {
+    block_ptr data;
+    size_t size;
+  };
+
+  size_t block_size_;
+  std::vector<block_t> blocks_;
+  size_t index_ = 0;
+  size_t offset_ = 0;
+};
+
+// Keep the first N elements inline, move all of them to the heap when there
+// are more, the heap memory is kept after clear().
+template <typename T, size_t N>
+class small_vector {
+ public:
+  void push_back(const T &val) {
+    if (heap_.empty() && size_ < N) {
+      inline_[size_++] = val;
+      return;
+    }
+
+    if (heap_.empty()) {
+      heap_.reserve(N * 2);
+      heap_.assign(inline_.begin(), inline_.begin() + size_);
+    }
+    heap_.push_back(val);
+    size_++;
+  }
+
+  T *begin() { return heap_.empty() ? inline_.data() : heap_.data(); }
+  T *end() { return begin() + size_; }
+  const T *begin() const {
+    return heap_.empty() ? inline_.data() : heap_.data();
+  }
+  const T *end() const { return begin() + size_; }
+
+  T &operator[](size_t i) { return begin()[i]; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() {
+    heap_.clear();
+    size_ = 0;
+  }
+
+ private:
+  std::array<T, N> inline_;
+  std::vector<T> heap_;
+  size_t size_ = 0;
+};
+}  // namespace cinatra
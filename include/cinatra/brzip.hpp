@@ -7,34 +7,49 @@
 #include <string>
 #include <string_view>
 
+#include "string_resize.hpp"
+
 namespace cinatra::br_codec {
 
 #define BROTLI_BUFFER_SIZE 1024
 
-inline bool brotli_compress(std::string_view input, std::string &output) {
-  auto instance = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
-  std::array<uint8_t, BROTLI_BUFFER_SIZE> buffer;
-  std::stringstream result;
-
-  size_t available_in = input.size(), available_out = buffer.size();
-  const uint8_t *next_in = reinterpret_cast<const uint8_t *>(input.data());
-  uint8_t *next_out = buffer.data();
-
-  do {
-    int ret = BrotliEncoderCompressStream(instance, BROTLI_OPERATION_FINISH,
-                                          &available_in, &next_in,
-                                          &available_out, &next_out, nullptr);
-    if (!ret)
+// run the encoder until the input is consumed and the output of op is
+// complete, the output is appended to output directly.
+inline bool brotli_compress_stream(BrotliEncoderState *state,
+                                   std::string_view input, std::string &output,
+                                   BrotliEncoderOperation op) {
+  size_t available_in = input.size();
+  auto next_in = reinterpret_cast<const uint8_t *>(input.data());
+  size_t reserve = input.size() + BROTLI_BUFFER_SIZE;
+  while (true) {
+    size_t old_size = output.size();
+    cinatra::detail::resize(output, old_size + reserve);
+    size_t available_out = reserve;
+    auto next_out = reinterpret_cast<uint8_t *>(output.data() + old_size);
+    if (!BrotliEncoderCompressStream(state, op, &available_in, &next_in,
+                                     &available_out, &next_out, nullptr)) {
+      output.resize(old_size);
       return false;
-    result.write(reinterpret_cast<const char *>(buffer.data()),
-                 buffer.size() - available_out);
-    available_out = buffer.size();
-    next_out = buffer.data();
-  } while (!(available_in == 0 && BrotliEncoderIsFinished(instance)));
+    }
+    output.resize(output.size() - available_out);
+    if (available_in == 0 && !BrotliEncoderHasMoreOutput(state) &&
+        (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(state))) {
+      return true;
+    }
+  }
+}
 
+inline bool brotli_compress(std::string_view input, std::string &output) {
+  // brotli can't reset an encoder, it's created for every call.
+  auto instance = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+  if (instance == nullptr) {
+    return false;
+  }
+  output.clear();
+  bool r = brotli_compress_stream(instance, input, output,
+                                  BROTLI_OPERATION_FINISH);
   BrotliEncoderDestroyInstance(instance);
-  output = result.str();
-  return true;
+  return r;
 }
 
 inline bool brotli_decompress(std::string_view input,
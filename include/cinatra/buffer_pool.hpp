@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "asio/streambuf.hpp"
+
+#ifndef CINATRA_BUFFER_POOL_HIGH_WATER
+// the most bytes a thread keeps in its free lists.
+#define CINATRA_BUFFER_POOL_HIGH_WATER (4 * 1024 * 1024)
+#endif
+
+#ifndef CINATRA_BUFFER_POOL_TRIM_PERIOD
+// the allocations of a thread between two trims.
+#define CINATRA_BUFFER_POOL_TRIM_PERIOD 4096
+#endif
+
+namespace cinatra {
+namespace detail {
+inline bool &buffer_pool_alive() {
+  thread_local bool alive = true;
+  return alive;
+}
+}  // namespace detail
+
+// The free buffers of a thread, the sizes are rounded up to powers of two and
+// every size class keeps a free list. A connection gives its buffers back when
+// it's idle and takes them again for the next request, so the memory is held
+// by the busy connections only. A buffer freed on another thread goes to the
+// pool of that thread.
+//
+// The free lists of a thread hold CINATRA_BUFFER_POOL_HIGH_WATER bytes at
+// most. Every CINATRA_BUFFER_POOL_TRIM_PERIOD allocations the buffers which
+// stayed in a free list for the whole period are freed, so a burst of large
+// bodies doesn't stay cached after it.
+class buffer_pool {
+ public:
+  static constexpr size_t min_size = 64;
+  static constexpr size_t max_size = 1024 * 1024;
+
+  // nullptr while the thread is exiting.
+  static buffer_pool *local() {
+    thread_local buffer_pool pool;
+    return detail::buffer_pool_alive() ? &pool : nullptr;
+  }
+
+  static void *allocate(size_t size) {
+    if (auto pool = local(); pool != nullptr && size <= max_size) {
+      return pool->take(size);
+    }
+    return ::operator new(size);
+  }
+
+  // size is the size passed to allocate().
+  static void deallocate(void *ptr, size_t size) noexcept {
+    if (auto pool = local(); pool != nullptr && size <= max_size) {
+      pool->give(ptr, size);
+      return;
+    }
+    ::operator delete(ptr);
+  }
+
+  // the size of the buffer really allocated for size.
+  static size_t class_size(size_t size) {
+    return size <= min_size ? min_size : std::bit_ceil(size);
+  }
+
+  // the bytes in the free lists.
+  size_t cached_bytes() const { return cached_; }
+
+  // free the buffers which weren't taken since the last trim.
+  void trim() {
+    takes_ = 0;
+    for (size_t i = 0; i < class_num; i++) {
+      for (; low_[i] > 0; low_[i]--) {
+        auto node = free_[i];
+        free_[i] = node->next;
+        count_[i]--;
+        cached_ -= min_size << i;
+        ::operator delete(node);
+      }
+      low_[i] = count_[i];
+    }
+  }
+
+  ~buffer_pool() {
+    detail::buffer_pool_alive() = false;
+    for (auto head : free_) {
+      while (head != nullptr) {
+        auto next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  }
+
+ private:
+  struct free_node {
+    free_node *next;
+  };
+
+  static constexpr size_t class_num =
+      std::countr_zero(max_size) - std::countr_zero(min_size) + 1;
+
+  static size_t class_index(size_t size) {
+    return std::countr_zero(class_size(size)) - std::countr_zero(min_size);
+  }
+
+  void *take(size_t size) {
+    if (++takes_ >= CINATRA_BUFFER_POOL_TRIM_PERIOD) {
+      trim();
+    }
+    size_t i = class_index(size);
+    if (auto node = free_[i]; node != nullptr) {
+      free_[i] = node->next;
+      count_[i]--;
+      cached_ -= min_size << i;
+      low_[i] = (std::min)(low_[i], count_[i]);
+      return node;
+    }
+    return ::operator new(min_size << i);
+  }
+
+  void give(void *ptr, size_t size) {
+    size_t i = class_index(size);
+    size_t bytes = min_size << i;
+    if (cached_ + bytes > CINATRA_BUFFER_POOL_HIGH_WATER) {
+      trim();
+      if (cached_ + bytes > CINATRA_BUFFER_POOL_HIGH_WATER) {
+        ::operator delete(ptr);
+        return;
+      }
+    }
+    auto node = static_cast<free_node *>(ptr);
+    node->next = free_[i];
+    free_[i] = node;
+    count_[i]++;
+    cached_ += bytes;
+  }
+
+  free_node *free_[class_num] = {};
+  size_t count_[class_num] = {};
+  // the fewest buffers in a free list since the last trim, they are not used
+  // in the period.
+  size_t low_[class_num] = {};
+  size_t cached_ = 0;
+  size_t takes_ = 0;
+};
+
+// The allocator of the containers whose memory comes from the buffer pool of
+// the thread.
+template <typename T>
+class pool_allocator {
+ public:
+  using value_type = T;
+
+  pool_allocator() noexcept = default;
+  template <typename U>
+  pool_allocator(const pool_allocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(buffer_pool::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept {
+    buffer_pool::deallocate(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const pool_allocator<U> &) const noexcept {
+    return true;
+  }
+};
+
+using pooled_streambuf = asio::basic_streambuf<pool_allocator<char>>;
+
+// A growable byte buffer of the buffer pool, the data is kept when it grows.
+class pooled_buffer {
+ public:
+  pooled_buffer() = default;
+  pooled_buffer(const pooled_buffer &) = delete;
+  pooled_buffer &operator=(const pooled_buffer &) = delete;
+
+  pooled_buffer(pooled_buffer &&other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        capacity_(std::exchange(other.capacity_, 0)) {}
+
+  pooled_buffer &operator=(pooled_buffer &&other) noexcept {
+    if (this != &other) {
+      release();
+      data_ = std::exchange(other.data_, nullptr);
+      capacity_ = std::exchange(other.capacity_, 0);
+    }
+    return *this;
+  }
+
+  ~pooled_buffer() { release(); }
+
+  char *data() { return data_; }
+  const char *data() const { return data_; }
+  size_t capacity() const { return capacity_; }
+
+  // make it size bytes at least, the first keep bytes are copied to the new
+  // buffer.
+  void reserve(size_t size, size_t keep) {
+    if (size <= capacity_) {
+      return;
+    }
+    size_t capacity =
+        size <= buffer_pool::max_size ? buffer_pool::class_size(size) : size;
+    auto data = static_cast<char *>(buffer_pool::allocate(capacity));
+    if (keep > 0) {
+      std::memcpy(data, data_, keep);
+    }
+    release();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void release() {
+    if (data_ != nullptr) {
+      buffer_pool::deallocate(data_, capacity_);
+      data_ = nullptr;
+      capacity_ = 0;
+    }
+  }
+
+ private:
+  char *data_ = nullptr;
+  size_t capacity_ = 0;
+};
+}  // namespace cinatra
@@ -0,0 +1,275 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "define.h"
+#include "utils.hpp"
+#ifdef CINATRA_ENABLE_GZIP
+#include "gzip.hpp"
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+#include "brzip.hpp"
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+#include "zstd_codec.hpp"
+#endif
+
+#if defined(CINATRA_ENABLE_GZIP) || defined(CINATRA_ENABLE_BROTLI) || \
+    defined(CINATRA_ENABLE_ZSTD)
+#define CINATRA_HAS_COMPRESSION
+#endif
+
+namespace cinatra {
+// the quality of brotli for the dynamic responses, the default 11 is too
+// slow to compress at request time.
+#ifndef CINATRA_BROTLI_STREAM_QUALITY
+#define CINATRA_BROTLI_STREAM_QUALITY 5
+#endif
+
+inline std::string_view encoding_name(content_encoding encoding) {
+  switch (encoding) {
+    case content_encoding::gzip:
+      return "gzip";
+    case content_encoding::deflate:
+      return "deflate";
+    case content_encoding::br:
+      return "br";
+    case content_encoding::zstd:
+      return "zstd";
+    default:
+      return "";
+  }
+}
+
+// the best coding accepted by the client and supported by the build.
+inline content_encoding negotiate_encoding(std::string_view accept_encoding) {
+  if (accept_encoding.empty()) {
+    return content_encoding::none;
+  }
+#ifdef CINATRA_ENABLE_ZSTD
+  if (accepts_encoding(accept_encoding, "zstd")) {
+    return content_encoding::zstd;
+  }
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+  if (accepts_encoding(accept_encoding, "br")) {
+    return content_encoding::br;
+  }
+#endif
+#ifdef CINATRA_ENABLE_GZIP
+  if (accepts_encoding(accept_encoding, "gzip")) {
+    return content_encoding::gzip;
+  }
+  if (accepts_encoding(accept_encoding, "deflate")) {
+    return content_encoding::deflate;
+  }
+#endif
+  return content_encoding::none;
+}
+
+// the codings decoded by decompress_data, for the Accept-Encoding of a
+// request.
+inline constexpr std::string_view supported_encodings() {
+#if defined(CINATRA_ENABLE_ZSTD) && defined(CINATRA_ENABLE_BROTLI) && \
+    defined(CINATRA_ENABLE_GZIP)
+  return "zstd, br, gzip, deflate";
+#elif defined(CINATRA_ENABLE_ZSTD) && defined(CINATRA_ENABLE_BROTLI)
+  return "zstd, br";
+#elif defined(CINATRA_ENABLE_ZSTD) && defined(CINATRA_ENABLE_GZIP)
+  return "zstd, gzip, deflate";
+#elif defined(CINATRA_ENABLE_ZSTD)
+  return "zstd";
+#elif defined(CINATRA_ENABLE_BROTLI) && defined(CINATRA_ENABLE_GZIP)
+  return "br, gzip, deflate";
+#elif defined(CINATRA_ENABLE_BROTLI)
+  return "br";
+#elif defined(CINATRA_ENABLE_GZIP)
+  return "gzip, deflate";
+#else
+  return "";
+#endif
+}
+
+// Compress a streamed body piece by piece, such as a chunked response or
+// SSE, nothing is buffered. Every piece is flushed, so the client decodes it
+// at once, the last piece finishes the stream. The zlib and zstd states are
+// borrowed from the pools of the thread and returned by reset.
+class stream_compressor {
+ public:
+  stream_compressor() = default;
+  stream_compressor(const stream_compressor &) = delete;
+  stream_compressor &operator=(const stream_compressor &) = delete;
+  ~stream_compressor() { reset(); }
+
+  bool init(content_encoding encoding) {
+    reset();
+#ifdef CINATRA_ENABLE_GZIP
+    if (encoding == content_encoding::gzip ||
+        encoding == content_encoding::deflate) {
+      if (auto pool = gzip_codec::detail::z_context_pool::local(); pool) {
+        // the deflate coding is raw deflate, the same as gzip_codec.
+        zctx_ = encoding == content_encoding::gzip
+                    ? pool->acquire(false, -1, windowBits | GZIP_ENCODING)
+                    : pool->acquire(false, -1, -windowBits);
+      }
+      if (zctx_ == nullptr) {
+        return false;
+      }
+      encoding_ = encoding;
+      return true;
+    }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+    if (encoding == content_encoding::zstd) {
+      if (auto pool = zstd_codec::detail::cctx_pool::local(); pool) {
+        zstd_ = pool->acquire(CINATRA_ZSTD_LEVEL);
+      }
+      if (zstd_ == nullptr) {
+        return false;
+      }
+      encoding_ = encoding;
+      return true;
+    }
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+    if (encoding == content_encoding::br) {
+      br_ = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+      if (br_ == nullptr) {
+        return false;
+      }
+      BrotliEncoderSetParameter(br_, BROTLI_PARAM_QUALITY,
+                                CINATRA_BROTLI_STREAM_QUALITY);
+      encoding_ = encoding;
+      return true;
+    }
+#endif
+    return false;
+  }
+
+  // the compressed data is appended to out.
+  bool compress(std::string_view data, std::string &out, bool finish) {
+#ifdef CINATRA_ENABLE_GZIP
+    if (zctx_) {
+      int ret = gzip_codec::detail::run_stream(
+          &zctx_->strm, data, out, finish ? Z_FINISH : Z_SYNC_FLUSH, false);
+      return finish ? ret == Z_STREAM_END : (ret == Z_OK || ret == Z_BUF_ERROR);
+    }
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+    if (br_) {
+      return br_codec::brotli_compress_stream(
+          br_, data, out,
+          finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH);
+    }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+    if (zstd_) {
+      return zstd_codec::compress_stream(zstd_.get(), data, out,
+                                         finish ? ZSTD_e_end : ZSTD_e_flush);
+    }
+#endif
+    return false;
+  }
+
+  bool active() const { return encoding_ != content_encoding::none; }
+
+  content_encoding encoding() const { return encoding_; }
+
+  void reset() {
+#ifdef CINATRA_ENABLE_GZIP
+    if (zctx_) {
+      if (auto pool = gzip_codec::detail::z_context_pool::local(); pool) {
+        pool->release(std::move(zctx_));
+      }
+      zctx_ = nullptr;
+    }
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+    if (br_) {
+      BrotliEncoderDestroyInstance(br_);
+      br_ = nullptr;
+    }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+    if (zstd_) {
+      if (auto pool = zstd_codec::detail::cctx_pool::local(); pool) {
+        pool->release(std::move(zstd_));
+      }
+      zstd_ = nullptr;
+    }
+#endif
+    encoding_ = content_encoding::none;
+  }
+
+ private:
+  content_encoding encoding_ = content_encoding::none;
+#ifdef CINATRA_ENABLE_GZIP
+  std::unique_ptr<gzip_codec::detail::z_context> zctx_;
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+  BrotliEncoderState *br_ = nullptr;
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+  zstd_codec::detail::cctx_ptr zstd_;
+#endif
+};
+
+// compress the whole data, the result is appended to out.
+inline bool compress_data(content_encoding encoding, std::string_view data,
+                          std::string &out) {
+  switch (encoding) {
+#ifdef CINATRA_ENABLE_GZIP
+    case content_encoding::gzip:
+      return gzip_codec::compress(data, out);
+    case content_encoding::deflate: {
+      stream_compressor compressor;
+      return compressor.init(encoding) && compressor.compress(data, out, true);
+    }
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+    case content_encoding::br: {
+      stream_compressor compressor;
+      return compressor.init(encoding) && compressor.compress(data, out, true);
+    }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+    case content_encoding::zstd:
+      return zstd_codec::compress(data, out, CINATRA_ZSTD_LEVEL, nullptr);
+#endif
+    default:
+      return false;
+  }
+}
+
+// decompress the whole data, the result is appended to out. A zstd frame
+// larger than max_size is rejected.
+inline bool decompress_data(content_encoding encoding, std::string_view data,
+                            std::string &out,
+                            size_t max_size = MAX_HTTP_BODY_SIZE) {
+  switch (encoding) {
+#ifdef CINATRA_ENABLE_GZIP
+    case content_encoding::gzip:
+      return gzip_codec::uncompress(data, out);
+    case content_encoding::deflate:
+      return gzip_codec::inflate(data, out);
+#endif
+#ifdef CINATRA_ENABLE_BROTLI
+    case content_encoding::br: {
+      std::string decompressed;
+      if (!br_codec::brotli_decompress(data, decompressed)) {
+        return false;
+      }
+      out.append(decompressed);
+      return true;
+    }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+    case content_encoding::zstd:
+      return zstd_codec::decompress(data, out, max_size);
+#endif
+    default:
+      return false;
+  }
+}
+}  // namespace cinatra
@@ -41,6 +41,11 @@ class cookie {
   std::string to_string() const {
     std::string result;
     result.reserve(256);
+    append_to(result);
+    return result;
+  }
+
+  void append_to(std::string &result) const {
     result.append(name_);
     result.append("=");
     if (version_ == 0) {
@@ -109,7 +114,6 @@ class cookie {
       }
       result.append("; Version=\"1\"");
     }
-    return result;
   }
 
  private:
@@ -23,13 +23,11 @@
 #include "async_simple/Unit.h"
 #include "async_simple/coro/FutureAwaiter.h"
 #include "async_simple/coro/Lazy.h"
+#include "cinatra_log_wrapper.hpp"
+#include "compressor.hpp"
 #ifdef CINATRA_ENABLE_GZIP
-#include "gzip.hpp"
-#endif
-#ifdef CINATRA_ENABLE_BROTLI
-#include "brzip.hpp"
+#include "ws_deflate.hpp"
 #endif
-#include "cinatra_log_wrapper.hpp"
 #include "http_parser.hpp"
 #include "multipart.hpp"
 #include "picohttpparser.h"
@@ -37,9 +35,11 @@
 #include "string_resize.hpp"
 #include "uri.hpp"
 #include "websocket.hpp"
+#include "ws_frame_reader.hpp"
 #include "ylt/coro_io/coro_file.hpp"
 #include "ylt/coro_io/coro_io.hpp"
 #include "ylt/coro_io/io_context_pool.hpp"
+#include "ylt/coro_io/timing_wheel.hpp"
 
 namespace coro_io {
 template <typename T, typename U>
@@ -162,7 +162,7 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
 
   coro_http_client(asio::io_context::executor_type executor)
       : executor_wrapper_(executor),
-        timer_(&executor_wrapper_),
+        timer_(executor),
         socket_(std::make_shared<socket_t>(executor)),
         head_buf_(socket_->head_buf_),
         chunked_buf_(socket_->chunked_buf_) {}
@@ -293,8 +293,13 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
   }
 
 #ifdef CINATRA_ENABLE_GZIP
-  void set_ws_deflate(bool enable_ws_deflate) {
+  // Offer permessage-deflate when the websocket connects, the deflate and
+  // inflate streams are kept between the messages unless no context takeover
+  // is agreed.
+  void set_ws_deflate(bool enable_ws_deflate,
+                      ws_deflate_options options = {}) {
     enable_ws_deflate_ = enable_ws_deflate;
+    ws_deflate_options_ = options;
   }
 #endif
 
@@ -334,10 +339,12 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
         }
         add_header("Sec-WebSocket-Key", ws_sec_key_);
         add_header("Sec-WebSocket-Version", "13");
+        ws_reader_ = {};
 #ifdef CINATRA_ENABLE_GZIP
+        ws_deflate_.reset();
         if (enable_ws_deflate_)
           add_header("Sec-WebSocket-Extensions",
-                     "permessage-deflate; client_max_window_bits");
+                     make_ws_deflate_offer(ws_deflate_options_));
 #endif
         req_context<> ctx{};
         data = co_await async_request(std::move(uri), http_method::GET,
@@ -347,11 +354,10 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
         if (enable_ws_deflate_) {
           for (auto c : data.resp_headers) {
             if (c.name == "Sec-WebSocket-Extensions") {
-              if (c.value.find("permessage-deflate;") != std::string::npos) {
-                is_server_support_ws_deflate_ = true;
-              }
-              else {
-                is_server_support_ws_deflate_ = false;
+              if (auto agreed =
+                      parse_ws_deflate_response(c.value, ws_deflate_options_);
+                  agreed) {
+                ws_deflate_.init(*agreed, false);
               }
               break;
             }
@@ -436,8 +442,9 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
   async_simple::coro::Lazy<void> write_ws_frame(std::span<char> msg,
                                                 websocket ws, opcode op,
                                                 resp_data &data,
-                                                bool eof = true) {
-    auto header = ws.encode_frame(msg, op, eof, enable_ws_deflate_);
+                                                bool eof = true,
+                                                bool compressed = false) {
+    auto header = ws.encode_frame(msg, op, eof, compressed);
     std::vector<asio::const_buffer> buffers{
         asio::buffer(header), asio::buffer(msg.data(), msg.size())};
 
@@ -450,16 +457,14 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
 
 #ifdef CINATRA_ENABLE_GZIP
   void gzip_compress(std::string_view source, std::string &dest_buf,
-                     std::span<char> &span, resp_data &data) {
-    if (enable_ws_deflate_ && is_server_support_ws_deflate_) {
-      if (cinatra::gzip_codec::deflate(source, dest_buf)) {
-        span = dest_buf;
-      }
-      else {
-        CINATRA_LOG_ERROR << "compress data error, data: " << source;
-        data.net_err = std::make_error_code(std::errc::protocol_error);
-        data.status = 404;
-      }
+                     std::span<char> &span, resp_data &data, bool eof) {
+    if (ws_deflate_.compress(source, dest_buf, eof)) {
+      span = dest_buf;
+    }
+    else {
+      CINATRA_LOG_ERROR << "compress data error, data: " << source;
+      data.net_err = std::make_error_code(std::errc::protocol_error);
+      data.status = 404;
     }
   }
 #endif
@@ -479,29 +484,48 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       }
     }
 
+    // the control frames are never compressed.
+    bool compressed = false;
+#ifdef CINATRA_ENABLE_GZIP
+    compressed = ws_deflate_.can_compress() &&
+                 (op == opcode::text || op == opcode::binary);
+#endif
+
     std::span<char> span{};
     if constexpr (is_span_v<Source>) {
       span = {source.data(), source.size()};
 #ifdef CINATRA_ENABLE_GZIP
       std::string dest_buf;
-      if (enable_ws_deflate_) {
-        gzip_compress({source.data(), source.size()}, dest_buf, span, data);
+      compressed = compressed && source.size() > 0;
+      if (compressed) {
+        gzip_compress({source.data(), source.size()}, dest_buf, span, data,
+                      true);
+        if (data.status == 404) {
+          co_return data;
+        }
       }
 #endif
-      co_await write_ws_frame(span, ws, op, data, true);
+      co_await write_ws_frame(span, ws, op, data, true, compressed);
     }
     else {
+      // the first frame has the opcode and RSV1 of the message.
+      bool first = true;
       while (true) {
         auto result = co_await source();
         span = {result.buf.data(), result.buf.size()};
 #ifdef CINATRA_ENABLE_GZIP
         std::string dest_buf;
-        if (enable_ws_deflate_) {
+        if (compressed) {
           gzip_compress({result.buf.data(), result.buf.size()}, dest_buf, span,
-                        data);
+                        data, result.eof);
+          if (data.status == 404) {
+            break;
+          }
         }
 #endif
-        co_await write_ws_frame(span, ws, op, data, result.eof);
+        co_await write_ws_frame(span, ws, first ? op : opcode::cont, data,
+                                result.eof, first && compressed);
+        first = false;
 
         if (result.eof || data.status == 404) {
           break;
@@ -680,23 +704,19 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
 
   struct timer_guard {
     timer_guard(coro_http_client *self,
-                std::chrono::steady_clock::duration duration, std::string msg)
+                std::chrono::steady_clock::duration duration,
+                std::string_view msg)
         : self(self), dur_(duration) {
       self->socket_->is_timeout_ = false;
 
       if (duration.count() > 0) {
-        self->timeout(self->timer_, duration, std::move(msg))
-            .start([](auto &&) {
-            });
+        self->timeout(duration, msg);
       }
       return;
     }
     ~timer_guard() {
       if (dur_.count() > 0 && self->socket_->is_timeout_ == false) {
-        try {
-          self->timer_.cancel();
-        } catch (...) {
-        }
+        self->timer_.cancel();
       }
     }
     coro_http_client *self;
@@ -843,15 +863,7 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
     }
   }
 #ifdef __linux__
-  struct fd_guard {
-    int fd;
-    fd_guard(const char *file_path) : fd(::open(file_path, O_RDONLY)) {}
-    ~fd_guard() {
-      if (fd >= 0) {
-        ::close(fd);
-      }
-    }
-  };
+  using fd_guard = coro_io::fd_guard;
   async_simple::coro::Lazy<void> send_file_no_copy_with_length(
       const std::filesystem::path &source, std::error_code &ec,
       std::size_t length, std::size_t offset) {
@@ -1743,6 +1755,15 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       req_str.append("Connection: keep-alive\r\n");
     }
 
+#ifdef CINATRA_ENABLE_ZSTD
+    // advertise the codings decoded transparently.
+    if (req_headers_.find("Accept-Encoding") == req_headers_.end()) {
+      req_str.append("Accept-Encoding: ")
+          .append(supported_encodings())
+          .append("\r\n");
+    }
+#endif
+
     // For HTTPS proxying, Proxy-Authorization is already sent in the CONNECT
     // request.  After the tunnel is established the request goes directly to
     // the upstream server, so it must not carry proxy credentials.
@@ -1849,7 +1870,8 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       }
 
       if constexpr (is_sse_event_handler_v<BodyTarget>) {
-        auto content_type = parser_.get_header_value("Content-Type");
+        auto content_type =
+            parser_.get_header_value(http_header_id::content_type);
         if (content_type.find("text/event-stream") == std::string_view::npos) {
           ec = std::make_error_code(std::errc::protocol_error);
           break;
@@ -1896,17 +1918,18 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       redirect_uri_.clear();
       bool is_redirect = parser_.is_location();
       if (is_redirect)
-        redirect_uri_ = parser_.get_header_value("Location");
-
-      if (!parser_.get_header_value("Content-Encoding").empty()) {
-        if (parser_.get_header_value("Content-Encoding").find("gzip") !=
-            std::string_view::npos)
+        redirect_uri_ = parser_.get_header_value(http_header_id::location);
+
+      if (auto encoding =
+              parser_.get_header_value(http_header_id::content_encoding);
+          !encoding.empty()) {
+        if (encoding.find("zstd") != std::string_view::npos)
+          encoding_type_ = content_encoding::zstd;
+        else if (encoding.find("gzip") != std::string_view::npos)
           encoding_type_ = content_encoding::gzip;
-        else if (parser_.get_header_value("Content-Encoding").find("deflate") !=
-                 std::string_view::npos)
+        else if (encoding.find("deflate") != std::string_view::npos)
           encoding_type_ = content_encoding::deflate;
-        else if (parser_.get_header_value("Content-Encoding").find("br") !=
-                 std::string_view::npos)
+        else if (encoding.find("br") != std::string_view::npos)
           encoding_type_ = content_encoding::br;
       }
       else {
@@ -2026,44 +2049,16 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       }
 
       std::string_view reply(data_ptr, content_len);
-#ifdef CINATRA_ENABLE_GZIP
-      if (encoding_type_ == content_encoding::gzip) {
+      data.resp_body = reply;
+#ifdef CINATRA_HAS_COMPRESSION
+      if (encoding_type_ != content_encoding::none) {
         uncompressed_str_.clear();
-        bool r = gzip_codec::uncompress(reply, uncompressed_str_);
-        if (r)
+        if (decompress_data(encoding_type_, reply, uncompressed_str_,
+                            max_http_body_len_)) {
           data.resp_body = uncompressed_str_;
-        else
-          data.resp_body = reply;
-      }
-      else if (encoding_type_ == content_encoding::deflate) {
-        uncompressed_str_.clear();
-        bool r = gzip_codec::inflate(reply, uncompressed_str_);
-        if (r)
-          data.resp_body = uncompressed_str_;
-        else
-          data.resp_body = reply;
-      }
-#endif
-#if defined(CINATRA_ENABLE_BROTLI) && defined(CINATRA_ENABLE_GZIP)
-      else if (encoding_type_ == content_encoding::br)
-#endif
-#if defined(CINATRA_ENABLE_BROTLI) && !defined(CINATRA_ENABLE_GZIP)
-        if (encoding_type_ == content_encoding::br)
-#endif
-#ifdef CINATRA_ENABLE_BROTLI
-        {
-          uncompressed_str_.clear();
-          bool r = br_codec::brotli_decompress(reply, uncompressed_str_);
-          if (r)
-            data.resp_body = uncompressed_str_;
-          else
-            data.resp_body = reply;
         }
+      }
 #endif
-#if defined(CINATRA_ENABLE_BROTLI) || defined(CINATRA_ENABLE_GZIP)
-        else
-#endif
-          data.resp_body = reply;
 
       head_buf_.consume(content_len);
     }
@@ -2537,66 +2532,67 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
   async_simple::coro::Lazy<resp_data> async_read_ws() {
     resp_data data{};
 
-    head_buf_.consume(head_buf_.size());
     std::shared_ptr sock = socket_;
-    asio::streambuf &read_buf = sock->head_buf_;
+    if (head_buf_.size() > 0) {
+      // the frames sent right after the handshake response.
+      ws_reader_.append(asio::buffer_cast<const char *>(head_buf_.data()),
+                        head_buf_.size());
+      head_buf_.consume(head_buf_.size());
+    }
     bool has_init_ssl = false;
 #ifdef CINATRA_ENABLE_SSL
     has_init_ssl = has_init_ssl_;
 #endif
     websocket ws{};
     while (true) {
-      if (auto [ec, _] = co_await async_read_ws(
-              sock, read_buf, ws.left_header_len(), has_init_ssl);
-          ec) {
-        if (socket_->is_timeout_) {
-          co_return resp_data{std::make_error_code(std::errc::timed_out), 404};
-        }
-        data.net_err = ec;
-        data.status = 404;
+      std::span<char> payload{};
+      auto ret = ws_reader_.next_frame(ws, payload, false);
+      if (ret == ws_frame_status::incomplete) {
+        if (auto [ec, size] = co_await async_read_some_ws(
+                sock, ws_reader_.prepare(), has_init_ssl);
+            ec) {
+          if (socket_->is_timeout_) {
+            co_return resp_data{std::make_error_code(std::errc::timed_out),
+                                404};
+          }
+          data.net_err = ec;
+          data.status = 404;
+
+          if (sock->has_closed_) {
+            co_return data;
+          }
 
-        if (sock->has_closed_) {
+          close_socket(*sock);
           co_return data;
         }
-
-        close_socket(*sock);
-        co_return data;
-      }
-
-      const char *data_ptr = asio::buffer_cast<const char *>(read_buf.data());
-      auto ret = ws.parse_header(data_ptr, read_buf.size(), false);
-      if (ret == ws_header_status::incomplete) {
+        else {
+          ws_reader_.commit(size);
+        }
         continue;
       }
-      else if (ret == ws_header_status::error) {
+      else if (ret == ws_frame_status::error) {
         data.net_err = std::make_error_code(std::errc::protocol_error);
         data.status = 404;
         close_socket(*sock);
         co_return data;
       }
 
-      frame_header *header = (frame_header *)data_ptr;
-      bool is_close_frame = header->opcode == opcode::close;
-
-      read_buf.consume(read_buf.size());
-
-      size_t payload_len = ws.payload_length();
-
-      if (auto [ec, size] =
-              co_await async_read_ws(sock, read_buf, payload_len, has_init_ssl);
-          ec) {
-        data.net_err = ec;
-        data.status = 404;
-        close_socket(*sock);
-        co_return data;
-      }
-
-      data_ptr = asio::buffer_cast<const char *>(read_buf.data());
+      bool is_close_frame = ws.get_opcode() == opcode::close;
+      size_t payload_len = payload.size();
+      const char *data_ptr = payload.data();
 #ifdef CINATRA_ENABLE_GZIP
-      if (is_server_support_ws_deflate_ && enable_ws_deflate_) {
+      // RSV1 is set on the first frame of a compressed message only, the
+      // control frames are never compressed.
+      bool is_data_frame = !is_close_frame &&
+                           ws.get_opcode() != opcode::ping &&
+                           ws.get_opcode() != opcode::pong;
+      if (is_data_frame && ws.get_opcode() != opcode::cont) {
+        ws_read_compressed_ = ws.is_compressed() && ws_deflate_.enabled();
+      }
+      if (is_data_frame && ws_read_compressed_) {
         inflate_str_.clear();
-        if (!cinatra::gzip_codec::inflate({data_ptr, payload_len},
-                                          inflate_str_)) {
+        if (!ws_deflate_.decompress({data_ptr, payload_len}, inflate_str_,
+                                    ws.is_fin())) {
           CINATRA_LOG_ERROR << "uncompuress data error";
           data.status = 404;
           data.net_err = std::make_error_code(std::errc::protocol_error);
@@ -2615,8 +2611,6 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
       data.status = 200;
       data.resp_body = {data_ptr, payload_len};
 
-      read_buf.consume(read_buf.size());
-
       if (is_close_frame) {
         std::string reason = "close";
         auto close_str = ws.format_close_payload(close_code::normal,
@@ -2639,16 +2633,16 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
   }
 
   template <typename AsioBuffer>
-  async_simple::coro::Lazy<std::pair<std::error_code, size_t>> async_read_ws(
-      auto sock, AsioBuffer &&buffer, size_t size_to_read,
-      bool has_init_ssl = false) noexcept {
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_read_some_ws(auto sock, AsioBuffer &&buffer,
+                     bool has_init_ssl = false) noexcept {
 #ifdef CINATRA_ENABLE_SSL
     if (has_init_ssl) {
-      return coro_io::async_read(*sock->ssl_stream_, buffer, size_to_read);
+      return coro_io::async_read_some(*sock->ssl_stream_, buffer);
     }
     else {
 #endif
-      return coro_io::async_read(sock->impl_, buffer, size_to_read);
+      return coro_io::async_read_some(sock->impl_, buffer);
 #ifdef CINATRA_ENABLE_SSL
     }
 #endif
@@ -2748,21 +2742,17 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
     socket.has_closed_ = true;
   }
 
-  async_simple::coro::Lazy<bool> timeout(
-      auto &timer, std::chrono::steady_clock::duration duration,
-      std::string msg) {
-    auto watcher = std::weak_ptr(socket_);
-    timer.expires_after(duration);
-    auto is_timeout = co_await timer.async_await();
-    if (!is_timeout) {
-      co_return false;
-    }
-    if (auto socket = watcher.lock(); socket) {
-      socket_->is_timeout_ = true;
-      CINATRA_LOG_WARNING << msg << " timeout";
-      close_socket(*socket_);
-    }
-    co_return true;
+  // the deadline is in the timing wheel of the client's io_context, arming it
+  // doesn't create a timer.
+  void timeout(std::chrono::steady_clock::duration duration,
+               std::string_view msg) {
+    timer_.arm(duration, [watcher = std::weak_ptr(socket_), msg] {
+      if (auto socket = watcher.lock(); socket) {
+        socket->is_timeout_ = true;
+        CINATRA_LOG_WARNING << msg << " timeout";
+        close_socket(*socket);
+      }
+    });
   }
 
   template <typename S>
@@ -2779,10 +2769,14 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
     return has_http_scheme;
   }
 
+  // the read buffers of multipart_reader_t.
+  asio::streambuf &head_buf() { return head_buf_; }
+  asio::streambuf &chunked_buf() { return chunked_buf_; }
+
   friend class multipart_reader_t<coro_http_client>;
   http_parser parser_;
   coro_io::ExecutorWrapper<> executor_wrapper_;
-  coro_io::period_timer timer_;
+  coro_io::wheel_timer timer_;
   std::shared_ptr<socket_t> socket_;
   asio::streambuf &head_buf_;
   asio::streambuf &chunked_buf_;
@@ -2824,9 +2818,12 @@ class coro_http_client : public std::enable_shared_from_this<coro_http_client> {
   bool should_reset_ = false;
   config config_;
 
+  ws_frame_reader ws_reader_;
   bool enable_ws_deflate_ = false;
 #ifdef CINATRA_ENABLE_GZIP
-  bool is_server_support_ws_deflate_ = false;
+  ws_deflate_options ws_deflate_options_;
+  ws_deflate ws_deflate_;
+  bool ws_read_compressed_ = false;
   std::string inflate_str_;
 #endif
   content_encoding encoding_type_ = content_encoding::none;
@@ -3,12 +3,14 @@
 #include <async_simple/coro/SyncAwait.h>
 
 #include <asio/buffer.hpp>
+#include <deque>
+#include <optional>
 #include <system_error>
 #include <thread>
 
 #include "asio/dispatch.hpp"
-#include "asio/streambuf.hpp"
 #include "async_simple/coro/Lazy.h"
+#include "buffer_pool.hpp"
 #include "cinatra/cinatra_log_wrapper.hpp"
 #include "cinatra/response_cv.hpp"
 #include "cookie.hpp"
@@ -17,15 +19,20 @@
 #include "define.h"
 #include "http_parser.hpp"
 #include "multipart.hpp"
+#include "outbound_queue.hpp"
 #include "session_manager.hpp"
 #include "sha1.hpp"
+#include "ssl_context.hpp"
 #include "string_resize.hpp"
 #include "websocket.hpp"
+#include "ws_frame_reader.hpp"
 #ifdef CINATRA_ENABLE_GZIP
 #include "gzip.hpp"
+#include "ws_deflate.hpp"
 #endif
 #include "ylt/coro_io/coro_file.hpp"
 #include "ylt/coro_io/coro_io.hpp"
+#include "ylt/coro_io/timing_wheel.hpp"
 
 namespace cinatra {
 struct websocket_result {
@@ -35,6 +42,23 @@ struct websocket_result {
   bool eof;
 };
 
+// the deadlines of the phases of a connection, zero is no limit. A connection
+// is closed when a phase runs out of its time.
+struct http_deadlines {
+  // waiting for the next request, or for a message of a websocket.
+  std::chrono::steady_clock::duration idle{};
+  // reading the rest of the header after its first bytes.
+  std::chrono::steady_clock::duration header_read{};
+  // reading the body, the one read by the handler too, such as a chunked
+  // or multipart body.
+  std::chrono::steady_clock::duration body_read{};
+  // running the handler, the reads of a websocket handler are idle and the
+  // body reads have body_read, it starts again after them.
+  std::chrono::steady_clock::duration handler{};
+  // a write of a response or of a queued message.
+  std::chrono::steady_clock::duration write{};
+};
+
 class coro_http_connection
     : public std::enable_shared_from_this<coro_http_connection> {
  public:
@@ -45,7 +69,6 @@ class coro_http_connection
         socket_(std::move(socket)),
         router_(router),
         max_http_header_size_(8 * 1024),
-        head_buf_(max_http_header_size_),
         request_(parser_, this),
         response_(this) {
     buffers_.reserve(3);
@@ -56,33 +79,22 @@ class coro_http_connection
 #ifdef CINATRA_ENABLE_SSL
   bool init_ssl(const std::string &cert_file, const std::string &key_file,
                 std::string passwd) {
-    unsigned long ssl_options = asio::ssl::context::default_workarounds |
-                                asio::ssl::context::no_sslv2 |
-                                asio::ssl::context::single_dh_use;
-    try {
-      ssl_ctx_ =
-          std::make_unique<asio::ssl::context>(asio::ssl::context::sslv23);
-
-      ssl_ctx_->set_options(ssl_options);
-      if (!passwd.empty()) {
-        ssl_ctx_->set_password_callback([pwd = std::move(passwd)](auto, auto) {
-          return pwd;
-        });
-      }
-
-      std::error_code ec;
-      if (fs::exists(cert_file, ec)) {
-        ssl_ctx_->use_certificate_chain_file(std::move(cert_file));
-      }
-
-      if (fs::exists(key_file, ec)) {
-        ssl_ctx_->use_private_key_file(std::move(key_file),
-                                       asio::ssl::context::pem);
-      }
+    auto ctx = create_ssl_server_context(ssl_server_config{
+        .cert_file = cert_file, .key_file = key_file, .passwd = passwd});
+    if (ctx == nullptr) {
+      return false;
+    }
+    return init_ssl(std::move(ctx));
+  }
 
+  // share the ssl context created by the server, avoid loading the cert and
+  // key for every new connection.
+  bool init_ssl(std::shared_ptr<ssl_server_context> ctx) {
+    try {
+      ssl_ctx_ = std::move(ctx);
       ssl_stream_ =
           std::make_unique<asio::ssl::stream<asio::ip::tcp::socket &>>(
-              socket_, *ssl_ctx_);
+              socket_, *ssl_ctx_->ctx);
       use_ssl_ = true;
     } catch (const std::exception &e) {
       CINATRA_LOG_ERROR << "init ssl failed, reason: " << e.what();
@@ -98,8 +110,8 @@ class coro_http_connection
 #endif
     std::chrono::system_clock::time_point start{};
     std::chrono::system_clock::time_point mid{};
-    std::destroy_at(&head_buf_);
-    new (&head_buf_) asio::streambuf(max_http_header_size_);
+    reset_head_buf();
+    init_deadlines();
     while (true) {
 #ifdef CINATRA_ENABLE_SSL
       if (use_ssl_ && !has_shake) {
@@ -114,7 +126,8 @@ class coro_http_connection
         has_shake = true;
       }
 #endif
-      auto [ec, size] = co_await async_read_until(head_buf_, TWO_CRCF);
+      arm_read_deadline(deadlines_.idle);
+      auto [ec, head_len] = co_await read_http_head();
       if (ec == asio::error::not_found) {
         CINATRA_LOG_WARNING << "http header too large (> "
                             << max_http_header_size_ << " bytes)";
@@ -133,8 +146,6 @@ class coro_http_connection
         break;
       }
 
-      const char *data_ptr = asio::buffer_cast<const char *>(head_buf_.data());
-      int head_len = parser_.parse_request(data_ptr, size, 0);
       if (head_len <= 0) {
         CINATRA_LOG_ERROR << "parse http header error";
         response_.set_status_and_content(status_type::bad_request,
@@ -155,7 +166,8 @@ class coro_http_connection
         break;
       }
 
-      head_buf_.consume(size);
+      const char *head = asio::buffer_cast<const char *>(head_buf_->data());
+      head_buf_->consume(head_len);
       keep_alive_ = check_keep_alive();
 
       auto type = request_.get_content_type();
@@ -165,14 +177,6 @@ class coro_http_connection
         if (body_len == 0) {
           if (parser_.method() == "GET"sv) {
             if (request_.is_upgrade()) {
-#ifdef CINATRA_ENABLE_GZIP
-              if (request_.is_support_compressed()) {
-                is_client_ws_compressed_ = true;
-              }
-              else {
-                is_client_ws_compressed_ = false;
-              }
-#endif
               // websocket
               build_ws_handshake_head();
               bool ok = co_await reply(true);  // response ws handshake
@@ -181,25 +185,27 @@ class coro_http_connection
                 break;
               }
               response_.set_delay(true);
+              keep_upgrade_head(head, head_len);
             }
           }
         }
-        else if (body_len <= head_buf_.size()) {
-          if (body_len > 0) {
-            detail::resize(body_, body_len);
-            auto data_ptr = asio::buffer_cast<const char *>(head_buf_.data());
-            memcpy(body_.data(), data_ptr, body_len);
-            head_buf_.consume(head_buf_.size());
-          }
+        else if (body_len <= head_buf_->size()) {
+          body_.reserve(body_len, 0);
+          body_len_ = body_len;
+          auto data_ptr = asio::buffer_cast<const char *>(head_buf_->data());
+          memcpy(body_.data(), data_ptr, body_len);
+          head_buf_->consume(body_len);
         }
         else {
-          size_t part_size = head_buf_.size();
+          size_t part_size = head_buf_->size();
           size_t size_to_read = body_len - part_size;
-          auto data_ptr = asio::buffer_cast<const char *>(head_buf_.data());
-          detail::resize(body_, body_len);
+          auto data_ptr = asio::buffer_cast<const char *>(head_buf_->data());
+          body_.reserve(body_len, 0);
+          body_len_ = body_len;
           memcpy(body_.data(), data_ptr, part_size);
-          head_buf_.consume(part_size);
+          head_buf_->consume(part_size);
 
+          arm_read_deadline(deadlines_.body_read);
           auto [ec, size] = co_await async_read(
               asio::buffer(body_.data() + part_size, size_to_read),
               size_to_read);
@@ -215,16 +221,17 @@ class coro_http_connection
           parser_.method().data(),
           parser_.method().length() + 1 + parser_.url().length()};
 
-      std::string decode_key;
       if (parser_.url().find('%') != std::string_view::npos) {
-        decode_key = code_utils::url_decode(key);
-        key = decode_key;
+        // the path params point to it, keep it until the next request.
+        decode_key_ = code_utils::url_decode(key);
+        key = decode_key_;
       }
 
-      if (!body_.empty()) {
-        request_.set_body(body_);
+      if (body_len_ > 0) {
+        request_.set_body({body_.data(), body_len_});
       }
 
+      arm_read_deadline(deadlines_.handler);
       if (auto handler = router_.get_handler(key); handler) {
         router_.route(handler, request_, response_, key);
       }
@@ -232,94 +239,47 @@ class coro_http_connection
         if (auto coro_handler = router_.get_coro_handler(key); coro_handler) {
           co_await router_.route_coro(coro_handler, request_, response_, key);
         }
+        else if (auto route = router_.match(key, request_.params_,
+                                            request_.matches_);
+                 route) {
+          if (route->handler) {
+            router_.route(&route->handler, request_, response_, key);
+          }
+          else if (route->coro_handler) {
+            co_await router_.route_coro(&route->coro_handler, request_,
+                                        response_, key);
+          }
+          else {
+            response_.set_status(status_type::not_found);
+          }
+        }
         else {
-          bool is_exist = false;
-          bool is_coro_exist = false;
-          bool is_matched_regex_router = false;
-          std::function<void(coro_http_request & req,
-                             coro_http_response & resp)>
-              handler;
-          std::string method_str{parser_.method()};
-          std::string url_path = method_str;
-          url_path.append(" ").append(parser_.url());
-          std::tie(is_exist, handler, request_.params_) =
-              router_.get_router_tree()->get(url_path, method_str);
-          if (is_exist) {
-            if (handler) {
-              (handler)(request_, response_);
-            }
-            else {
-              response_.set_status(status_type::not_found);
-            }
+          // exact route -> parameter, wildcard and regex route -> default ->
+          // not found
+          if (default_handler_) {
+            co_await default_handler_(request_, response_);
           }
           else {
-            std::function<async_simple::coro::Lazy<void>(
-                coro_http_request & req, coro_http_response & resp)>
-                coro_handler;
-
-            std::tie(is_coro_exist, coro_handler, request_.params_) =
-                router_.get_coro_router_tree()->get_coro(url_path, method_str);
-
-            if (is_coro_exist) {
-              if (coro_handler) {
-                co_await coro_handler(request_, response_);
-              }
-              else {
-                response_.set_status(status_type::not_found);
-              }
-            }
-            else {
-              // coro regex router
-              auto coro_regex_handlers = router_.get_coro_regex_handlers();
-              if (coro_regex_handlers.size() != 0) {
-                for (auto &pair : coro_regex_handlers) {
-                  std::string coro_regex_key{key};
-
-                  if (std::regex_match(coro_regex_key, request_.matches_,
-                                       std::get<0>(pair))) {
-                    auto coro_handler = std::get<1>(pair);
-                    if (coro_handler) {
-                      co_await coro_handler(request_, response_);
-                      is_matched_regex_router = true;
-                    }
-                  }
-                }
-              }
-              // regex router
-              if (!is_matched_regex_router) {
-                auto regex_handlers = router_.get_regex_handlers();
-                if (regex_handlers.size() != 0) {
-                  for (auto &pair : regex_handlers) {
-                    std::string regex_key{key};
-                    if (std::regex_match(regex_key, request_.matches_,
-                                         std::get<0>(pair))) {
-                      auto handler = std::get<1>(pair);
-                      if (handler) {
-                        (handler)(request_, response_);
-                        is_matched_regex_router = true;
-                      }
-                    }
-                  }
-                }
-              }
-              // radix route -> radix coro route -> regex coro -> regex ->
-              // default -> not found
-              if (!is_matched_regex_router) {
-                if (default_handler_) {
-                  co_await default_handler_(request_, response_);
-                }
-                else {
-                  // not found
-                  response_.set_status(status_type::not_found);
-                }
-              }
-            }
+            response_.set_status(status_type::not_found);
           }
         }
       }
 
+      arm_read_deadline({});
+
+      if (!outbound_.idle()) {
+        // the handler may return before the messages it posted are written.
+        co_await flush_outbound();
+      }
+
       if (!response_.get_delay()) {
-        if (head_buf_.size()) {
+#ifdef CINATRA_HAS_COMPRESSION
+        if (auto_compress_) {
+          response_.auto_compress(request_.get_accept_encoding(),
+                                  compress_min_size_);
+        }
+#endif
+        if (head_buf_->size()) {
           if (type == content_type::multipart ||
               type == content_type::chunked) {
             if (response_.content().empty())
@@ -333,69 +293,23 @@ class coro_http_connection
                 << ec.message();
             break;
           }
-          else if (parser_.method()[0] != 'G' && parser_.method()[0] != 'H') {
-            // handle pipeling, only support GET and HEAD method now.
-            response_.set_status_and_content(status_type::method_not_allowed,
-                                             "method not allowed");
-            co_await reply();
-          }
           else {
-            resp_str_.reserve(512);
-            response_.build_resp_str(resp_str_);
-
-            while (true) {
-              size_t left_size = head_buf_.size();
-              auto next_data_ptr =
-                  asio::buffer_cast<const char *>(head_buf_.data());
-              std::string_view left_content{next_data_ptr, left_size};
-              size_t pos = left_content.find(TWO_CRCF);
-              if (pos == std::string_view::npos) {
-                break;
-              }
-              http_parser parser;
-              int head_len = parser.parse_request(next_data_ptr, left_size, 0);
-              if (head_len <= 0) {
-                CINATRA_LOG_ERROR << "parse http header error";
-                response_.set_status_and_content(status_type::bad_request,
-                                                 "invalid http protocol");
-                co_await reply();
-                close();
-                break;
-              }
-
-              head_buf_.consume(pos + TWO_CRCF.length());
-
-              std::string_view next_key = {
-                  parser.method().data(),
-                  parser.method().length() + 1 + parser.url().length()};
-
-              coro_http_request req(parser, this);
-              coro_http_response resp(this);
-              resp.need_date_head(response_.need_date());
-              if (auto handler = router_.get_handler(next_key); handler) {
-                router_.route(handler, req, resp, key);
-              }
-              else {
-                if (auto coro_handler = router_.get_coro_handler(next_key);
-                    coro_handler) {
-                  co_await router_.route_coro(coro_handler, req, resp, key);
-                }
-                else {
-                  resp.set_status(status_type::not_found);
+            handle_session_for_response();
+            if (keep_alive_) {
+              // pipelined requests are left in head_buf_, buffer the response
+              // and write all of them together with the last response.
+              response_.build_resp_str(pipeline_buf_);
+              if (pipeline_buf_.size() >= max_pipeline_buf_size) {
+                if (auto ec = co_await flush_pipeline(); ec) {
+                  close();
+                  break;
                 }
               }
-
-              resp.build_resp_str(resp_str_);
             }
-
-            auto [write_ec, _] = co_await async_write(asio::buffer(resp_str_));
-            if (write_ec) {
-              CINATRA_LOG_ERROR << "async_write error: " << write_ec.message();
-              close();
-              co_return;
+            else {
+              co_await reply();
             }
           }
-          head_buf_.consume(head_buf_.size());
         }
         else {
           handle_session_for_response();
@@ -415,17 +329,71 @@ class coro_http_connection
       response_.clear();
       request_.clear();
       buffers_.clear();
-      body_.clear();
+      body_.release();
+      body_len_ = 0;
+      // the chunks are in it until the request ends.
+      chunked_buf_ = nullptr;
       resp_str_.clear();
       multipart_body_finished_ = false;
       multi_buf_ = true;
-      if (need_shrink_every_time_) {
-        body_.shrink_to_fit();
-      }
+#ifdef CINATRA_HAS_COMPRESSION
+      // the chunked response isn't ended by the handler.
+      chunked_compressor_.reset();
+#endif
     }
 
-    if (head_buf_.size()) {
-      head_buf_.consume(head_buf_.size());
+    if (head_buf_->size()) {
+      head_buf_->consume(head_buf_->size());
+    }
+  }
+
+  // read until the http header is complete. picohttpparser only scans the
+  // newly received bytes for the end of header(last_len), the header is parsed
+  // once when it is complete, the data after the header is kept in head_buf_->
+  async_simple::coro::Lazy<std::pair<std::error_code, int>> read_http_head() {
+    size_t last_len = 0;
+    // the idle deadline until the first bytes of the request.
+    bool reading_head = false;
+    while (true) {
+      if (head_buf_->size() > 0) {
+        const char *data_ptr =
+            asio::buffer_cast<const char *>(head_buf_->data());
+        int head_len =
+            parser_.parse_request(data_ptr, head_buf_->size(), last_len);
+        if (head_len != -2) {
+          co_return std::make_pair(std::error_code{}, head_len);
+        }
+        last_len = head_buf_->size();
+        if (!reading_head) {
+          reading_head = true;
+          arm_read_deadline(deadlines_.header_read);
+        }
+      }
+
+      // don't hold the pipelined responses while waiting for more data.
+      if (!pipeline_buf_.empty()) {
+        if (auto ec = co_await flush_pipeline(); ec) {
+          co_return std::make_pair(ec, 0);
+        }
+      }
+
+      if (head_buf_->size() >= max_http_header_size_) {
+        co_return std::make_pair(
+            asio::error::make_error_code(asio::error::not_found), 0);
+      }
+
+      if (head_buf_->size() == 0) {
+        if (auto ec = co_await wait_idle(); ec) {
+          co_return std::make_pair(ec, 0);
+        }
+      }
+
+      auto [ec, size] = co_await async_read_some(
+          head_buf_->prepare(read_size_helper(*head_buf_, 65536)));
+      if (ec) {
+        co_return std::make_pair(ec, 0);
+      }
+      head_buf_->commit(size);
     }
   }
 
@@ -489,10 +457,21 @@ class coro_http_connection
     max_http_header_size_ = max_size;
   }
 
+  // compress the responses of the compressible types by Accept-Encoding, the
+  // chunked responses and SSE piece by piece, the others of min_size bytes
+  // and up.
+  void set_auto_compression(bool enable, size_t min_size) {
+    auto_compress_ = enable;
+    compress_min_size_ = min_size;
+  }
+
 #ifdef INJECT_FOR_HTTP_SEVER_TEST
   void set_write_failed_forever(bool r) { write_failed_forever_ = r; }
 
   void set_read_failed_forever(bool r) { read_failed_forever_ = r; }
+
+  // the thread which created the connection, the one which accepted it.
+  std::thread::id accept_thread_id() const { return accept_thread_id_; }
 #endif
 
   async_simple::coro::Lazy<bool> write_data(std::string_view message) {
@@ -508,18 +487,81 @@ class coro_http_connection
     co_return true;
   }
 
+  // the kernel can copy a file to the socket directly only without tls, the
+  // tls stream must encrypt the data in userspace.
+  bool support_sendfile() const {
+#if defined(__linux__) && defined(CINATRA_ENABLE_SSL)
+    return !use_ssl_;
+#elif defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+#ifdef __linux__
+  // write [offset, offset + size) of the file by sendfile, the data isn't
+  // copied to userspace.
+  async_simple::coro::Lazy<bool> write_file(int fd, uint64_t offset,
+                                            size_t size) {
+#ifdef INJECT_FOR_HTTP_SEVER_TEST
+    if (write_failed_forever_) {
+      close();
+      co_return false;
+    }
+#endif
+    if (!pipeline_buf_.empty()) [[unlikely]] {
+      if (auto ec = co_await flush_pipeline(); ec) {
+        close();
+        co_return false;
+      }
+    }
+    arm_write_deadline(deadlines_.write);
+    auto [ec, n] =
+        co_await coro_io::async_sendfile(socket_, fd, (off_t)offset, size);
+    arm_write_deadline({});
+    if (!ec && n != size) {
+      // the file is truncated while sending it.
+      ec = std::make_error_code(std::errc::invalid_argument);
+    }
+    if (ec) {
+      CINATRA_LOG_ERROR << "sendfile error: " << ec.message();
+      close();
+      co_return false;
+    }
+
+    co_return true;
+  }
+#endif
+
   async_simple::coro::Lazy<bool> begin_chunked() {
     response_.set_delay(true);
     response_.set_status(status_type::ok);
+#ifdef CINATRA_HAS_COMPRESSION
+    if (auto_compress_) {
+      begin_chunked_compression();
+    }
+#endif
     co_return co_await reply();
   }
 
   async_simple::coro::Lazy<bool> write_chunked(std::string_view chunked_data,
                                                bool eof = false) {
     response_.set_delay(true);
-    buffers_.clear();
-    to_chunked_buffers(buffers_, chunk_size_str_, chunked_data, eof);
-    co_return co_await reply(false);
+    auto ec = co_await send_outbound(
+        make_outbound_view(outbound_type::chunk, chunked_data, eof));
+    co_return !ec;
+  }
+
+  // queue a chunk after begin_chunked() without waiting for it to be written,
+  // false if the connection is closed. Thread safe.
+  bool post_chunked(std::string chunked_data) {
+    if (has_closed_) {
+      return false;
+    }
+    push_outbound(
+        make_outbound(outbound_type::chunk, std::move(chunked_data), false));
+    return true;
   }
 
   async_simple::coro::Lazy<bool> end_chunked() {
@@ -535,20 +577,26 @@ class coro_http_connection
   }
 
   async_simple::coro::Lazy<bool> write_sse_event(sse_event event) {
-    sse_payload_ = serialize_sse_event(event);
-    return write_sse_payload();
+    return write_chunked_owned(serialize_sse_event(event));
   }
 
   async_simple::coro::Lazy<bool> write_sse_data(std::string data) {
-    sse_payload_ = serialize_sse_event(sse_event{.data = std::move(data)});
-    return write_sse_payload();
+    sse_event event;
+    event.data = std::move(data);
+    return write_chunked_owned(serialize_sse_event(event));
   }
 
   async_simple::coro::Lazy<bool> write_sse_comment(std::string comment) {
-    sse_payload_.clear();
-    append_sse_field(sse_payload_, "", comment, true);
-    sse_payload_.append(CRCF);
-    return write_sse_payload();
+    std::string payload;
+    append_sse_field(payload, "", comment, true);
+    payload.append(CRCF);
+    return write_chunked_owned(std::move(payload));
+  }
+
+  // queue an event after begin_sse() without waiting for it to be written,
+  // false if the connection is closed. Thread safe.
+  bool post_sse_event(const sse_event &event) {
+    return post_chunked(serialize_sse_event(event));
   }
 
   async_simple::coro::Lazy<bool> end_sse() { co_return co_await end_chunked(); }
@@ -574,52 +622,50 @@ class coro_http_connection
   async_simple::coro::Lazy<bool> write_multipart(
       std::string_view part_data, std::string_view content_type) {
     response_.set_delay(true);
-    buffers_.clear();
-    std::string part_head = "--";
-    part_head.append(response_.get_boundary()).append(CRCF);
-    part_head.append("Content-Type: ").append(content_type).append(CRCF);
-    part_head.append("Content-Length: ")
+    std::string part = "--";
+    part.append(response_.get_boundary()).append(CRCF);
+    part.append("Content-Type: ").append(content_type).append(CRCF);
+    part.append("Content-Length: ")
         .append(std::to_string(part_data.size()))
         .append(TWO_CRCF);
+    part.append(part_data).append(CRCF);
 
-    buffers_.push_back(asio::buffer(part_head));
-    buffers_.push_back(asio::buffer(part_data));
-    buffers_.push_back(asio::buffer(CRCF));
-
-    auto [ec, _] = co_await async_write(buffers_);
+    auto ec = co_await send_outbound(
+        make_outbound(outbound_type::raw, std::move(part)));
     co_return !ec;
   }
 
   async_simple::coro::Lazy<bool> end_multipart() {
     response_.set_delay(true);
-    buffers_.clear();
     std::string multipart_end = "--";
     multipart_end.append(response_.get_boundary()).append("--").append(CRCF);
-    auto [ec, _] = co_await async_write(asio::buffer(multipart_end));
+    auto ec = co_await send_outbound(
+        make_outbound(outbound_type::raw, std::move(multipart_end)));
     co_return !ec;
   }
 
   async_simple::coro::Lazy<chunked_result> read_chunked() {
-    if (head_buf_.size() > 0) {
-      const char *data_ptr = asio::buffer_cast<const char *>(head_buf_.data());
-      chunked_buf_.sputn(data_ptr, head_buf_.size());
-      head_buf_.consume(head_buf_.size());
+    auto &chunked_buf = this->chunked_buf();
+    if (head_buf_->size() > 0) {
+      const char *data_ptr = asio::buffer_cast<const char *>(head_buf_->data());
+      chunked_buf.sputn(data_ptr, head_buf_->size());
+      head_buf_->consume(head_buf_->size());
     }
 
     chunked_result result{};
     std::error_code ec{};
     size_t size = 0;
 
-    if (std::tie(ec, size) = co_await async_read_until(chunked_buf_, CRCF);
+    if (std::tie(ec, size) = co_await async_read_until(chunked_buf, CRCF);
         ec) {
       result.ec = ec;
       close();
       co_return result;
     }
 
-    size_t buf_size = chunked_buf_.size();
+    size_t buf_size = chunked_buf.size();
     size_t additional_size = buf_size - size;
-    const char *data_ptr = asio::buffer_cast<const char *>(chunked_buf_.data());
+    const char *data_ptr = asio::buffer_cast<const char *>(chunked_buf.data());
     std::string_view size_str(data_ptr, size - CRCF.size());
     size_t chunk_size;
     auto [ptr, err] = std::from_chars(
@@ -630,12 +676,22 @@ class coro_http_connection
       co_return result;
     }
 
-    chunked_buf_.consume(size);
+    if (chunk_size > size_t(max_http_body_len_)) [[unlikely]] {
+      CINATRA_LOG_ERROR << "chunk size " << chunk_size << " is too large (> "
+                        << max_http_body_len_ << " bytes)";
+      result.ec = std::make_error_code(std::errc::message_size);
+      close();
+      co_return result;
+    }
+
+    chunked_buf.consume(size);
 
     if (additional_size < size_t(chunk_size + 2)) {
       // not a complete chunk, read left chunk data.
       size_t size_to_read = chunk_size + 2 - additional_size;
-      if (std::tie(ec, size) = co_await async_read(chunked_buf_, size_to_read);
+      if (std::tie(ec, size) = co_await read_body([&, size_to_read] {
+            return async_read(chunked_buf, size_to_read);
+          });
           ec) {
         result.ec = ec;
         close();
@@ -645,87 +701,125 @@ class coro_http_connection
 
     if (chunk_size == 0) {
       // all finished, no more data
-      chunked_buf_.consume(chunked_buf_.size());
+      chunked_buf.consume(chunked_buf.size());
       result.eof = true;
       co_return result;
     }
 
-    data_ptr = asio::buffer_cast<const char *>(chunked_buf_.data());
+    data_ptr = asio::buffer_cast<const char *>(chunked_buf.data());
     result.data = std::string_view{data_ptr, (size_t)chunk_size};
-    chunked_buf_.consume(chunk_size + CRCF.size());
+    chunked_buf.consume(chunk_size + CRCF.size());
 
     co_return result;
   }
 
+  // the frame is queued and written by the writer of the connection, so it's
+  // safe to write from many coroutines and threads at the same time.
   async_simple::coro::Lazy<std::error_code> write_websocket(
       std::string_view msg, opcode op = opcode::text, bool eof = true) {
-    std::vector<asio::const_buffer> buffers;
-    std::string_view header;
-#ifdef CINATRA_ENABLE_GZIP
-    std::string dest_buf;
-    if (is_client_ws_compressed_ && msg.size() > 0) {
-      if (!cinatra::gzip_codec::deflate(msg, dest_buf)) {
-        CINATRA_LOG_ERROR << "compress data error, data: " << msg;
-        co_return std::make_error_code(std::errc::protocol_error);
-      }
+    co_return co_await send_outbound(
+        make_outbound_view(outbound_type::ws_frame, msg, eof, op));
+  }
 
-      header = ws_.encode_ws_header(dest_buf.length(), op, eof, true, false);
-      buffers.push_back(asio::buffer(header));
-      buffers.push_back(asio::buffer(dest_buf));
-    }
-    else {
-#endif
-      header = ws_.encode_ws_header(msg.length(), op, eof, false, false);
-      buffers.push_back(asio::buffer(header));
-      buffers.push_back(asio::buffer(msg));
-#ifdef CINATRA_ENABLE_GZIP
+  // queue a message without waiting for it to be written, false if the
+  // connection is closed. The messages queued meanwhile are written by one
+  // write. Thread safe.
+  bool post_websocket(std::string msg, opcode op = opcode::text) {
+    if (has_closed_) {
+      return false;
     }
-#endif
-    auto [ec, sz] = co_await async_write(buffers);
-    co_return ec;
+    push_outbound(
+        make_outbound(outbound_type::ws_frame, std::move(msg), true, op));
+    return true;
   }
 
-  async_simple::coro::Lazy<websocket_result> read_websocket() {
-    auto [ec, ws_hd_size] = co_await async_read(head_buf_, SHORT_HEADER);
-    websocket_result result{ec};
-    if (ec) {
-      close();
-      co_return result;
+  // wait until the messages queued before are written, the error of the
+  // connection if it's closed. With max_bytes it returns at once if at most
+  // max_bytes are waiting, a producer which posts without waiting calls it to
+  // slow down to the speed of the peer.
+  async_simple::coro::Lazy<std::error_code> flush_outbound(
+      size_t max_bytes = 0) {
+    if (has_closed_) {
+      co_return std::make_error_code(std::errc::not_connected);
     }
+    if (outbound_.idle() ||
+        (max_bytes > 0 && outbound_bytes_ <= max_bytes)) {
+      co_return std::error_code{};
+    }
+    co_return co_await send_outbound(make_outbound(outbound_type::flush, {}));
+  }
 
-    while (true) {
-      const char *data_ptr = asio::buffer_cast<const char *>(head_buf_.data());
-      auto status = ws_.parse_header(data_ptr, ws_.len_bytes());
-      if (status == ws_header_status::complete) {
-        ws_.reset_len_bytes();
-        head_buf_.consume(head_buf_.size());
-        std::span<char> payload{};
-        auto payload_length = ws_.payload_length();
-
-        if (max_part_size_ != 0 && payload_length > max_part_size_) {
-          std::string close_reason = "message_too_big";
-          std::string close_msg = ws_.format_close_payload(
-              close_code::too_big, close_reason.data(), close_reason.size());
-          co_await write_websocket(close_msg, opcode::close);
+  // the bytes queued and not written yet.
+  size_t outbound_bytes() const { return outbound_bytes_; }
+
+  // queue a frame shared with other connections, the frames are written in
+  // order on the io thread of the connection. When max_queue frames are
+  // waiting, the policy drops the oldest one or closes the connection.
+  // Thread safe.
+  void send_shared_frame(std::shared_ptr<const ws_shared_frame> frame,
+                         size_t max_queue, ws_overflow_policy policy) {
+    if (has_closed_) {
+      return;
+    }
+    asio::dispatch(socket_.get_executor(), [this, self = shared_from_this(),
+                                            frame = std::move(frame),
+                                            max_queue, policy]() mutable {
+      if (has_closed_) {
+        return;
+      }
+      auto &frames = ws_state().shared_frames;
+      if (frames.size() >= max_queue) {
+        if (policy == ws_overflow_policy::disconnect) {
+          CINATRA_LOG_WARNING << "websocket peer is too slow, close conn "
+                              << conn_id_;
+          frames.clear();
           close();
-          result.ec = std::error_code(asio::error::message_size,
-                                      asio::error::get_system_category());
-          break;
+          return;
         }
+        frames.pop_front();
+        ws_->dropped_shared_frames++;
+      }
+      frames.push_back(std::move(frame));
+      if (frames.size() == 1) {
+        // the writer takes all the frames waiting when it reaches the mark.
+        push_outbound(make_outbound(outbound_type::shared_frames, {}));
+      }
+    });
+  }
 
-        if (payload_length > 0) {
-          detail::resize(body_, payload_length);
-          auto [ec, read_sz] =
-              co_await async_read(asio::buffer(body_), payload_length);
-          if (ec) {
-            close();
-            result.ec = ec;
-            break;
-          }
-          payload = body_;
-        }
+  // the shared frames dropped by ws_overflow_policy::drop_oldest.
+  size_t dropped_shared_frames() const {
+    return ws_ == nullptr ? 0 : ws_->dropped_shared_frames.load();
+  }
+
+  // the window bits of a shared frame this connection sends compressed, 0 if
+  // it sends the uncompressed one.
+  int shared_frame_deflate_bits() const {
+#ifdef CINATRA_ENABLE_GZIP
+    return ws_ == nullptr ? 0 : ws_->deflate.window_bits();
+#else
+    return 0;
+#endif
+  }
+
+  // the frames already in the receive buffer are decoded without reading the
+  // socket, the data of the result is valid until the next read_websocket().
+  async_simple::coro::Lazy<websocket_result> read_websocket() {
+    websocket_result result{};
+    auto &state = ws_state();
+    if (head_buf_->size() > 0) {
+      // the frames sent right after the handshake.
+      state.reader.append(asio::buffer_cast<const char *>(head_buf_->data()),
+                          head_buf_->size());
+      head_buf_->consume(head_buf_->size());
+    }
 
-        ws_frame_type type = ws_.parse_payload(payload);
+    while (true) {
+      std::span<char> payload{};
+      auto status =
+          state.reader.next_frame(state.ws, payload, true, max_part_size_);
+      if (status == ws_frame_status::complete) {
+        ws_frame_type type = state.ws.parse_payload(payload);
 
         switch (type) {
           case cinatra::ws_frame_type::WS_ERROR_FRAME:
@@ -736,13 +830,18 @@ class coro_http_connection
             continue;
           case ws_frame_type::WS_INCOMPLETE_TEXT_FRAME:
           case ws_frame_type::WS_INCOMPLETE_BINARY_FRAME:
+#ifdef CINATRA_ENABLE_GZIP
+            if (!inflate_payload(payload, result)) {
+              break;
+            }
+#endif
             result.eof = false;
             result.data = {payload.data(), payload.size()};
             break;
           case cinatra::ws_frame_type::WS_TEXT_FRAME:
           case cinatra::ws_frame_type::WS_BINARY_FRAME: {
 #ifdef CINATRA_ENABLE_GZIP
-            if (!gzip_compress(payload, result)) {
+            if (!inflate_payload(payload, result)) {
               break;
             }
 #endif
@@ -750,17 +849,12 @@ class coro_http_connection
             result.data = {payload.data(), payload.size()};
           } break;
           case cinatra::ws_frame_type::WS_CLOSE_FRAME: {
-#ifdef CINATRA_ENABLE_GZIP
-            if (!gzip_compress(payload, result)) {
-              break;
-            }
-#endif
             close_frame close_frame =
-                ws_.parse_close_payload(payload.data(), payload.size());
+                state.ws.parse_close_payload(payload.data(), payload.size());
             result.eof = true;
             result.data = {close_frame.message, close_frame.length};
 
-            std::string close_msg = ws_.format_close_payload(
+            std::string close_msg = state.ws.format_close_payload(
                 close_code::normal, close_frame.message, close_frame.length);
 
             co_await write_websocket(close_msg, opcode::close);
@@ -786,15 +880,35 @@ class coro_http_connection
         result.type = type;
         co_return result;
       }
-      else if (status == ws_header_status::incomplete) {
-        auto [ec, sz] = co_await async_read(head_buf_, ws_.left_header_len());
+      else if (status == ws_frame_status::incomplete) {
+        arm_read_deadline(deadlines_.idle);
+        std::error_code ec;
+        if (state.reader.size() == 0) {
+          ec = co_await wait_idle();
+        }
+        size_t size = 0;
+        if (!ec) {
+          std::tie(ec, size) = co_await async_read_some(state.reader.prepare());
+        }
+        arm_read_deadline({});
         if (ec) {
           close();
           result.ec = ec;
           break;
         }
+        state.reader.commit(size);
         continue;
       }
+      else if (status == ws_frame_status::too_big) {
+        std::string close_reason = "message_too_big";
+        std::string close_msg = state.ws.format_close_payload(
+            close_code::too_big, close_reason.data(), close_reason.size());
+        co_await write_websocket(close_msg, opcode::close);
+        close();
+        result.ec = std::error_code(asio::error::message_size,
+                                    asio::error::get_system_category());
+        break;
+      }
       else {
         close();
         result.ec = std::make_error_code(std::errc::protocol_error);
@@ -806,17 +920,25 @@ class coro_http_connection
   }
 
 #ifdef CINATRA_ENABLE_GZIP
-  bool gzip_compress(std::span<char> &payload, websocket_result &result) {
-    if (is_client_ws_compressed_) {
-      inflate_str_.clear();
-      if (!cinatra::gzip_codec::inflate({payload.data(), payload.size()},
-                                        inflate_str_)) {
-        CINATRA_LOG_ERROR << "compress data error";
-        result.ec = std::make_error_code(std::errc::protocol_error);
-        return false;
-      }
-      payload = inflate_str_;
+  // inflate a frame of a message compressed by permessage-deflate, RSV1 is
+  // set on the first frame of the message only.
+  bool inflate_payload(std::span<char> &payload, websocket_result &result) {
+    auto &state = *ws_;
+    if (state.ws.get_opcode() != opcode::cont) {
+      state.read_compressed =
+          state.ws.is_compressed() && state.deflate.enabled();
+    }
+    if (!state.read_compressed) {
+      return true;
+    }
+    state.inflate_str.clear();
+    if (!state.deflate.decompress({payload.data(), payload.size()},
+                                  state.inflate_str, state.ws.is_fin())) {
+      CINATRA_LOG_ERROR << "uncompress data error";
+      result.ec = std::make_error_code(std::errc::protocol_error);
+      return false;
     }
+    payload = state.inflate_str;
     return true;
   }
 #endif
@@ -831,10 +953,16 @@ class coro_http_connection
 
   void set_ws_max_size(uint64_t max_size) { max_part_size_ = max_size; }
 
-  void set_shrink_to_fit(bool r) {
-    need_shrink_every_time_ = r;
-    response_.set_shrink_to_fit(r);
+#ifdef CINATRA_ENABLE_GZIP
+  void set_ws_deflate(bool enable, const ws_deflate_options &options) {
+    ws_deflate_enabled_ = enable;
+    ws_deflate_options_ = options;
   }
+#endif
+
+  // the request body is given back to the buffer pool by the end of every
+  // request, only the response content is affected.
+  void set_shrink_to_fit(bool r) { response_.set_shrink_to_fit(r); }
 
 #ifdef INJECT_FOR_HTTP_SEVER_TEST
   async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
@@ -856,7 +984,6 @@ class coro_http_connection
       return async_read_failed();
     }
 #endif
-    set_last_time();
 #ifdef CINATRA_ENABLE_SSL
     if (use_ssl_) {
       return coro_io::async_read(*ssl_stream_, buffer, size_to_read);
@@ -869,6 +996,21 @@ class coro_http_connection
 #endif
   }
 
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>> async_read_some(
+      AsioBuffer &&buffer) noexcept {
+#ifdef CINATRA_ENABLE_SSL
+    if (use_ssl_) {
+      return coro_io::async_read_some(*ssl_stream_, buffer);
+    }
+    else {
+#endif
+      return coro_io::async_read_some(socket_, buffer);
+#ifdef CINATRA_ENABLE_SSL
+    }
+#endif
+  }
+
   template <typename AsioBuffer>
   async_simple::coro::Lazy<std::pair<std::error_code, size_t>> async_write(
       AsioBuffer &&buffer) {
@@ -877,7 +1019,58 @@ class coro_http_connection
       return async_write_failed();
     }
 #endif
-    set_last_time();
+    if (!pipeline_buf_.empty()) [[unlikely]] {
+      return async_write_with_pipeline(buffer);
+    }
+    return async_write_impl(buffer);
+  }
+
+  async_simple::coro::Lazy<std::error_code> flush_pipeline() {
+    auto [ec, _] = co_await async_write_impl(asio::buffer(pipeline_buf_));
+    pipeline_buf_.clear();
+    if (ec) {
+      CINATRA_LOG_ERROR << "async_write error: " << ec.message();
+    }
+    co_return ec;
+  }
+
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_write_with_pipeline(const AsioBuffer &buffer) {
+    // the buffered pipelined responses must be sent before this one, gather
+    // them into one write.
+    std::vector<asio::const_buffer> buffers;
+    buffers.push_back(asio::buffer(pipeline_buf_));
+    for (auto it = asio::buffer_sequence_begin(buffer);
+         it != asio::buffer_sequence_end(buffer); ++it) {
+      buffers.push_back(*it);
+    }
+    auto result = co_await async_write_impl(buffers);
+    pipeline_buf_.clear();
+    co_return result;
+  }
+
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_write_impl(AsioBuffer &&buffer) {
+    if (write_deadline_ != nullptr) [[unlikely]] {
+      return async_write_with_deadline(buffer);
+    }
+    return async_write_socket(buffer);
+  }
+
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_write_with_deadline(AsioBuffer &buffer) {
+    arm_write_deadline(deadlines_.write);
+    auto result = co_await async_write_socket(buffer);
+    arm_write_deadline({});
+    co_return result;
+  }
+
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_write_socket(AsioBuffer &&buffer) {
 #ifdef CINATRA_ENABLE_SSL
     if (use_ssl_) {
       return coro_io::async_write(*ssl_stream_, buffer);
@@ -893,7 +1086,32 @@ class coro_http_connection
   template <typename AsioBuffer>
   async_simple::coro::Lazy<std::pair<std::error_code, size_t>> async_read_until(
       AsioBuffer &buffer, asio::string_view delim) noexcept {
-    set_last_time();
+    return read_body([this, &buffer, delim] {
+      return async_read_until_socket(buffer, delim);
+    });
+  }
+
+  // a read of the body by the handler, such as a chunked or multipart body,
+  // has the body_read deadline instead of the handler's, which starts again
+  // after the read.
+  template <typename Read>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>> read_body(
+      Read read) {
+    if (read_deadline_ == nullptr ||
+        deadlines_.body_read == std::chrono::steady_clock::duration::zero())
+        [[likely]] {
+      co_return co_await read();
+    }
+    arm_read_deadline(deadlines_.body_read);
+    auto result = co_await read();
+    arm_read_deadline(deadlines_.handler);
+    co_return result;
+  }
+
+  template <typename AsioBuffer>
+  async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
+  async_read_until_socket(AsioBuffer &buffer,
+                          asio::string_view delim) noexcept {
 #ifdef CINATRA_ENABLE_SSL
     if (use_ssl_) {
       return coro_io::async_read_until(*ssl_stream_, buffer, delim);
@@ -906,14 +1124,13 @@ class coro_http_connection
 #endif
   }
 
-  void set_last_time() {
-    if (checkout_timeout_) {
-      last_rwtime_ = std::chrono::system_clock::now();
-    }
-  }
-
-  std::chrono::system_clock::time_point get_last_rwtime() {
-    return last_rwtime_;
+  // the timers are created only if the server has deadlines, they are armed
+  // by the phases of the connection.
+  void set_deadlines(const http_deadlines &deadlines) {
+    deadlines_ = deadlines;
+    auto executor = executor_->get_asio_executor();
+    read_deadline_ = std::make_unique<coro_io::wheel_timer>(executor);
+    write_deadline_ = std::make_unique<coro_io::wheel_timer>(executor);
   }
 
   auto get_executor() { return executor_; }
@@ -925,6 +1142,15 @@ class coro_http_connection
 
     asio::dispatch(socket_.get_executor(),
                    [this, need_cb, self = shared_from_this()] {
+#ifdef CINATRA_ENABLE_SSL
+                     if (use_ssl_) {
+                       // quiet shutdown, openssl drops the session from the
+                       // server cache if the ssl is not shutdown.
+                       SSL_set_shutdown(ssl_stream_->native_handle(),
+                                        SSL_SENT_SHUTDOWN |
+                                            SSL_RECEIVED_SHUTDOWN);
+                     }
+#endif
                      std::error_code ec;
                      socket_.shutdown(asio::socket_base::shutdown_both, ec);
                      socket_.close(ec);
@@ -939,8 +1165,6 @@ class coro_http_connection
 
   bool has_closed() const { return has_closed_; }
 
-  void set_check_timeout(bool r) { checkout_timeout_ = r; }
-
   void handle_session_for_response() {
     if (request_.has_session()) {
       auto session =
@@ -953,29 +1177,386 @@ class coro_http_connection
   }
 
  private:
-  async_simple::coro::Lazy<bool> write_chunked_owned(std::string chunked_data,
-                                                     bool eof = false) {
-    response_.set_delay(true);
+  void init_deadlines() {
+    if (read_deadline_ == nullptr) {
+      return;
+    }
+    auto on_deadline = [weak = weak_from_this()] {
+      if (auto self = weak.lock(); self) {
+        CINATRA_LOG_INFO << "conn " << self->conn_id_ << " timeout";
+        self->close();
+      }
+    };
+    read_deadline_->set_callback(on_deadline);
+    write_deadline_->set_callback(std::move(on_deadline));
+  }
+
+  // zero cancels the deadline.
+  void arm_read_deadline(std::chrono::steady_clock::duration duration) {
+    if (read_deadline_ == nullptr) [[likely]] {
+      return;
+    }
+    if (duration > std::chrono::steady_clock::duration::zero()) {
+      read_deadline_->arm(duration);
+    }
+    else {
+      read_deadline_->cancel();
+    }
+  }
+
+  void arm_write_deadline(std::chrono::steady_clock::duration duration) {
+    if (write_deadline_ == nullptr) [[likely]] {
+      return;
+    }
+    if (duration > std::chrono::steady_clock::duration::zero()) {
+      write_deadline_->arm(duration);
+    }
+    else {
+      write_deadline_->cancel();
+    }
+  }
+
+  // the state of a websocket, most connections never upgrade.
+  struct websocket_state {
+    websocket ws;
+    ws_frame_reader reader;
+    // the upgrade request, the request's views point to it.
+    std::string head;
+    // the frames of websocket_hub waiting to be written.
+    std::deque<std::shared_ptr<const ws_shared_frame>> shared_frames;
+    // a message of many frames is being written, the shared frames wait
+    // until its last frame.
+    bool fragment_open = false;
+    bool shared_frames_held = false;
+    std::atomic<size_t> dropped_shared_frames = 0;
+#ifdef CINATRA_ENABLE_GZIP
+    ws_deflate deflate;
+    bool read_compressed = false;
+    bool write_compressed = false;
+    std::string inflate_str;
+    std::string deflate_str;
+#endif
+  };
+
+  // created on the io thread, by the upgrade or the first websocket write.
+  websocket_state &ws_state() {
+    if (ws_ == nullptr) [[unlikely]] {
+      ws_ = std::make_unique<websocket_state>();
+    }
+    return *ws_;
+  }
+
+  pooled_streambuf &head_buf() { return *head_buf_; }
+
+  pooled_streambuf &chunked_buf() {
+    if (chunked_buf_ == nullptr) {
+      chunked_buf_ = std::make_unique<pooled_streambuf>();
+    }
+    return *chunked_buf_;
+  }
+
+  // the buffer of the old streambuf goes back to the buffer pool, the new one
+  // takes a buffer of the size it needs by the next read.
+  void reset_head_buf() { head_buf_.emplace(max_http_header_size_); }
+
+  // an idle connection holds no buffer, it waits for the socket to be
+  // readable and takes them again from the buffer pool. The tls stream may
+  // have data decrypted already, it keeps its buffers.
+  async_simple::coro::Lazy<std::error_code> wait_idle() {
+#ifdef CINATRA_ENABLE_SSL
+    if (use_ssl_) {
+      co_return std::error_code{};
+    }
+#endif
+    std::error_code ec;
+    if (socket_.available(ec) > 0 || ec) {
+      co_return ec;
+    }
+    if (ws_ != nullptr) {
+      // the shrunk headers of the upgrade request are read by the handler.
+      ws_->reader.release();
+    }
+    else {
+      parser_.release_headers();
+    }
+    response_.release_memory();
+    reset_head_buf();
+    chunked_buf_ = nullptr;
+    std::string{}.swap(resp_str_);
+    co_return co_await coro_io::async_wait(socket_, asio::socket_base::wait_read);
+  }
+
+  // a websocket may live for long, move its upgrade request out of the read
+  // buffer to a string of its size, and the headers to an array of their
+  // number.
+  void keep_upgrade_head(const char *head, size_t len) {
+    auto &state = ws_state();
+    state.head.assign(head, len);
+    parser_.parse_request(state.head.data(), len, 0);
+    parser_.shrink_headers();
+    if (head_buf_->size() > 0) {
+      // the frames sent right after the handshake.
+      state.reader.append(asio::buffer_cast<const char *>(head_buf_->data()),
+                          head_buf_->size());
+    }
+    reset_head_buf();
+  }
+
+  static std::unique_ptr<outbound_message> make_outbound(
+      outbound_type type, std::string data, bool eof = true,
+      opcode op = opcode::text) {
+    auto msg = std::make_unique<outbound_message>();
+    msg->type = type;
+    msg->op = op;
+    msg->eof = eof;
+    msg->data = std::move(data);
+    msg->view = msg->data;
+    return msg;
+  }
+
+  // the message borrows data, the caller waits until it's written.
+  static std::unique_ptr<outbound_message> make_outbound_view(
+      outbound_type type, std::string_view data, bool eof = true,
+      opcode op = opcode::text) {
+    auto msg = std::make_unique<outbound_message>();
+    msg->type = type;
+    msg->op = op;
+    msg->eof = eof;
+    msg->view = data;
+    return msg;
+  }
+
+  void push_outbound(std::unique_ptr<outbound_message> msg) {
+    outbound_bytes_ += msg->view.size();
+    if (outbound_.push(std::move(msg))) {
+      drain_outbound(shared_from_this()).via(executor_).detach();
+    }
+  }
+
+  async_simple::coro::Lazy<std::error_code> send_outbound(
+      std::unique_ptr<outbound_message> msg) {
+    if (has_closed_) {
+      co_return std::make_error_code(std::errc::not_connected);
+    }
+    coro_io::callback_awaitor<std::error_code> awaitor;
+    co_return co_await awaitor.await_resume([&](auto handler) {
+      msg->on_written = handler;
+      push_outbound(std::move(msg));
+    });
+  }
+
+  // the only writer of the connection's queue, it runs on the io thread. The
+  // messages are framed and compressed in the order of the queue, and all the
+  // messages waiting are written by one write.
+  async_simple::coro::Lazy<void> drain_outbound(
+      [[maybe_unused]] std::shared_ptr<coro_http_connection> self) {
+    std::vector<std::unique_ptr<outbound_message>> batch;
+    std::vector<std::shared_ptr<const ws_shared_frame>> frames;
     std::vector<asio::const_buffer> buffers;
-    std::string chunk_size_str;
-    to_chunked_buffers(buffers, chunk_size_str, chunked_data, eof);
-    auto [ec, _] = co_await async_write(buffers);
-    if (ec) {
-      CINATRA_LOG_ERROR << "async_write error: " << ec.message();
-      close();
-      co_return false;
+    std::vector<std::pair<outbound_message::handler_t, std::error_code>> done;
+    while (true) {
+      auto list = outbound_.pop_all();
+      if (list == nullptr) {
+        if (outbound_.try_stop()) {
+          break;
+        }
+        continue;
+      }
+      size_t bytes = 0;
+      while (list != nullptr) {
+        auto next = list->next;
+        bytes += list->view.size();
+        batch.emplace_back(list);
+        list = next;
+      }
+
+      std::error_code ec;
+      if (has_closed_) {
+        ec = std::make_error_code(std::errc::not_connected);
+      }
+      else {
+        for (auto &msg : batch) {
+          if (!encode_outbound(*msg, buffers, frames)) {
+            ec = msg->ec;
+            close();
+            break;
+          }
+        }
+        if (!ec && !buffers.empty()) {
+          std::tie(ec, std::ignore) = co_await async_write(buffers);
+          if (ec) {
+            CINATRA_LOG_ERROR << "async_write error: " << ec.message();
+            close();
+          }
+        }
+      }
+      outbound_bytes_ -= bytes;
+      buffers.clear();
+      frames.clear();
+
+      for (auto &msg : batch) {
+        if (msg->on_written) {
+          done.emplace_back(*msg->on_written, msg->ec ? msg->ec : ec);
+        }
+      }
+      batch.clear();
+      // the producers may queue more messages when resumed, this writer takes
+      // them.
+      for (auto &[handler, result] : done) {
+        handler.set_value_then_resume(result);
+      }
+      done.clear();
     }
+  }
 
-    co_return true;
+  // false if the connection must be closed.
+  bool encode_outbound(
+      outbound_message &msg, std::vector<asio::const_buffer> &buffers,
+      std::vector<std::shared_ptr<const ws_shared_frame>> &frames) {
+    switch (msg.type) {
+      case outbound_type::raw:
+        buffers.push_back(asio::buffer(msg.view));
+        break;
+      case outbound_type::ws_frame:
+        return encode_ws_frame(msg, buffers, frames);
+      case outbound_type::chunk:
+        return encode_chunk(msg, buffers);
+      case outbound_type::shared_frames:
+        encode_shared_frames(buffers, frames);
+        break;
+      case outbound_type::flush:
+        break;
+    }
+    return true;
   }
 
-  async_simple::coro::Lazy<bool> write_sse_payload() {
-    response_.set_delay(true);
-    buffers_.clear();
-    to_chunked_buffers(buffers_, chunk_size_str_, sse_payload_, false);
-    co_return co_await reply(false);
+  bool encode_ws_frame(
+      outbound_message &msg, std::vector<asio::const_buffer> &buffers,
+      std::vector<std::shared_ptr<const ws_shared_frame>> &frames) {
+    bool compressed = false;
+    auto &state = ws_state();
+#ifdef CINATRA_ENABLE_GZIP
+    // the first frame decides whether the message is compressed, the control
+    // frames are never compressed.
+    if (msg.op == opcode::text || msg.op == opcode::binary) {
+      state.write_compressed =
+          state.deflate.can_compress() && msg.view.size() > 0;
+    }
+    else if (msg.op != opcode::cont) {
+      state.write_compressed = false;
+    }
+    if (state.write_compressed) {
+      state.deflate_str.clear();
+      if (!state.deflate.compress(msg.view, state.deflate_str, msg.eof)) {
+        CINATRA_LOG_ERROR << "compress data error, data: " << msg.view;
+        msg.ec = std::make_error_code(std::errc::protocol_error);
+        return false;
+      }
+      msg.data.swap(state.deflate_str);
+      msg.view = msg.data;
+      compressed = msg.op != opcode::cont;
+      if (msg.eof) {
+        state.write_compressed = false;
+      }
+    }
+#endif
+    msg.head.assign(state.ws.encode_ws_header(msg.view.size(), msg.op,
+                                              msg.eof, compressed, false));
+    buffers.push_back(asio::buffer(msg.head));
+    buffers.push_back(asio::buffer(msg.view));
+    if (msg.op == opcode::text || msg.op == opcode::binary ||
+        msg.op == opcode::cont) {
+      state.fragment_open = !msg.eof;
+      if (msg.eof && state.shared_frames_held) {
+        encode_shared_frames(buffers, frames);
+      }
+    }
+    return true;
+  }
+
+  void encode_shared_frames(
+      std::vector<asio::const_buffer> &buffers,
+      std::vector<std::shared_ptr<const ws_shared_frame>> &frames) {
+    auto &state = ws_state();
+    // a data frame can't be put between the frames of another message.
+    state.shared_frames_held = state.fragment_open;
+    if (state.fragment_open) {
+      return;
+    }
+    for (auto &frame : state.shared_frames) {
+      buffers.push_back(asio::buffer(pick_shared_frame(*frame)));
+    }
+    frames.insert(frames.end(),
+                  std::make_move_iterator(state.shared_frames.begin()),
+                  std::make_move_iterator(state.shared_frames.end()));
+    state.shared_frames.clear();
   }
 
+  bool encode_chunk(outbound_message &msg,
+                    std::vector<asio::const_buffer> &buffers) {
+#ifdef CINATRA_HAS_COMPRESSION
+    if (chunked_compressor_.active()) {
+      compressed_chunk_.clear();
+      bool ok =
+          chunked_compressor_.compress(msg.view, compressed_chunk_, msg.eof);
+      if (msg.eof) {
+        chunked_compressor_.reset();
+      }
+      if (!ok) {
+        CINATRA_LOG_ERROR << "compress chunked data error";
+        msg.ec = std::make_error_code(std::errc::protocol_error);
+        return false;
+      }
+      msg.data.swap(compressed_chunk_);
+      msg.view = msg.data;
+      if (msg.view.empty() && !msg.eof) {
+        return true;
+      }
+    }
+#endif
+    to_chunked_buffers(buffers, msg.head, msg.view, msg.eof);
+    return true;
+  }
+
+  std::string_view pick_shared_frame(const ws_shared_frame &frame) {
+#ifdef CINATRA_ENABLE_GZIP
+    if (int bits = ws_->deflate.window_bits(); bits != 0) {
+      for (auto &[frame_bits, deflated] : frame.deflated) {
+        if (frame_bits == bits) {
+          // the peer's window now ends with this message.
+          ws_->deflate.forget_context();
+          return deflated;
+        }
+      }
+    }
+#endif
+    return frame.plain;
+  }
+
+  async_simple::coro::Lazy<bool> write_chunked_owned(std::string chunked_data,
+                                                     bool eof = false) {
+    auto ec = co_await send_outbound(
+        make_outbound(outbound_type::chunk, std::move(chunked_data), eof));
+    co_return !ec;
+  }
+
+#ifdef CINATRA_HAS_COMPRESSION
+  // compress the chunked response of a compressible type by Accept-Encoding,
+  // unless the handler encodes it.
+  void begin_chunked_compression() {
+    if (!response_.find_header("Content-Encoding").empty() ||
+        !is_compressible_mime(response_.content_type_value())) {
+      return;
+    }
+    response_.add_header("Vary", "Accept-Encoding");
+    auto encoding = negotiate_encoding(request_.get_accept_encoding());
+    if (encoding != content_encoding::none &&
+        chunked_compressor_.init(encoding)) {
+      response_.add_header("Content-Encoding", encoding_name(encoding));
+    }
+  }
+#endif
+
   bool check_keep_alive() {
     if (parser_.has_close()) {
       return false;
@@ -987,7 +1568,9 @@ class coro_http_connection
     uint8_t sha1buf[20], key_src[60];
     char accept_key[29];
 
-    std::memcpy(key_src, request_.get_header_value("sec-websocket-key").data(),
+    std::memcpy(key_src,
+                request_.get_header_value(http_header_id::sec_websocket_key)
+                    .data(),
                 24);
     std::memcpy(key_src + 24, ws_guid, 36);
     sha1_context ctx;
@@ -1002,11 +1585,20 @@ class coro_http_connection
     response_.add_header("Upgrade", "WebSocket");
     response_.add_header("Connection", "Upgrade");
     response_.add_header("Sec-WebSocket-Accept", std::string(accept_key, 28));
-    auto protocal_str = request_.get_header_value("sec-websocket-protocol");
+    auto protocal_str =
+        request_.get_header_value(http_header_id::sec_websocket_protocol);
 #ifdef CINATRA_ENABLE_GZIP
-    if (is_client_ws_compressed_) {
-      response_.add_header("Sec-WebSocket-Extensions",
-                           "permessage-deflate; client_no_context_takeover");
+    auto &deflate = ws_state().deflate;
+    deflate.reset();
+    if (ws_deflate_enabled_) {
+      std::string extension;
+      if (auto agreed = accept_ws_deflate_offer(
+              request_.get_header_value(
+                  http_header_id::sec_websocket_extensions),
+              ws_deflate_options_, extension);
+          agreed && deflate.init(*agreed, true)) {
+        response_.add_header("Sec-WebSocket-Extensions", extension);
+      }
     }
 #endif
     if (!protocal_str.empty()) {
@@ -1038,9 +1630,12 @@ class coro_http_connection
   asio::ip::tcp::socket socket_;
   coro_http_router &router_;
   size_t max_http_header_size_ = 8 * 1024;
-  asio::streambuf head_buf_;
-  std::string body_;
-  asio::streambuf chunked_buf_;
+  std::optional<pooled_streambuf> head_buf_;
+  // borrowed from the buffer pool for a request, given back by its end.
+  pooled_buffer body_;
+  size_t body_len_ = 0;
+  // created by the first chunked or multipart request.
+  std::unique_ptr<pooled_streambuf> chunked_buf_;
   http_parser parser_;
   bool keep_alive_;
   coro_http_request request_;
@@ -1049,36 +1644,48 @@ class coro_http_connection
   std::atomic<bool> has_closed_{false};
   uint64_t conn_id_{0};
   std::function<void(const uint64_t &conn_id)> quit_cb_ = nullptr;
-  bool checkout_timeout_ = false;
-  std::atomic<std::chrono::system_clock::time_point> last_rwtime_ =
-      std::chrono::system_clock::now();
+  http_deadlines deadlines_;
+  std::unique_ptr<coro_io::wheel_timer> read_deadline_;
+  std::unique_ptr<coro_io::wheel_timer> write_deadline_;
   uint64_t max_part_size_ = 8 * 1024 * 1024;
+  std::string decode_key_;
   std::string resp_str_;
+  // responses of pipelined requests which have not been written.
+  std::string pipeline_buf_;
+  static constexpr size_t max_pipeline_buf_size = 64 * 1024;
   bool multipart_body_finished_ = false;
 
 #ifdef CINATRA_ENABLE_GZIP
-  bool is_client_ws_compressed_ = false;
-  std::string inflate_str_;
+  bool ws_deflate_enabled_ = true;
+  ws_deflate_options ws_deflate_options_;
 #endif
 
-  websocket ws_;
+  std::unique_ptr<websocket_state> ws_;
+  // the messages of the streaming writes, written by drain_outbound().
+  outbound_queue outbound_;
+  std::atomic<size_t> outbound_bytes_ = 0;
 #ifdef CINATRA_ENABLE_SSL
-  std::unique_ptr<asio::ssl::context> ssl_ctx_ = nullptr;
+  std::shared_ptr<ssl_server_context> ssl_ctx_ = nullptr;
   std::unique_ptr<asio::ssl::stream<asio::ip::tcp::socket &>> ssl_stream_;
   bool use_ssl_ = false;
 #endif
-  bool need_shrink_every_time_ = false;
   bool multi_buf_ = true;
   std::function<async_simple::coro::Lazy<void>(coro_http_request &,
                                                coro_http_response &)>
       default_handler_ = nullptr;
   std::string chunk_size_str_;
-  std::string sse_payload_;
+  bool auto_compress_ = false;
+  size_t compress_min_size_ = 0;
+#ifdef CINATRA_HAS_COMPRESSION
+  stream_compressor chunked_compressor_;
+  std::string compressed_chunk_;
+#endif
   std::string remote_addr_;
   int64_t max_http_body_len_ = 0;
 #ifdef INJECT_FOR_HTTP_SEVER_TEST
   bool write_failed_forever_ = false;
   bool read_failed_forever_ = false;
+  std::thread::id accept_thread_id_ = std::this_thread::get_id();
 #endif
 };
 }  // namespace cinatra
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <any>
+#include <array>
 #include <charconv>
 #include <initializer_list>
 #include <optional>
@@ -8,6 +9,7 @@
 #include <string>
 
 #include "async_simple/coro/Lazy.h"
+#include "compressor.hpp"
 #include "define.h"
 #include "http_parser.hpp"
 #include "session.hpp"
@@ -15,11 +17,40 @@
 #include "utils.hpp"
 #include "ws_define.h"
 
+#ifndef CINATRA_MAX_ROUTE_PARAMS
+#define CINATRA_MAX_ROUTE_PARAMS 16
+#endif
+
 namespace cinatra {
+using route_matches = std::match_results<std::string_view::const_iterator>;
+
+// the path parameters of the matched route, the values point to the request
+// line of the connection and are valid until the next request is read.
+struct route_params {
+  // return empty if the route has no parameter named name.
+  std::string_view operator[](std::string_view name) const {
+    if (names == nullptr) {
+      return {};
+    }
+    for (size_t i = 0; i < size && i < names->size(); i++) {
+      if ((*names)[i] == name) {
+        return values[i];
+      }
+    }
+    return {};
+  }
 
-inline std::vector<std::pair<int, int>> parse_ranges(std::string_view range_str,
-                                                     size_t file_size,
-                                                     bool &is_valid) {
+  bool empty() const { return size == 0; }
+
+  std::array<std::string_view, CINATRA_MAX_ROUTE_PARAMS> values;
+  size_t size = 0;
+  // the parameter names of the matched route, in the same order as values.
+  const std::vector<std::string> *names = nullptr;
+};
+
+// the offsets are 64 bits, the files may be larger than 2GB.
+inline std::vector<std::pair<int64_t, int64_t>> parse_ranges(
+    std::string_view range_str, size_t file_size, bool &is_valid) {
   range_str = trim_sv(range_str);
   if (range_str.empty()) {
     return {{0, file_size - 1}};
@@ -34,13 +65,13 @@ inline std::vector<std::pair<int, int>> parse_ranges(std::string_view range_str,
     return {{0, file_size - 1}};
   }
 
-  std::vector<std::pair<int, int>> vec;
+  std::vector<std::pair<int64_t, int64_t>> vec;
   auto ranges = split_sv(range_str, ",");
   for (auto range : ranges) {
     auto sub_range = split_sv(range, "-");
     auto fist_range = trim_sv(sub_range[0]);
 
-    int start = 0;
+    int64_t start = 0;
     if (fist_range.empty()) {
       start = -1;
     }
@@ -53,7 +84,7 @@ inline std::vector<std::pair<int, int>> parse_ranges(std::string_view range_str,
       }
     }
 
-    int end = 0;
+    int64_t end = 0;
     if (sub_range.size() == 1) {
       end = file_size - 1;
     }
@@ -73,13 +104,13 @@ inline std::vector<std::pair<int, int>> parse_ranges(std::string_view range_str,
       }
     }
 
-    if (start > 0 && (start >= file_size || start == end)) {
+    if (start > 0 && ((size_t)start >= file_size || start == end)) {
       // out of range
       is_valid = false;
       return {};
     }
 
-    if (end > 0 && end >= file_size) {
+    if (end > 0 && (size_t)end >= file_size) {
       end = file_size - 1;
     }
 
@@ -100,14 +131,11 @@ class coro_http_request {
       : parser_(parser), conn_(conn) {}
 
   std::string_view get_header_value(std::string_view key) {
-    auto headers = parser_.get_headers();
-    for (auto &header : headers) {
-      if (iequal0(header.name, key)) {
-        return header.value;
-      }
-    }
+    return parser_.get_header_value(key);
+  }
 
-    return {};
+  std::string_view get_header_value(http_header_id id) {
+    return parser_.get_header_value(id);
   }
 
   std::string_view get_query_value(std::string_view key) {
@@ -129,7 +157,7 @@ class coro_http_request {
 
   std::string_view full_url() { return parser_.full_url(); }
 
-  void set_body(std::string &body) {
+  void set_body(std::string_view body) {
     body_ = body;
     auto type = get_content_type();
     if (type == content_type::urlencoded) {
@@ -142,13 +170,15 @@ class coro_http_request {
   bool is_chunked() { return parser_.is_chunked(); }
 
   std::string_view get_accept_encoding() {
-    return get_header_value("Accept-Encoding");
+    return get_header_value(http_header_id::accept_encoding);
   }
 
   content_encoding get_encoding_type() {
-    auto encoding_type = get_header_value("Content-Encoding");
+    auto encoding_type = get_header_value(http_header_id::content_encoding);
     if (!encoding_type.empty()) {
-      if (encoding_type.find("gzip") != std::string_view::npos)
+      if (encoding_type.find("zstd") != std::string_view::npos)
+        return content_encoding::zstd;
+      else if (encoding_type.find("gzip") != std::string_view::npos)
         return content_encoding::gzip;
       else if (encoding_type.find("deflate") != std::string_view::npos)
         return content_encoding::deflate;
@@ -162,34 +192,27 @@ class coro_http_request {
     }
   }
 
-  content_type get_content_type() {
-    if (is_chunked())
-      return content_type::chunked;
-
-    auto content_type = get_header_value("content-type");
-    if (!content_type.empty()) {
-      if (content_type.find("application/x-www-form-urlencoded") !=
-          std::string_view::npos) {
-        return content_type::urlencoded;
-      }
-      else if (content_type.find("multipart/form-data") !=
-               std::string_view::npos) {
-        return content_type::multipart;
-      }
-      else if (content_type.find("application/octet-stream") !=
-               std::string_view::npos) {
-        return content_type::octet_stream;
-      }
-      else {
-        return content_type::string;
-      }
+#ifdef CINATRA_HAS_COMPRESSION
+  // decode the body by Content-Encoding into out, false if the coding isn't
+  // supported by the build, the body is corrupted or a zstd body decodes to
+  // more than max_size.
+  bool decode_body(std::string &out, size_t max_size = MAX_HTTP_BODY_SIZE) {
+    auto encoding = get_encoding_type();
+    if (encoding == content_encoding::none) {
+      out.append(body_);
+      return true;
     }
+    return decompress_data(encoding, body_, out, max_size);
+  }
+#endif
 
-    if (is_websocket_) {
+  content_type get_content_type() {
+    auto type = parser_.get_content_type();
+    if (type == content_type::unknown && is_websocket_) {
       return content_type::websocket;
     }
 
-    return content_type::unknown;
+    return type;
   }
 
   std::string_view get_url() { return parser_.url(); }
@@ -197,7 +220,7 @@ class coro_http_request {
   std::string_view get_method() { return parser_.method(); }
 
   std::string_view get_boundary() {
-    auto content_type = get_header_value("content-type");
+    auto content_type = get_header_value(http_header_id::content_type);
     if (content_type.empty()) {
       return {};
     }
@@ -216,14 +239,14 @@ class coro_http_request {
     if (!parser_.has_upgrade())
       return false;
 
-    auto u = get_header_value("Upgrade");
+    auto u = get_header_value(http_header_id::upgrade);
     if (u.empty())
       return false;
 
     if (u != WEBSOCKET)
       return false;
 
-    auto sec_ws_key = get_header_value("sec-websocket-key");
+    auto sec_ws_key = get_header_value(http_header_id::sec_websocket_key);
     if (sec_ws_key.empty() || sec_ws_key.size() != 24)
       return false;
 
@@ -232,7 +255,8 @@ class coro_http_request {
   }
 
   bool is_support_compressed() {
-    auto extension_str = get_header_value("Sec-WebSocket-Extensions");
+    auto extension_str =
+        get_header_value(http_header_id::sec_websocket_extensions);
     if (extension_str.find("permessage-deflate") != std::string::npos) {
       return true;
     }
@@ -263,7 +287,7 @@ class coro_http_request {
   std::shared_ptr<session> get_session(bool create = true) {
     auto &session_manager = session_manager::get();
 
-    auto cookies = get_cookies(get_header_value("Cookie"));
+    auto cookies = get_cookies(get_header_value(http_header_id::cookie));
     std::string session_id;
     auto iter = cookies.find(CSESSIONID);
     if (iter == cookies.end() && !create) {
@@ -289,6 +313,8 @@ class coro_http_request {
   bool has_session() { return !cached_session_id_.empty(); }
   void clear() {
     body_ = {};
+    params_.size = 0;
+    params_.names = nullptr;
     if (!aspect_data_.empty()) {
       aspect_data_.clear();
     }
@@ -297,8 +323,14 @@ class coro_http_request {
     }
   }
 
-  std::unordered_map<std::string, std::string> params_;
-  std::smatch matches_;
+  std::string_view get_path_param(std::string_view name) const {
+    return params_[name];
+  }
+
+  const route_params &get_path_params() const { return params_; }
+
+  route_params params_;
+  route_matches matches_;
 
  private:
   http_parser &parser_;
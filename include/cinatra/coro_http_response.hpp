@@ -9,15 +9,13 @@
 #include <vector>
 
 #include "async_simple/coro/Lazy.h"
+#include "arena.hpp"
 #include "async_simple/coro/SyncAwait.h"
 #include "cookie.hpp"
 #include "define.h"
-#ifdef CINATRA_ENABLE_GZIP
-#include "gzip.hpp"
-#endif
-#ifdef CINATRA_ENABLE_BROTLI
-#include "brzip.hpp"
-#endif
+#include "compressor.hpp"
+#include "http_parser.hpp"
+#include "mime_types.hpp"
 #include "picohttpparser.h"
 #include "response_cv.hpp"
 #include "time_util.hpp"
@@ -34,6 +32,10 @@ struct resp_header_sv {
   std::string_view value;
 };
 
+#ifndef CINATRA_INLINE_RESP_HEADERS
+#define CINATRA_INLINE_RESP_HEADERS 8
+#endif
+
 enum class format_type {
   normal,
   chunked,
@@ -121,6 +123,34 @@ class coro_http_response {
     }
 #endif
 
+#ifdef CINATRA_ENABLE_ZSTD
+    if (encoding == content_encoding::zstd) {
+      if (client_encoding_type.empty() ||
+          client_encoding_type.find("zstd") != std::string_view::npos) {
+        std::string zstd_str;
+        bool r = zstd_codec::compress(content, zstd_str);
+        if (!r) {
+          set_status_and_content(status_type::internal_server_error,
+                                 "zstd compress error");
+        }
+        else {
+          add_header("Content-Encoding", "zstd");
+          set_content(std::move(zstd_str));
+        }
+      }
+      else {
+        if (is_view) {
+          content_view_ = content;
+        }
+        else {
+          content_ = std::move(content);
+        }
+      }
+      has_set_content_ = true;
+      return;
+    }
+#endif
+
 #ifdef CINATRA_ENABLE_BROTLI
     if (encoding == content_encoding::br) {
       if (client_encoding_type.empty() ||
@@ -157,6 +187,59 @@ class coro_http_response {
     }
     has_set_content_ = true;
   }
+
+#ifdef CINATRA_HAS_COMPRESSION
+  // compress the content by the Accept-Encoding of the request, if it's of a
+  // compressible type, min_size bytes and up, and not encoded by the handler.
+  void auto_compress(std::string_view accept_encoding, size_t min_size) {
+    std::string_view content =
+        content_.empty() ? content_view_ : std::string_view(content_);
+    if (content.size() < min_size || fmt_type_ == format_type::chunked ||
+        status_ != status_type::ok ||
+        !find_header("Content-Encoding").empty() ||
+        !find_header("Content-Length").empty() ||
+        !is_compressible_mime(content_type_value())) {
+      return;
+    }
+    add_header("Vary", "Accept-Encoding");
+    auto encoding = negotiate_encoding(accept_encoding);
+    if (encoding == content_encoding::none) {
+      return;
+    }
+    std::string compressed;
+    if (!compress_data(encoding, content, compressed) ||
+        compressed.size() >= content.size()) {
+      return;
+    }
+    add_header("Content-Encoding", encoding_name(encoding));
+    content_ = std::move(compressed);
+    content_view_ = {};
+  }
+#endif
+
+  // the value of the Content-Type header, or set by set_content_type.
+  std::string_view content_type_value() {
+    if (auto value = find_header("Content-Type"); !value.empty()) {
+      return value;
+    }
+    std::string_view line = content_type_;
+    if (line.starts_with("Content-Type: ") && line.ends_with(CRCF)) {
+      line.remove_prefix(14);
+      line.remove_suffix(CRCF.size());
+      return line;
+    }
+    return {};
+  }
+
+  std::string_view find_header(std::string_view key) {
+    for (auto &[k, v] : resp_headers_) {
+      if (iequal0(k, key)) {
+        return v;
+      }
+    }
+    return {};
+  }
+
   void set_delay(bool r) { delay_ = r; }
   bool get_delay() const { return delay_; }
   void set_format_type(format_type type) { fmt_type_ = type; }
@@ -169,8 +252,10 @@ class coro_http_response {
   std::string_view content() { return content_; }
   size_t content_size() { return content_.size(); }
 
-  void add_header(auto k, auto v) {
-    resp_headers_.emplace_back(resp_header{std::move(k), std::move(v)});
+  // the key and value are copied to the arena of the connection, which is
+  // reset after the response is sent.
+  void add_header(std::string_view k, std::string_view v) {
+    resp_headers_.push_back(resp_header_sv{arena_.copy(k), arena_.copy(v)});
   }
 
   void add_header_span(std::span<http_header> resp_headers) {
@@ -246,7 +331,12 @@ class coro_http_response {
                 : resp_str.append(CONN_CLOSE_SV);
     }
 
+    if (!content_type_.empty()) {
+      resp_str.append(content_type_);
+    }
+
     append_header_str(resp_str, resp_headers_);
+    append_header_str(resp_str, cookies_);
 
     if (!resp_header_span_.empty()) {
       append_header_str(resp_str, resp_header_span_);
@@ -305,13 +395,6 @@ class coro_http_response {
       buffers.emplace_back(asio::buffer(TRANSFER_ENCODING_SV));
     }
     else {
-      if (!cookies_.empty()) {
-        for (auto &[_, cookie] : cookies_) {
-          resp_headers_.emplace_back(
-              resp_header{"Set-Cookie", cookie.to_string()});
-        }
-      }
-
       if (!content_.empty()) {
         if (!has_len)
           handle_content_len(buffers, content_);
@@ -343,6 +426,7 @@ class coro_http_response {
     }
 
     append_header(buffers, resp_headers_);
+    append_header(buffers, cookies_);
 
     if (!resp_header_span_.empty()) {
       append_header(buffers, resp_header_span_);
@@ -376,15 +460,34 @@ class coro_http_response {
     boundary_.clear();
     has_set_content_ = false;
     cookies_.clear();
+    arena_.reset();
     need_date_ = true;
     content_type_ = {};
     content_view_ = {};
   }
 
+  // give back the memory kept for the next response, for an idle connection.
+  void release_memory() {
+    arena_.release();
+    std::string{}.swap(content_);
+  }
+
   void set_shrink_to_fit(bool r) { need_shrink_every_time_ = r; }
 
+  // a cookie with the same name replaces the previous one.
   void add_cookie(const cookie &cookie) {
-    cookies_[cookie.get_name()] = cookie;
+    cookie_buf_.clear();
+    cookie.append_to(cookie_buf_);
+    // the value starts with "name=".
+    auto value = arena_.copy(cookie_buf_);
+    auto prefix = value.substr(0, value.find('=') + 1);
+    for (auto &[k, v] : cookies_) {
+      if (v.starts_with(prefix)) {
+        v = value;
+        return;
+      }
+    }
+    cookies_.push_back(resp_header_sv{SET_COOKIE_SV, value});
   }
 
   void redirect(const std::string &url, bool is_forever = false) {
@@ -420,14 +523,17 @@ class coro_http_response {
   std::optional<bool> keepalive_;
   bool delay_;
   char buf_[32];
-  std::vector<resp_header> resp_headers_;
+  arena arena_;
+  small_vector<resp_header_sv, CINATRA_INLINE_RESP_HEADERS> resp_headers_;
   std::span<http_header> resp_header_span_;
   coro_http_connection *conn_;
   std::string boundary_;
   bool has_set_content_ = false;
   bool need_shrink_every_time_ = false;
   bool need_date_ = true;
-  std::unordered_map<std::string, cookie> cookies_;
+  // Set-Cookie headers, the values are in the arena.
+  small_vector<resp_header_sv, 2> cookies_;
+  std::string cookie_buf_;
   std::string_view content_type_;
   std::string_view content_view_;
 };
@@ -74,40 +74,18 @@ class coro_http_router {
         http_handler = std::move(handler);
       }
 
-      if (whole_str.find(":") != std::string::npos) {
-        std::string method_str(method_name);
-        coro_router_tree_->coro_insert(whole_str, std::move(http_handler),
-                                       method_str);
+      if (is_route_pattern(whole_str)) {
+        if (auto entry = route_tree_.insert(whole_str); entry) {
+          entry->coro_handler = std::move(http_handler);
+        }
       }
       else {
-        if (whole_str.find("{") != std::string::npos ||
-            whole_str.find(")") != std::string::npos) {
-          std::string pattern = whole_str;
-
-          if (pattern.find("{}") != std::string::npos) {
-            replace_all(pattern, "{}", "([^/]+)");
-          }
-
-          auto it = std::find_if(coro_regex_handles_.begin(),
-                                 coro_regex_handles_.end(), [&](const auto& t) {
-                                   return std::get<2>(t) == pattern;
-                                 });
-          if (it != coro_regex_handles_.end()) {
-            std::get<1>(*it) = std::move(http_handler);
-          }
-          else {
-            coro_regex_handles_.emplace_back(std::regex(pattern),
-                                             std::move(http_handler), pattern);
-          }
-        }
-        else {
-          auto [it, ok] = coro_keys_.emplace(std::move(whole_str));
-          if (!ok) {
-            CINATRA_LOG_WARNING << key << " has already registered.";
-            return;
-          }
-          coro_handles_.emplace(*it, std::move(http_handler));
+        auto [it, ok] = coro_keys_.emplace(std::move(whole_str));
+        if (!ok) {
+          CINATRA_LOG_WARNING << key << " has already registered.";
+          return;
         }
+        coro_handles_.emplace(*it, std::move(http_handler));
       }
     }
     else {
@@ -131,28 +109,9 @@ class coro_http_router {
         http_handler = std::move(handler);
       }
 
-      if (whole_str.find(':') != std::string::npos) {
-        std::string method_str(method_name);
-        router_tree_->insert(whole_str, std::move(http_handler), method_str);
-      }
-      else if (whole_str.find("{") != std::string::npos ||
-               whole_str.find(")") != std::string::npos) {
-        std::string pattern = whole_str;
-
-        if (pattern.find("{}") != std::string::npos) {
-          replace_all(pattern, "{}", "([^/]+)");
-        }
-
-        auto it = std::find_if(regex_handles_.begin(), regex_handles_.end(),
-                               [&](const auto& t) {
-                                 return std::get<2>(t) == pattern;
-                               });
-        if (it != regex_handles_.end()) {
-          std::get<1>(*it) = std::move(http_handler);
-        }
-        else {
-          regex_handles_.emplace_back(std::regex(pattern),
-                                      std::move(http_handler), pattern);
+      if (is_route_pattern(whole_str)) {
+        if (auto entry = route_tree_.insert(whole_str); entry) {
+          entry->handler = std::move(http_handler);
         }
       }
       else {
@@ -267,17 +226,18 @@ class coro_http_router {
 
   const auto& get_coro_handlers() const { return coro_handles_; }
 
-  std::shared_ptr<radix_tree> get_router_tree() { return router_tree_; }
-
-  std::shared_ptr<radix_tree> get_coro_router_tree() {
-    return coro_router_tree_;
+  // match the routes with parameters or regex, the key is like
+  // "GET /user/cinatra".
+  const route_entry* match(std::string_view key, route_params& params,
+                           route_matches& matches) const {
+    return route_tree_.match(key, params, matches);
   }
 
-  const auto& get_coro_regex_handlers() { return coro_regex_handles_; }
-
-  const auto& get_regex_handlers() { return regex_handles_; }
-
  private:
+  static bool is_route_pattern(std::string_view key) {
+    return key.find_first_of(":{)") != std::string_view::npos;
+  }
+
   std::function<void(coro_http_request&, coro_http_response&, std::string_view)>
       error_handler_;
 
@@ -293,22 +253,6 @@ class coro_http_router {
                          coro_http_request& req, coro_http_response& resp)>>
       coro_handles_;
 
-  std::shared_ptr<radix_tree> router_tree_ =
-      std::make_shared<radix_tree>(radix_tree());
-
-  std::shared_ptr<radix_tree> coro_router_tree_ =
-      std::make_shared<radix_tree>(radix_tree());
-
-  std::vector<std::tuple<
-      std::regex,
-      std::function<void(coro_http_request& req, coro_http_response& resp)>,
-      std::string>>
-      regex_handles_;
-
-  std::vector<std::tuple<std::regex,
-                         std::function<async_simple::coro::Lazy<void>(
-                             coro_http_request& req, coro_http_response& resp)>,
-                         std::string>>
-      coro_regex_handles_;
+  route_tree route_tree_;
 };
 }  // namespace cinatra
\ No newline at end of file
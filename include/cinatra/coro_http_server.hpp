@@ -5,6 +5,7 @@
 #include "cinatra/coro_http_router.hpp"
 #include "cinatra/define.h"
 #include "cinatra/mime_types.hpp"
+#include "cinatra/static_file_cache.hpp"
 #include "cinatra_log_wrapper.hpp"
 #include "coro_http_connection.hpp"
 #include "ylt/coro_io/coro_file.hpp"
@@ -24,18 +25,18 @@ class coro_http_server {
       : out_ctx_(&ctx),
         port_(port),
         acceptor_(ctx),
-        check_timer_(ctx),
         cache_refresh_timer_(ctx) {
     init_address(std::move(address));
+    init_shards();
   }
 
   coro_http_server(asio::io_context &ctx,
                    std::string address /* = "0.0.0.0:9001" */)
       : out_ctx_(&ctx),
         acceptor_(ctx),
-        check_timer_(ctx),
         cache_refresh_timer_(ctx) {
     init_address(std::move(address));
+    init_shards();
   }
 
   coro_http_server(size_t thread_num, unsigned short port,
@@ -43,10 +44,10 @@ class coro_http_server {
       : pool_(std::make_unique<coro_io::io_context_pool>(thread_num,
                                                          cpu_affinity)),
         port_(port),
-        acceptor_(pool_->get_executor()->get_asio_executor()),
-        check_timer_(pool_->get_executor()->get_asio_executor()),
+        acceptor_(pool_->get_executor(0)->get_asio_executor()),
         cache_refresh_timer_(pool_->get_executor()->get_asio_executor()) {
     init_address(std::move(address));
+    init_shards();
   }
 
   coro_http_server(size_t thread_num,
@@ -54,10 +55,10 @@ class coro_http_server {
                    bool cpu_affinity = false)
       : pool_(std::make_unique<coro_io::io_context_pool>(thread_num,
                                                          cpu_affinity)),
-        acceptor_(pool_->get_executor()->get_asio_executor()),
-        check_timer_(pool_->get_executor()->get_asio_executor()),
+        acceptor_(pool_->get_executor(0)->get_asio_executor()),
         cache_refresh_timer_(pool_->get_executor()->get_asio_executor()) {
     init_address(std::move(address));
+    init_shards();
   }
 
   ~coro_http_server() {
@@ -67,6 +68,19 @@ class coro_http_server {
 
   void set_no_delay(bool r) { no_delay_ = r; }
 
+  // Every io_context of the server's pool owns a SO_REUSEPORT acceptor on the
+  // same port, the kernel balances new connections between them and each
+  // connection stays on the io thread which accepted it. Only works with the
+  // thread pool constructors on the platforms support SO_REUSEPORT, call it
+  // before start.
+  void set_reuse_port(bool r) { reuse_port_ = r; }
+
+  // max number of pending connections accepted in one wakeup in reuse port
+  // mode.
+  void set_max_accept_batch(size_t max_batch) {
+    max_accept_batch_ = max_batch;
+  }
+
   void set_max_http_body_size(int64_t max_size) {
     max_http_body_len_ = max_size;
   }
@@ -78,11 +92,31 @@ class coro_http_server {
 #ifdef CINATRA_ENABLE_SSL
   void init_ssl(const std::string &cert_file, const std::string &key_file,
                 const std::string &passwd = "") {
-    cert_file_ = cert_file;
-    key_file_ = key_file;
-    passwd_ = passwd;
+    ssl_conf_.cert_file = cert_file;
+    ssl_conf_.key_file = key_file;
+    ssl_conf_.passwd = passwd;
     use_ssl_ = true;
   }
+
+  // session cache and session tickets let the reconnecting clients skip the
+  // full handshake, call it before server start.
+  void set_ssl_session_cache(
+      size_t cache_size,
+      std::chrono::seconds timeout = std::chrono::seconds(300)) {
+    ssl_conf_.session_cache_size = cache_size;
+    ssl_conf_.session_timeout = timeout;
+  }
+
+  // rotate the session ticket keys every interval, 0 disables session tickets.
+  void set_ssl_ticket_key_rotation(std::chrono::seconds interval) {
+    ssl_conf_.ticket_key_rotation = interval;
+  }
+
+  // the ssl context shared by all connections, it is nullptr before server
+  // start.
+  asio::ssl::context *ssl_context() {
+    return ssl_ctx_ ? ssl_ctx_->ctx.get() : nullptr;
+  }
 #endif
 
   // only call once, not thread safe.
@@ -94,7 +128,19 @@ class coro_http_server {
 
   // only call once, not thread safe.
   async_simple::Future<std::error_code> async_start() {
+#ifdef CINATRA_ENABLE_SSL
+    if (use_ssl_ && ssl_ctx_ == nullptr) {
+      ssl_ctx_ = create_ssl_server_context(ssl_conf_);
+      if (ssl_ctx_ == nullptr) {
+        errc_ = std::make_error_code(std::errc::invalid_argument);
+      }
+    }
+    if (!errc_) {
+      errc_ = listen();
+    }
+#else
     errc_ = listen();
+#endif
 
     async_simple::Promise<std::error_code> promise;
     auto future = promise.getFuture();
@@ -106,15 +152,31 @@ class coro_http_server {
         });
       }
 
-      accept().start([p = std::move(promise), this](auto &&res) mutable {
-        if (res.hasError()) {
-          errc_ = std::make_error_code(std::errc::io_error);
-          p.setValue(errc_);
-        }
-        else {
-          p.setValue(res.value());
-        }
-      });
+      connection_shard *local_shard =
+          use_reuse_port() ? shards_[0].get() : nullptr;
+      accept(acceptor_, acceptor_close_waiter_, local_shard)
+          .start([p = std::move(promise), this](auto &&res) mutable {
+            if (res.hasError()) {
+              errc_ = std::make_error_code(std::errc::io_error);
+              p.setValue(errc_);
+            }
+            else {
+              p.setValue(res.value());
+            }
+          });
+      for (size_t i = 0; i < reuse_port_acceptors_.size(); ++i) {
+        auto &acc = reuse_port_acceptors_[i];
+        accept(acc->acceptor, acc->close_waiter, shards_[i + 1].get())
+            .start([](auto &&) {
+            });
+      }
+
+      // the files cached by serve_static_file_ are refreshed without a
+      // static dir too.
+      if (!cache_refresh_done_.valid()) {
+        set_cache_refresh_interval(cache_refresh_interval_,
+                                   max_cache_file_size_);
+      }
     }
     else {
       promise.setValue(errc_);
@@ -130,7 +192,6 @@ class coro_http_server {
     }
 
     stop_timer_ = true;
-    check_timer_.cancel();
     // Wake up the sleeping cache refresh coroutine so it can exit cleanly.
     cache_refresh_timer_.cancel();
     // Wait for the coroutine to fully exit before stopping the pool.
@@ -142,13 +203,16 @@ class coro_http_server {
 
     close_acceptor();
 
-    // close current connections.
-    {
-      std::scoped_lock lock(conn_mtx_);
-      for (auto &conn : connections_) {
-        conn.second->close(false);
-      }
-      connections_.clear();
+    // close current connections on their io threads.
+    for (auto &shard : shards_) {
+      asio::dispatch(shard->executor->get_asio_executor(), [shard] {
+        shard->stopping = true;
+        for (auto &[id, conn] : shard->connections) {
+          conn->close(false);
+        }
+        shard->connections.clear();
+        shard->count.store(0, std::memory_order_relaxed);
+      });
     }
 
     if (out_ctx_ == nullptr) {
@@ -305,10 +369,13 @@ class coro_http_server {
         std::forward<Aspects>(aspects)...);
   }
 
+  // cache the files of the static directory which are not larger than
+  // max_size, until the budget of the cache is used up.
   void set_max_size_of_cache_files(size_t max_size = 3 * 1024 * 1024) {
+    max_cache_file_size_ = max_size;
+    static_cache_.clear();
+    uint64_t generation = static_cache_.generation();
     std::error_code ec;
-    auto new_cache =
-        std::make_shared<std::unordered_map<std::string, std::string>>();
     for (const auto &file :
          std::filesystem::recursive_directory_iterator(static_dir_, ec)) {
       if (ec) {
@@ -321,18 +388,72 @@ class coro_http_server {
           continue;
         }
 
-        std::ifstream ifs(file.path(), std::ios::binary);
-        if (ifs.is_open()) {
-          std::string content;
-          detail::resize(content, filesize);
-          ifs.read(content.data(), content.size());
-          new_cache->emplace(file.path().string(), std::move(content));
+        std::string key = static_file_cache::make_key(file.path());
+        if (!is_in_dir(key, static_dir_)) {
+          // a symlink to a file out of the static directory.
+          continue;
+        }
+        auto entry = load_static_file(key, key, "");
+        if (entry) {
+          static_cache_.insert(key, std::move(entry), generation);
+        }
+      }
+    }
+  }
+
+  // Serve the precompressed sidecars of the static files by Accept-Encoding,
+  // app.js.br, app.js.zst or app.js.gz for app.js, a sidecar older than the
+  // file is ignored. The missing sidecars are generated in the background if
+  // generate_missing is true.
+  void set_precompressed_files(bool enable, bool generate_missing = false) {
+    precompressed_ = enable;
+    // the cached heads are built without Vary.
+    static_cache_.clear();
+    if (enable && generate_missing) {
+      generate_precompressed_files().start([](auto &&) {
+      });
+    }
+  }
+
+  // compress the static files which have no fresh sidecars on the block
+  // executor, return the number of the sidecars written. The server must
+  // outlive it.
+  async_simple::coro::Lazy<size_t> generate_precompressed_files(
+      size_t min_size = 256) {
+    // captured by reference, see the comment in cache_refresh_loop.
+    std::string static_dir = static_dir_;
+    auto result = co_await coro_io::post([&static_dir, min_size]() {
+      size_t count = 0;
+      std::error_code ec;
+      for (const auto &file :
+           fs::recursive_directory_iterator(static_dir, ec)) {
+        std::string path = file.path().string();
+        if (ec || !file.is_regular_file(ec) ||
+            !is_compressible_mime(get_mime_type(get_extension(path))) ||
+            file.file_size(ec) < min_size) {
+          continue;
         }
+        count += write_sidecars(path);
       }
+      return count;
+    });
+    if (result.hasError()) {
+      co_return 0;
     }
-    std::atomic_store(&file_cache_, new_cache);
+    if (result.value() > 0) {
+      // the cached files don't know their new sidecars.
+      static_cache_.clear();
+    }
+    co_return result.value();
+  }
+
+  // the total bytes of the cached static files, 0 disables the cache.
+  void set_static_cache_budget(size_t budget) {
+    static_cache_.set_budget(budget);
   }
 
+  static_cache_stats get_static_cache_stats() { return static_cache_.stats(); }
+
   const coro_http_router &get_router() const { return router_; }
 
   void set_file_resp_format_type(file_resp_format_type type) {
@@ -342,13 +463,25 @@ class coro_http_server {
   void set_transfer_chunked_size(size_t size) { chunked_size_ = size; }
 
   // Enable background cache refresh for the static resource directory.
-  // The timer checks the directory mtime every `interval`; only when the
-  // directory has changed (file added/removed) is the cache rebuilt.
+  // Every `interval` the changed files are dropped from the cache, by the
+  // events of inotify or by checking the stat of the cached files out of the
+  // watched directory. The files not larger than max_file_size are cached
+  // when they are requested. It's started by async_start() if not called.
   void set_cache_refresh_interval(
       std::chrono::steady_clock::duration interval = std::chrono::seconds(3),
       size_t max_file_size = 3 * 1024 * 1024) {
     cache_refresh_interval_ = interval;
     max_cache_file_size_ = max_file_size;
+    if (cache_refresh_done_.valid() &&
+        cache_refresh_done_.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+      // the loop is running, wake it up to take the new interval.
+      asio::dispatch(cache_refresh_timer_.get_executor(), [this] {
+        cache_refresh_timer_.cancel();
+      });
+      return;
+    }
+    static_cache_.watch(static_dir_);
     cache_refresh_stopped_ = std::promise<void>{};
     cache_refresh_done_ = cache_refresh_stopped_.get_future();
     cache_refresh_loop().start([](auto &&) {
@@ -409,17 +542,18 @@ class coro_http_server {
           std::string rel = req.matches_.str(1);
           replace_all(rel, "\\", "/");
           std::string file_name =
-              (fs::path(base_dir) / rel).make_preferred().string();
-
-          std::error_code path_ec;
-          auto abs = fs::weakly_canonical(file_name, path_ec);
-          auto base = fs::weakly_canonical(base_dir, path_ec);
-          if (path_ec || abs.string().find(base.string()) != 0) {
+              static_file_cache::make_key(fs::path(base_dir) / rel);
+          // checked before the cache, which may hold files of other
+          // directories cached by serve_static_file_.
+          if (!is_in_dir(file_name, base_dir)) {
             resp.set_status(status_type::bad_request);
             co_return;
           }
 
-          co_await serve_static_file_(file_name, req, resp);
+          if (co_await serve_cached_file(file_name, req, resp)) {
+            co_return;
+          }
+          co_await serve_file(file_name, req, resp);
         },
         std::forward<Aspects>(aspects)...);
 
@@ -430,41 +564,92 @@ class coro_http_server {
   async_simple::coro::Lazy<void> serve_static_file_(
       const std::string &file_name, coro_http_request &req,
       coro_http_response &resp) {
+    std::string key = static_file_cache::make_key(file_name);
+    if (co_await serve_cached_file(key, req, resp)) {
+      co_return;
+    }
+    co_await serve_file(key, req, resp);
+  }
+
+  async_simple::coro::Lazy<void> serve_file(const std::string &file_name,
+                                            coro_http_request &req,
+                                            coro_http_response &resp) {
     std::string_view extension = get_extension(file_name);
     std::string_view mime = get_mime_type(extension);
-    auto range_str = req.get_header_value("Range");
-
-    auto cache = std::atomic_load(&file_cache_);
-    if (cache) {
-      if (auto it = cache->find(file_name); it != cache->end()) {
-        auto range_header = build_range_header(
-            mime, file_name, std::to_string(fs::file_size(file_name)));
-        resp.set_delay(true);
-        const std::string &body = it->second;
-        std::array<asio::const_buffer, 2> arr{asio::buffer(range_header),
-                                              asio::buffer(body)};
-        co_await req.get_conn()->async_write(arr);
-        co_return;
-      }
+    auto range_str = req.get_header_value(http_header_id::range);
+
+    file_validator validator;
+    if (!stat_file(file_name, validator) || validator.is_directory) {
+      resp.set_status(status_type::not_found);
+      co_return;
     }
 
-    std::string content;
-    detail::resize(content, chunked_size_);
+    if (!range_str.empty() &&
+        !if_range_matches(req.get_header_value(http_header_id::if_range),
+                          validator.etag, validator.mtime)) {
+      range_str = {};
+    }
 
-    if (fs::is_directory(file_name)) {
-      resp.set_status(status_type::not_found);
+    // the file sent, the original file or its precompressed sidecar.
+    std::string path = file_name;
+    std::string_view encoding;
+    if (precompressed_ && range_str.empty()) {
+      auto accept_encoding = req.get_accept_encoding();
+      for (auto &sidecar : sidecars) {
+        if (!accepts_encoding(accept_encoding, sidecar.encoding)) {
+          continue;
+        }
+        std::string sidecar_path = file_name + std::string(sidecar.suffix);
+        file_validator sidecar_validator;
+        if (stat_file(sidecar_path, sidecar_validator) &&
+            !sidecar_validator.is_directory &&
+            sidecar_validator.mtime >= validator.mtime) {
+          path = std::move(sidecar_path);
+          validator = std::move(sidecar_validator);
+          encoding = sidecar.encoding;
+          break;
+        }
+      }
+    }
+    std::string extra_headers = build_encoding_headers(encoding);
+    size_t file_size = validator.size;
+
+    // answer the revalidation before opening the file.
+    if (is_not_modified(req.get_header_value(http_header_id::if_none_match),
+                        req.get_header_value(http_header_id::if_modified_since),
+                        validator.etag, validator.mtime)) {
+      resp.set_delay(true);
+      co_await req.get_conn()->write_data(build_not_modified_head(
+          validator.etag, validator.last_modified, extra_headers));
       co_return;
     }
 
-    std::error_code size_ec;
-    size_t file_size = fs::file_size(file_name, size_ec);
-    if (size_ec) {
-      resp.set_status(status_type::not_found);
+    if (range_str.empty() && file_size <= max_cache_file_size_ &&
+        static_cache_.budget() > 0) {
+      if (auto entry = co_await cache_static_file(file_name, path, encoding);
+          entry) {
+        co_await write_cached_file(*entry, req, resp);
+        co_return;
+      }
+    }
+
+#ifdef __linux__
+    if (req.get_conn()->support_sendfile() &&
+        (format_type_ != file_resp_format_type::chunked ||
+         !range_str.empty())) {
+      coro_io::fd_guard guard(path.c_str());
+      if (guard.fd < 0) {
+        resp.set_status(status_type::not_found);
+        co_return;
+      }
+      co_await send_file_ranges(guard.fd, file_name, mime, validator,
+                                extra_headers, range_str, req, resp);
       co_return;
     }
+#endif
 
     coro_io::coro_file in_file{};
-    in_file.open(file_name, std::ios::in);
+    in_file.open(path, std::ios::in);
     if (!in_file.is_open()) {
 #ifndef NDEBUG
       resp.set_status_and_content(status_type::not_found,
@@ -476,7 +661,17 @@ class coro_http_server {
     }
 
     if (format_type_ == file_resp_format_type::chunked && range_str.empty()) {
+      std::string content;
+      detail::resize(content, chunked_size_);
       resp.add_header("Content-Type", std::string{mime});
+      resp.add_header("ETag", validator.etag);
+      resp.add_header("Last-Modified", validator.last_modified);
+      if (!encoding.empty()) {
+        resp.add_header("Content-Encoding", encoding);
+      }
+      if (precompressed_) {
+        resp.add_header("Vary", "Accept-Encoding");
+      }
       resp.set_format_type(format_type::chunked);
       bool ok;
       if (ok = co_await resp.get_conn()->begin_chunked(); !ok) {
@@ -503,114 +698,58 @@ class coro_http_server {
       co_return;
     }
 
-    auto pos = range_str.find('=');
-    if (pos != std::string_view::npos) {
-      range_str = range_str.substr(pos + 1);
-      bool is_valid = true;
-      auto ranges = parse_ranges(range_str, file_size, is_valid);
-      if (!is_valid) {
-        resp.set_status(status_type::range_not_satisfiable);
-        co_return;
-      }
-      assert(!ranges.empty());
-
-      if (ranges.size() == 1) {
-        auto [start, end] = ranges[0];
-        in_file.seek(start, std::ios::beg);
-        size_t part_size = end + 1 - start;
-        int status = (part_size == file_size) ? 200 : 206;
-        std::string content_range = "Content-Range: bytes ";
-        content_range.append(std::to_string(start))
-            .append("-")
-            .append(std::to_string(end))
-            .append("/")
-            .append(std::to_string(file_size))
-            .append(CRCF);
-        auto range_header = build_range_header(
-            mime, file_name, std::to_string(part_size), status, content_range);
-        resp.set_delay(true);
-        bool r = co_await req.get_conn()->write_data(range_header);
-        if (!r) {
-          co_return;
-        }
-        co_await send_single_part(in_file, content, req, resp, part_size);
-      }
-      else {
-        resp.set_delay(true);
-        std::string file_size_str = std::to_string(file_size);
-        size_t content_len = 0;
-        std::vector<std::string> multi_heads =
-            build_part_heads(ranges, mime, file_size_str, content_len);
-        auto range_header = build_multiple_range_header(content_len);
-        bool r = co_await req.get_conn()->write_data(range_header);
-        if (!r) {
-          co_return;
-        }
-        for (int i = 0; i < ranges.size(); i++) {
-          r = co_await req.get_conn()->write_data(multi_heads[i]);
-          if (!r) {
-            co_return;
-          }
-          auto [start, end] = ranges[i];
-          bool ok = in_file.seek(start, std::ios::beg);
-          if (!ok) {
-            resp.set_status_and_content(status_type::bad_request,
-                                        "invalid range");
-            co_await resp.get_conn()->reply();
-            co_return;
-          }
-          size_t part_size = end + 1 - start;
-          std::string_view more =
-              (i == (int)ranges.size() - 1) ? MULTIPART_END : CRCF;
-          r = co_await send_single_part(in_file, content, req, resp, part_size,
-                                        more);
-          if (!r) {
-            co_return;
-          }
-        }
-      }
-      co_return;
-    }
-
-    auto range_header =
-        build_range_header(mime, file_name, std::to_string(file_size));
-    resp.set_delay(true);
-    bool r = co_await req.get_conn()->write_data(range_header);
-    if (!r) {
-      co_return;
-    }
-    while (true) {
-      auto [ec, size] =
-          co_await in_file.async_read(content.data(), content.size());
-      if (ec) {
-        resp.set_status(status_type::no_content);
-        co_await resp.get_conn()->reply();
-        co_return;
-      }
-      r = co_await req.get_conn()->write_data(
-          std::string_view(content.data(), size));
-      if (!r) {
-        co_return;
-      }
-      if (in_file.eof()) {
-        break;
-      }
-    }
+    co_await send_file_ranges(in_file, file_name, mime, validator,
+                              extra_headers, range_str, req, resp);
   }
 
-  void set_check_duration(auto duration) { check_duration_ = duration; }
+  // the connections aren't scanned any more, every connection arms its own
+  // deadlines in the timing wheel of its io thread.
+  void set_check_duration(auto) {}
 
+  // close a connection which doesn't make progress in timeout_duration while
+  // it waits for a request, reads a request or writes. The body read by the
+  // handler, such as a chunked or multipart body, is limited too, the rest of
+  // the handler isn't, see http_deadlines::handler.
   void set_timeout_duration(
       std::chrono::steady_clock::duration timeout_duration) {
     if (timeout_duration > std::chrono::steady_clock::duration::zero()) {
-      need_check_ = true;
-      timeout_duration_ = timeout_duration;
-      start_check_timer();
+      set_deadlines(http_deadlines{.idle = timeout_duration,
+                                   .header_read = timeout_duration,
+                                   .body_read = timeout_duration,
+                                   .write = timeout_duration});
     }
   }
 
+  // the deadlines of every phase of the connections, zero is no limit.
+  void set_deadlines(const http_deadlines &deadlines) {
+    deadlines_ = deadlines;
+    need_check_ = true;
+  }
+
   void set_shrink_to_fit(bool r) { need_shrink_every_time_ = r; }
 
+#ifdef CINATRA_HAS_COMPRESSION
+  // Compress the responses of the compressible types by Accept-Encoding,
+  // the chunked responses and SSE are compressed piece by piece, the others
+  // are compressed if they are min_size bytes and up. A response with
+  // Content-Encoding set by the handler is not touched.
+  void set_auto_compression(bool enable, size_t min_size = 1024) {
+    auto_compress_ = enable;
+    compress_min_size_ = min_size;
+  }
+#endif
+
+#ifdef CINATRA_ENABLE_GZIP
+  // Accept permessage-deflate offers of the WebSocket clients, it's enabled
+  // by default. Every connection keeps its deflate and inflate streams
+  // between the messages unless no context takeover is agreed, the options
+  // limit what the clients may ask for.
+  void set_ws_deflate(bool enable, ws_deflate_options options = {}) {
+    ws_deflate_enabled_ = enable;
+    ws_deflate_options_ = options;
+  }
+#endif
+
   void set_default_handler(std::function<async_simple::coro::Lazy<void>(
                                coro_http_request &, coro_http_response &)>
                                handler) {
@@ -624,9 +763,14 @@ class coro_http_server {
     router_.set_error_handler(std::move(handler));
   }
 
+  // the sum of the counters of the io threads, it may be stale while the
+  // connections are coming and leaving.
   size_t connection_count() {
-    std::scoped_lock lock(conn_mtx_);
-    return connections_.size();
+    size_t count = 0;
+    for (auto &shard : shards_) {
+      count += shard->count.load(std::memory_order_relaxed);
+    }
+    return count;
   }
 
   std::string_view address() { return address_; }
@@ -635,7 +779,6 @@ class coro_http_server {
  private:
   std::error_code listen() {
     CINATRA_LOG_INFO << "begin to listen " << port_;
-    using asio::ip::tcp;
     asio::error_code ec;
 
     asio::ip::tcp::resolver resolver(acceptor_.get_executor());
@@ -651,197 +794,277 @@ class coro_http_server {
     }
 
     auto endpoint = results.begin()->endpoint();
-    acceptor_.open(endpoint.protocol(), ec);
+    if (ec = listen(acceptor_, endpoint); ec) {
+      return ec;
+    }
+
+    auto end_point = acceptor_.local_endpoint(ec);
+    if (ec) {
+      CINATRA_LOG_ERROR << "get local endpoint port: " << port_
+                        << " error: " << ec.message();
+      return ec;
+    }
+    port_ = end_point.port();
+
+    if (use_reuse_port()) {
+      endpoint.port(port_);
+      for (size_t i = 1; i < pool_->pool_size(); ++i) {
+        auto acc =
+            std::make_unique<reuse_port_acceptor>(pool_->get_executor(i));
+        if (ec = listen(acc->acceptor, endpoint); ec) {
+          return ec;
+        }
+        reuse_port_acceptors_.push_back(std::move(acc));
+      }
+      CINATRA_LOG_INFO << "reuse port with " << pool_->pool_size()
+                       << " acceptors";
+    }
+
+    CINATRA_LOG_INFO << "listen port " << port_ << " successfully";
+    return {};
+  }
+
+  std::error_code listen(asio::ip::tcp::acceptor &acceptor,
+                         const asio::ip::tcp::endpoint &endpoint) {
+    using asio::ip::tcp;
+    asio::error_code ec;
+    acceptor.open(endpoint.protocol(), ec);
     if (ec) {
       CINATRA_LOG_ERROR << "acceptor open failed" << " error: " << ec.message();
       return ec;
     }
 #ifdef __GNUC__
-    acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+    acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
 #endif
-    acceptor_.bind(endpoint, ec);
+#ifdef SO_REUSEPORT
+    if (use_reuse_port()) {
+      acceptor.set_option(
+          asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true),
+          ec);
+      if (ec) {
+        CINATRA_LOG_ERROR << "set reuse port error: " << ec.message();
+        return ec;
+      }
+    }
+#endif
+    acceptor.bind(endpoint, ec);
     if (ec) {
       CINATRA_LOG_ERROR << "bind port: " << port_ << " error: " << ec.message();
       std::error_code ignore_ec;
-      acceptor_.cancel(ignore_ec);
-      acceptor_.close(ignore_ec);
+      acceptor.cancel(ignore_ec);
+      acceptor.close(ignore_ec);
       return ec;
     }
 #ifdef _MSC_VER
-    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor.set_option(tcp::acceptor::reuse_address(true));
 #endif
-    acceptor_.listen(asio::socket_base::max_listen_connections, ec);
+    acceptor.listen(asio::socket_base::max_listen_connections, ec);
     if (ec) {
       CINATRA_LOG_ERROR << "get local endpoint port: " << port_
                         << " listen error: " << ec.message();
       return ec;
     }
 
-    auto end_point = acceptor_.local_endpoint(ec);
-    if (ec) {
-      CINATRA_LOG_ERROR << "get local endpoint port: " << port_
-                        << " error: " << ec.message();
-      return ec;
+    if (use_reuse_port()) {
+      // the pending connections are drained by sync accept after wakeup.
+      acceptor.non_blocking(true, ec);
     }
-    port_ = end_point.port();
-
-    CINATRA_LOG_INFO << "listen port " << port_ << " successfully";
     return {};
   }
 
-  async_simple::coro::Lazy<std::error_code> accept() {
+  bool use_reuse_port() const {
+#ifdef SO_REUSEPORT
+    return reuse_port_ && out_ctx_ == nullptr;
+#else
+    return false;
+#endif
+  }
+
+  struct connection_shard;
+
+  // local_shard is not null in reuse port mode, the new connections are
+  // bound to the io_context of the acceptor, otherwise the connections are
+  // dispatched to the io_contexts in round-robin.
+  async_simple::coro::Lazy<std::error_code> accept(
+      asio::ip::tcp::acceptor &acceptor, std::promise<void> &close_waiter,
+      connection_shard *local_shard = nullptr) {
     for (;;) {
-      coro_io::ExecutorWrapper<> *executor;
-      if (out_ctx_ == nullptr) {
-        executor = pool_->get_executor();
-      }
-      else {
-        out_executor_ = std::make_unique<coro_io::ExecutorWrapper<>>(
-            out_ctx_->get_executor());
-        executor = out_executor_.get();
+      connection_shard *shard = local_shard;
+      if (shard == nullptr) {
+        auto i = next_shard_.fetch_add(1, std::memory_order_relaxed);
+        shard = shards_[i % shards_.size()].get();
       }
+      auto executor = shard->executor;
 
       asio::ip::tcp::socket socket(executor->get_asio_executor());
-      auto error = co_await coro_io::async_accept(acceptor_, socket);
+      auto error = co_await coro_io::async_accept(acceptor, socket);
       if (error) {
         CINATRA_LOG_INFO << "accept failed, error: " << error.message();
         if (error == asio::error::operation_aborted ||
             error == asio::error::bad_descriptor) {
-          acceptor_close_waiter_.set_value();
+          close_waiter.set_value();
           co_return error;
         }
         continue;
       }
 
-      uint64_t conn_id = ++conn_id_;
-      CINATRA_LOG_DEBUG << "new connection comming, id: " << conn_id;
-      auto conn = std::make_shared<coro_http_connection>(
-          executor, std::move(socket), router_);
-      if (no_delay_) {
-        conn->tcp_socket().set_option(asio::ip::tcp::no_delay(true));
-      }
-      conn->set_max_http_body_size(max_http_body_len_);
-      conn->set_max_http_header_size(max_http_header_size_);
-      if (need_shrink_every_time_) {
-        conn->set_shrink_to_fit(true);
-      }
-      if (need_check_) {
-        conn->set_check_timeout(true);
+      start_connection(std::move(socket), shard);
+
+      if (local_shard == nullptr) {
+        continue;
       }
-      if (default_handler_) {
-        conn->set_default_handler(default_handler_);
+
+      // drain the pending connections of this wakeup.
+      for (size_t i = 0; i < max_accept_batch_; ++i) {
+        asio::ip::tcp::socket next_socket(executor->get_asio_executor());
+        acceptor.accept(next_socket, error);
+        if (error) {
+          if (error != asio::error::would_block &&
+              error != asio::error::try_again) {
+            CINATRA_LOG_INFO << "accept failed, error: " << error.message();
+          }
+          break;
+        }
+        start_connection(std::move(next_socket), shard);
       }
+    }
+  }
+
+  void start_connection(asio::ip::tcp::socket socket, connection_shard *shard) {
+    uint64_t conn_id = conn_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+    CINATRA_LOG_DEBUG << "new connection comming, id: " << conn_id;
+    auto conn = std::make_shared<coro_http_connection>(
+        shard->executor, std::move(socket), router_);
+    if (no_delay_) {
+      std::error_code ec;
+      conn->tcp_socket().set_option(asio::ip::tcp::no_delay(true), ec);
+    }
+    conn->set_max_http_body_size(max_http_body_len_);
+    conn->set_max_http_header_size(max_http_header_size_);
+    if (need_shrink_every_time_) {
+      conn->set_shrink_to_fit(true);
+    }
+    if (need_check_) {
+      conn->set_deadlines(deadlines_);
+    }
+    if (default_handler_) {
+      conn->set_default_handler(default_handler_);
+    }
+    if (auto_compress_) {
+      conn->set_auto_compression(true, compress_min_size_);
+    }
+#ifdef CINATRA_ENABLE_GZIP
+    conn->set_ws_deflate(ws_deflate_enabled_, ws_deflate_options_);
+#endif
 
 #ifdef INJECT_FOR_HTTP_SEVER_TEST
-      if (write_failed_forever_) {
-        conn->set_write_failed_forever(write_failed_forever_);
-      }
-      if (read_failed_forever_) {
-        conn->set_read_failed_forever(read_failed_forever_);
-      }
+    if (write_failed_forever_) {
+      conn->set_write_failed_forever(write_failed_forever_);
+    }
+    if (read_failed_forever_) {
+      conn->set_read_failed_forever(read_failed_forever_);
+    }
 #endif
 
 #ifdef CINATRA_ENABLE_SSL
-      if (use_ssl_) {
-        conn->init_ssl(cert_file_, key_file_, passwd_);
-      }
+    if (use_ssl_) {
+      conn->init_ssl(ssl_ctx_);
+    }
 #endif
 
-      conn->set_quit_callback(
-          [this](const uint64_t &id) {
-            std::scoped_lock lock(conn_mtx_);
-            if (!connections_.empty())
-              connections_.erase(id);
-          },
-          conn_id);
-
-      {
-        std::scoped_lock lock(conn_mtx_);
-        connections_.emplace(conn_id, conn);
-      }
+    // called on the io thread of the connection.
+    conn->set_quit_callback(
+        [shard](const uint64_t &id) {
+          if (shard->connections.erase(id) != 0) {
+            shard->count.fetch_sub(1, std::memory_order_relaxed);
+          }
+        },
+        conn_id);
 
-      start_one(conn).via(conn->get_executor()).detach();
-    }
+    start_one(conn, shard).via(conn->get_executor()).detach();
   }
 
+  // a RescheduleLazy runs on the io thread of the connection, so the
+  // connection is registered by its own thread.
   async_simple::coro::Lazy<void> start_one(
-      std::shared_ptr<coro_http_connection> conn) noexcept {
+      std::shared_ptr<coro_http_connection> conn,
+      connection_shard *shard) noexcept {
+    if (shard->stopping) {
+      conn->close(false);
+      co_return;
+    }
+    shard->connections.emplace(conn->conn_id(), conn);
+    shard->count.fetch_add(1, std::memory_order_relaxed);
     co_await conn->start();
   }
 
+  void init_shards() {
+    if (out_ctx_ != nullptr) {
+      out_executor_ =
+          std::make_unique<coro_io::ExecutorWrapper<>>(out_ctx_->get_executor());
+      shards_.push_back(std::make_shared<connection_shard>());
+      shards_.back()->executor = out_executor_.get();
+      return;
+    }
+    for (size_t i = 0; i < pool_->pool_size(); ++i) {
+      shards_.push_back(std::make_shared<connection_shard>());
+      shards_.back()->executor = pool_->get_executor(i);
+    }
+  }
+
   void close_acceptor() {
-    asio::dispatch(acceptor_.get_executor(), [this]() {
+    close_acceptor(acceptor_, acceptor_close_waiter_);
+    for (auto &acc : reuse_port_acceptors_) {
+      close_acceptor(acc->acceptor, acc->close_waiter);
+    }
+  }
+
+  void close_acceptor(asio::ip::tcp::acceptor &acceptor,
+                      std::promise<void> &close_waiter) {
+    asio::dispatch(acceptor.get_executor(), [&acceptor]() {
       asio::error_code ec;
-      acceptor_.cancel(ec);
-      acceptor_.close(ec);
+      acceptor.cancel(ec);
+      acceptor.close(ec);
     });
-    acceptor_close_waiter_.get_future().wait();
+    close_waiter.get_future().wait();
   }
 
   // Coroutine-based cache refresh loop.
   //
   // Sleep is done via period_timer::async_await() so stop() can wake it up
-  // immediately by cancelling the timer. File reads are offloaded to the
-  // global block executor via coro_io::post (non-blocking for the event loop),
-  // with all data captured by value so 'this' is never accessed from that
-  // thread. After the loop exits, the promise is fulfilled so stop() can
+  // immediately by cancelling the timer. The invalidation is offloaded to the
+  // global block executor via coro_io::post, the stat of the files may be
+  // slow. After the loop exits, the promise is fulfilled so stop() can
   // safely proceed to pool_->stop() without a use-after-free.
   async_simple::coro::Lazy<void> cache_refresh_loop() {
     while (true) {
       cache_refresh_timer_.expires_after(cache_refresh_interval_);
       bool timer_ok = co_await cache_refresh_timer_.async_await();
-      if (!timer_ok || stop_timer_) {
+      if (stop_timer_) {
         break;
       }
-
-      std::error_code mtime_ec;
-      auto dir_mtime = fs::last_write_time(static_dir_, mtime_ec);
-      if (mtime_ec || dir_mtime == last_dir_mtime_) {
+      if (!timer_ok) {
+        // cancelled by set_cache_refresh_interval, sleep with the new
+        // interval.
         continue;
       }
-      last_dir_mtime_ = dir_mtime;
 
       // static_dir is a snapshot of static_dir_ on this coroutine's frame.
       // Captured by reference so the lambda closure holds only a pointer —
       // avoids GCC 11 coroutine-parameter SSO bitcopy bug where _M_p is
-      // copied but not updated to the new frame location, causing ASAN
-      // "attempting free on address which was not malloc()-ed" on destruction.
-      // The frame stays alive for the entire co_await suspension, so the
-      // reference is valid when the block executor reads it.
+      // copied but not updated to the new frame location. The frame stays
+      // alive for the entire co_await suspension.
       std::string static_dir = static_dir_;
-      size_t max_size = max_cache_file_size_;
-      auto result = co_await coro_io::post([&static_dir, max_size]() {
-        using FileMap = std::unordered_map<std::string, std::string>;
-        auto new_cache = std::make_shared<FileMap>();
-        std::error_code iter_ec;
-        for (const auto &file :
-             fs::recursive_directory_iterator(static_dir, iter_ec)) {
-          if (iter_ec || file.is_directory()) {
-            continue;
-          }
-          size_t filesize = fs::file_size(file, iter_ec);
-          if (iter_ec || filesize > max_size) {
-            continue;
-          }
-          std::ifstream ifs(file.path(), std::ios::binary);
-          if (ifs.is_open()) {
-            std::string content(filesize, '\0');
-            ifs.read(content.data(), content.size());
-            new_cache->emplace(file.path().string(), std::move(content));
-          }
-        }
-        return new_cache;
+      co_await coro_io::post([&cache = static_cache_, &static_dir]() {
+        cache.watch(static_dir);
+        cache.refresh();
       });
 
       // Re-check stop flag: stop() may have been called while we were
-      // doing file reads on the block executor.
+      // checking the files on the block executor.
       if (stop_timer_) {
         break;
       }
-
-      if (!result.hasError()) {
-        std::atomic_store(&file_cache_, result.value());
-      }
     }
 
     // Signal stop() that this coroutine has fully exited and will no
@@ -849,41 +1072,14 @@ class coro_http_server {
     cache_refresh_stopped_.set_value();
   }
 
-  void start_check_timer() {
-    check_timer_.expires_after(check_duration_);
-    check_timer_.async_wait([this](auto ec) {
-      if (ec || stop_timer_) {
-        return;
-      }
-
-      check_timeout();
-      start_check_timer();
-    });
-  }
-
-  void check_timeout() {
-    auto cur_time = std::chrono::system_clock::now();
-
-    std::unordered_map<uint64_t, std::shared_ptr<coro_http_connection>> conns;
-
-    {
-      std::scoped_lock lock(conn_mtx_);
-      for (auto it = connections_.begin();
-           it != connections_.end();)  // no "++"!
-      {
-        if (cur_time - it->second->get_last_rwtime() > timeout_duration_) {
-          it->second->close(false);
-          connections_.erase(it++);
-        }
-        else {
-          ++it;
-        }
-      }
-    }
-  }
-
-  std::string build_multiple_range_header(size_t content_len) {
+  std::string build_multiple_range_header(
+      size_t content_len, const file_validator *validator = nullptr,
+      std::string_view extra_headers = "") {
     std::string header_str = "HTTP/1.1 206 Partial Content\r\n";
+    if (validator) {
+      append_validator(header_str, validator->etag, validator->last_modified);
+    }
+    header_str.append(extra_headers);
     header_str.append("Content-Length: ");
     header_str.append(std::to_string(content_len)).append(CRCF);
     header_str.append("Content-Type: multipart/byteranges; boundary=");
@@ -911,7 +1107,8 @@ class coro_http_server {
       size_t part_size = end + 1 - start + CRCF.size();
       content_len += part_size;
     }
-    content_len += (BOUNDARY.size() + 4);
+    // the CRCF after the last part is the beginning of MULTIPART_END.
+    content_len += MULTIPART_END.size() - CRCF.size();
     return multi_heads;
   }
 
@@ -919,10 +1116,16 @@ class coro_http_server {
                                  std::string_view filename,
                                  std::string_view file_size_str,
                                  int status = 200,
-                                 std::string_view content_range = "") {
+                                 std::string_view content_range = "",
+                                 const file_validator *validator = nullptr,
+                                 std::string_view extra_headers = "") {
     std::string header_str = "HTTP/1.1 ";
     header_str.append(std::to_string(status));
     header_str.append(" OK\r\nAccept-Ranges: bytes\r\n");
+    if (validator) {
+      append_validator(header_str, validator->etag, validator->last_modified);
+    }
+    header_str.append(extra_headers);
     if (!content_range.empty()) {
       header_str.append(content_range);
     }
@@ -943,10 +1146,338 @@ class coro_http_server {
     return header_str;
   }
 
+  // whether the file is in the directory after the symlinks are resolved.
+  static bool is_in_dir(const std::string &file_name,
+                        const std::string &dir) {
+    std::error_code ec;
+    auto abs = fs::weakly_canonical(file_name, ec);
+    if (ec) {
+      return false;
+    }
+    auto base = fs::weakly_canonical(dir, ec);
+    if (ec) {
+      return false;
+    }
+    auto [it, _] = std::mismatch(base.begin(), base.end(), abs.begin(),
+                                 abs.end());
+    return it == base.end();
+  }
+
+  async_simple::coro::Lazy<bool> serve_cached_file(
+      const std::string &file_name, coro_http_request &req,
+      coro_http_response &resp) {
+    auto entry = static_cache_.find(file_name);
+    if (entry == nullptr) {
+      co_return false;
+    }
+    if (entry->sidecars &&
+        req.get_header_value(http_header_id::range).empty()) {
+      auto accept_encoding = req.get_accept_encoding();
+      for (size_t i = 0; i < sidecars.size(); i++) {
+        if ((entry->sidecars & (1 << i)) &&
+            accepts_encoding(accept_encoding, sidecars[i].encoding)) {
+          thread_local std::string key;
+          static_file_cache::make_variant_key(key, file_name,
+                                              sidecars[i].encoding);
+          entry = static_cache_.find(key, false);
+          if (entry == nullptr) {
+            // the variant is cached by serve_file.
+            co_return false;
+          }
+          break;
+        }
+      }
+    }
+    if (is_not_modified(req.get_header_value(http_header_id::if_none_match),
+                        req.get_header_value(http_header_id::if_modified_since),
+                        entry->etag, entry->mtime)) {
+      resp.set_delay(true);
+      co_await req.get_conn()->write_data(entry->not_modified_head);
+      co_return true;
+    }
+    if (!req.get_header_value(http_header_id::range).empty()) {
+      // the ranges are sent from the file.
+      co_return false;
+    }
+    co_await write_cached_file(*entry, req, resp);
+    co_return true;
+  }
+
+  async_simple::coro::Lazy<void> write_cached_file(
+      const static_file_entry &entry, coro_http_request &req,
+      coro_http_response &resp) {
+    resp.set_delay(true);
+    std::array<asio::const_buffer, 2> arr{asio::buffer(entry.head),
+                                          asio::buffer(entry.body)};
+    co_await req.get_conn()->async_write(arr);
+  }
+
+  // read the file at path and build the response head of file_name, the
+  // path is a precompressed sidecar of file_name if encoding isn't empty.
+  static_file_cache::entry_ptr load_static_file(const std::string &path,
+                                                const std::string &file_name,
+                                                std::string_view encoding) {
+    file_validator validator;
+    if (!stat_file(path, validator) || validator.is_directory) {
+      return nullptr;
+    }
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) {
+      return nullptr;
+    }
+    auto entry = std::make_shared<static_file_entry>();
+    entry->body.assign(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+    entry->path = path;
+    entry->file_size = entry->body.size();
+    entry->etag = validator.etag;
+    entry->mtime = validator.mtime;
+    if (!encoding.empty()) {
+      entry->source = file_name;
+    }
+    else if (precompressed_) {
+      file_validator sidecar_validator;
+      for (size_t i = 0; i < sidecars.size(); i++) {
+        if (stat_file(path + std::string(sidecars[i].suffix),
+                      sidecar_validator) &&
+            sidecar_validator.mtime >= validator.mtime) {
+          entry->sidecars |= (1 << i);
+        }
+      }
+    }
+    std::string extra_headers = build_encoding_headers(encoding);
+    entry->head = build_range_header(
+        get_mime_type(get_extension(file_name)), file_name,
+        std::to_string(entry->file_size), 200, "", &validator, extra_headers);
+    entry->not_modified_head = build_not_modified_head(
+        validator.etag, validator.last_modified, extra_headers);
+    return entry;
+  }
+
+  // the file is read on the block executor, not to block the io thread.
+  async_simple::coro::Lazy<static_file_cache::entry_ptr> cache_static_file(
+      const std::string &file_name, const std::string &path,
+      std::string_view encoding) {
+    uint64_t generation = static_cache_.generation();
+    auto result = co_await coro_io::post([this, &path, &file_name, encoding]() {
+      return load_static_file(path, file_name, encoding);
+    });
+    if (result.hasError() || result.value() == nullptr) {
+      co_return nullptr;
+    }
+    auto entry = std::move(result.value());
+    if (encoding.empty()) {
+      static_cache_.insert(file_name, entry, generation);
+    }
+    else {
+      std::string key;
+      static_file_cache::make_variant_key(key, file_name, encoding);
+      static_cache_.insert(key, entry, generation);
+    }
+    co_return entry;
+  }
+
+  // write the whole file, a single range or a multipart/byteranges response,
+  // only the headers are built in userspace when the file is an fd.
+  async_simple::coro::Lazy<void> send_file_ranges(
+      auto &file, const std::string &file_name, std::string_view mime,
+      const file_validator &validator, std::string_view extra_headers,
+      std::string_view range_str, coro_http_request &req,
+      coro_http_response &resp) {
+    size_t file_size = validator.size;
+    auto pos = range_str.find('=');
+    if (pos == std::string_view::npos) {
+      auto range_header =
+          build_range_header(mime, file_name, std::to_string(file_size), 200,
+                             "", &validator, extra_headers);
+      resp.set_delay(true);
+      bool r = co_await req.get_conn()->write_data(range_header);
+      if (!r) {
+        co_return;
+      }
+      co_await send_file_part(file, req, resp, 0, file_size);
+      co_return;
+    }
+
+    range_str = range_str.substr(pos + 1);
+    bool is_valid = true;
+    auto ranges = parse_ranges(range_str, file_size, is_valid);
+    if (!is_valid) {
+      resp.set_status(status_type::range_not_satisfiable);
+      co_return;
+    }
+    assert(!ranges.empty());
+
+    if (ranges.size() == 1) {
+      auto [start, end] = ranges[0];
+      size_t part_size = end + 1 - start;
+      int status = (part_size == file_size) ? 200 : 206;
+      std::string content_range = "Content-Range: bytes ";
+      content_range.append(std::to_string(start))
+          .append("-")
+          .append(std::to_string(end))
+          .append("/")
+          .append(std::to_string(file_size))
+          .append(CRCF);
+      auto range_header =
+          build_range_header(mime, file_name, std::to_string(part_size),
+                             status, content_range, &validator, extra_headers);
+      resp.set_delay(true);
+      bool r = co_await req.get_conn()->write_data(range_header);
+      if (!r) {
+        co_return;
+      }
+      co_await send_file_part(file, req, resp, start, part_size);
+      co_return;
+    }
+
+    resp.set_delay(true);
+    std::string file_size_str = std::to_string(file_size);
+    size_t content_len = 0;
+    std::vector<std::string> multi_heads =
+        build_part_heads(ranges, mime, file_size_str, content_len);
+    auto range_header =
+        build_multiple_range_header(content_len, &validator, extra_headers);
+    // the delimiter of the previous part is sent with the next part head.
+    std::string_view delimiter = range_header;
+    for (size_t i = 0; i < ranges.size(); i++) {
+      std::array<asio::const_buffer, 2> arr{asio::buffer(delimiter),
+                                            asio::buffer(multi_heads[i])};
+      auto [ec, _] = co_await req.get_conn()->async_write(arr);
+      if (ec) {
+        co_return;
+      }
+      auto [start, end] = ranges[i];
+      size_t part_size = end + 1 - start;
+      bool r = co_await send_file_part(file, req, resp, start, part_size);
+      if (!r) {
+        co_return;
+      }
+      delimiter = CRCF;
+    }
+    co_await req.get_conn()->write_data(MULTIPART_END);
+  }
+
+#ifdef __linux__
+  async_simple::coro::Lazy<bool> send_file_part(int fd, coro_http_request &req,
+                                                coro_http_response &resp,
+                                                uint64_t start,
+                                                size_t part_size) {
+    co_return co_await req.get_conn()->write_file(fd, start, part_size);
+  }
+#endif
+
+  async_simple::coro::Lazy<bool> send_file_part(coro_io::coro_file &in_file,
+                                                coro_http_request &req,
+                                                coro_http_response &resp,
+                                                uint64_t start,
+                                                size_t part_size) {
+    if (!in_file.seek(start, std::ios::beg)) {
+      resp.set_status_and_content(status_type::bad_request, "invalid range");
+      co_await resp.get_conn()->reply();
+      co_return false;
+    }
+    std::string content;
+    detail::resize(content, (std::min)(part_size, chunked_size_));
+    co_return co_await send_single_part(in_file, content, req, resp,
+                                        part_size);
+  }
+
+  // a response of a static file varies by Accept-Encoding if the
+  // precompressed sidecars are enabled.
+  std::string build_encoding_headers(std::string_view encoding) {
+    std::string header_str;
+    if (!encoding.empty()) {
+      header_str.append("Content-Encoding: ").append(encoding).append(CRCF);
+    }
+    if (precompressed_) {
+      header_str.append("Vary: Accept-Encoding\r\n");
+    }
+    return header_str;
+  }
+
+  // write the missing or stale sidecars of the file, a sidecar no smaller
+  // than the file is not written.
+  static size_t write_sidecars(const std::string &path) {
+    file_validator validator;
+    if (!stat_file(path, validator)) {
+      return 0;
+    }
+    std::string content;
+    size_t count = 0;
+    for (auto &sidecar : sidecars) {
+      std::string sidecar_path = path + std::string(sidecar.suffix);
+      file_validator sidecar_validator;
+      if (stat_file(sidecar_path, sidecar_validator) &&
+          sidecar_validator.mtime >= validator.mtime) {
+        continue;
+      }
+
+      if (content.empty()) {
+        std::ifstream ifs(path, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+      }
+      std::string compressed;
+      bool ok = false;
+#ifdef CINATRA_ENABLE_BROTLI
+      if (sidecar.encoding == "br") {
+        ok = br_codec::brotli_compress(content, compressed);
+      }
+#endif
+#ifdef CINATRA_ENABLE_ZSTD
+      if (sidecar.encoding == "zstd") {
+        ok = zstd_codec::compress(content, compressed, 19, nullptr);
+      }
+#endif
+#ifdef CINATRA_ENABLE_GZIP
+      if (sidecar.encoding == "gzip") {
+        ok = gzip_codec::compress(content, compressed, 9);
+      }
+#endif
+      if (!ok || compressed.size() >= content.size()) {
+        continue;
+      }
+
+      // rename the complete file, a request never sees a partial sidecar.
+      std::string tmp_path = sidecar_path + ".tmp";
+      {
+        std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+        ofs.write(compressed.data(), compressed.size());
+        if (!ofs) {
+          continue;
+        }
+      }
+      std::error_code ec;
+      fs::rename(tmp_path, sidecar_path, ec);
+      if (ec) {
+        fs::remove(tmp_path, ec);
+        continue;
+      }
+      count++;
+    }
+    return count;
+  }
+
+  void append_validator(std::string &header_str, std::string_view etag,
+                        std::string_view last_modified) {
+    header_str.append("ETag: ").append(etag).append(CRCF);
+    header_str.append("Last-Modified: ").append(last_modified).append(CRCF);
+  }
+
+  std::string build_not_modified_head(std::string_view etag,
+                                      std::string_view last_modified,
+                                      std::string_view extra_headers = "") {
+    std::string header_str = "HTTP/1.1 304 Not Modified\r\n";
+    append_validator(header_str, etag, last_modified);
+    header_str.append(extra_headers);
+    header_str.append("Connection: keep-alive\r\n\r\n");
+    return header_str;
+  }
+
   async_simple::coro::Lazy<bool> send_single_part(auto &in_file, auto &content,
                                                   auto &req, auto &resp,
-                                                  size_t part_size,
-                                                  std::string_view more = "") {
+                                                  size_t part_size) {
     while (true) {
       size_t read_size = (std::min)(part_size, chunked_size_);
       if (read_size == 0) {
@@ -961,20 +1492,8 @@ class coro_http_server {
 
       part_size -= read_size;
 
-      bool r = true;
-      if (more.empty()) {
-        r = co_await req.get_conn()->write_data(
-            std::string_view(content.data(), size));
-      }
-      else {
-        std::array<asio::const_buffer, 2> arr{
-            asio::buffer(content.data(), size), asio::buffer(more)};
-        auto [ec, _] = co_await req.get_conn()->async_write(arr);
-        if (ec) {
-          r = false;
-        }
-      }
-
+      bool r = co_await req.get_conn()->write_data(
+          std::string_view(content.data(), size));
       if (!r) {
         co_return false;
       }
@@ -1091,14 +1610,34 @@ class coro_http_server {
   std::promise<void> acceptor_close_waiter_;
   bool no_delay_ = true;
 
-  uint64_t conn_id_ = 0;
-  std::unordered_map<uint64_t, std::shared_ptr<coro_http_connection>>
-      connections_;
-  std::mutex conn_mtx_;
-  std::chrono::steady_clock::duration check_duration_ =
-      std::chrono::seconds(15);
-  std::chrono::steady_clock::duration timeout_duration_{};
-  asio::steady_timer check_timer_;
+  struct reuse_port_acceptor {
+    reuse_port_acceptor(coro_io::ExecutorWrapper<> *e)
+        : acceptor(e->get_asio_executor()), executor(e) {}
+    asio::ip::tcp::acceptor acceptor;
+    coro_io::ExecutorWrapper<> *executor;
+    std::promise<void> close_waiter;
+  };
+  // the acceptors of io_context[1, n) in reuse port mode, acceptor_ is the
+  // acceptor of io_context[0].
+  std::vector<std::unique_ptr<reuse_port_acceptor>> reuse_port_acceptors_;
+  bool reuse_port_ = false;
+  size_t max_accept_batch_ = 64;
+
+  // the connections of an io_context, only touched on its io thread except
+  // the counter.
+  struct alignas(64) connection_shard {
+    coro_io::ExecutorWrapper<> *executor = nullptr;
+    std::unordered_map<uint64_t, std::shared_ptr<coro_http_connection>>
+        connections;
+    std::atomic<size_t> count = 0;
+    // set by stop() on the io thread, the connections accepted before it and
+    // registered after it are closed at once.
+    bool stopping = false;
+  };
+  std::vector<std::shared_ptr<connection_shard>> shards_;
+  std::atomic<size_t> next_shard_ = 0;
+  std::atomic<uint64_t> conn_id_ = 0;
+  http_deadlines deadlines_;
   bool need_check_ = false;
   std::atomic<bool> stop_timer_ = false;
 
@@ -1106,19 +1645,18 @@ class coro_http_server {
   std::string static_dir_ = "";
   size_t chunked_size_ = 1024 * 10;
 
-  std::shared_ptr<std::unordered_map<std::string, std::string>> file_cache_;
+  static_file_cache static_cache_;
+  bool precompressed_ = false;
   coro_io::period_timer cache_refresh_timer_;
   std::chrono::steady_clock::duration cache_refresh_interval_ =
       std::chrono::seconds(5);
   size_t max_cache_file_size_ = 3 * 1024 * 1024;
-  fs::file_time_type last_dir_mtime_{};
   std::promise<void> cache_refresh_stopped_;
   std::future<void> cache_refresh_done_;
   file_resp_format_type format_type_ = file_resp_format_type::range;
 #ifdef CINATRA_ENABLE_SSL
-  std::string cert_file_;
-  std::string key_file_;
-  std::string passwd_;
+  ssl_server_config ssl_conf_;
+  std::shared_ptr<ssl_server_context> ssl_ctx_;
   bool use_ssl_ = false;
 #endif
   coro_http_router router_;
@@ -1128,6 +1666,12 @@ class coro_http_server {
       default_handler_ = nullptr;
   int64_t max_http_body_len_ = MAX_HTTP_BODY_SIZE;
   size_t max_http_header_size_ = 8 * 1024;
+  bool auto_compress_ = false;
+  size_t compress_min_size_ = 1024;
+#ifdef CINATRA_ENABLE_GZIP
+  bool ws_deflate_enabled_ = true;
+  ws_deflate_options ws_deflate_options_;
+#endif
 #ifdef INJECT_FOR_HTTP_SEVER_TEST
   bool write_failed_forever_ = false;
   bool read_failed_forever_ = false;
@@ -2,400 +2,322 @@
 
 #include <async_simple/coro/Lazy.h>
 
+#include <array>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <regex>
 #include <string>
 #include <string_view>
-#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "cinatra/coro_http_request.hpp"
+#include "cinatra/utils.hpp"
 #include "coro_http_response.hpp"
-#include "ylt/util/type_traits.h"
 
 namespace cinatra {
 constexpr char type_asterisk = '*';
 constexpr char type_colon = ':';
 constexpr char type_slash = '/';
 
-typedef std::tuple<
-    bool, std::function<void(coro_http_request &req, coro_http_response &resp)>,
-    std::unordered_map<std::string, std::string>>
-    parse_result;
-
-typedef std::tuple<bool,
-                   std::function<async_simple::coro::Lazy<void>(
-                       coro_http_request &req, coro_http_response &resp)>,
-                   std::unordered_map<std::string, std::string>>
-    coro_result;
-
-struct handler_t {
-  std::string method;
-  std::function<void(coro_http_request &req, coro_http_response &resp)> handler;
+using http_handler_t =
+    std::function<void(coro_http_request &req, coro_http_response &resp)>;
+using coro_http_handler_t = std::function<async_simple::coro::Lazy<void>(
+    coro_http_request &req, coro_http_response &resp)>;
+
+struct route_entry {
+  http_handler_t handler;
+  coro_http_handler_t coro_handler;
+  // name of every wildcard segment in order, empty for "{}".
+  std::vector<std::string> param_names;
+  // the routes with "{}" or a regex fill coro_http_request::matches_.
+  std::optional<std::regex> regex;
+  std::string pattern;
 };
 
-struct coro_handler_t {
-  std::string method;
-  std::function<async_simple::coro::Lazy<void>(coro_http_request &req,
-                                               coro_http_response &resp)>
-      coro_handler;
+struct route_node {
+  std::string segment;
+  // literal segments, the key points to the segment of the child.
+  std::unordered_map<std::string_view, std::unique_ptr<route_node>> children;
+  // ":name" and "{}", match one non-empty segment.
+  std::unique_ptr<route_node> wildcard;
+  // "*name", match all the left segments.
+  std::unique_ptr<route_entry> catch_all;
+  std::unique_ptr<route_entry> entry;
+  // regex routes whose literal prefix ends at this node, tried in order.
+  std::vector<std::unique_ptr<route_entry>> regex_entries;
 };
 
-struct radix_tree_node {
-  std::string path;
-  handler_t handler;
-  coro_handler_t coro_handler;
-  std::string indices;
-  std::vector<std::shared_ptr<radix_tree_node>> children;
-  int max_params;
-
-  radix_tree_node() = default;
-  radix_tree_node(const std::string &path) { this->path = path; }
-  ~radix_tree_node() {}
-
-  std::function<void(coro_http_request &req, coro_http_response &resp)>
-  get_handler(const std::string &method) {
-    if (handler.method == method) {
-      return handler.handler;
-    }
-
-    return nullptr;
-  }
-
-  std::function<async_simple::coro::Lazy<void>(coro_http_request &req,
-                                               coro_http_response &resp)>
-  get_coro_handler(const std::string &method) {
-    if (coro_handler.method == method) {
-      return coro_handler.coro_handler;
+// All the routes with parameters or regex are compiled into one segment trie,
+// the key is like "GET /user/:id" and every segment split by '/' is an edge.
+// Literal edges are tried first, then the wildcard, then the catch-all, a
+// regex is only matched at the node where its literal prefix ends, so the
+// lookup cost depends on the depth of the path instead of the route count.
+// A regex whose prefix is not literal, such as "/a/x|GET /b/y" or "/a/?b",
+// is kept at the root and matched against the whole key.
+class route_tree {
+ public:
+  route_entry *insert(std::string_view path) {
+    // the kind of every segment is decided on its own, so a ':' inside a
+    // regex such as "(?:a|b)" doesn't make a param.
+    bool has_regex = false;
+    bool has_param = false;
+    for (size_t pos = 0; pos != std::string_view::npos;) {
+      size_t end = path.find(type_slash, pos);
+      auto kind = kind_of(path.substr(pos, end - pos));
+      has_regex |= kind == segment_kind::regex;
+      has_param |= kind == segment_kind::param || kind == segment_kind::rest;
+      pos = end == std::string_view::npos ? end : end + 1;
     }
-    return nullptr;
-  }
-
-  int add_handler(
-      std::function<void(coro_http_request &req, coro_http_response &resp)>
-          handler,
-      const std::string &method) {
-    this->handler = handler_t{method, handler};
-
-    return 0;
-  }
-
-  int add_coro_handler(std::function<async_simple::coro::Lazy<void>(
-                           coro_http_request &req, coro_http_response &resp)>
-                           coro_handler,
-                       const std::string &method) {
-    this->coro_handler = coro_handler_t{method, coro_handler};
-    return 0;
-  }
-
-  std::shared_ptr<radix_tree_node> insert_child(
-      char index, std::shared_ptr<radix_tree_node> child) {
-    auto i = this->get_index_position(index);
-    this->indices.insert(this->indices.begin() + i, index);
-    this->children.insert(this->children.begin() + i, child);
-    return child;
-  }
-
-  std::shared_ptr<radix_tree_node> get_child(char index) {
-    auto i = this->get_index_position(index);
-    return this->indices[i] != index ? nullptr : this->children[i];
-  }
-
-  int get_index_position(char target) {
-    int low = 0, high = this->indices.size(), mid;
-
-    while (low < high) {
-      mid = low + ((high - low) >> 1);
-      if (this->indices[mid] < target)
-        low = mid + 1;
-      else
-        high = mid;
+    if (has_regex && has_param) {
+      CINATRA_LOG_WARNING << path
+                          << ", a regex route can't have :name or *name";
+      return nullptr;
     }
-    return low;
-  }
-};
-
-class radix_tree {
- public:
-  radix_tree() {
-    this->root = std::make_shared<radix_tree_node>(radix_tree_node());
-  }
-
-  ~radix_tree() {}
-
-  int insert(
-      const std::string &path,
-      std::function<void(coro_http_request &req, coro_http_response &resp)>
-          handler,
-      const std::string &method) {
-    auto root = this->root;
-    int i = 0, n = path.size(), param_count = 0, code = 0;
-    while (i < n) {
-      if (!root->indices.empty() &&
-          (root->indices[0] == type_asterisk || path[i] == type_asterisk ||
-           (path[i] != type_colon && root->indices[0] == type_colon) ||
-           (path[i] == type_colon && root->indices[0] != type_colon) ||
-           (path[i] == type_colon && root->indices[0] == type_colon &&
-            path.substr(i + 1, find_pos(path, type_slash, i) - i - 1) !=
-                root->children[0]->path))) {
-        code = -1;
-        break;
-      }
-
-      auto child = root->get_child(path[i]);
-      if (!child) {
-        auto p = find_pos(path, type_colon, i);
-
-        if (p == n) {
-          p = find_pos(path, type_asterisk, i);
-
-          root = root->insert_child(path[i], std::make_shared<radix_tree_node>(
-                                                 path.substr(i, p - i)));
 
-          if (p < n) {
-            root = root->insert_child(
-                type_asterisk,
-                std::make_shared<radix_tree_node>(path.substr(p + 1)));
-            ++param_count;
-          }
-
-          code = root->add_handler(handler, method);
-          break;
+    route_node *node = &root_;
+    std::vector<std::string> names;
+    // only used by the routes with "{}", ":name" doesn't capture.
+    std::string pattern;
+    bool has_braces = false;
+    size_t pos = 0;
+    while (true) {
+      size_t end = path.find(type_slash, pos);
+      std::string_view seg = path.substr(pos, end - pos);
+      auto kind = kind_of(seg);
+
+      if (kind == segment_kind::rest) {
+        if (end != std::string_view::npos) {
+          CINATRA_LOG_WARNING << path << ", * must be the last segment";
+          return nullptr;
         }
-
-        root = root->insert_child(
-            path[i], std::make_shared<radix_tree_node>(path.substr(i, p - i)));
-
-        i = find_pos(path, type_slash, p);
-
-        root = root->insert_child(
-            type_colon,
-            std::make_shared<radix_tree_node>(path.substr(p + 1, i - p - 1)));
-        ++param_count;
-
-        if (i == n) {
-          code = root->add_handler(handler, method);
-          break;
+        names.emplace_back(seg.substr(1));
+        if (names.size() > CINATRA_MAX_ROUTE_PARAMS) {
+          return too_many_params(path);
+        }
+        if (node->catch_all) {
+          return conflict(path, *node->catch_all, names);
         }
+        node->catch_all = std::make_unique<route_entry>();
+        node->catch_all->param_names = std::move(names);
+        return node->catch_all.get();
       }
-      else {
-        root = child;
 
-        if (path[i] == type_colon) {
-          ++param_count;
-          i += root->path.size() + 1;
+      if (kind == segment_kind::regex) {
+        return insert_regex(is_literal_prefix(path, pos) ? node : &root_,
+                            path);
+      }
 
-          if (i == n) {
-            code = root->add_handler(handler, method);
-            break;
-          }
+      if (kind == segment_kind::literal) {
+        auto it = node->children.find(seg);
+        if (it == node->children.end()) {
+          auto child = std::make_unique<route_node>();
+          child->segment = seg;
+          std::string_view key = child->segment;
+          it = node->children.emplace(key, std::move(child)).first;
         }
-        else {
-          auto j = 0UL;
-          auto m = root->path.size();
-
-          for (; i < n && j < m && path[i] == root->path[j]; ++i, ++j) {
-          }
-
-          if (j < m) {
-            std::shared_ptr<radix_tree_node> child(
-                std::make_shared<radix_tree_node>(root->path.substr(j)));
-            child->handler = root->handler;
-            child->indices = root->indices;
-            child->children = root->children;
-
-            root->path = root->path.substr(0, j);
-            root->handler = {};
-            root->indices = child->path[0];
-            root->children = {child};
-          }
-
-          if (i == n) {
-            code = root->add_handler(handler, method);
-            break;
-          }
+        node = it->second.get();
+        pattern += seg;
+      }
+      else {
+        // ":name" and "{}" share the wildcard node of this depth.
+        bool is_braces = kind == segment_kind::braces;
+        has_braces |= is_braces;
+        names.emplace_back(is_braces ? "" : seg.substr(1));
+        if (!node->wildcard) {
+          node->wildcard = std::make_unique<route_node>();
         }
+        node = node->wildcard.get();
+        pattern += is_braces ? "([^/]+)" : "[^/]+";
       }
-    }
 
-    if (param_count > this->root->max_params)
-      this->root->max_params = param_count;
-
-    return code;
-  }
-
-  int coro_insert(const std::string &path,
-                  std::function<async_simple::coro::Lazy<void>(
-                      coro_http_request &req, coro_http_response &resp)>
-                      coro_handler,
-                  std::string &method) {
-    auto root = this->root;
-    int i = 0, n = path.size(), param_count = 0, code = 0;
-    while (i < n) {
-      if (!root->indices.empty() &&
-          (root->indices[0] == type_asterisk || path[i] == type_asterisk ||
-           (path[i] != type_colon && root->indices[0] == type_colon) ||
-           (path[i] == type_colon && root->indices[0] != type_colon) ||
-           (path[i] == type_colon && root->indices[0] == type_colon &&
-            path.substr(i + 1, find_pos(path, type_slash, i) - i - 1) !=
-                root->children[0]->path))) {
-        code = -1;
+      if (end == std::string_view::npos) {
         break;
       }
+      pattern += type_slash;
+      pos = end + 1;
+    }
 
-      auto child = root->get_child(path[i]);
-      if (!child) {
-        auto p = find_pos(path, type_colon, i);
-
-        if (p == n) {
-          p = find_pos(path, type_asterisk, i);
-
-          root = root->insert_child(path[i], std::make_shared<radix_tree_node>(
-                                                 path.substr(i, p - i)));
-
-          if (p < n) {
-            root = root->insert_child(
-                type_asterisk,
-                std::make_shared<radix_tree_node>(path.substr(p + 1)));
-            ++param_count;
-          }
-
-          code = root->add_coro_handler(coro_handler, method);
-          break;
-        }
-
-        root = root->insert_child(
-            path[i], std::make_shared<radix_tree_node>(path.substr(i, p - i)));
+    if (names.size() > CINATRA_MAX_ROUTE_PARAMS) {
+      return too_many_params(path);
+    }
 
-        i = find_pos(path, type_slash, p);
+    if (node->entry) {
+      return conflict(path, *node->entry, names);
+    }
+    node->entry = std::make_unique<route_entry>();
+    auto entry = node->entry.get();
+    entry->param_names = std::move(names);
+    if (has_braces) {
+      entry->regex.emplace(pattern);
+      entry->pattern = std::move(pattern);
+    }
+    return entry;
+  }
 
-        root = root->insert_child(
-            type_colon,
-            std::make_shared<radix_tree_node>(path.substr(p + 1, i - p - 1)));
-        ++param_count;
+  // the values of params point to path.
+  const route_entry *match(std::string_view path, route_params &params,
+                           route_matches &matches) const {
+    params.size = 0;
+    params.names = nullptr;
+    auto entry = match(&root_, path, 0, params, matches);
+    if (entry) {
+      params.names = &entry->param_names;
+    }
+    return entry;
+  }
 
-        if (i == n) {
-          code = root->add_coro_handler(coro_handler, method);
-          break;
+ private:
+  const route_entry *match(const route_node *node, std::string_view path,
+                           size_t pos, route_params &params,
+                           route_matches &matches) const {
+    if (pos == std::string_view::npos) {
+      if (node->entry) {
+        auto entry = node->entry.get();
+        if (entry->regex) {
+          std::regex_match(path.begin(), path.end(), matches, *entry->regex);
         }
+        return entry;
       }
-      else {
-        root = child;
-
-        if (path[i] == type_colon) {
-          ++param_count;
-          i += root->path.size() + 1;
-
-          if (i == n) {
-            code = root->add_coro_handler(coro_handler, method);
-            break;
+    }
+    else {
+      size_t end = path.find(type_slash, pos);
+      std::string_view seg = path.substr(pos, end - pos);
+      size_t next = end == std::string_view::npos ? end : end + 1;
+
+      if (!node->children.empty()) {
+        if (auto it = node->children.find(seg); it != node->children.end()) {
+          if (auto entry = match(it->second.get(), path, next, params, matches);
+              entry) {
+            return entry;
           }
         }
-        else {
-          auto j = 0UL;
-          auto m = root->path.size();
-
-          for (; i < n && j < m && path[i] == root->path[j]; ++i, ++j) {
-          }
-
-          if (j < m) {
-            std::shared_ptr<radix_tree_node> child(
-                std::make_shared<radix_tree_node>(root->path.substr(j)));
-            child->coro_handler = root->coro_handler;
-            child->indices = root->indices;
-            child->children = root->children;
-
-            root->path = root->path.substr(0, j);
-            root->coro_handler = {};
-            root->indices = child->path[0];
-            root->children = {child};
-          }
+      }
 
-          if (i == n) {
-            code = root->add_coro_handler(coro_handler, method);
-            break;
-          }
+      if (node->wildcard && !seg.empty()) {
+        size_t size = params.size;
+        params.values[params.size++] = seg;
+        if (auto entry =
+                match(node->wildcard.get(), path, next, params, matches);
+            entry) {
+          return entry;
         }
+        params.size = size;
+      }
+
+      if (node->catch_all && pos < path.size()) {
+        params.values[params.size++] = path.substr(pos);
+        return node->catch_all.get();
       }
     }
 
-    if (param_count > this->root->max_params)
-      this->root->max_params = param_count;
+    for (auto &entry : node->regex_entries) {
+      if (std::regex_match(path.begin(), path.end(), matches, *entry->regex)) {
+        return entry.get();
+      }
+    }
 
-    return code;
+    return nullptr;
   }
 
-  parse_result get(const std::string &path, const std::string &method) {
-    std::unordered_map<std::string, std::string> params;
-    auto root = this->root;
-
-    int i = 0, n = path.size(), p;
-
-    while (i < n) {
-      if (root->indices.empty())
-        return parse_result();
-
-      if (root->indices[0] == type_colon) {
-        root = root->children[0];
-
-        p = find_pos(path, type_slash, i);
-        params[root->path] = path.substr(i, p - i);
-        i = p;
-      }
-      else if (root->indices[0] == type_asterisk) {
-        root = root->children[0];
-        params[root->path] = path.substr(i);
-        break;
-      }
-      else {
-        root = root->get_child(path[i]);
-        if (!root || path.substr(i, root->path.size()) != root->path)
-          return parse_result();
-        i += root->path.size();
+  route_entry *insert_regex(route_node *node, std::string_view path) {
+    std::string pattern = to_regex_pattern(path);
+    for (auto &entry : node->regex_entries) {
+      if (entry->pattern == pattern) {
+        CINATRA_LOG_WARNING << path << " has already registered.";
+        return nullptr;
       }
     }
 
-    return parse_result{true, root->get_handler(method), params};
+    auto entry = std::make_unique<route_entry>();
+    entry->regex.emplace(pattern);
+    entry->pattern = std::move(pattern);
+    return node->regex_entries.emplace_back(std::move(entry)).get();
   }
 
-  coro_result get_coro(const std::string &path, const std::string &method) {
-    std::unordered_map<std::string, std::string> params;
-    auto root = this->root;
+  enum class segment_kind { literal, param, braces, rest, regex };
 
-    int i = 0, n = path.size(), p;
+  static segment_kind kind_of(std::string_view seg) {
+    if (seg == "{}") {
+      return segment_kind::braces;
+    }
+    if (seg.size() > 1 && seg[0] == type_colon &&
+        !has_regex_char(seg.substr(1))) {
+      return segment_kind::param;
+    }
+    if (seg.starts_with(type_asterisk) && !has_regex_char(seg.substr(1))) {
+      return segment_kind::rest;
+    }
+    return has_regex_char(seg) ? segment_kind::regex : segment_kind::literal;
+  }
 
-    while (i < n) {
-      if (root->indices.empty())
-        return coro_result();
+  // two routes end at the same entry, such as "/a/:id" and "/a/{}", the
+  // first one is kept like the exact routes.
+  static route_entry *conflict(std::string_view path, const route_entry &entry,
+                               const std::vector<std::string> &names) {
+    if (entry.param_names == names) {
+      CINATRA_LOG_WARNING << path << " has already registered.";
+    }
+    else {
+      CINATRA_LOG_WARNING << path << " conflicts with a route registered "
+                          << "before, the params are not the same.";
+    }
+    return nullptr;
+  }
 
-      if (root->indices[0] == type_colon) {
-        root = root->children[0];
+  static std::string to_regex_pattern(std::string_view path) {
+    std::string pattern{path};
+    replace_all(pattern, "{}", "([^/]+)");
+    return pattern;
+  }
 
-        p = find_pos(path, type_slash, i);
-        params[root->path] = path.substr(i, p - i);
-        i = p;
+  // whether the part of the pattern before pos only matches itself: no '|'
+  // outside the groups and no quantifier on the '/' before pos.
+  static bool is_literal_prefix(std::string_view path, size_t pos) {
+    std::string_view rest = path.substr(pos);
+    if (pos > 0 && (rest.find_first_of("?*+") == 0 ||
+                    (rest.starts_with('{') && !rest.starts_with("{}")))) {
+      return false;
+    }
+
+    int depth = 0;
+    bool in_class = false;
+    for (size_t i = 0; i < path.size(); i++) {
+      char c = path[i];
+      if (c == '\\') {
+        i++;
       }
-      else if (root->indices[0] == type_asterisk) {
-        root = root->children[0];
-        params[root->path] = path.substr(i);
-        break;
+      else if (in_class) {
+        in_class = c != ']';
       }
-      else {
-        root = root->get_child(path[i]);
-        if (!root || path.substr(i, root->path.size()) != root->path)
-          return coro_result();
-        i += root->path.size();
+      else if (c == '[') {
+        in_class = true;
+      }
+      else if (c == '(') {
+        depth++;
+      }
+      else if (c == ')') {
+        depth--;
+      }
+      else if (c == '|' && depth == 0) {
+        return false;
       }
     }
+    return true;
+  }
 
-    return coro_result{true, root->get_coro_handler(method), params};
+  static bool has_regex_char(std::string_view seg) {
+    return seg.find_first_of("\\^$.|?*+()[]{}") != std::string_view::npos;
   }
 
- private:
-  int find_pos(const std::string &str, char target, int start) {
-    auto i = str.find(target, start);
-    return i == -1 ? str.size() : i;
+  route_entry *too_many_params(std::string_view path) {
+    CINATRA_LOG_WARNING << path << " has more than " << CINATRA_MAX_ROUTE_PARAMS
+                        << " params, you can define macro "
+                           "CINATRA_MAX_ROUTE_PARAMS to expand it.";
+    return nullptr;
   }
 
-  std::shared_ptr<radix_tree_node> root;
+  route_node root_;
 };
-}  // namespace cinatra
\ No newline at end of file
+}  // namespace cinatra
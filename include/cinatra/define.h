@@ -25,7 +25,7 @@ enum class http_method {
   OPTIONS,
   DEL,
 };
-enum class content_encoding { gzip, deflate, br, none };
+enum class content_encoding { gzip, deflate, br, zstd, none };
 constexpr inline auto GET = http_method::GET;
 constexpr inline auto POST = http_method::POST;
 constexpr inline auto DEL = http_method::DEL;
@@ -119,6 +119,7 @@ constexpr std::string_view DATE_SV = "Date: ";
 constexpr std::string_view CONN_KEEP_SV = "Connection: keep-alive\r\n";
 constexpr std::string_view CONN_CLOSE_SV = "Connection: close\r\n";
 constexpr std::string_view COLON_SV = ": ";
+constexpr std::string_view SET_COOKIE_SV = "Set-Cookie";
 
 struct chunked_result {
   std::error_code ec;
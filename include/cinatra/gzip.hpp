@@ -1,7 +1,12 @@
 #pragma once
 #include <zlib.h>
 
+#include <algorithm>
+#include <memory>
 #include <string_view>
+#include <vector>
+
+#include "string_resize.hpp"
 namespace cinatra::gzip_codec {
 // from https://github.com/chafey/GZipCodec
 
@@ -9,6 +14,133 @@ namespace cinatra::gzip_codec {
 #define windowBits 15
 #define GZIP_ENCODING 16
 
+namespace detail {
+struct z_context {
+  z_stream strm{};
+  bool is_inflate = false;
+  int level = 0;
+  int window_bits = 0;
+
+  ~z_context() {
+    if (is_inflate) {
+      inflateEnd(&strm);
+    }
+    else {
+      deflateEnd(&strm);
+    }
+  }
+};
+
+inline bool &z_pool_alive() {
+  thread_local bool alive = true;
+  return alive;
+}
+
+// The idle zlib states of a thread, a state is reset and reused instead of
+// allocated for every call, one deflate state is about 256KB.
+class z_context_pool {
+ public:
+  static z_context_pool *local() {
+    thread_local z_context_pool pool;
+    return z_pool_alive() ? &pool : nullptr;
+  }
+
+  ~z_context_pool() { z_pool_alive() = false; }
+
+  std::unique_ptr<z_context> acquire(bool is_inflate, int level,
+                                     int window_bits) {
+    for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+      auto &ctx = *it;
+      if (ctx->is_inflate != is_inflate || ctx->level != level ||
+          ctx->window_bits != window_bits) {
+        continue;
+      }
+      int ret =
+          is_inflate ? inflateReset(&ctx->strm) : deflateReset(&ctx->strm);
+      auto result = std::move(ctx);
+      idle_.erase(it);
+      if (ret == Z_OK) {
+        return result;
+      }
+      break;
+    }
+
+    auto ctx = std::make_unique<z_context>();
+    int ret = is_inflate ? inflateInit2(&ctx->strm, window_bits)
+                         : deflateInit2(&ctx->strm, level, Z_DEFLATED,
+                                        window_bits, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+      return nullptr;
+    }
+    ctx->is_inflate = is_inflate;
+    ctx->level = level;
+    ctx->window_bits = window_bits;
+    return ctx;
+  }
+
+  void release(std::unique_ptr<z_context> ctx) {
+    if (ctx && idle_.size() < max_idle) {
+      idle_.push_back(std::move(ctx));
+    }
+  }
+
+ private:
+  static constexpr size_t max_idle = 8;
+  std::vector<std::unique_ptr<z_context>> idle_;
+};
+
+// a zlib state borrowed from the pool of the current thread.
+class z_context_guard {
+ public:
+  z_context_guard(bool is_inflate, int level, int window_bits) {
+    if (auto pool = z_context_pool::local(); pool) {
+      ctx_ = pool->acquire(is_inflate, level, window_bits);
+    }
+  }
+  z_context_guard(const z_context_guard &) = delete;
+  z_context_guard &operator=(const z_context_guard &) = delete;
+
+  ~z_context_guard() {
+    if (auto pool = z_context_pool::local(); pool) {
+      pool->release(std::move(ctx_));
+    }
+  }
+
+  z_stream *get() { return ctx_ ? &ctx_->strm : nullptr; }
+
+ private:
+  std::unique_ptr<z_context> ctx_;
+};
+
+// run deflate or inflate until the input is consumed, the output is written
+// to the end of out directly. Return the last result of zlib.
+inline int run_stream(z_stream *strm, std::string_view in, std::string &out,
+                      int flush, bool is_inflate) {
+  strm->next_in = (Bytef *)in.data();
+  strm->avail_in = (uInt)in.size();
+  size_t reserve = is_inflate ? (std::max)(in.size() * 3, (size_t)CHUNK)
+                              : deflateBound(strm, (uLong)in.size()) + 16;
+  int ret;
+  while (true) {
+    size_t old_size = out.size();
+    cinatra::detail::resize(out, old_size + reserve);
+    strm->next_out = (Bytef *)out.data() + old_size;
+    strm->avail_out = (uInt)reserve;
+    ret = is_inflate ? ::inflate(strm, flush) : ::deflate(strm, flush);
+    out.resize(out.size() - strm->avail_out);
+    if (ret == Z_STREAM_END || (ret != Z_OK && ret != Z_BUF_ERROR)) {
+      break;
+    }
+    if (strm->avail_out != 0) {
+      // all the input is consumed and the output is flushed.
+      break;
+    }
+    reserve = (std::max)(reserve, (size_t)CHUNK);
+  }
+  return ret;
+}
+}  // namespace detail
+
 // GZip Compression
 // @param data - the data to compress (does not have to be string, can be binary
 // data)
@@ -18,31 +150,12 @@ namespace cinatra::gzip_codec {
 // @return - true on success, false on failure
 inline bool compress(std::string_view data, std::string &compressed_data,
                      int level = -1) {
-  unsigned char out[CHUNK];
-  z_stream strm;
-  strm.zalloc = Z_NULL;
-  strm.zfree = Z_NULL;
-  strm.opaque = Z_NULL;
-  if (deflateInit2(&strm, level, Z_DEFLATED, windowBits | GZIP_ENCODING, 8,
-                   Z_DEFAULT_STRATEGY) != Z_OK) {
-    return false;
-  }
-  strm.next_in = (unsigned char *)data.data();
-  strm.avail_in = (uInt)data.length();
-  do {
-    int have;
-    strm.avail_out = CHUNK;
-    strm.next_out = out;
-    if (deflate(&strm, Z_FINISH) == Z_STREAM_ERROR) {
-      return false;
-    }
-    have = CHUNK - strm.avail_out;
-    compressed_data.append((char *)out, have);
-  } while (strm.avail_out == 0);
-  if (deflateEnd(&strm) != Z_OK) {
+  detail::z_context_guard ctx(false, level, windowBits | GZIP_ENCODING);
+  if (ctx.get() == nullptr) {
     return false;
   }
-  return true;
+  return detail::run_stream(ctx.get(), data, compressed_data, Z_FINISH,
+                            false) == Z_STREAM_END;
 }
 
 // GZip Decompression
@@ -50,42 +163,13 @@ inline bool compress(std::string_view data, std::string &compressed_data,
 // @param data - the resulting uncompressed data (may contain binary data)
 // @return - true on success, false on failure
 inline bool uncompress(std::string_view compressed_data, std::string &data) {
-  int ret;
-  unsigned have;
-  z_stream strm;
-  unsigned char out[CHUNK];
-
-  strm.zalloc = Z_NULL;
-  strm.zfree = Z_NULL;
-  strm.opaque = Z_NULL;
-  strm.avail_in = 0;
-  strm.next_in = Z_NULL;
-  if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
-    return false;
-  }
-
-  strm.avail_in = (uInt)compressed_data.length();
-  strm.next_in = (unsigned char *)compressed_data.data();
-  do {
-    strm.avail_out = CHUNK;
-    strm.next_out = out;
-    ret = inflate(&strm, Z_NO_FLUSH);
-    switch (ret) {
-      case Z_NEED_DICT:
-      case Z_DATA_ERROR:
-      case Z_MEM_ERROR:
-        inflateEnd(&strm);
-        return false;
-    }
-    have = CHUNK - strm.avail_out;
-    data.append((char *)out, have);
-  } while (strm.avail_out == 0);
-
-  if (inflateEnd(&strm) != Z_OK) {
+  detail::z_context_guard ctx(true, 0, 16 + MAX_WBITS);
+  if (ctx.get() == nullptr) {
     return false;
   }
-
-  return true;
+  int ret = detail::run_stream(ctx.get(), compressed_data, data, Z_NO_FLUSH,
+                               true);
+  return ret == Z_STREAM_END || ret == Z_OK || ret == Z_BUF_ERROR;
 }
 
 inline int compress_file(const char *src_file, const char *out_file_name) {
@@ -141,162 +225,125 @@ inline int uncompress_file(const char *src_file, const char *out_file_name) {
   return 0;
 }
 
+// raw deflate without the zlib header, the data is flushed by Z_SYNC_FLUSH.
 inline bool inflate(std::string_view str_src, std::string &str_dest) {
-  int err = Z_DATA_ERROR;
-  // Create stream
-  z_stream zs = {0};
-  // Set output data streams, do this here to avoid overwriting on recursive
-  // calls
-  const int OUTPUT_BUF_SIZE = 8192;
-  Bytef bytes_out[OUTPUT_BUF_SIZE] = {0};
-
-  // Initialise the z_stream
-  err = ::inflateInit2(&zs, -15);
-  if (err != Z_OK) {
+  detail::z_context_guard ctx(true, 0, -15);
+  if (ctx.get() == nullptr) {
     return false;
   }
+  int ret =
+      detail::run_stream(ctx.get(), str_src, str_dest, Z_SYNC_FLUSH, true);
+  return ret == Z_STREAM_END || ret == Z_OK || ret == Z_BUF_ERROR;
+}
 
-  // Use whatever input is provided
-  zs.next_in = (Bytef *)(str_src.data());
-  zs.avail_in = str_src.length();
-
-  do {
-    try {
-      // Initialise stream values
-      // zs->zalloc = (alloc_func)0;
-      // zs->zfree = (free_func)0;
-      // zs->opaque = (voidpf)0;
-
-      zs.next_out = bytes_out;
-      zs.avail_out = OUTPUT_BUF_SIZE;
-
-      // Try to unzip the data
-      err = ::inflate(&zs, Z_SYNC_FLUSH);
-
-      // Is zip finished reading all currently available input and writing all
-      // generated output
-      if (err == Z_STREAM_END) {
-        // Finish up
-        [[maybe_unused]] int kerr = ::inflateEnd(&zs);
-
-        // Got a good result, set the size to the amount unzipped in this call
-        // (including all recursive calls)
-
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
-        return true;
-      }
-      else if ((err == Z_OK) && (zs.avail_out == 0) && (zs.avail_in != 0)) {
-        // Output array was not big enough, call recursively until there is
-        // enough space
-
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
+inline bool deflate(std::string_view str_src, std::string &str_dest) {
+  detail::z_context_guard ctx(false, 1, -15);
+  if (ctx.get() == nullptr) {
+    return false;
+  }
+  int ret =
+      detail::run_stream(ctx.get(), str_src, str_dest, Z_SYNC_FLUSH, false);
+  if (ret != Z_OK && ret != Z_BUF_ERROR) {
+    return false;
+  }
+  // subtract 4 to remove the extra 00 00 ff ff added to the end of the deflat
+  // function
+  str_dest.resize(str_dest.size() - 4);
+  return true;
+}
 
-        continue;
-      }
-      else if ((err == Z_OK) && (zs.avail_in == 0)) {
-        // All available input has been processed, everything ok.
-        // Set the size to the amount unzipped in this call (including all
-        // recursive calls)
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
+// A raw deflate stream kept across the messages, such as permessage-deflate
+// with context takeover, the window of the earlier messages is reused.
+class deflate_stream {
+ public:
+  // window_bits is 9 to 15, zlib doesn't support 8 for raw deflate.
+  bool init(int level, int window_bits) {
+    auto ctx = std::make_unique<detail::z_context>();
+    if (deflateInit2(&ctx->strm, level, Z_DEFLATED, -window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    ctx->level = level;
+    ctx->window_bits = -window_bits;
+    ctx_ = std::move(ctx);
+    return true;
+  }
 
-        [[maybe_unused]] int kerr = ::inflateEnd(&zs);
+  bool valid() const { return ctx_ != nullptr; }
 
-        break;
-      }
-      else {
-        return false;
-      }
-    } catch (...) {
+  // compress a piece of the message and flush it, the end of the message is
+  // without the trailing 00 00 ff ff.
+  bool compress(std::string_view data, std::string &out, bool finish = true) {
+    if (ctx_ == nullptr) {
       return false;
     }
-  } while (true);
-
-  return err == Z_OK;
-}
+    int ret =
+        detail::run_stream(&ctx_->strm, data, out, Z_SYNC_FLUSH, false);
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      return false;
+    }
+    if (finish) {
+      out.resize(out.size() - 4);
+    }
+    return true;
+  }
 
-inline bool deflate(std::string_view str_src, std::string &str_dest) {
-  int err = Z_DATA_ERROR;
-  // Create stream
-  z_stream zs = {0};
-  // Set output data streams, do this here to avoid overwriting on recursive
-  // calls
-  const int OUTPUT_BUF_SIZE = 8192;
-  Bytef bytes_out[OUTPUT_BUF_SIZE] = {0};
-
-  // Initialise the z_stream
-  err = ::deflateInit2(&zs, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
-  if (err != Z_OK) {
-    return false;
+  // forget the window, the next message is compressed alone.
+  void reset() {
+    if (ctx_) {
+      deflateReset(&ctx_->strm);
+    }
   }
-  // Use whatever input is provided
-  zs.next_in = (Bytef *)(str_src.data());
-  zs.avail_in = str_src.length();
-
-  do {
-    try {
-      // Initialise stream values
-      // zs->zalloc = (alloc_func)0;
-      // zs->zfree = (free_func)0;
-      // zs->opaque = (voidpf)0;
-
-      zs.next_out = bytes_out;
-      zs.avail_out = OUTPUT_BUF_SIZE;
-
-      // Try to unzip the data
-      err = ::deflate(&zs, Z_SYNC_FLUSH);
-
-      // Is zip finished reading all currently available input and writing all
-      // generated output
-      if (err == Z_STREAM_END) {
-        // Finish up
-        [[maybe_unused]] int kerr = ::deflateEnd(&zs);
-
-        // Got a good result, set the size to the amount unzipped in this call
-        // (including all recursive calls)
-
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
-        return true;
-      }
-      else if ((err == Z_OK) && (zs.avail_out == 0) && (zs.avail_in != 0)) {
-        // Output array was not big enough, call recursively until there is
-        // enough space
 
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
+ private:
+  std::unique_ptr<detail::z_context> ctx_;
+};
 
-        continue;
-      }
-      else if ((err == Z_OK) && (zs.avail_in == 0)) {
-        // All available input has been processed, everything ok.
-        // Set the size to the amount unzipped in this call (including all
-        // recursive calls)
-        str_dest.append((const char *)bytes_out,
-                        OUTPUT_BUF_SIZE - zs.avail_out);
+// The raw inflate stream of the messages of a deflate_stream.
+class inflate_stream {
+ public:
+  bool init(int window_bits) {
+    auto ctx = std::make_unique<detail::z_context>();
+    if (inflateInit2(&ctx->strm, -window_bits) != Z_OK) {
+      return false;
+    }
+    ctx->is_inflate = true;
+    ctx->window_bits = -window_bits;
+    ctx_ = std::move(ctx);
+    return true;
+  }
 
-        [[maybe_unused]] int kerr = ::deflateEnd(&zs);
+  bool valid() const { return ctx_ != nullptr; }
 
-        break;
-      }
-      else {
-        return false;
-      }
-    } catch (...) {
+  // decompress a piece of the message, the trailing 00 00 ff ff removed by
+  // the sender is restored at the end of the message.
+  bool decompress(std::string_view data, std::string &out,
+                  bool finish = true) {
+    if (ctx_ == nullptr) {
       return false;
     }
-  } while (true);
+    int ret = detail::run_stream(&ctx_->strm, data, out, Z_SYNC_FLUSH, true);
+    if ((ret == Z_OK || ret == Z_BUF_ERROR) && finish) {
+      static constexpr char tail[] = {'\x00', '\x00', '\xff', '\xff'};
+      ret = detail::run_stream(&ctx_->strm, {tail, sizeof(tail)}, out,
+                               Z_SYNC_FLUSH, true);
+    }
+    if (ret == Z_STREAM_END) {
+      // the sender finished the stream, the next message begins a new one.
+      inflateReset(&ctx_->strm);
+      return true;
+    }
+    return ret == Z_OK || ret == Z_BUF_ERROR;
+  }
 
-  if (err == Z_OK) {
-    // subtract 4 to remove the extra 00 00 ff ff added to the end of the deflat
-    // function
-    str_dest = str_dest.substr(0, str_dest.length() - 4);
-    return true;
+  void reset() {
+    if (ctx_) {
+      inflateReset(&ctx_->strm);
+    }
   }
 
-  return false;
-}
+ private:
+  std::unique_ptr<detail::z_context> ctx_;
+};
 
 }  // namespace cinatra::gzip_codec
\ No newline at end of file
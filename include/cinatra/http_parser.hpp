@@ -7,6 +7,7 @@
 #include <string_view>
 #include <unordered_map>
 
+#include "buffer_pool.hpp"
 #include "cinatra/utils.hpp"
 #include "cinatra_log_wrapper.hpp"
 #include "define.h"
@@ -26,10 +27,102 @@ inline bool iequal0(std::string_view a, std::string_view b) {
   });
 }
 
+// the headers used by cinatra, they are indexed once after the header is
+// parsed, so looking up them is an array access.
+enum class http_header_id : uint8_t {
+  content_length,
+  content_type,
+  content_encoding,
+  transfer_encoding,
+  connection,
+  host,
+  cookie,
+  accept_encoding,
+  accept_ranges,
+  upgrade,
+  range,
+  if_range,
+  if_none_match,
+  if_modified_since,
+  location,
+  sec_websocket_key,
+  sec_websocket_extensions,
+  sec_websocket_protocol,
+  unknown,
+};
+
+inline constexpr std::array<std::string_view,
+                            static_cast<size_t>(http_header_id::unknown)>
+    known_header_names = {
+        "content-length",
+        "content-type",
+        "content-encoding",
+        "transfer-encoding",
+        "connection",
+        "host",
+        "cookie",
+        "accept-encoding",
+        "accept-ranges",
+        "upgrade",
+        "range",
+        "if-range",
+        "if-none-match",
+        "if-modified-since",
+        "location",
+        "sec-websocket-key",
+        "sec-websocket-extensions",
+        "sec-websocket-protocol",
+};
+
+inline http_header_id to_header_id(std::string_view name) {
+  for (size_t i = 0; i < known_header_names.size(); i++) {
+    auto known = known_header_names[i];
+    auto equal_lower = [](char a, char b) {
+      return a == tolower(static_cast<unsigned char>(b));
+    };
+    if (known.size() == name.size() &&
+        std::equal(known.begin(), known.end(), name.begin(), equal_lower)) {
+      return static_cast<http_header_id>(i);
+    }
+  }
+  return http_header_id::unknown;
+}
+
+// whether the comma separated value has the token, ignore case.
+inline bool has_header_token(std::string_view value, std::string_view token) {
+  for (auto item : split_sv(value, ",")) {
+    if (iequal0(trim_sv(item), token)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 class http_parser {
  public:
+  // give the header array back to the buffer pool, the headers parsed are
+  // gone. The next parse takes an array again.
+  void release_headers() {
+    header_buf_.release();
+    num_headers_ = 0;
+  }
+
+  // move the headers parsed to an array of their number, for a request kept
+  // for long, such as the upgrade request of a websocket.
+  void shrink_headers() {
+    size_t size = (std::max)(num_headers_, size_t(1)) * sizeof(http_header);
+    if (buffer_pool::class_size(size) >= header_buf_.capacity()) {
+      return;
+    }
+    pooled_buffer buf;
+    buf.reserve(size, 0);
+    std::memcpy(buf.data(), header_buf_.data(),
+                num_headers_ * sizeof(http_header));
+    header_buf_ = std::move(buf);
+  }
+
   void parse_body_len() {
-    auto header_value = this->get_header_value("content-length"sv);
+    auto header_value = get_header_value(http_header_id::content_length);
     if (header_value.empty()) {
       body_len_ = 0;
     }
@@ -46,15 +139,22 @@ class http_parser {
   int parse_response(const char *data, size_t size, int last_len) {
     int minor_version;
 
+    reserve_headers();
     num_headers_ = CINATRA_MAX_HTTP_HEADER_FIELD_SIZE;
     const char *msg;
     size_t msg_len;
     header_len_ = cinatra::detail::phr_parse_response(
-        data, size, &minor_version, &status_, &msg, &msg_len, headers_.data(),
+        data, size, &minor_version, &status_, &msg, &msg_len, headers(),
         &num_headers_, last_len);
     msg_ = {msg, msg_len};
+    if (header_len_ >= 0) {
+      index_headers();
+    }
+    else {
+      known_headers_.fill({});
+    }
     parse_body_len();
-    if (header_len_ < 0) [[unlikely]] {
+    if (header_len_ == -1) [[unlikely]] {
       CINATRA_LOG_WARNING << "parse http head failed";
       if (num_headers_ == CINATRA_MAX_HTTP_HEADER_FIELD_SIZE) {
         output_error();
@@ -66,6 +166,7 @@ class http_parser {
   int parse_request(const char *data, size_t size, int last_len) {
     int minor_version;
 
+    reserve_headers();
     num_headers_ = CINATRA_MAX_HTTP_HEADER_FIELD_SIZE;
 
     const char *method;
@@ -76,19 +177,23 @@ class http_parser {
     bool has_query{};
     header_len_ = detail::phr_parse_request(
         data, size, &method, &method_len, &url, &url_len, &minor_version,
-        headers_.data(), &num_headers_, last_len, has_connection_, has_close_,
+        headers(), &num_headers_, last_len, has_connection_, has_close_,
         has_upgrade_, has_query);
 
     if (header_len_ < 0) [[unlikely]] {
-      CINATRA_LOG_WARNING << "parse http head failed";
-      if (num_headers_ == CINATRA_MAX_HTTP_HEADER_FIELD_SIZE) {
-        output_error();
+      // -2 means the header is incomplete, need to read more data.
+      if (header_len_ == -1) {
+        CINATRA_LOG_WARNING << "parse http head failed";
+        if (num_headers_ == CINATRA_MAX_HTTP_HEADER_FIELD_SIZE) {
+          output_error();
+        }
       }
       return header_len_;
     }
 
     method_ = {method, method_len};
     url_ = {url, url_len};
+    index_headers();
 
     auto methd_type = method_type(method_);
     if (methd_type == http_method::GET || methd_type == http_method::HEAD) {
@@ -117,10 +222,17 @@ class http_parser {
 
   bool has_upgrade() { return has_upgrade_; }
 
+  std::string_view get_header_value(http_header_id id) const {
+    return known_headers_[static_cast<size_t>(id)];
+  }
+
   std::string_view get_header_value(std::string_view key) const {
+    if (auto id = to_header_id(key); id != http_header_id::unknown) {
+      return get_header_value(id);
+    }
     for (size_t i = 0; i < num_headers_; i++) {
-      if (iequal0(headers_[i].name, key))
-        return headers_[i].value;
+      if (iequal0(headers()[i].name, key))
+        return headers()[i].value;
     }
     return {};
   }
@@ -139,7 +251,8 @@ class http_parser {
   }
 
   bool is_chunked() const {
-    auto transfer_encoding = this->get_header_value("transfer-encoding"sv);
+    auto transfer_encoding =
+        get_header_value(http_header_id::transfer_encoding);
     if (transfer_encoding == "chunked"sv) {
       return true;
     }
@@ -147,8 +260,11 @@ class http_parser {
     return false;
   }
 
+  // the type of the body, computed once when the header is parsed.
+  content_type get_content_type() const { return content_type_; }
+
   bool is_multipart() {
-    auto content_type = get_header_value("Content-Type");
+    auto content_type = get_header_value(http_header_id::content_type);
     if (content_type.empty()) {
       return false;
     }
@@ -161,7 +277,7 @@ class http_parser {
   }
 
   std::string_view get_boundary() {
-    auto content_type = get_header_value("Content-Type");
+    auto content_type = get_header_value(http_header_id::content_type);
     size_t pos = content_type.find("=--");
     if (pos == std::string_view::npos) {
       return "";
@@ -171,12 +287,12 @@ class http_parser {
   }
 
   bool is_resp_ranges() const {
-    auto value = this->get_header_value("Accept-Ranges"sv);
+    auto value = get_header_value(http_header_id::accept_ranges);
     return !value.empty();
   }
 
   bool is_websocket() const {
-    auto upgrade = this->get_header_value("Upgrade"sv);
+    auto upgrade = get_header_value(http_header_id::upgrade);
     return upgrade == "WebSocket"sv || upgrade == "websocket"sv;
   }
 
@@ -184,7 +300,7 @@ class http_parser {
     if (is_websocket()) {
       return true;
     }
-    auto val = this->get_header_value("connection"sv);
+    auto val = get_header_value(http_header_id::connection);
     if (val.empty() || iequal0(val, "keep-alive"sv)) {
       return true;
     }
@@ -201,7 +317,7 @@ class http_parser {
   int64_t total_len() const { return header_len_ + body_len_; }
 
   bool is_location() {
-    auto location = this->get_header_value("Location"sv);
+    auto location = get_header_value(http_header_id::location);
     return !location.empty();
   }
 
@@ -212,7 +328,7 @@ class http_parser {
   std::string_view url() const { return url_; }
 
   std::span<http_header> get_headers() {
-    return {headers_.data(), num_headers_};
+    return {headers(), num_headers_};
   }
 
   void parse_query(std::string_view str) {
@@ -241,6 +357,62 @@ class http_parser {
   }
 
  private:
+  void reserve_headers() {
+    header_buf_.reserve(CINATRA_MAX_HTTP_HEADER_FIELD_SIZE * sizeof(http_header),
+                        0);
+  }
+
+  http_header *headers() {
+    return reinterpret_cast<http_header *>(header_buf_.data());
+  }
+
+  const http_header *headers() const {
+    return reinterpret_cast<const http_header *>(header_buf_.data());
+  }
+
+  void index_headers() {
+    known_headers_.fill({});
+    for (size_t i = 0; i < num_headers_; i++) {
+      auto id = to_header_id(headers()[i].name);
+      if (id == http_header_id::unknown) {
+        continue;
+      }
+      // keep the first one like the linear lookup.
+      auto &value = known_headers_[static_cast<size_t>(id)];
+      if (value.data() == nullptr) {
+        value = headers()[i].value;
+      }
+    }
+
+    auto connection = get_header_value(http_header_id::connection);
+    has_connection_ = connection.data() != nullptr;
+    has_close_ = has_connection_ && has_header_token(connection, "close");
+    has_upgrade_ = has_connection_ && has_header_token(connection, "upgrade");
+    content_type_ = parse_content_type();
+  }
+
+  content_type parse_content_type() const {
+    if (is_chunked()) {
+      return content_type::chunked;
+    }
+
+    auto type = get_header_value(http_header_id::content_type);
+    if (type.empty()) {
+      return content_type::unknown;
+    }
+    if (type.find("application/x-www-form-urlencoded") !=
+        std::string_view::npos) {
+      return content_type::urlencoded;
+    }
+    if (type.find("multipart/form-data") != std::string_view::npos) {
+      return content_type::multipart;
+    }
+    if (type.find("application/octet-stream") != std::string_view::npos) {
+      return content_type::octet_stream;
+    }
+    return content_type::string;
+  }
+
   void output_error() {
     CINATRA_LOG_ERROR << "the field of http head is out of max limit "
                       << CINATRA_MAX_HTTP_HEADER_FIELD_SIZE
@@ -257,7 +429,11 @@ class http_parser {
   bool has_connection_{};
   bool has_close_{};
   bool has_upgrade_{};
-  std::array<http_header, CINATRA_MAX_HTTP_HEADER_FIELD_SIZE> headers_;
+  // taken from the buffer pool by the first parse, 3.2KB by default.
+  pooled_buffer header_buf_;
+  std::array<std::string_view, static_cast<size_t>(http_header_id::unknown)>
+      known_headers_;
+  content_type content_type_ = content_type::unknown;
   std::string_view method_;
   std::string_view url_;
   std::string_view full_url_;
@@ -509,4 +509,18 @@ inline std::string_view get_mime_type(std::string_view extension) {
 
   return it->second;
 }
+
+// the text formats are worth compressing, the images, videos and archives
+// are compressed already. The parameters like charset are ignored.
+inline bool is_compressible_mime(std::string_view mime) {
+  mime = mime.substr(0, mime.find(';'));
+  while (!mime.empty() && mime.back() == ' ') {
+    mime.remove_suffix(1);
+  }
+  return mime.starts_with("text/") || mime == "application/javascript" ||
+         mime == "application/x-javascript" || mime == "application/json" ||
+         mime == "application/xml" || mime == "image/svg+xml" ||
+         mime == "application/wasm" || mime.ends_with("+xml") ||
+         mime.ends_with("+json");
+}
 }  // namespace cinatra
@@ -8,8 +8,8 @@ class multipart_reader_t {
  public:
   multipart_reader_t(T *conn)
       : conn_(conn),
-        head_buf_(conn_->head_buf_),
-        chunked_buf_(conn_->chunked_buf_) {}
+        head_buf_(conn_->head_buf()),
+        chunked_buf_(conn_->chunked_buf()) {}
 
   async_simple::coro::Lazy<part_head_t> read_part_head(
       std::string_view boundary) {
@@ -116,8 +116,9 @@ class multipart_reader_t {
 
  private:
   T *conn_;
-  asio::streambuf &head_buf_;
-  asio::streambuf &chunked_buf_;
+  // the read buffers of the connection or the client.
+  decltype(std::declval<T &>().head_buf()) head_buf_;
+  decltype(std::declval<T &>().chunked_buf()) chunked_buf_;
 };
 
 template <typename T>
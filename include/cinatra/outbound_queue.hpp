@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "websocket.hpp"
+#include "ylt/coro_io/coro_io.hpp"
+
+namespace cinatra {
+enum class outbound_type : uint8_t {
+  // written as it is.
+  raw,
+  // framed, and compressed by permessage-deflate, by the writer.
+  ws_frame,
+  // a chunk of the chunked response, compressed by the writer if the response
+  // is compressed.
+  chunk,
+  // the shared frames of websocket_hub queued on the connection.
+  shared_frames,
+  // nothing to write, completed after the messages queued before it.
+  flush,
+};
+
+// A message queued to the writer of a connection, the framing is built by the
+// writer in head. An awaited write borrows the buffer of the producer, which
+// waits until it's written, a posted message owns its data.
+struct outbound_message {
+  using handler_t = coro_io::callback_awaitor<std::error_code>::awaitor_handler;
+
+  outbound_type type = outbound_type::raw;
+  opcode op = opcode::text;
+  bool eof = true;
+  // the bytes to write, the borrowed buffer or data.
+  std::string_view view;
+  std::string data;
+  std::string head;
+  std::error_code ec;
+  // resume the producer waiting for the message to be written.
+  std::optional<handler_t> on_written;
+  outbound_message *next = nullptr;
+};
+
+// A lock free queue of many producers and one consumer. The producers push to
+// an intrusive stack, the consumer takes the whole stack at once and reverses
+// it. A tag in the head tells whether the consumer is running, so the producer
+// which pushes to an idle queue is the one to start the consumer.
+class outbound_queue {
+ public:
+  outbound_queue() = default;
+  outbound_queue(const outbound_queue &) = delete;
+  outbound_queue &operator=(const outbound_queue &) = delete;
+
+  ~outbound_queue() {
+    auto head = head_.load(std::memory_order_acquire);
+    while (head != nullptr && head != running_tag()) {
+      auto next = head->next;
+      delete head;
+      head = next;
+    }
+  }
+
+  // true if the consumer is idle, the caller must start it.
+  bool push(std::unique_ptr<outbound_message> msg) {
+    auto node = msg.release();
+    auto head = head_.load(std::memory_order_relaxed);
+    do {
+      node->next = head;
+    } while (!head_.compare_exchange_weak(head, node, std::memory_order_release,
+                                          std::memory_order_relaxed));
+    return head == nullptr;
+  }
+
+  // take all the messages in the order of push, nullptr if none. Only called
+  // by the consumer.
+  outbound_message *pop_all() {
+    auto head = head_.exchange(running_tag(), std::memory_order_acquire);
+    outbound_message *list = nullptr;
+    while (head != nullptr && head != running_tag()) {
+      auto next = head->next;
+      head->next = list;
+      list = head;
+      head = next;
+    }
+    return list;
+  }
+
+  // the consumer is going to stop, false if a message is pushed meanwhile.
+  bool try_stop() {
+    auto expected = running_tag();
+    return head_.compare_exchange_strong(expected, nullptr,
+                                         std::memory_order_acq_rel);
+  }
+
+  // nothing queued and the consumer is not running.
+  bool idle() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+ private:
+  static outbound_message *running_tag() {
+    static outbound_message tag;
+    return &tag;
+  }
+
+  std::atomic<outbound_message *> head_ = nullptr;
+};
+}  // namespace cinatra
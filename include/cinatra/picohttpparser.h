@@ -48,6 +48,17 @@
 #include <arm_neon.h>
 #endif
 
+// without a compile time ISA, choose the SSE4.2/AVX2/AVX-512 scanner by the
+// cpu features at runtime, so one binary runs well on every x86-64 machine.
+#if !defined(CINATRA_SSE) && !defined(CINATRA_AVX2) &&                \
+    !defined(CINATRA_ARM_OPT) && !defined(CINATRA_DISABLE_SIMD_DISPATCH) && \
+    (defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)))
+#define CINATRA_SIMD_DISPATCH
+#include <immintrin.h>
+
+#include <atomic>
+#endif
+
 #ifdef _MSC_VER
 #define ssize_t intptr_t
 #else
@@ -201,10 +212,190 @@ static const char *token_char_map =
     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
     "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
 
+#ifdef CINATRA_SIMD_DISPATCH
+enum class phr_kernel { scalar, sse42, avx2, avx512 };
+
+// the widest kernel the cpu supports.
+inline phr_kernel supported_phr_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) {
+    return phr_kernel::avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return phr_kernel::avx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return phr_kernel::sse42;
+  }
+  return phr_kernel::scalar;
+}
+
+// most header tokens are shorter than 32 bytes, SSE4.2 is the fastest for them,
+// AVX2 and AVX-512 only win on long values like big cookies and tokens, they
+// can be chosen by set_phr_kernel() for such traffic.
+inline phr_kernel detect_phr_kernel() {
+  auto kernel = supported_phr_kernel();
+  return kernel > phr_kernel::sse42 ? phr_kernel::sse42 : kernel;
+}
+
+inline std::atomic<phr_kernel> &phr_kernel_ref() {
+  static std::atomic<phr_kernel> kernel = detect_phr_kernel();
+  return kernel;
+}
+
+inline phr_kernel current_phr_kernel() {
+  return phr_kernel_ref().load(std::memory_order_relaxed);
+}
+
+// for test and benchmark, return false if the cpu doesn't support it.
+inline bool set_phr_kernel(phr_kernel kernel) {
+  if (kernel > supported_phr_kernel()) {
+    return false;
+  }
+  phr_kernel_ref().store(kernel, std::memory_order_relaxed);
+  return true;
+}
+
+/* ranges is the pairs of [lo, hi] like _mm_cmpestri, the kernels scan the full
+ * blocks and leave the tail to the scalar loop of the caller, except AVX-512
+ * which scans the tail by a masked load */
+__attribute__((target("sse4.2"))) inline const char *findchar_sse42(
+    const char *buf, const char *buf_end, const char *ranges, int ranges_size,
+    int *found) {
+  *found = 0;
+  if (likely(buf_end - buf >= 16)) {
+    __m128i ranges16 = _mm_loadu_si128((const __m128i *)ranges);
+
+    size_t left = (buf_end - buf) & ~15;
+    do {
+      __m128i b16 = _mm_loadu_si128((const __m128i *)buf);
+      int r = _mm_cmpestri(
+          ranges16, ranges_size, b16, 16,
+          _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+      if (unlikely(r != 16)) {
+        buf += r;
+        *found = 1;
+        break;
+      }
+      buf += 16;
+      left -= 16;
+    } while (likely(left != 0));
+  }
+  return buf;
+}
+
+template <int Pairs>
+__attribute__((target("avx2"))) inline const char *findchar_avx2_impl(
+    const char *buf, const char *buf_end, const char *ranges, int *found) {
+  __m256i lo[Pairs], span[Pairs];
+  for (int i = 0; i < Pairs; i++) {
+    unsigned char l = ranges[2 * i], h = ranges[2 * i + 1];
+    lo[i] = _mm256_set1_epi8((char)l);
+    span[i] = _mm256_set1_epi8((char)(h - l));
+  }
+
+  while (buf_end - buf >= 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)buf);
+    __m256i hit = _mm256_setzero_si256();
+    for (int i = 0; i < Pairs; i++) {
+      /* lo <= b <= hi is (b - lo) <= (hi - lo) unsigned */
+      __m256i d = _mm256_sub_epi8(b, lo[i]);
+      hit = _mm256_or_si256(
+          hit, _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[i]), d));
+    }
+    unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+    if (mask != 0) {
+      *found = 1;
+      return buf + __builtin_ctz(mask);
+    }
+    buf += 32;
+  }
+  return buf;
+}
+
+template <int Pairs>
+__attribute__((target("avx512f,avx512bw"))) inline const char *
+findchar_avx512_impl(const char *buf, const char *buf_end, const char *ranges,
+                     int *found) {
+  __m512i lo[Pairs], span[Pairs];
+  for (int i = 0; i < Pairs; i++) {
+    unsigned char l = ranges[2 * i], h = ranges[2 * i + 1];
+    lo[i] = _mm512_set1_epi8((char)l);
+    span[i] = _mm512_set1_epi8((char)(h - l));
+  }
+
+  while (buf < buf_end) {
+    size_t left = buf_end - buf;
+    __mmask64 valid = left >= 64 ? ~0ULL : (1ULL << left) - 1;
+    __m512i b = _mm512_maskz_loadu_epi8(valid, buf);
+    __mmask64 hit = 0;
+    for (int i = 0; i < Pairs; i++) {
+      hit |= _mm512_cmple_epu8_mask(_mm512_sub_epi8(b, lo[i]), span[i]);
+    }
+    hit &= valid;
+    if (hit != 0) {
+      *found = 1;
+      return buf + __builtin_ctzll(hit);
+    }
+    buf += left >= 64 ? 64 : left;
+  }
+  return buf;
+}
+
+/* most tokens end in the first 64 bytes, SSE4.2 finds them without the setup
+ * of the wide vectors, AVX2 or AVX-512 only scans the long values like cookies
+ * and tokens. */
+template <bool Avx512>
+inline const char *findchar_wide(const char *buf, const char *buf_end,
+                                 const char *ranges, int ranges_size,
+                                 int *found) {
+  const char *head_end = buf_end - buf > 64 ? buf + 64 : buf_end;
+  buf = findchar_sse42(buf, head_end, ranges, ranges_size, found);
+  if (*found || head_end == buf_end) {
+    return buf;
+  }
+
+  switch (ranges_size / 2) {
+#define FINDCHAR_WIDE_CASE(n)                                                \
+  case n:                                                                    \
+    buf = Avx512 ? findchar_avx512_impl<n>(buf, buf_end, ranges, found)      \
+                 : findchar_avx2_impl<n>(buf, buf_end, ranges, found);       \
+    break;
+    FINDCHAR_WIDE_CASE(1)
+    FINDCHAR_WIDE_CASE(2)
+    FINDCHAR_WIDE_CASE(3)
+    FINDCHAR_WIDE_CASE(4)
+    FINDCHAR_WIDE_CASE(5)
+    FINDCHAR_WIDE_CASE(6)
+    FINDCHAR_WIDE_CASE(7)
+    FINDCHAR_WIDE_CASE(8)
+#undef FINDCHAR_WIDE_CASE
+    default:
+      return buf;
+  }
+  if (*found || Avx512) {
+    return buf;
+  }
+  return findchar_sse42(buf, buf_end, ranges, ranges_size, found);
+}
+#endif
+
 static const char *findchar_fast(const char *buf, const char *buf_end,
                                  const char *ranges, int ranges_size,
                                  int *found) {
   *found = 0;
+#ifdef CINATRA_SIMD_DISPATCH
+  switch (current_phr_kernel()) {
+    case phr_kernel::avx512:
+      return findchar_wide<true>(buf, buf_end, ranges, ranges_size, found);
+    case phr_kernel::avx2:
+      return findchar_wide<false>(buf, buf_end, ranges, ranges_size, found);
+    case phr_kernel::sse42:
+      return findchar_sse42(buf, buf_end, ranges, ranges_size, found);
+    default:
+      return buf;
+  }
+#endif
 #ifdef CINATRA_SSE
   if (likely(buf_end - buf >= 16)) {
     __m128i ranges16 = _mm_loadu_si128((const __m128i *)ranges);
@@ -303,6 +494,16 @@ static const char *get_token_to_eol(const char *buf, const char *buf_end,
     }
   }
 #else
+#ifdef CINATRA_SIMD_DISPATCH
+  if (current_phr_kernel() != phr_kernel::scalar) {
+    static const char ALIGNED(16) ranges1[] = "\0\010\012\037\177\177";
+    int found;
+    buf = findchar_fast(buf, buf_end, ranges1, sizeof(ranges1) - 1, &found);
+    if (found)
+      goto FOUND_CTL;
+  }
+  else
+#endif
   /* find non-printable char within the next 8 bytes, this is the hottest code;
    * manually inlined */
   while (likely(buf_end - buf >= 8)) {
@@ -867,7 +1068,8 @@ static const char *parse_headers(const char *buf, const char *buf_end,
 #define ADVANCE_PATH(tok, toklen, has_query)                                  \
   do {                                                                        \
     const char *tok_start = buf;                                              \
-    static const char ALIGNED(16) ranges2[] = "\000\040\177\177";             \
+    /* stop at '?' too, the scalar loop below marks has_query */              \
+    static const char ALIGNED(16) ranges2[] = "\000\040??\177\177";           \
     int found2;                                                               \
     buf = findchar_fast(buf, buf_end, ranges2, sizeof(ranges2) - 1, &found2); \
     if (!found2) {                                                            \
@@ -956,14 +1158,14 @@ inline int phr_parse_request(const char *buf_start, size_t len,
     return r;
   }
 
-  if ((buf = parse_request(buf + last_len, buf_end, method, method_len, path,
-                           path_len, minor_version, headers, num_headers,
-                           max_headers, &r, has_connection, has_close,
-                           has_upgrade, has_query)) == NULL) {
+  if ((buf = parse_request(buf, buf_end, method, method_len, path, path_len,
+                           minor_version, headers, num_headers, max_headers,
+                           &r, has_connection, has_close, has_upgrade,
+                           has_query)) == NULL) {
     return r;
   }
 
-  return (int)(buf - buf_start - last_len);
+  return (int)(buf - buf_start);
 }
 
 inline const char *parse_response(const char *buf, const char *buf_end,
@@ -0,0 +1,235 @@
+#pragma once
+#ifdef CINATRA_ENABLE_SSL
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include <array>
+#include <asio/ssl.hpp>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "cinatra_log_wrapper.hpp"
+#include "define.h"
+
+namespace cinatra {
+struct ssl_server_config {
+  std::string cert_file;
+  std::string key_file;
+  std::string passwd;
+  // max number of sessions kept in the server side session cache, 0 means
+  // unlimited(openssl default is 20k).
+  size_t session_cache_size = 20 * 1024;
+  // how long a cached session or a ticket can be resumed.
+  std::chrono::seconds session_timeout = std::chrono::seconds(300);
+  // rotate the session ticket keys every interval, 0 disables stateless
+  // session tickets and only the session cache is used for resumption.
+  std::chrono::seconds ticket_key_rotation = std::chrono::seconds(3600);
+};
+
+// A small key ring for stateless session tickets: tickets are always issued
+// with the current key, tickets issued by the previous key are still accepted
+// but renewed, older tickets fall back to a full handshake.
+class ssl_ticket_keys {
+ public:
+  explicit ssl_ticket_keys(std::chrono::seconds rotation)
+      : rotation_(rotation) {
+    rotate(std::chrono::steady_clock::now());
+  }
+
+  static bool attach(SSL_CTX *ctx, std::shared_ptr<ssl_ticket_keys> keys) {
+    if (SSL_CTX_set_ex_data(ctx, ex_index(), keys.get()) != 1) {
+      return false;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &ticket_key_cb) == 1;
+#else
+    return SSL_CTX_set_tlsext_ticket_key_cb(ctx, &ticket_key_cb) == 1;
+#endif
+  }
+
+ private:
+  struct key_t {
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+  };
+
+  static int ex_index() {
+    static int index =
+        SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+  }
+
+  void rotate(std::chrono::steady_clock::time_point now) {
+    prev_ = cur_;
+    has_prev_ = created_ != std::chrono::steady_clock::time_point{};
+    RAND_bytes(cur_.name, sizeof(cur_.name));
+    RAND_bytes(cur_.aes_key, sizeof(cur_.aes_key));
+    RAND_bytes(cur_.hmac_key, sizeof(cur_.hmac_key));
+    created_ = now;
+  }
+
+  // copy the key used to encrypt a new ticket, rotate it when it is expired.
+  key_t encrypt_key() {
+    std::scoped_lock lock(mtx_);
+    auto now = std::chrono::steady_clock::now();
+    if (now - created_ >= rotation_) {
+      rotate(now);
+    }
+    return cur_;
+  }
+
+  // 1: current key, 2: previous key(ticket should be renewed), 0: unknown.
+  int decrypt_key(const unsigned char *name, key_t &key) {
+    std::scoped_lock lock(mtx_);
+    if (std::memcmp(name, cur_.name, sizeof(cur_.name)) == 0) {
+      key = cur_;
+      return 1;
+    }
+    if (has_prev_ && std::memcmp(name, prev_.name, sizeof(prev_.name)) == 0) {
+      key = prev_;
+      return 2;
+    }
+    return 0;
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  static bool init_hmac(EVP_MAC_CTX *hctx, unsigned char *hmac_key) {
+    OSSL_PARAM params[3];
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmac_key,
+                                                  32);
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                 (char *)"sha256", 0);
+    params[2] = OSSL_PARAM_construct_end();
+    return EVP_MAC_CTX_set_params(hctx, params) == 1;
+  }
+
+  static int ticket_key_cb(::SSL *ssl, unsigned char *key_name,
+                           unsigned char *iv, EVP_CIPHER_CTX *ctx,
+                           EVP_MAC_CTX *hctx, int enc) {
+#else
+  static bool init_hmac(HMAC_CTX *hctx, unsigned char *hmac_key) {
+    return HMAC_Init_ex(hctx, hmac_key, 32, EVP_sha256(), nullptr) == 1;
+  }
+
+  static int ticket_key_cb(::SSL *ssl, unsigned char *key_name,
+                           unsigned char *iv, EVP_CIPHER_CTX *ctx,
+                           HMAC_CTX *hctx, int enc) {
+#endif
+    auto self = static_cast<ssl_ticket_keys *>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_index()));
+    if (self == nullptr) {
+      return -1;
+    }
+
+    key_t key;
+    int ret = 1;
+    if (enc) {
+      key = self->encrypt_key();
+      if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+        return -1;
+      }
+      std::memcpy(key_name, key.name, sizeof(key.name));
+      if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aes_key,
+                             iv) != 1) {
+        return -1;
+      }
+    }
+    else {
+      ret = self->decrypt_key(key_name, key);
+      if (ret == 0) {
+        return 0;
+      }
+      if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aes_key,
+                             iv) != 1) {
+        return -1;
+      }
+    }
+
+    if (!init_hmac(hctx, key.hmac_key)) {
+      return -1;
+    }
+    return ret;
+  }
+
+  std::mutex mtx_;
+  std::chrono::seconds rotation_;
+  std::chrono::steady_clock::time_point created_{};
+  key_t cur_{};
+  key_t prev_{};
+  bool has_prev_ = false;
+};
+
+// The server side ssl context, it is created only once and shared by all the
+// connections, so the cert chain and private key are loaded only once and
+// the session cache and ticket keys can be used by all connections.
+struct ssl_server_context {
+  std::unique_ptr<asio::ssl::context> ctx;
+  std::shared_ptr<ssl_ticket_keys> ticket_keys;
+};
+
+inline std::shared_ptr<ssl_server_context> create_ssl_server_context(
+    const ssl_server_config &conf) {
+  unsigned long ssl_options = asio::ssl::context::default_workarounds |
+                              asio::ssl::context::no_sslv2 |
+                              asio::ssl::context::single_dh_use;
+  try {
+    auto server_ctx = std::make_shared<ssl_server_context>();
+    server_ctx->ctx =
+        std::make_unique<asio::ssl::context>(asio::ssl::context::sslv23);
+    auto &ssl_ctx = *server_ctx->ctx;
+
+    ssl_ctx.set_options(ssl_options);
+    if (!conf.passwd.empty()) {
+      ssl_ctx.set_password_callback([pwd = conf.passwd](auto, auto) {
+        return pwd;
+      });
+    }
+
+    std::error_code ec;
+    if (fs::exists(conf.cert_file, ec)) {
+      ssl_ctx.use_certificate_chain_file(conf.cert_file);
+    }
+
+    if (fs::exists(conf.key_file, ec)) {
+      ssl_ctx.use_private_key_file(conf.key_file, asio::ssl::context::pem);
+    }
+
+    SSL_CTX *handle = ssl_ctx.native_handle();
+    static constexpr std::string_view sid_ctx = "cinatra";
+    SSL_CTX_set_session_id_context(handle,
+                                   (const unsigned char *)sid_ctx.data(),
+                                   (unsigned int)sid_ctx.size());
+    SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(handle, (long)conf.session_cache_size);
+    SSL_CTX_set_timeout(handle, (long)conf.session_timeout.count());
+
+    if (conf.ticket_key_rotation.count() > 0) {
+      server_ctx->ticket_keys =
+          std::make_shared<ssl_ticket_keys>(conf.ticket_key_rotation);
+      if (!ssl_ticket_keys::attach(handle, server_ctx->ticket_keys)) {
+        CINATRA_LOG_ERROR << "init ssl session ticket keys failed";
+        return nullptr;
+      }
+    }
+    else {
+      SSL_CTX_set_options(handle, SSL_OP_NO_TICKET);
+    }
+
+    return server_ctx;
+  } catch (const std::exception &e) {
+    CINATRA_LOG_ERROR << "init ssl failed, reason: " << e.what();
+    return nullptr;
+  }
+}
+}  // namespace cinatra
+#endif
@@ -0,0 +1,494 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "time_util.hpp"
+#include "utils.hpp"
+
+#ifndef CINATRA_STATIC_CACHE_BUDGET
+#define CINATRA_STATIC_CACHE_BUDGET (64 * 1024 * 1024)
+#endif
+
+namespace cinatra {
+// The validators of a static file for the conditional requests, the strong
+// ETag is made of the inode, size and mtime of the file.
+struct file_validator {
+  std::string etag;
+  std::string last_modified;
+  std::time_t mtime = 0;
+  size_t size = 0;
+  bool is_directory = false;
+};
+
+// one stat for the size, the type and the validators of the file.
+inline bool stat_file(const std::string &path, file_validator &validator) {
+  uint64_t inode = 0;
+  uint64_t mtime_ns = 0;
+#ifdef _WIN32
+  std::error_code ec;
+  auto status = std::filesystem::status(path, ec);
+  if (ec || !std::filesystem::exists(status)) {
+    return false;
+  }
+  validator.is_directory = std::filesystem::is_directory(status);
+  validator.size =
+      validator.is_directory ? 0 : std::filesystem::file_size(path, ec);
+  auto time = std::chrono::clock_cast<std::chrono::system_clock>(
+      std::filesystem::last_write_time(path, ec));
+  mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 time.time_since_epoch())
+                 .count();
+  validator.mtime = std::chrono::system_clock::to_time_t(time);
+#else
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  validator.is_directory = S_ISDIR(st.st_mode);
+  validator.size = st.st_size;
+  validator.mtime = st.st_mtime;
+  inode = st.st_ino;
+#ifdef __APPLE__
+  mtime_ns = st.st_mtimespec.tv_sec * 1000000000ull + st.st_mtimespec.tv_nsec;
+#else
+  mtime_ns = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+#endif
+#endif
+  char buf[64];
+  int n = snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx\"",
+                   (unsigned long long)inode,
+                   (unsigned long long)validator.size,
+                   (unsigned long long)mtime_ns);
+  validator.etag.assign(buf, n);
+  validator.last_modified = get_gmt_time_str(buf, validator.mtime);
+  return true;
+}
+
+// If-None-Match takes precedence over If-Modified-Since, the weak comparison
+// is used for If-None-Match.
+inline bool is_not_modified(std::string_view if_none_match,
+                            std::string_view if_modified_since,
+                            std::string_view etag, std::time_t mtime) {
+  if (!if_none_match.empty()) {
+    for (auto tag : split_sv(if_none_match, ",")) {
+      tag = trim_sv(tag);
+      if (tag.starts_with("W/")) {
+        tag.remove_prefix(2);
+      }
+      if (tag == "*" || tag == etag) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  if (!if_modified_since.empty()) {
+    auto [ok, time] = get_timestamp(if_modified_since);
+    return ok && mtime <= time;
+  }
+  return false;
+}
+
+// the range is used only if If-Range is the current ETag or Last-Modified,
+// otherwise the whole file is sent.
+inline bool if_range_matches(std::string_view if_range, std::string_view etag,
+                             std::time_t mtime) {
+  if (if_range.empty()) {
+    return true;
+  }
+  if (if_range.starts_with("\"")) {
+    return if_range == etag;
+  }
+  auto [ok, time] = get_timestamp(if_range);
+  return ok && time == mtime;
+}
+
+// The precompressed files next to a static file, such as app.js.br for
+// app.js, in the order of preference.
+struct sidecar_t {
+  std::string_view suffix;
+  std::string_view encoding;
+};
+inline constexpr std::array<sidecar_t, 3> sidecars{
+    {{".br", "br"}, {".zst", "zstd"}, {".gz", "gzip"}}};
+
+// A cached static file, the response head is built once when the file is
+// cached, a hit writes the head and the body without building anything.
+struct static_file_entry {
+  std::string head;
+  std::string not_modified_head;
+  std::string body;
+  // the file of the body, and the original file if it's a precompressed
+  // variant.
+  std::string path;
+  std::string source;
+  // the bits of the fresh sidecars of the file.
+  uint8_t sidecars = 0;
+  std::string etag;
+  std::time_t mtime = 0;
+  size_t file_size = 0;
+  mutable std::atomic<bool> referenced = false;
+
+  size_t bytes() const {
+    return head.size() + not_modified_head.size() + body.size();
+  }
+};
+
+struct static_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t invalidations;
+  size_t bytes;
+  size_t entries;
+};
+
+// The static files cache of the server, the total size of the entries is
+// limited by a budget and the entries are evicted by CLOCK. A changed or
+// removed file is invalidated by inotify, or by checking the stat of every
+// entry where inotify isn't available.
+class static_file_cache {
+ public:
+  static_file_cache(size_t budget = CINATRA_STATIC_CACHE_BUDGET)
+      : budget_(budget) {}
+
+  static_file_cache(const static_file_cache &) = delete;
+  static_file_cache &operator=(const static_file_cache &) = delete;
+
+  ~static_file_cache() {
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+      ::close(inotify_fd_);
+    }
+#endif
+  }
+
+  // the paths are normalized, a file has only one key.
+  static std::string make_key(const std::filesystem::path &path) {
+    return path.lexically_normal().make_preferred().string();
+  }
+
+  // the key of a precompressed variant of the file, it's different from the
+  // key of the sidecar file itself, which is served as it is.
+  static void make_variant_key(std::string &out, std::string_view key,
+                               std::string_view encoding) {
+    out.assign(key).append("\n").append(encoding);
+  }
+
+  using entry_ptr = std::shared_ptr<const static_file_entry>;
+
+  entry_ptr find(const std::string &key, bool count_miss = true) {
+    {
+      std::shared_lock lock(mtx_);
+      if (auto it = map_.find(key); it != map_.end()) {
+        it->second.entry->referenced.store(true, std::memory_order_relaxed);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second.entry;
+      }
+    }
+    if (count_miss) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return nullptr;
+  }
+
+  // the files are changed while loading them if the generation is changed,
+  // don't cache the stale content.
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  bool insert(const std::string &key, entry_ptr entry, uint64_t generation) {
+    size_t bytes = entry->bytes();
+    std::unique_lock lock(mtx_);
+    if (bytes > budget_ || generation != generation_) {
+      return false;
+    }
+    erase_impl(key);
+    while (bytes_ + bytes > budget_) {
+      evict_one();
+    }
+    auto pos = ring_.insert(hand_, key);
+    map_.emplace(key, node_t{std::move(entry), pos});
+    bytes_ += bytes;
+    return true;
+  }
+
+  void erase(const std::string &key) {
+    std::unique_lock lock(mtx_);
+    generation_++;
+    if (erase_impl(key)) {
+      invalidations_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // erase the file, its precompressed variants, and the original file if
+  // it's a sidecar, whose sidecars are changed.
+  void invalidate_file(const std::string &path) {
+    erase(path);
+    std::string key;
+    for (auto &sidecar : sidecars) {
+      make_variant_key(key, path, sidecar.encoding);
+      erase(key);
+      if (path.ends_with(sidecar.suffix)) {
+        std::string_view source(path.data(),
+                                path.size() - sidecar.suffix.size());
+        make_variant_key(key, source, sidecar.encoding);
+        erase(key);
+        erase(std::string(source));
+      }
+    }
+  }
+
+  // erase the files under the directory.
+  void erase_dir(const std::string &dir) {
+    std::string prefix = make_key(dir);
+    prefix.push_back(std::filesystem::path::preferred_separator);
+    std::unique_lock lock(mtx_);
+    generation_++;
+    for (auto it = ring_.begin(); it != ring_.end();) {
+      auto key = *it++;
+      if (key.starts_with(prefix) && erase_impl(key)) {
+        invalidations_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void clear() {
+    std::unique_lock lock(mtx_);
+    generation_++;
+    map_.clear();
+    ring_.clear();
+    hand_ = ring_.end();
+    bytes_ = 0;
+  }
+
+  void set_budget(size_t budget) {
+    std::unique_lock lock(mtx_);
+    budget_ = budget;
+    while (bytes_ > budget_) {
+      evict_one();
+    }
+  }
+
+  size_t budget() const { return budget_; }
+
+  static_cache_stats stats() {
+    std::shared_lock lock(mtx_);
+    return {hits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+            evictions_.load(std::memory_order_relaxed),
+            invalidations_.load(std::memory_order_relaxed),
+            bytes_,
+            map_.size()};
+  }
+
+  // watch the directory and its subdirectories, return false if the changes
+  // can't be watched by inotify.
+  bool watch(const std::string &dir) {
+#ifdef __linux__
+    std::string root = make_key(dir);
+    if (root == watch_dir_) {
+      return inotify_fd_ >= 0;
+    }
+    if (inotify_fd_ >= 0) {
+      ::close(inotify_fd_);
+      watches_.clear();
+    }
+    watch_dir_ = root;
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+      return false;
+    }
+    if (!add_watch(root)) {
+      ::close(inotify_fd_);
+      inotify_fd_ = -1;
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // invalidate the changed files since the last time.
+  void refresh() {
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+      read_events();
+      // the files out of the watched directory, such as the ones served by
+      // serve_static_file_, have no events.
+      check_stat(watch_dir_);
+      return;
+    }
+#endif
+    check_stat();
+  }
+
+  // the fallback without inotify: compare the ETag of every entry with the
+  // file, a precompressed variant is stale if the original file is newer.
+  // The entries under watched_dir are skipped.
+  void check_stat(std::string_view watched_dir = {}) {
+    std::string prefix;
+    if (!watched_dir.empty()) {
+      prefix.assign(watched_dir);
+      prefix.push_back(std::filesystem::path::preferred_separator);
+    }
+    std::vector<std::pair<std::string, entry_ptr>> entries;
+    {
+      std::shared_lock lock(mtx_);
+      for (auto &[key, node] : map_) {
+        if (prefix.empty() || !key.starts_with(prefix)) {
+          entries.emplace_back(key, node.entry);
+        }
+      }
+    }
+    file_validator validator;
+    for (auto &[key, entry] : entries) {
+      if (!stat_file(entry->path, validator) ||
+          validator.etag != entry->etag) {
+        erase(key);
+        continue;
+      }
+      if (!entry->source.empty() &&
+          (!stat_file(entry->source, validator) ||
+           validator.mtime > entry->mtime)) {
+        erase(key);
+      }
+    }
+  }
+
+ private:
+  struct node_t {
+    entry_ptr entry;
+    std::list<std::string>::iterator pos;
+  };
+
+  bool erase_impl(const std::string &key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+      return false;
+    }
+    if (hand_ == it->second.pos) {
+      ++hand_;
+    }
+    bytes_ -= it->second.entry->bytes();
+    ring_.erase(it->second.pos);
+    map_.erase(it);
+    return true;
+  }
+
+  // the hand skips the recently used entries and clears their bits, the
+  // first entry not used since the last round is evicted.
+  void evict_one() {
+    while (true) {
+      if (hand_ == ring_.end()) {
+        hand_ = ring_.begin();
+      }
+      auto &entry = map_.at(*hand_).entry;
+      if (entry->referenced.exchange(false, std::memory_order_relaxed)) {
+        ++hand_;
+        continue;
+      }
+      std::string key = *hand_;
+      erase_impl(key);
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+#ifdef __linux__
+  bool add_watch(const std::string &dir) {
+    constexpr uint32_t mask = IN_CREATE | IN_CLOSE_WRITE | IN_MODIFY |
+                              IN_ATTRIB | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = ::inotify_add_watch(inotify_fd_, dir.c_str(), mask);
+    if (wd < 0) {
+      return false;
+    }
+    watches_[wd] = dir;
+    std::error_code ec;
+    for (auto &file : std::filesystem::directory_iterator(dir, ec)) {
+      if (file.is_directory(ec)) {
+        add_watch(make_key(file.path()));
+      }
+    }
+    return true;
+  }
+
+  void read_events() {
+    alignas(inotify_event) char buf[4096];
+    while (true) {
+      ssize_t len = ::read(inotify_fd_, buf, sizeof(buf));
+      if (len <= 0) {
+        break;
+      }
+      for (char *ptr = buf; ptr < buf + len;) {
+        auto event = reinterpret_cast<inotify_event *>(ptr);
+        ptr += sizeof(inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          // the events are lost, nothing can be trusted.
+          clear();
+          continue;
+        }
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+          continue;
+        }
+        if (event->mask & IN_IGNORED) {
+          watches_.erase(it);
+          continue;
+        }
+        if (event->len == 0) {
+          // the watched directory itself is removed or moved.
+          erase_dir(it->second);
+          continue;
+        }
+        std::string path =
+            make_key(std::filesystem::path(it->second) / event->name);
+        if (event->mask & IN_ISDIR) {
+          erase_dir(path);
+          if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            add_watch(path);
+          }
+        }
+        else {
+          invalidate_file(path);
+        }
+      }
+    }
+  }
+
+  int inotify_fd_ = -1;
+  std::string watch_dir_;
+  std::unordered_map<int, std::string> watches_;
+#endif
+
+  std::shared_mutex mtx_;
+  size_t budget_;
+  size_t bytes_ = 0;
+  std::unordered_map<std::string, node_t> map_;
+  std::list<std::string> ring_;
+  std::list<std::string>::iterator hand_ = ring_.end();
+  std::atomic<uint64_t> generation_ = 0;
+  std::atomic<uint64_t> hits_ = 0;
+  std::atomic<uint64_t> misses_ = 0;
+  std::atomic<uint64_t> evictions_ = 0;
+  std::atomic<uint64_t> invalidations_ = 0;
+};
+}  // namespace cinatra
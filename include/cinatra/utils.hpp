@@ -16,6 +16,7 @@
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -136,6 +137,35 @@ inline std::string_view trim_sv(std::string_view v) {
   return v;
 }
 
+// the coding is acceptable if it's listed without q=0, or if it isn't listed
+// and "*" is listed without q=0. The codings are case-insensitive.
+inline bool accepts_encoding(std::string_view accept_encoding,
+                             std::string_view coding) {
+  std::optional<bool> exact;
+  std::optional<bool> any;
+  for (auto item : split_sv(accept_encoding, ",")) {
+    auto pos = item.find(';');
+    auto name = trim_sv(item.substr(0, pos));
+    bool is_coding = std::equal(name.begin(), name.end(), coding.begin(),
+                                coding.end(), [](char a, char b) {
+                                  return tolower(a) == tolower(b);
+                                });
+    if (!is_coding && name != "*") {
+      continue;
+    }
+    bool acceptable = true;
+    if (pos != std::string_view::npos) {
+      auto param = trim_sv(item.substr(pos + 1));
+      if (param.starts_with("q=") || param.starts_with("Q=")) {
+        param.remove_prefix(2);
+        acceptable = param.find_first_not_of("0.") != std::string_view::npos;
+      }
+    }
+    (is_coding ? exact : any) = acceptable;
+  }
+  return exact.value_or(any.value_or(false));
+}
+
 inline void to_chunked_buffers(std::vector<asio::const_buffer> &buffers,
                                std::string &size_str,
                                std::string_view chunk_data, bool eof) {
@@ -1,6 +1,7 @@
 #pragma once
 #include "utils.hpp"
 #include "ws_define.h"
+#include "ws_mask.hpp"
 
 namespace cinatra {
 enum ws_header_status {
@@ -51,6 +52,7 @@ class websocket {
 
     msg_opcode_ = inp[0] & 0x0F;
     msg_fin_ = (inp[0] >> 7) & 0x01;
+    msg_rsv1_ = (inp[0] >> 6) & 0x01;
     unsigned char msg_masked = (inp[1] >> 7) & 0x01;
 
     int pos = 2;
@@ -108,11 +110,9 @@ class websocket {
   void reset_len_bytes() { len_bytes_ = SHORT_HEADER; }
 
   ws_frame_type parse_payload(std::span<char> buf) {
-    // unmask data:
+    // unmask data in place:
     if (*(uint32_t *)mask_key_ != 0) {
-      for (size_t i = 0; i < payload_length_; i++) {
-        buf[i] = buf[i] ^ mask_key_[i % 4];
-      }
+      detail::mask_payload(buf.data(), payload_length_, mask_key_);
     }
 
     if (msg_opcode_ == 0x0)
@@ -184,9 +184,7 @@ class websocket {
   }
 
   void encode_ws_payload(std::span<char> &data) {
-    for (int i = 0; i < data.size(); ++i) {
-      data[i] ^= mask_key_[i % 4];
-    }
+    detail::mask_payload(data.data(), data.size(), mask_key_);
   }
 
   std::string_view encode_frame(std::span<char> &data, opcode op, bool eof,
@@ -232,6 +230,11 @@ class websocket {
 
   opcode get_opcode() { return (opcode)msg_opcode_; }
 
+  bool is_fin() const { return msg_fin_; }
+
+  // RSV1 of the frame, the message is compressed by permessage-deflate.
+  bool is_compressed() const { return msg_rsv1_; }
+
  private:
   size_t encode_header(size_t length, opcode code, bool is_compressed = false) {
     size_t header_length;
@@ -271,9 +274,29 @@ class websocket {
   uint8_t mask_key_[4] = {};
   unsigned char msg_opcode_ = 0;
   unsigned char msg_fin_ = 0;
+  unsigned char msg_rsv1_ = 0;
 
   char msg_header_[14];
   ws_head_len len_bytes_ = SHORT_HEADER;
 };
 
+// A message encoded once and written to many connections, such as a publish
+// of websocket_hub, it's immutable after it's shared.
+struct ws_shared_frame {
+  // the header and the payload of the uncompressed frame.
+  std::string plain;
+  // the frames of the message compressed alone by permessage-deflate, with
+  // the window bits of each.
+  std::vector<std::pair<int, std::string>> deflated;
+};
+
+// What a connection does when its queue of shared frames is full, the peer
+// doesn't read as fast as the messages come.
+enum class ws_overflow_policy {
+  // drop the oldest frame waiting.
+  drop_oldest,
+  // close the connection.
+  disconnect,
+};
+
 }  // namespace cinatra
@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "coro_http_connection.hpp"
+#include "websocket.hpp"
+#ifdef CINATRA_ENABLE_GZIP
+#include "gzip.hpp"
+#endif
+
+namespace cinatra {
+// Topics of websocket connections. A publish encodes the frame once, and the
+// compressed frame once for every window of permessage-deflate in use, then
+// queues the shared frame to every subscriber, which writes it on its own io
+// thread. A subscriber reading slower than the publishes loses the oldest
+// frames or is closed, by the overflow policy.
+class websocket_hub {
+ public:
+  explicit websocket_hub(
+      size_t max_queue = 1024,
+      ws_overflow_policy policy = ws_overflow_policy::drop_oldest)
+      : max_queue_(max_queue), policy_(policy) {}
+
+  // conn is req.get_conn() of a websocket handler, false if it has subscribed
+  // the topic.
+  bool subscribe(std::string_view topic, coro_http_connection *conn) {
+    std::scoped_lock lock(mtx_);
+    auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+      it = topics_.emplace(std::string(topic), subscribers{}).first;
+    }
+    return it->second.emplace(conn, conn->weak_from_this()).second;
+  }
+
+  bool unsubscribe(std::string_view topic, coro_http_connection *conn) {
+    std::scoped_lock lock(mtx_);
+    auto it = topics_.find(topic);
+    if (it == topics_.end() || it->second.erase(conn) == 0) {
+      return false;
+    }
+    if (it->second.empty()) {
+      topics_.erase(it);
+    }
+    return true;
+  }
+
+  void unsubscribe_all(coro_http_connection *conn) {
+    std::scoped_lock lock(mtx_);
+    for (auto it = topics_.begin(); it != topics_.end();) {
+      it->second.erase(conn);
+      if (it->second.empty()) {
+        it = topics_.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+
+  // the closed connections are removed by the next publish of the topic.
+  size_t subscriber_count(std::string_view topic) {
+    std::scoped_lock lock(mtx_);
+    auto it = topics_.find(topic);
+    return it == topics_.end() ? 0 : it->second.size();
+  }
+
+  // queue the message to every subscriber of the topic, return the number of
+  // the subscribers.
+  size_t publish(std::string_view topic, std::string_view msg,
+                 opcode op = opcode::text) {
+    std::vector<std::shared_ptr<coro_http_connection>> conns;
+    std::vector<int> deflate_bits;
+    {
+      std::scoped_lock lock(mtx_);
+      auto it = topics_.find(topic);
+      if (it == topics_.end()) {
+        return 0;
+      }
+      conns.reserve(it->second.size());
+      for (auto iter = it->second.begin(); iter != it->second.end();) {
+        auto conn = iter->second.lock();
+        if (conn == nullptr || conn->has_closed()) {
+          iter = it->second.erase(iter);
+          continue;
+        }
+        if (int bits = conn->shared_frame_deflate_bits(); bits != 0) {
+          if (std::find(deflate_bits.begin(), deflate_bits.end(), bits) ==
+              deflate_bits.end()) {
+            deflate_bits.push_back(bits);
+          }
+        }
+        conns.push_back(std::move(conn));
+        ++iter;
+      }
+      if (it->second.empty()) {
+        topics_.erase(it);
+      }
+    }
+    if (conns.empty()) {
+      return 0;
+    }
+
+    auto frame = encode(msg, op, deflate_bits);
+    for (auto &conn : conns) {
+      conn->send_shared_frame(frame, max_queue_, policy_);
+    }
+    return conns.size();
+  }
+
+ private:
+  using subscribers = std::unordered_map<coro_http_connection *,
+                                         std::weak_ptr<coro_http_connection>>;
+
+  std::shared_ptr<ws_shared_frame> encode(std::string_view msg, opcode op,
+                                          const std::vector<int> &bits) {
+    auto frame = std::make_shared<ws_shared_frame>();
+    websocket ws{};
+    frame->plain.append(
+        ws.encode_ws_header(msg.size(), op, true, false, false));
+    frame->plain.append(msg);
+#ifdef CINATRA_ENABLE_GZIP
+    if (msg.empty() || (op != opcode::text && op != opcode::binary)) {
+      return frame;
+    }
+    std::string deflated;
+    std::scoped_lock lock(deflate_mtx_);
+    for (int window_bits : bits) {
+      auto &stream = deflate_streams_[window_bits];
+      if (!stream.valid() &&
+          !stream.init(ws_deflate_options{}.level, window_bits)) {
+        continue;
+      }
+      deflated.clear();
+      bool ok = stream.compress(msg, deflated);
+      // the message is compressed alone, no subscriber refers to it later.
+      stream.reset();
+      if (!ok || deflated.size() >= msg.size()) {
+        // the subscribers with this window get the plain frame.
+        continue;
+      }
+      std::string encoded;
+      encoded.append(
+          ws.encode_ws_header(deflated.size(), op, true, true, false));
+      encoded.append(deflated);
+      frame->deflated.emplace_back(window_bits, std::move(encoded));
+    }
+#endif
+    return frame;
+  }
+
+  struct topic_hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const {
+      return std::hash<std::string_view>{}(str);
+    }
+  };
+
+  std::mutex mtx_;
+  std::unordered_map<std::string, subscribers, topic_hash, std::equal_to<>>
+      topics_;
+  size_t max_queue_;
+  ws_overflow_policy policy_;
+#ifdef CINATRA_ENABLE_GZIP
+  std::mutex deflate_mtx_;
+  std::map<int, gzip_codec::deflate_stream> deflate_streams_;
+#endif
+};
+}  // namespace cinatra
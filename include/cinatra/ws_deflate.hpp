@@ -0,0 +1,291 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "gzip.hpp"
+
+namespace cinatra {
+// The parameters of permessage-deflate, RFC 7692. As the options of a server
+// or a client, they are the most it accepts: a peer which asks for no context
+// takeover or a smaller window gets it.
+struct ws_deflate_options {
+  bool server_no_context_takeover = false;
+  bool client_no_context_takeover = false;
+  int server_max_window_bits = 15;
+  int client_max_window_bits = 15;
+  // the level of the own deflate stream.
+  int level = 1;
+};
+
+namespace detail {
+inline std::string_view trim_ws_param(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+// call fn(name, value) for every parameter of a permessage-deflate extension,
+// false if it's another extension or fn fails.
+template <typename Fn>
+inline bool for_each_ws_deflate_param(std::string_view extension, Fn &&fn) {
+  size_t pos = extension.find(';');
+  if (trim_ws_param(extension.substr(0, pos)) != "permessage-deflate") {
+    return false;
+  }
+  while (pos != std::string_view::npos) {
+    extension.remove_prefix(pos + 1);
+    pos = extension.find(';');
+    auto param = trim_ws_param(extension.substr(0, pos));
+    std::string_view value;
+    if (auto eq = param.find('='); eq != std::string_view::npos) {
+      value = trim_ws_param(param.substr(eq + 1));
+      param = trim_ws_param(param.substr(0, eq));
+      if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+      }
+      if (value.empty()) {
+        return false;
+      }
+    }
+    if (!fn(param, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 8 to 15, 0 if the value is invalid.
+inline int parse_window_bits(std::string_view value) {
+  int bits = 0;
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), bits);
+  if (ec != std::errc{} || ptr != value.data() + value.size() || bits < 8 ||
+      bits > 15) {
+    return 0;
+  }
+  return bits;
+}
+
+inline void append_ws_deflate_params(std::string &str,
+                                     const ws_deflate_options &params,
+                                     bool client_bits, bool client_bits_value,
+                                     bool server_bits) {
+  str.append("permessage-deflate");
+  if (params.server_no_context_takeover) {
+    str.append("; server_no_context_takeover");
+  }
+  if (params.client_no_context_takeover) {
+    str.append("; client_no_context_takeover");
+  }
+  if (server_bits) {
+    str.append("; server_max_window_bits=")
+        .append(std::to_string(params.server_max_window_bits));
+  }
+  if (client_bits) {
+    str.append("; client_max_window_bits");
+    if (client_bits_value) {
+      str.append("=").append(std::to_string(params.client_max_window_bits));
+    }
+  }
+}
+}  // namespace detail
+
+// Accept the first acceptable offer of Sec-WebSocket-Extensions by the
+// options of the server, the parameters agreed are returned and the
+// Sec-WebSocket-Extensions of the response is appended to response.
+inline std::optional<ws_deflate_options> accept_ws_deflate_offer(
+    std::string_view extensions, const ws_deflate_options &options,
+    std::string &response) {
+  while (!extensions.empty()) {
+    size_t pos = extensions.find(',');
+    auto offer = extensions.substr(0, pos);
+    extensions.remove_prefix(pos == std::string_view::npos ? extensions.size()
+                                                           : pos + 1);
+
+    ws_deflate_options agreed{};
+    agreed.level = options.level;
+    bool server_bits = false;
+    bool client_bits = false;
+    unsigned seen = 0;
+    bool ok = detail::for_each_ws_deflate_param(
+        offer, [&](std::string_view name, std::string_view value) {
+          unsigned bit = 0;
+          if (name == "server_no_context_takeover" && value.empty()) {
+            agreed.server_no_context_takeover = true;
+            bit = 1;
+          }
+          else if (name == "client_no_context_takeover" && value.empty()) {
+            agreed.client_no_context_takeover = true;
+            bit = 2;
+          }
+          else if (name == "server_max_window_bits") {
+            agreed.server_max_window_bits = detail::parse_window_bits(value);
+            server_bits = true;
+            bit = 4;
+            if (agreed.server_max_window_bits == 0) {
+              return false;
+            }
+          }
+          else if (name == "client_max_window_bits") {
+            if (!value.empty()) {
+              agreed.client_max_window_bits = detail::parse_window_bits(value);
+              if (agreed.client_max_window_bits == 0) {
+                return false;
+              }
+            }
+            client_bits = true;
+            bit = 8;
+          }
+          // an unknown or a duplicated parameter declines the offer.
+          if (bit == 0 || (seen & bit)) {
+            return false;
+          }
+          seen |= bit;
+          return true;
+        });
+    if (!ok) {
+      continue;
+    }
+
+    agreed.server_no_context_takeover |= options.server_no_context_takeover;
+    agreed.client_no_context_takeover |= options.client_no_context_takeover;
+    agreed.server_max_window_bits = (std::min)(agreed.server_max_window_bits,
+                                               options.server_max_window_bits);
+    if (client_bits) {
+      agreed.client_max_window_bits = (std::min)(
+          agreed.client_max_window_bits, options.client_max_window_bits);
+    }
+    detail::append_ws_deflate_params(
+        response, agreed, client_bits && agreed.client_max_window_bits < 15,
+        true, server_bits || agreed.server_max_window_bits < 15);
+    return agreed;
+  }
+  return std::nullopt;
+}
+
+// the Sec-WebSocket-Extensions of the request of a client.
+inline std::string make_ws_deflate_offer(const ws_deflate_options &options) {
+  std::string offer;
+  detail::append_ws_deflate_params(offer, options, true,
+                                   options.client_max_window_bits < 15,
+                                   options.server_max_window_bits < 15);
+  return offer;
+}
+
+// the parameters agreed by the Sec-WebSocket-Extensions of the response,
+// nullopt if the server declines the offer or the response is invalid.
+inline std::optional<ws_deflate_options> parse_ws_deflate_response(
+    std::string_view extensions, const ws_deflate_options &options) {
+  ws_deflate_options agreed{};
+  agreed.level = options.level;
+  bool ok = detail::for_each_ws_deflate_param(
+      detail::trim_ws_param(extensions),
+      [&](std::string_view name, std::string_view value) {
+        if (name == "server_no_context_takeover" && value.empty()) {
+          agreed.server_no_context_takeover = true;
+        }
+        else if (name == "client_no_context_takeover" && value.empty()) {
+          agreed.client_no_context_takeover = true;
+        }
+        else if (name == "server_max_window_bits") {
+          agreed.server_max_window_bits = detail::parse_window_bits(value);
+          return agreed.server_max_window_bits != 0 &&
+                 agreed.server_max_window_bits <=
+                     options.server_max_window_bits;
+        }
+        else if (name == "client_max_window_bits") {
+          agreed.client_max_window_bits = detail::parse_window_bits(value);
+          return agreed.client_max_window_bits != 0;
+        }
+        else {
+          return false;
+        }
+        return true;
+      });
+  if (!ok || (options.server_no_context_takeover &&
+              !agreed.server_no_context_takeover)) {
+    return std::nullopt;
+  }
+  agreed.client_no_context_takeover |= options.client_no_context_takeover;
+  agreed.client_max_window_bits = (std::min)(agreed.client_max_window_bits,
+                                             options.client_max_window_bits);
+  return agreed;
+}
+
+// The deflate and inflate streams of a WebSocket connection, they live as
+// long as the connection, unless the peer asks for no context takeover.
+class ws_deflate {
+ public:
+  // is_server selects the server_* parameters for the own deflate stream and
+  // the client_* ones for the inflate stream.
+  bool init(const ws_deflate_options &agreed, bool is_server) {
+    int own_bits = is_server ? agreed.server_max_window_bits
+                             : agreed.client_max_window_bits;
+    int peer_bits = is_server ? agreed.client_max_window_bits
+                              : agreed.server_max_window_bits;
+    no_context_takeover_ = is_server ? agreed.server_no_context_takeover
+                                     : agreed.client_no_context_takeover;
+    if (!inflate_.init(peer_bits)) {
+      return false;
+    }
+    // raw deflate can't keep a window of 256 bytes, the messages are sent
+    // uncompressed then, which permessage-deflate allows.
+    if (own_bits > 8 && deflate_.init(agreed.level, own_bits)) {
+      own_bits_ = own_bits;
+    }
+    enabled_ = true;
+    return true;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  bool can_compress() const { return deflate_.valid(); }
+
+  // the window of the own deflate stream, 0 if the messages are sent
+  // uncompressed.
+  int window_bits() const { return deflate_.valid() ? own_bits_ : 0; }
+
+  // a message compressed alone by another stream is sent, the next message
+  // must not refer to the earlier ones, which the peer doesn't see as the
+  // last ones any more.
+  void forget_context() { deflate_.reset(); }
+
+  // compress a piece of the message, the last piece has fin.
+  bool compress(std::string_view data, std::string &out, bool fin = true) {
+    if (!deflate_.compress(data, out, fin)) {
+      return false;
+    }
+    if (fin && no_context_takeover_) {
+      deflate_.reset();
+    }
+    return true;
+  }
+
+  // decompress a piece of a message with RSV1, the last piece has fin.
+  bool decompress(std::string_view data, std::string &out, bool fin = true) {
+    return inflate_.decompress(data, out, fin);
+  }
+
+  void reset() {
+    deflate_ = {};
+    inflate_ = {};
+    enabled_ = false;
+    no_context_takeover_ = false;
+    own_bits_ = 0;
+  }
+
+ private:
+  gzip_codec::deflate_stream deflate_;
+  gzip_codec::inflate_stream inflate_;
+  bool enabled_ = false;
+  bool no_context_takeover_ = false;
+  int own_bits_ = 0;
+};
+}  // namespace cinatra
@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <string>
+
+#include "buffer_pool.hpp"
+#include "websocket.hpp"
+
+namespace cinatra {
+enum class ws_frame_status { complete, incomplete, error, too_big };
+
+// The receive buffer of a websocket connection. The socket is read in big
+// chunks and every complete frame in the buffer is decoded without another
+// read, the payload is a view into the buffer. A partial frame stays in the
+// buffer until the next read completes it.
+class ws_frame_reader {
+ public:
+  // decode the next frame buffered, the header is parsed into ws. On complete
+  // payload is the frame's payload in the buffer, it's valid until the next
+  // prepare(). too_big means the payload is longer than max_payload (0 is no
+  // limit), the frame is left in the buffer.
+  ws_frame_status next_frame(websocket &ws, std::span<char> &payload,
+                             bool is_server, size_t max_payload = 0) {
+    size_t size = end_ - begin_;
+    missing_ = 2;
+    if (size < 2) {
+      missing_ = 2 - size;
+      return ws_frame_status::incomplete;
+    }
+
+    // parse_header wants the exact length of the header, the first two bytes
+    // tell the rest.
+    const char *data = buf_.data() + begin_;
+    auto status = ws.parse_header(data, 2, is_server);
+    size_t header_len = 2;
+    if (status == ws_header_status::incomplete) {
+      header_len += ws.left_header_len();
+      if (size < header_len) {
+        missing_ = header_len - size;
+        return ws_frame_status::incomplete;
+      }
+      status = ws.parse_header(data, header_len, is_server);
+    }
+    if (status == ws_header_status::error) {
+      return ws_frame_status::error;
+    }
+
+    size_t payload_len = ws.payload_length();
+    if (max_payload != 0 && payload_len > max_payload) {
+      return ws_frame_status::too_big;
+    }
+    if (size - header_len < payload_len) {
+      missing_ = header_len + payload_len - size;
+      return ws_frame_status::incomplete;
+    }
+
+    payload = {buf_.data() + begin_ + header_len, payload_len};
+    begin_ += header_len + payload_len;
+    missing_ = 0;
+    return ws_frame_status::complete;
+  }
+
+  // the writable space for the next read, big enough for the rest of the
+  // incomplete frame, the data buffered is moved to the front first.
+  std::span<char> prepare() { return reserve(missing_); }
+
+  void commit(size_t n) { end_ += n; }
+
+  // the data read ahead by someone else, such as the frames sent right after
+  // the handshake.
+  void append(const char *data, size_t n) {
+    std::memcpy(reserve(n).data(), data, n);
+    commit(n);
+  }
+
+  size_t size() const { return end_ - begin_; }
+
+  // release a buffer grown by a big frame once it's consumed.
+  void shrink_to_fit() {
+    if (begin_ == end_ && buf_.capacity() > read_chunk) {
+      release();
+    }
+  }
+
+  // give the buffer back to the buffer pool while nothing is buffered, the
+  // next prepare() takes one again.
+  void release() {
+    if (begin_ == end_) {
+      buf_.release();
+      begin_ = end_ = 0;
+    }
+  }
+
+ private:
+  std::span<char> reserve(size_t n) {
+    size_t size = end_ - begin_;
+    if (begin_ > 0) {
+      if (size > 0) {
+        std::memmove(buf_.data(), buf_.data() + begin_, size);
+      }
+      begin_ = 0;
+      end_ = size;
+    }
+    buf_.reserve((std::max)(size + n, read_chunk), size);
+    return {buf_.data() + end_, buf_.capacity() - end_};
+  }
+
+  static constexpr size_t read_chunk = 8192;
+
+  pooled_buffer buf_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  // the bytes needed to complete the current frame.
+  size_t missing_ = 2;
+};
+}  // namespace cinatra
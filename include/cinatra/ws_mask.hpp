@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// x86-64 builds pick the SSE2/AVX2/AVX-512 kernel by the cpu features at
+// runtime, aarch64 always has NEON.
+#if !defined(CINATRA_DISABLE_SIMD_DISPATCH) && defined(__x86_64__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define CINATRA_WS_MASK_DISPATCH
+#include <immintrin.h>
+
+#include <atomic>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CINATRA_WS_MASK_NEON
+#include <arm_neon.h>
+#endif
+
+namespace cinatra::detail {
+// the mask key of the byte at pos of a payload, as a word whose bytes are in
+// memory order, so a word of the payload at pos is masked by one xor.
+inline uint32_t rotate_mask_key(const uint8_t key[4], size_t pos) {
+  uint8_t rotated[4];
+  for (size_t i = 0; i < 4; i++) {
+    rotated[i] = key[(pos + i) % 4];
+  }
+  uint32_t word;
+  std::memcpy(&word, rotated, 4);
+  return word;
+}
+
+inline void mask_scalar(char *data, size_t len, uint32_t key) {
+  size_t i = 0;
+  uint64_t key64 = ((uint64_t)key << 32) | key;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    word ^= key64;
+    std::memcpy(data + i, &word, 8);
+  }
+  uint8_t key_bytes[4];
+  std::memcpy(key_bytes, &key, 4);
+  for (; i < len; i++) {
+    data[i] ^= key_bytes[i % 4];
+  }
+}
+
+#ifdef CINATRA_WS_MASK_DISPATCH
+enum class mask_kernel { scalar, sse2, avx2, avx512 };
+
+// the widest kernel the cpu supports, x86-64 always has SSE2.
+inline mask_kernel supported_mask_kernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) {
+    return mask_kernel::avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return mask_kernel::avx2;
+  }
+  return mask_kernel::sse2;
+}
+
+inline std::atomic<mask_kernel> &mask_kernel_ref() {
+  static std::atomic<mask_kernel> kernel = supported_mask_kernel();
+  return kernel;
+}
+
+inline mask_kernel current_mask_kernel() {
+  return mask_kernel_ref().load(std::memory_order_relaxed);
+}
+
+// for test and benchmark, return false if the cpu doesn't support it.
+inline bool set_mask_kernel(mask_kernel kernel) {
+  if (kernel > supported_mask_kernel()) {
+    return false;
+  }
+  mask_kernel_ref().store(kernel, std::memory_order_relaxed);
+  return true;
+}
+
+// the kernels mask the full blocks and return the length done, the tail is
+// left to mask_scalar.
+__attribute__((target("sse2"))) inline size_t mask_sse2(char *data, size_t len,
+                                                        uint32_t key) {
+  __m128i k = _mm_set1_epi32((int)key);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(data + i));
+    _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(b, k));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) inline size_t mask_avx2(char *data, size_t len,
+                                                        uint32_t key) {
+  __m256i k = _mm256_set1_epi32((int)key);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)(data + i));
+    _mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(b, k));
+  }
+  return i;
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline size_t mask_avx512(
+    char *data, size_t len, uint32_t key) {
+  __m512i k = _mm512_set1_epi32((int)key);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i b = _mm512_loadu_si512((const void *)(data + i));
+    _mm512_storeu_si512((void *)(data + i), _mm512_xor_si512(b, k));
+  }
+  return i;
+}
+#endif
+
+#ifdef CINATRA_WS_MASK_NEON
+inline size_t mask_neon(char *data, size_t len, uint32_t key) {
+  uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(key));
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t b = vld1q_u8((const uint8_t *)(data + i));
+    vst1q_u8((uint8_t *)(data + i), veorq_u8(b, k));
+  }
+  return i;
+}
+#endif
+
+// xor the payload with the mask key in place, pos is the offset of data in
+// the payload. The bytes before the first 16-byte boundary are masked one by
+// one, so most of the vector loads and stores are aligned.
+inline void mask_payload(char *data, size_t len, const uint8_t key[4],
+                         size_t pos = 0) {
+  size_t head = (16 - ((uintptr_t)data & 15)) & 15;
+  if (head > len) {
+    head = len;
+  }
+  for (size_t i = 0; i < head; i++) {
+    data[i] ^= key[(pos + i) % 4];
+  }
+  data += head;
+  len -= head;
+  if (len == 0) {
+    return;
+  }
+
+  uint32_t word = rotate_mask_key(key, pos + head);
+  size_t done = 0;
+#if defined(CINATRA_WS_MASK_DISPATCH)
+  if (len >= 16) {
+    switch (current_mask_kernel()) {
+      case mask_kernel::avx512:
+        done = mask_avx512(data, len, word);
+        break;
+      case mask_kernel::avx2:
+        done = mask_avx2(data, len, word);
+        break;
+      default:
+        break;
+    }
+    // the rest of the wide kernels is less than a 64 or 32 bytes block.
+    if (current_mask_kernel() != mask_kernel::scalar) {
+      done += mask_sse2(data + done, len - done, word);
+    }
+  }
+#elif defined(CINATRA_WS_MASK_NEON)
+  done = mask_neon(data, len, word);
+#endif
+  // a block is a multiple of 4 bytes, the key of the tail is still word.
+  mask_scalar(data + done, len - done, word);
+}
+}  // namespace cinatra::detail
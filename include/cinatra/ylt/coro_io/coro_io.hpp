@@ -45,7 +45,9 @@
 #include "../util/type_traits.h"
 #endif
 #ifdef __linux__
+#include <fcntl.h>
 #include <sys/sendfile.h>
+#include <unistd.h>
 #endif
 
 namespace coro_io {
@@ -151,6 +153,18 @@ async_read_some(Socket &socket, AsioBuffer &&buffer) noexcept {
   });
 }
 
+// wait until the socket is readable or writable, nothing is read or written.
+template <typename Socket>
+inline async_simple::coro::Lazy<std::error_code> async_wait(
+    Socket &socket, typename Socket::wait_type type) noexcept {
+  callback_awaitor<std::error_code> awaitor;
+  co_return co_await awaitor.await_resume([&](auto handler) {
+    socket.async_wait(type, [&, handler](const auto &ec) {
+      handler.set_value_then_resume(ec);
+    });
+  });
+}
+
 template <typename Socket, typename AsioBuffer>
 inline async_simple::coro::Lazy<std::pair<std::error_code, size_t>>
 async_read_at(uint64_t offset, Socket &socket, AsioBuffer &&buffer) noexcept {
@@ -560,6 +574,18 @@ inline auto pipe_signal_handler = [] {
   return 0;
 }();
 
+struct fd_guard {
+  int fd;
+  fd_guard(const char *file_path) : fd(::open(file_path, O_RDONLY)) {}
+  fd_guard(const fd_guard &) = delete;
+  fd_guard &operator=(const fd_guard &) = delete;
+  ~fd_guard() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
 // FIXME: this function may not thread-safe if it not running in socket's
 // executor
 inline async_simple::coro::Lazy<std::pair<std::error_code, std::size_t>>
@@ -0,0 +1,329 @@
+#pragma once
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace coro_io {
+class wheel_timer;
+
+// A hierarchical timing wheel of an io_context, the deadlines of all the
+// connections and clients on the io_context share one steady_timer. Arm,
+// re-arm and cancel of a wheel_timer are O(1) list operations, the steady_timer
+// wakes up only at the next tick which has timers to cascade or to fire.
+//
+// 4 levels of 64 slots with the tick of 1ms cover about 4.6 hours, a longer
+// timer is kept in the last level and put back until it's due. The callbacks
+// are called on the io thread of the io_context.
+class timing_wheel : public std::enable_shared_from_this<timing_wheel> {
+ public:
+  using clock = std::chrono::steady_clock;
+  static constexpr auto tick = std::chrono::milliseconds(1);
+
+  explicit timing_wheel(asio::io_context &ctx)
+      : timer_(std::make_unique<asio::steady_timer>(ctx)),
+        origin_(clock::now()) {}
+
+  // the wheel of the io_context, it's created by the first call.
+  static std::shared_ptr<timing_wheel> of(asio::io_context &ctx);
+
+  // the timers armed.
+  size_t size() const {
+    std::scoped_lock lock(mtx_);
+    return count_;
+  }
+
+  // the io_context is shutting down, the timers are never fired.
+  void shutdown() {
+    std::scoped_lock lock(mtx_);
+    for (auto &level : slots_) {
+      for (auto &head : level) {
+        while (head != nullptr) {
+          unlink(head);
+        }
+      }
+    }
+    count_ = 0;
+    timer_.reset();
+  }
+
+ private:
+  friend class wheel_timer;
+  static constexpr int levels = 4;
+  static constexpr int slot_bits = 6;
+  static constexpr uint64_t slot_num = uint64_t(1) << slot_bits;
+  static constexpr uint64_t slot_mask = slot_num - 1;
+  static constexpr uint64_t max_delta = uint64_t(1) << (slot_bits * levels);
+  static constexpr uint64_t never = (std::numeric_limits<uint64_t>::max)();
+
+  uint64_t current_tick() const {
+    return uint64_t((clock::now() - origin_) / tick);
+  }
+
+  void arm(wheel_timer *node, clock::duration duration,
+           std::function<void()> *fn);
+  void set_callback(wheel_timer *node, std::function<void()> fn);
+  bool cancel(wheel_timer *node);
+  void link(wheel_timer *node);
+  void unlink(wheel_timer *node);
+  uint64_t next_tick() const;
+  void schedule();
+  void on_timer();
+  void cascade(int level, uint64_t slot);
+
+  mutable std::mutex mtx_;
+  std::unique_ptr<asio::steady_timer> timer_;
+  clock::time_point origin_;
+  // the tick processed last, the slots are relative to it.
+  uint64_t now_ = 0;
+  // the tick the steady_timer waits for.
+  uint64_t planned_ = never;
+  size_t count_ = 0;
+  wheel_timer *slots_[levels][slot_num] = {};
+  uint64_t occupied_[levels] = {};
+};
+
+// A timer of the timing wheel of an io_context. It can be armed from any
+// thread, the callback is called on the io thread. Re-arming replaces the
+// deadline, destroying it cancels it.
+class wheel_timer {
+ public:
+  explicit wheel_timer(asio::io_context &ctx) : wheel_(timing_wheel::of(ctx)) {}
+
+  explicit wheel_timer(asio::io_context::executor_type executor)
+      : wheel_timer(executor.context()) {}
+
+  wheel_timer(const wheel_timer &) = delete;
+  wheel_timer &operator=(const wheel_timer &) = delete;
+
+  ~wheel_timer() { cancel(); }
+
+  void arm(std::chrono::steady_clock::duration duration,
+           std::function<void()> fn) {
+    wheel_->arm(this, duration, &fn);
+  }
+
+  // arm with the callback set before.
+  void arm(std::chrono::steady_clock::duration duration) {
+    wheel_->arm(this, duration, nullptr);
+  }
+
+  void set_callback(std::function<void()> fn) {
+    wheel_->set_callback(this, std::move(fn));
+  }
+
+  // false if it isn't armed, or it's being fired.
+  bool cancel() { return wheel_->cancel(this); }
+
+ private:
+  friend class timing_wheel;
+  std::shared_ptr<timing_wheel> wheel_;
+  std::function<void()> fn_;
+  wheel_timer *next_ = nullptr;
+  wheel_timer **pprev_ = nullptr;
+  uint64_t expiry_ = 0;
+  uint8_t level_ = 0;
+  uint8_t slot_ = 0;
+};
+
+namespace detail {
+class timing_wheel_service : public asio::execution_context::service {
+ public:
+  using key_type = timing_wheel_service;
+  static inline asio::execution_context::id id;
+
+  explicit timing_wheel_service(asio::execution_context &ctx)
+      : asio::execution_context::service(ctx),
+        wheel_(std::make_shared<timing_wheel>(
+            static_cast<asio::io_context &>(ctx))) {}
+
+  void shutdown() override { wheel_->shutdown(); }
+
+  std::shared_ptr<timing_wheel> wheel_;
+};
+}  // namespace detail
+
+inline std::shared_ptr<timing_wheel> timing_wheel::of(asio::io_context &ctx) {
+  return asio::use_service<detail::timing_wheel_service>(ctx).wheel_;
+}
+
+inline void timing_wheel::arm(wheel_timer *node, clock::duration duration,
+                              std::function<void()> *fn) {
+  uint64_t ticks = duration <= clock::duration::zero()
+                       ? 1
+                       : uint64_t((duration + tick - clock::duration(1)) / tick);
+  std::scoped_lock lock(mtx_);
+  if (fn != nullptr) {
+    node->fn_ = std::move(*fn);
+  }
+  if (timer_ == nullptr) {
+    return;
+  }
+  if (node->pprev_ != nullptr) {
+    unlink(node);
+    count_--;
+  }
+  uint64_t now = current_tick();
+  if (count_ == 0) {
+    // nothing is relative to the old tick.
+    now_ = (std::max)(now_, now);
+  }
+  node->expiry_ = (std::max)(now, now_) + ticks;
+  link(node);
+  count_++;
+  if (next_tick() < planned_) {
+    schedule();
+  }
+}
+
+inline void timing_wheel::set_callback(wheel_timer *node,
+                                       std::function<void()> fn) {
+  std::scoped_lock lock(mtx_);
+  node->fn_ = std::move(fn);
+}
+
+inline bool timing_wheel::cancel(wheel_timer *node) {
+  std::scoped_lock lock(mtx_);
+  if (node->pprev_ == nullptr) {
+    return false;
+  }
+  unlink(node);
+  count_--;
+  return true;
+}
+
+inline void timing_wheel::link(wheel_timer *node) {
+  uint64_t delta = node->expiry_ > now_ ? node->expiry_ - now_ : 0;
+  uint64_t expiry = node->expiry_;
+  if (delta >= max_delta) {
+    expiry = now_ + max_delta - 1;
+    delta = max_delta - 1;
+  }
+  int level = 0;
+  while (delta >= (uint64_t(1) << (slot_bits * (level + 1)))) {
+    level++;
+  }
+  uint64_t slot = (expiry >> (slot_bits * level)) & slot_mask;
+  auto &head = slots_[level][slot];
+  node->next_ = head;
+  if (head != nullptr) {
+    head->pprev_ = &node->next_;
+  }
+  head = node;
+  node->pprev_ = &head;
+  node->level_ = uint8_t(level);
+  node->slot_ = uint8_t(slot);
+  occupied_[level] |= uint64_t(1) << slot;
+}
+
+inline void timing_wheel::unlink(wheel_timer *node) {
+  *node->pprev_ = node->next_;
+  if (node->next_ != nullptr) {
+    node->next_->pprev_ = node->pprev_;
+  }
+  node->next_ = nullptr;
+  node->pprev_ = nullptr;
+  if (slots_[node->level_][node->slot_] == nullptr) {
+    occupied_[node->level_] &= ~(uint64_t(1) << node->slot_);
+  }
+}
+
+// the next tick which has a slot to fire or to cascade.
+inline uint64_t timing_wheel::next_tick() const {
+  uint64_t next = never;
+  for (int level = 0; level < levels; level++) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    int shift = slot_bits * level;
+    uint64_t base = now_ >> shift;
+    int idx = int(base & slot_mask);
+    // a slot of the current index is in the next round.
+    uint64_t offset =
+        std::countr_zero(std::rotr(occupied_[level], (idx + 1) % 64)) + 1;
+    next = (std::min)(next, (base + offset) << shift);
+  }
+  return next;
+}
+
+inline void timing_wheel::schedule() {
+  planned_ = next_tick();
+  if (planned_ == never) {
+    timer_->cancel();
+    return;
+  }
+  timer_->expires_at(origin_ + planned_ * tick);
+  timer_->async_wait([weak = weak_from_this()](std::error_code ec) {
+    if (ec) {
+      return;
+    }
+    if (auto wheel = weak.lock(); wheel) {
+      wheel->on_timer();
+    }
+  });
+}
+
+inline void timing_wheel::cascade(int level, uint64_t slot) {
+  auto node = slots_[level][slot];
+  while (node != nullptr) {
+    auto next = node->next_;
+    unlink(node);
+    link(node);
+    node = next;
+  }
+}
+
+inline void timing_wheel::on_timer() {
+  std::vector<std::function<void()>> fired;
+  {
+    std::scoped_lock lock(mtx_);
+    if (timer_ == nullptr) {
+      return;
+    }
+    uint64_t now = current_tick();
+    while (count_ > 0) {
+      uint64_t next = next_tick();
+      if (next > now) {
+        break;
+      }
+      now_ = next;
+      for (int level = levels - 1; level > 0; level--) {
+        int shift = slot_bits * level;
+        if ((now_ & ((uint64_t(1) << shift) - 1)) == 0) {
+          cascade(level, (now_ >> shift) & slot_mask);
+        }
+      }
+      auto node = slots_[0][now_ & slot_mask];
+      while (node != nullptr) {
+        auto next_node = node->next_;
+        unlink(node);
+        if (node->expiry_ > now_) {
+          // longer than the wheel.
+          link(node);
+        }
+        else {
+          count_--;
+          fired.push_back(node->fn_);
+        }
+        node = next_node;
+      }
+    }
+    if (count_ == 0) {
+      now_ = (std::max)(now_, now);
+    }
+    planned_ = never;
+    schedule();
+  }
+  for (auto &fn : fired) {
+    if (fn) {
+      fn();
+    }
+  }
+}
+}  // namespace coro_io
@@ -0,0 +1,243 @@
+#pragma once
+#include <zstd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "define.h"
+#include "string_resize.hpp"
+
+namespace cinatra::zstd_codec {
+#ifndef CINATRA_ZSTD_LEVEL
+#define CINATRA_ZSTD_LEVEL 3
+#endif
+
+// A dictionary trained on the typical payloads, such as by `zstd --train`.
+// It helps the small payloads most, the peers must load the same dictionary,
+// a frame refers to its dictionary by the id.
+class dictionary {
+ public:
+  dictionary(std::string_view content, int level = CINATRA_ZSTD_LEVEL)
+      : cdict_(ZSTD_createCDict(content.data(), content.size(), level)),
+        ddict_(ZSTD_createDDict(content.data(), content.size())),
+        id_(ZSTD_getDictID_fromDict(content.data(), content.size())) {}
+  dictionary(const dictionary &) = delete;
+  dictionary &operator=(const dictionary &) = delete;
+
+  ~dictionary() {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+  }
+
+  bool valid() const { return cdict_ != nullptr && ddict_ != nullptr; }
+
+  // 0 for the raw content dictionary without the header of zstd.
+  unsigned id() const { return id_; }
+
+  const ZSTD_CDict *cdict() const { return cdict_; }
+  const ZSTD_DDict *ddict() const { return ddict_; }
+
+ private:
+  ZSTD_CDict *cdict_;
+  ZSTD_DDict *ddict_;
+  unsigned id_;
+};
+
+inline std::shared_ptr<const dictionary> &shared_dictionary_ref() {
+  static std::shared_ptr<const dictionary> dict;
+  return dict;
+}
+
+// The dictionary of the process, the frames which refer to it are
+// decompressed with it, and zstd_codec::compress uses it by default. The
+// automatic compression for Accept-Encoding never uses it, the browsers
+// don't have it. Set it before any server or client starts, nullptr removes
+// it.
+inline void set_shared_dictionary(std::shared_ptr<const dictionary> dict) {
+  if (dict && !dict->valid()) {
+    dict = nullptr;
+  }
+  shared_dictionary_ref() = std::move(dict);
+}
+
+inline const dictionary *shared_dictionary() {
+  return shared_dictionary_ref().get();
+}
+
+namespace detail {
+struct cctx_deleter {
+  void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+};
+using cctx_ptr = std::unique_ptr<ZSTD_CCtx, cctx_deleter>;
+
+inline bool &cctx_pool_alive() {
+  thread_local bool alive = true;
+  return alive;
+}
+
+// The idle compression contexts of a thread, a context is reset and reused
+// instead of allocated for every call.
+class cctx_pool {
+ public:
+  static cctx_pool *local() {
+    thread_local cctx_pool pool;
+    return cctx_pool_alive() ? &pool : nullptr;
+  }
+
+  ~cctx_pool() { cctx_pool_alive() = false; }
+
+  // the context compresses with the dictionary if it's not nullptr, with the
+  // level otherwise.
+  cctx_ptr acquire(int level, const dictionary *dict = nullptr) {
+    cctx_ptr ctx;
+    if (!idle_.empty()) {
+      ctx = std::move(idle_.back());
+      idle_.pop_back();
+      ZSTD_CCtx_reset(ctx.get(), ZSTD_reset_session_and_parameters);
+    }
+    else {
+      ctx.reset(ZSTD_createCCtx());
+      if (ctx == nullptr) {
+        return nullptr;
+      }
+    }
+    if (dict) {
+      ZSTD_CCtx_refCDict(ctx.get(), dict->cdict());
+    }
+    else {
+      ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel, level);
+    }
+    return ctx;
+  }
+
+  void release(cctx_ptr ctx) {
+    if (ctx && idle_.size() < max_idle) {
+      idle_.push_back(std::move(ctx));
+    }
+  }
+
+ private:
+  static constexpr size_t max_idle = 8;
+  std::vector<cctx_ptr> idle_;
+};
+
+struct dctx_deleter {
+  void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+// the most bytes reserved before any data is decompressed.
+inline constexpr size_t max_first_reserve = 1024 * 1024;
+
+// decompression never suspends, one context per thread is enough.
+inline ZSTD_DCtx *local_dctx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, dctx_deleter> ctx(ZSTD_createDCtx());
+  return ctx.get();
+}
+}  // namespace detail
+
+// compress data with the context until the input is consumed and the output
+// of the directive is complete, the output is appended to out.
+inline bool compress_stream(ZSTD_CCtx *ctx, std::string_view data,
+                            std::string &out, ZSTD_EndDirective directive) {
+  ZSTD_inBuffer input{data.data(), data.size(), 0};
+  size_t reserve = ZSTD_compressBound(data.size());
+  while (true) {
+    size_t old_size = out.size();
+    cinatra::detail::resize(out, old_size + reserve);
+    ZSTD_outBuffer output{out.data() + old_size, reserve, 0};
+    size_t remaining = ZSTD_compressStream2(ctx, &output, &input, directive);
+    out.resize(old_size + output.pos);
+    if (ZSTD_isError(remaining)) {
+      return false;
+    }
+    if (remaining == 0 && input.pos == input.size) {
+      return true;
+    }
+    reserve = (std::max)(remaining, ZSTD_CStreamOutSize());
+  }
+}
+
+// the compressed data is appended to out.
+inline bool compress(std::string_view data, std::string &out,
+                     int level = CINATRA_ZSTD_LEVEL,
+                     const dictionary *dict = shared_dictionary()) {
+  auto pool = detail::cctx_pool::local();
+  if (pool == nullptr) {
+    return false;
+  }
+  auto ctx = pool->acquire(level, dict);
+  if (ctx == nullptr) {
+    return false;
+  }
+  size_t old_size = out.size();
+  size_t bound = ZSTD_compressBound(data.size());
+  cinatra::detail::resize(out, old_size + bound);
+  size_t size = ZSTD_compress2(ctx.get(), out.data() + old_size, bound,
+                               data.data(), data.size());
+  pool->release(std::move(ctx));
+  if (ZSTD_isError(size)) {
+    out.resize(old_size);
+    return false;
+  }
+  out.resize(old_size + size);
+  return true;
+}
+
+// the decompressed data is appended to out. A frame which refers to a
+// dictionary other than the shared one can't be decompressed, nor the one
+// larger than max_size. The content size in the frame header is sent by the
+// peer, the output grows by the data decompressed instead.
+inline bool decompress(std::string_view data, std::string &out,
+                       size_t max_size = MAX_HTTP_BODY_SIZE) {
+  auto ctx = detail::local_dctx();
+  if (ctx == nullptr) {
+    return false;
+  }
+  ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+  auto dict = shared_dictionary();
+  unsigned id = ZSTD_getDictID_fromFrame(data.data(), data.size());
+  if (dict && dict->id() == id) {
+    // a raw content dictionary has no id, nor the frames of it.
+    ZSTD_DCtx_refDDict(ctx, dict->ddict());
+  }
+  else if (id != 0) {
+    return false;
+  }
+
+  size_t reserve = ZSTD_DStreamOutSize();
+  if (auto size = ZSTD_getFrameContentSize(data.data(), data.size());
+      size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR) {
+    if (size > max_size) {
+      return false;
+    }
+    reserve = std::clamp((size_t)size, reserve, detail::max_first_reserve);
+  }
+  size_t start = out.size();
+  ZSTD_inBuffer input{data.data(), data.size(), 0};
+  while (true) {
+    size_t old_size = out.size();
+    cinatra::detail::resize(out, old_size + reserve);
+    ZSTD_outBuffer output{out.data() + old_size, reserve, 0};
+    size_t ret = ZSTD_decompressStream(ctx, &output, &input);
+    out.resize(old_size + output.pos);
+    if (ZSTD_isError(ret) || out.size() - start > max_size) {
+      out.resize(start);
+      return false;
+    }
+    if (input.pos == input.size) {
+      if (ret == 0) {
+        return true;
+      }
+      if (output.pos < reserve) {
+        // the frame is truncated.
+        out.resize(start);
+        return false;
+      }
+    }
+    reserve = (std::max)(reserve, out.size() - start);
+  }
+}
+}  // namespace cinatra::zstd_codec
@@ -275,6 +275,80 @@ TEST_CASE("test brotli type") {
 }
 #endif
 
+#ifdef CINATRA_ENABLE_ZSTD
+TEST_CASE("test zstd type") {
+  std::string content;
+  for (int i = 0; i < 100; i++) {
+    content.append("{\"id\":").append(std::to_string(i)).append("},");
+  }
+
+  coro_http_server server(1, 19001);
+  server.set_http_handler<GET, POST>(
+      "/get", [&](coro_http_request &req, coro_http_response &resp) {
+        if (req.get_encoding_type() == content_encoding::zstd) {
+          std::string decode_str;
+          CHECK(req.decode_body(decode_str));
+          CHECK(decode_str == content);
+        }
+        resp.set_status_and_content(status_type::ok, content,
+                                    content_encoding::zstd,
+                                    req.get_accept_encoding());
+      });
+  server.async_start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  // the client advertises zstd and decodes the response.
+  coro_http_client client{};
+  auto result = client.get("http://127.0.0.1:19001/get");
+  CHECK(get_header_value(result.resp_headers, "Content-Encoding") == "zstd");
+  CHECK(result.resp_body == content);
+
+  std::string ziped_str;
+  CHECK(zstd_codec::compress(content, ziped_str));
+  std::unordered_map<std::string, std::string> headers = {
+      {"Content-Encoding", "zstd"},
+  };
+  result = async_simple::coro::syncAwait(client.async_post(
+      "http://127.0.0.1:19001/get", ziped_str, req_content_type::none, headers));
+  CHECK(result.resp_body == content);
+
+  // a frame of a dictionary is decoded with the same shared dictionary.
+  zstd_codec::set_shared_dictionary(
+      std::make_shared<zstd_codec::dictionary>(content.substr(0, 200)));
+  std::string dict_str, decoded;
+  CHECK(zstd_codec::compress(content, dict_str));
+  CHECK(dict_str.size() < ziped_str.size());
+  CHECK(zstd_codec::decompress(dict_str, decoded));
+  CHECK(decoded == content);
+  result = client.get("http://127.0.0.1:19001/get");
+  CHECK(result.resp_body == content);
+  zstd_codec::set_shared_dictionary(nullptr);
+  server.stop();
+}
+
+TEST_CASE("test zstd forged content size") {
+  // a single segment frame which declares 3GB and holds an empty raw block.
+  std::string frame{"\x28\xb5\x2f\xfd\xe0", 5};
+  uint64_t declared = 3ull * 1024 * 1024 * 1024;
+  for (int i = 0; i < 8; i++) {
+    frame.push_back(char(declared >> (i * 8)));
+  }
+  frame.append("\x01\x00\x00", 3);
+  std::string out;
+  CHECK(!zstd_codec::decompress(frame, out));
+  CHECK(out.empty());
+  CHECK(out.capacity() < 3ull * 1024 * 1024);
+
+  std::string content(64 * 1024, 'x');
+  std::string ziped_str;
+  CHECK(zstd_codec::compress(content, ziped_str, CINATRA_ZSTD_LEVEL, nullptr));
+  CHECK(!zstd_codec::decompress(ziped_str, out, 1024));
+  CHECK(out.empty());
+  CHECK(zstd_codec::decompress(ziped_str, out, content.size()));
+  CHECK(out == content);
+}
+#endif
+
 #ifdef CINATRA_ENABLE_SSL
 TEST_CASE("test ssl client") {
   {
@@ -785,6 +859,16 @@ TEST_CASE("test pipeline") {
         res.set_status_and_content(status_type::ok, "hello coro");
         co_return;
       });
+  server.set_http_handler<POST, PUT>(
+      "/echo", [](coro_http_request &req, coro_http_response &res) {
+        res.set_status_and_content(status_type::ok,
+                                   std::string(req.get_body()));
+      });
+  server.set_http_handler<GET>(
+      "/user/:id", [](coro_http_request &req, coro_http_response &res) {
+        res.set_status_and_content(status_type::ok,
+                                   std::string(req.params_["id"]));
+      });
   server.set_http_handler<GET, POST>(
       "/test_available", [](coro_http_request &req, coro_http_response &res) {
         std::string str(1400, 'a');
@@ -875,7 +959,7 @@ TEST_CASE("test pipeline") {
     http_parser parser{};
     int r = parser.parse_response(result.resp_body.data(),
                                   result.resp_body.size(), 0);
-    CHECK(parser.status() != 200);
+    CHECK(parser.status() == 200);
   }
 
   {
@@ -906,12 +990,59 @@ TEST_CASE("test pipeline") {
                                "127.0.0.1:18090\r\n\r\n"));
     CHECK(!ec);
 
+    // the response of the valid request is sent before the bad request one.
     auto result =
         async_simple::coro::syncAwait(client.async_read_raw(http_method::GET));
     http_parser parser{};
     int r = parser.parse_response(result.resp_body.data(),
                                   result.resp_body.size(), 0);
-    CHECK(parser.status() != 200);
+    CHECK(parser.status() == 200);
+    if (result.resp_body.size() == (size_t)parser.total_len()) {
+      result = async_simple::coro::syncAwait(
+          client.async_read_raw(http_method::GET));
+    }
+    std::string_view left = result.resp_body.substr(parser.total_len());
+    http_parser parser2{};
+    r = parser2.parse_response(left.data(), left.size(), 0);
+    CHECK(parser2.status() == 400);
+  }
+
+  {
+    coro_http_client client{};
+    std::string uri = "http://127.0.0.1:19001";
+    async_simple::coro::syncAwait(client.connect(uri));
+    // pipelined requests with body, radix tree route and coroutine route.
+    auto ec = async_simple::coro::syncAwait(client.async_write_raw(
+        "POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+        "5\r\n\r\nhelloGET /user/42 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+        "PUT /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+        "3\r\n\r\nabcPOST /coro HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"));
+    CHECK(!ec);
+
+    std::vector<std::string> bodies;
+    std::string data;
+    while (bodies.size() < 4) {
+      auto result = async_simple::coro::syncAwait(
+          client.async_read_raw(http_method::POST, true));
+      if (result.net_err) {
+        break;
+      }
+      data.append(result.resp_body);
+      while (true) {
+        http_parser parser{};
+        int r = parser.parse_response(data.data(), data.size(), 0);
+        if (r <= 0 || data.size() < (size_t)parser.total_len()) {
+          break;
+        }
+        bodies.emplace_back(data.substr(r, parser.body_len()));
+        data.erase(0, parser.total_len());
+      }
+    }
+    REQUIRE(bodies.size() == 4);
+    CHECK(bodies[0] == "hello");
+    CHECK(bodies[1] == "42");
+    CHECK(bodies[2] == "abc");
+    CHECK(bodies[3] == "hello coro");
   }
 
   {
@@ -1563,7 +1694,7 @@ TEST_CASE("test head put and some other request") {
       });
   server.set_http_handler<cinatra::http_method::PUT>(
       "/delete/:name", [](coro_http_request &req, coro_http_response &resp) {
-        auto &filename = req.params_["name"];
+        auto filename = req.params_["name"];
         std::error_code ec;
         fs::remove(filename, ec);
         std::string result = ec ? "delete failed" : "ok";
@@ -1571,7 +1702,7 @@ TEST_CASE("test head put and some other request") {
       });
   server.set_http_handler<cinatra::http_method::DEL>(
       "/delete/:name", [](coro_http_request &req, coro_http_response &resp) {
-        auto &filename = req.params_["name"];
+        auto filename = req.params_["name"];
         std::error_code ec;
         fs::remove(filename, ec);
         std::string result = ec ? "delete failed" : "delete ok";
@@ -2846,6 +2977,38 @@ TEST_CASE("test sse server and client") {
           co_return;
         }
 
+        ok = co_await conn->end_sse();
+        CHECK(ok);
+      });
+  server.set_http_handler<GET>(
+      "/sse_posted",
+      [](coro_http_request &,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        auto *conn = resp.get_conn();
+        bool ok = co_await conn->begin_sse();
+        CHECK(ok);
+        if (!ok) {
+          co_return;
+        }
+
+        // the events are posted by other threads, the writer of the
+        // connection keeps the order of every thread.
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; t++) {
+          threads.emplace_back([conn, t] {
+            for (int i = 0; i < 100; i++) {
+              conn->post_sse_event(sse_event{.data = std::to_string(i),
+                                             .id = std::to_string(t)});
+            }
+          });
+        }
+        for (auto &thd : threads) {
+          thd.join();
+        }
+        auto ec = co_await conn->flush_outbound();
+        CHECK(!ec);
+        CHECK(conn->outbound_bytes() == 0);
+
         ok = co_await conn->end_sse();
         CHECK(ok);
       });
@@ -2986,6 +3149,25 @@ TEST_CASE("test sse server and client") {
     CHECK(client.has_closed());
   }
 
+  SUBCASE("events posted from many threads") {
+    coro_http_client client{};
+    int next[2] = {0, 0};
+    bool in_order = true;
+    auto result = async_simple::coro::syncAwait(client.async_get_sse(
+        "http://127.0.0.1:19001/sse_posted",
+        [&](const sse_event &event) {
+          int t = event.id == "1";
+          in_order = in_order && event.data == std::to_string(next[t]);
+          next[t]++;
+        }));
+
+    CHECK(!result.net_err);
+    CHECK(result.eof);
+    CHECK(in_order);
+    CHECK(next[0] == 100);
+    CHECK(next[1] == 100);
+  }
+
   SUBCASE("empty event fields are handled") {
     auto payload = serialize_sse_event(sse_event{.data = ""});
     CHECK(payload == "data: \r\n\r\n");
@@ -257,6 +257,137 @@ TEST_CASE("test websocket content ge 65535") {
   test_websocket_content(65536);
 }
 
+TEST_CASE("test websocket mask kernels") {
+  const uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+  auto check_mask = [&] {
+    // every offset of the payload in the buffer and every length up to a few
+    // blocks of the widest kernel, masked from the middle of the payload too.
+    std::string storage(300, '\0');
+    for (size_t i = 0; i < storage.size(); i++) {
+      storage[i] = (char)(i * 7 + 3);
+    }
+    for (size_t offset = 0; offset < 16; offset++) {
+      for (size_t len = 0; len < 260; len++) {
+        std::string buf = storage;
+        char *data = buf.data() + offset;
+        size_t half = len / 3;
+        detail::mask_payload(data, half, key);
+        detail::mask_payload(data + half, len - half, key, half);
+        for (size_t i = 0; i < len; i++) {
+          REQUIRE(data[i] == (char)(storage[offset + i] ^ key[i % 4]));
+        }
+        detail::mask_payload(data, len, key);
+        REQUIRE(buf == storage);
+      }
+    }
+  };
+
+#ifdef CINATRA_WS_MASK_DISPATCH
+  using detail::mask_kernel;
+  auto origin = detail::current_mask_kernel();
+  for (auto kernel : {mask_kernel::scalar, mask_kernel::sse2,
+                      mask_kernel::avx2, mask_kernel::avx512}) {
+    if (detail::set_mask_kernel(kernel)) {
+      check_mask();
+    }
+  }
+  detail::set_mask_kernel(origin);
+#else
+  check_mask();
+#endif
+}
+
+TEST_CASE("test websocket frame reader") {
+  // frames of every header length, masked like the frames of a client.
+  std::vector<std::string> payloads{"", "a", std::string(125, 'b'),
+                                    std::string(126, 'c'),
+                                    std::string(70000, 'd'), "hello"};
+  std::string stream;
+  for (auto &payload : payloads) {
+    websocket ws{};
+    std::string masked = payload;
+    std::span<char> span(masked);
+    auto header = ws.encode_frame(span, opcode::binary, true);
+    stream.append(header).append(masked);
+  }
+
+  // the stream is read in chunks of every size, the frames complete in a
+  // chunk are decoded without another read.
+  for (size_t chunk : {(size_t)1, (size_t)3, (size_t)100, (size_t)8192,
+                       stream.size()}) {
+    ws_frame_reader reader;
+    websocket ws{};
+    size_t pos = 0, index = 0;
+    while (index < payloads.size()) {
+      std::span<char> payload{};
+      auto status = reader.next_frame(ws, payload, true);
+      if (status == ws_frame_status::incomplete) {
+        REQUIRE(pos < stream.size());
+        auto space = reader.prepare();
+        size_t n = (std::min)({chunk, space.size(), stream.size() - pos});
+        std::memcpy(space.data(), stream.data() + pos, n);
+        reader.commit(n);
+        pos += n;
+        continue;
+      }
+      REQUIRE(status == ws_frame_status::complete);
+      CHECK(ws.parse_payload(payload) == ws_frame_type::WS_BINARY_FRAME);
+      CHECK(std::string_view(payload.data(), payload.size()) ==
+            payloads[index]);
+      index++;
+    }
+    CHECK(reader.size() == 0);
+  }
+
+  ws_frame_reader reader;
+  websocket ws{};
+  std::span<char> payload{};
+  reader.append(stream.data(), stream.size());
+  CHECK(reader.next_frame(ws, payload, true, 100) ==
+        ws_frame_status::complete);
+  CHECK(reader.next_frame(ws, payload, true, 100) ==
+        ws_frame_status::complete);
+  CHECK(reader.next_frame(ws, payload, true, 100) ==
+        ws_frame_status::too_big);
+}
+
+#ifdef INJECT_FOR_HTTP_CLIENT_TEST
+TEST_CASE("test websocket many frames in one read") {
+  cinatra::coro_http_server server(1, 18090);
+  server.set_http_handler<cinatra::GET>(
+      "/ws",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        while (true) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec || result.type == ws_frame_type::WS_CLOSE_FRAME) {
+            break;
+          }
+          co_await req.get_conn()->write_websocket(result.data);
+        }
+      });
+  server.async_start();
+
+  coro_http_client client{};
+  async_simple::coro::syncAwait(client.connect("ws://localhost:18090/ws"));
+  std::string frames;
+  for (int i = 0; i < 100; i++) {
+    websocket ws{};
+    std::string msg = "msg" + std::to_string(i);
+    std::span<char> span(msg);
+    auto header = ws.encode_frame(span, opcode::text, true);
+    frames.append(header).append(msg);
+  }
+  async_simple::coro::syncAwait(client.async_write_raw(frames));
+  for (int i = 0; i < 100; i++) {
+    auto data = async_simple::coro::syncAwait(client.read_websocket());
+    CHECK(data.resp_body == "msg" + std::to_string(i));
+  }
+  client.close();
+  server.stop();
+}
+#endif
+
 TEST_CASE("test send after server stop") {
   cinatra::coro_http_server server(1, 18090);
   server.async_start();
@@ -275,6 +406,41 @@ TEST_CASE("test send after server stop") {
   CHECK(data.net_err);
 }
 
+TEST_CASE("test upgrade headers after idle read") {
+  cinatra::coro_http_server server(1, 18090);
+  server.set_http_handler<cinatra::GET>(
+      "/ws",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        while (true) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec || result.type == ws_frame_type::WS_CLOSE_FRAME) {
+            break;
+          }
+          // the read has waited for the socket of the idle websocket.
+          std::string reply(req.get_header_value("X-Token"));
+          reply.append(":").append(std::to_string(req.get_headers().size()));
+          co_await req.get_conn()->write_websocket(reply);
+        }
+      });
+  server.async_start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  coro_http_client client{};
+  client.add_header("X-Token", "abc");
+  auto ret =
+      async_simple::coro::syncAwait(client.connect("ws://127.0.0.1:18090/ws"));
+  REQUIRE(ret.status == 101);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  async_simple::coro::syncAwait(client.write_websocket("hello"));
+  auto data = async_simple::coro::syncAwait(client.read_websocket());
+  CHECK(data.resp_body.starts_with("abc:"));
+  CHECK(data.resp_body != "abc:0");
+  client.close();
+  server.stop();
+}
+
 TEST_CASE("test read write in different threads") {
   cinatra::coro_http_server server(1, 18090);
   size_t count = 0;
@@ -442,3 +608,352 @@ TEST_CASE("test websocket permessage defalte") {
   client.close();
 }
 #endif
+
+#ifdef CINATRA_ENABLE_GZIP
+TEST_CASE("test websocket permessage deflate negotiation") {
+  std::string response;
+  auto agreed = accept_ws_deflate_offer(
+      "x-webkit-deflate-frame, permessage-deflate; client_max_window_bits=10; "
+      "server_no_context_takeover",
+      {}, response);
+  REQUIRE(agreed);
+  CHECK(agreed->server_no_context_takeover);
+  CHECK(!agreed->client_no_context_takeover);
+  CHECK(agreed->client_max_window_bits == 10);
+  CHECK(response ==
+        "permessage-deflate; server_no_context_takeover; "
+        "client_max_window_bits=10");
+
+  // a duplicated or an unknown parameter declines the offer.
+  response.clear();
+  CHECK(!accept_ws_deflate_offer(
+      "permessage-deflate; server_max_window_bits=10; server_max_window_bits=9",
+      {}, response));
+  CHECK(!accept_ws_deflate_offer("permessage-deflate; foo", {}, response));
+  CHECK(!accept_ws_deflate_offer("permessage-deflate; server_max_window_bits",
+                                 {}, response));
+  CHECK(response.empty());
+
+  // the server may limit its own window without the offer asking for it.
+  ws_deflate_options options{};
+  options.server_max_window_bits = 12;
+  agreed = accept_ws_deflate_offer("permessage-deflate", options, response);
+  REQUIRE(agreed);
+  CHECK(response == "permessage-deflate; server_max_window_bits=12");
+
+  ws_deflate_options offer{};
+  offer.client_no_context_takeover = true;
+  CHECK(make_ws_deflate_offer(offer) ==
+        "permessage-deflate; client_no_context_takeover; "
+        "client_max_window_bits");
+  agreed = parse_ws_deflate_response(
+      "permessage-deflate; server_max_window_bits=12", offer);
+  REQUIRE(agreed);
+  CHECK(agreed->client_no_context_takeover);
+  CHECK(agreed->server_max_window_bits == 12);
+  offer.server_max_window_bits = 10;
+  CHECK(!parse_ws_deflate_response(
+      "permessage-deflate; server_max_window_bits=12", offer));
+
+  // the window of the earlier messages is kept with context takeover.
+  for (bool takeover : {true, false}) {
+    ws_deflate_options params{};
+    params.server_no_context_takeover = !takeover;
+    ws_deflate server_side, client_side;
+    REQUIRE(server_side.init(params, true));
+    REQUIRE(client_side.init(params, false));
+    std::string msg =
+        R"({"symbol":"cinatra","price":100.25,"volume":4096,"side":"buy"})";
+    std::vector<size_t> sizes;
+    for (int i = 0; i < 3; i++) {
+      std::string compressed, decompressed;
+      CHECK(server_side.compress(msg, compressed));
+      CHECK(client_side.decompress(compressed, decompressed));
+      CHECK(decompressed == msg);
+      sizes.push_back(compressed.size());
+    }
+    if (takeover) {
+      CHECK(sizes[1] < sizes[0]);
+    }
+    else {
+      CHECK(sizes[1] == sizes[0]);
+    }
+  }
+}
+
+TEST_CASE("test websocket permessage deflate context takeover") {
+  coro_http_server server(1, 18090);
+  ws_deflate_options options{};
+  options.server_max_window_bits = 10;
+  server.set_ws_deflate(true, options);
+  server.set_http_handler<cinatra::GET>(
+      "/ws_deflate",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        std::string msg;
+        while (true) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec || result.type == ws_frame_type::WS_CLOSE_FRAME) {
+            break;
+          }
+          msg.append(result.data);
+          if (result.eof) {
+            co_await req.get_conn()->write_websocket(msg);
+            msg.clear();
+          }
+        }
+      });
+  server.async_start();
+
+  coro_http_client client{};
+  client.set_ws_deflate(true);
+  auto r = async_simple::coro::syncAwait(
+      client.connect("ws://localhost:18090/ws_deflate"));
+  for (auto &[k, v] : r.resp_headers) {
+    if (k == "Sec-WebSocket-Extensions") {
+      CHECK(v == "permessage-deflate; server_max_window_bits=10");
+    }
+  }
+
+  for (int i = 0; i < 10; i++) {
+    std::string msg = R"({"id":)" + std::to_string(i) +
+                      R"(,"name":"cinatra","tags":["http","websocket"]})";
+    async_simple::coro::syncAwait(client.write_websocket(msg));
+    auto data = async_simple::coro::syncAwait(client.read_websocket());
+    CHECK(data.resp_body == msg);
+  }
+
+  // a message of many frames is compressed as one stream.
+  std::vector<std::string> pieces{"hello ", "deflate ", "websocket"};
+  size_t index = 0;
+  auto source_fn = [&]() -> async_simple::coro::Lazy<read_result> {
+    auto &piece = pieces[index++];
+    co_return read_result{{piece.data(), piece.size()},
+                          index == pieces.size()};
+  };
+  async_simple::coro::syncAwait(client.write_websocket(std::move(source_fn)));
+  auto data = async_simple::coro::syncAwait(client.read_websocket());
+  CHECK(data.resp_body == "hello deflate websocket");
+
+  client.close();
+  server.stop();
+}
+#endif
+
+TEST_CASE("test websocket hub") {
+  websocket_hub hub;
+  coro_http_server server(1, 18090);
+  server.set_http_handler<cinatra::GET>(
+      "/hub",
+      [&hub](coro_http_request &req,
+             coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        auto conn = req.get_conn();
+        while (true) {
+          auto result = co_await conn->read_websocket();
+          if (result.ec || result.type == ws_frame_type::WS_CLOSE_FRAME) {
+            break;
+          }
+          if (result.data.starts_with("sub:")) {
+            hub.subscribe(result.data.substr(4), conn);
+          }
+          co_await conn->write_websocket(result.data);
+        }
+        hub.unsubscribe_all(conn);
+      });
+  server.async_start();
+
+  std::vector<std::unique_ptr<coro_http_client>> clients;
+  for (std::string topic : {"a", "a", "b"}) {
+    auto client = std::make_unique<coro_http_client>();
+#ifdef CINATRA_ENABLE_GZIP
+    // the shared frame is compressed alone for it.
+    client->set_ws_deflate(clients.size() == 1);
+#endif
+    async_simple::coro::syncAwait(client->connect("ws://localhost:18090/hub"));
+    async_simple::coro::syncAwait(client->write_websocket("sub:" + topic));
+    auto data = async_simple::coro::syncAwait(client->read_websocket());
+    CHECK(data.resp_body == "sub:" + topic);
+    clients.push_back(std::move(client));
+  }
+  CHECK(hub.subscriber_count("a") == 2);
+  CHECK(hub.subscriber_count("b") == 1);
+  CHECK(hub.publish("c", "nobody") == 0);
+
+  std::string repeated = R"({"symbol":"cinatra","price":100.25,"side":"buy"})";
+  for (int i = 0; i < 10; i++) {
+    CHECK(hub.publish("a", repeated + std::to_string(i)) == 2);
+  }
+  CHECK(hub.publish("b", "to b") == 1);
+  for (size_t i = 0; i < 2; i++) {
+    for (int j = 0; j < 10; j++) {
+      auto data = async_simple::coro::syncAwait(clients[i]->read_websocket());
+      CHECK(data.resp_body == repeated + std::to_string(j));
+    }
+    // the own messages of the connection are still decoded after the shared
+    // ones.
+    async_simple::coro::syncAwait(
+        clients[i]->write_websocket(std::string(repeated)));
+    auto data = async_simple::coro::syncAwait(clients[i]->read_websocket());
+    CHECK(data.resp_body == repeated);
+  }
+  auto data = async_simple::coro::syncAwait(clients[2]->read_websocket());
+  CHECK(data.resp_body == "to b");
+
+  CHECK(hub.unsubscribe("a", nullptr) == false);
+  clients[0]->close();
+  clients.erase(clients.begin());
+  auto start = std::chrono::steady_clock::now();
+  while (hub.publish("a", "after close") != 1 &&
+         std::chrono::steady_clock::now() - start < 5s) {
+    std::this_thread::sleep_for(10ms);
+  }
+  CHECK(hub.subscriber_count("a") == 1);
+  server.stop();
+}
+
+TEST_CASE("test websocket hub disconnect slow subscriber") {
+  websocket_hub hub(2, ws_overflow_policy::disconnect);
+  coro_http_server server(1, 18090);
+  server.set_http_handler<cinatra::GET>(
+      "/hub",
+      [&hub](coro_http_request &req,
+             coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        hub.subscribe("slow", req.get_conn());
+        while (true) {
+          auto result = co_await req.get_conn()->read_websocket();
+          if (result.ec) {
+            break;
+          }
+        }
+      });
+  server.async_start();
+
+  coro_http_client client{};
+  async_simple::coro::syncAwait(client.connect("ws://localhost:18090/hub"));
+  // the client never reads, the socket buffers fill up and then the queue.
+  std::string big(1024 * 1024, 'x');
+  auto start = std::chrono::steady_clock::now();
+  while (hub.publish("slow", big) != 0 &&
+         std::chrono::steady_clock::now() - start < 10s) {
+    std::this_thread::sleep_for(1ms);
+  }
+  CHECK(hub.subscriber_count("slow") == 0);
+  server.stop();
+}
+
+TEST_CASE("test websocket hub frames after a fragmented message") {
+  websocket_hub hub;
+  std::string shared(200, 'h');
+  coro_http_server server(1, 18090);
+#ifdef CINATRA_ENABLE_GZIP
+  server.set_ws_deflate(true);
+#endif
+  server.set_http_handler<cinatra::GET>(
+      "/fragment",
+      [&](coro_http_request &req,
+          coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        auto conn = req.get_conn();
+        hub.subscribe("t", conn);
+        auto result = co_await conn->read_websocket();
+        if (result.ec) {
+          co_return;
+        }
+        // published on the io thread of the connection, queued between the
+        // frames of the message.
+        co_await conn->write_websocket(std::string(100, 'a'), opcode::text,
+                                       false);
+        hub.publish("t", shared + "1");
+        co_await conn->write_websocket(std::string(100, 'b'), opcode::cont,
+                                       false);
+        hub.publish("t", shared + "2");
+        co_await conn->write_websocket(std::string(100, 'c'), opcode::cont);
+        hub.unsubscribe_all(conn);
+        co_await conn->read_websocket();
+      });
+  server.async_start();
+
+  for (bool deflate : {false, true}) {
+    coro_http_client client{};
+#ifdef CINATRA_ENABLE_GZIP
+    client.set_ws_deflate(deflate);
+#else
+    if (deflate) {
+      break;
+    }
+#endif
+    async_simple::coro::syncAwait(
+        client.connect("ws://localhost:18090/fragment"));
+    async_simple::coro::syncAwait(client.write_websocket("start"));
+    for (char c : {'a', 'b', 'c'}) {
+      auto data = async_simple::coro::syncAwait(client.read_websocket());
+      CHECK(data.resp_body == std::string(100, c));
+    }
+    for (int i = 1; i <= 2; i++) {
+      auto data = async_simple::coro::syncAwait(client.read_websocket());
+      CHECK(data.resp_body == shared + std::to_string(i));
+    }
+    client.close();
+  }
+  server.stop();
+}
+
+TEST_CASE("test websocket write from many threads") {
+  coro_http_server server(1, 18091);
+  server.set_http_handler<cinatra::GET>(
+      "/post",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        auto conn = req.get_conn();
+        auto result = co_await conn->read_websocket();
+        if (result.ec) {
+          co_return;
+        }
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+          threads.emplace_back([conn, t] {
+            for (int i = 0; i < 500; i++) {
+              conn->post_websocket(std::to_string(t) + ":" +
+                                   std::to_string(i));
+            }
+          });
+        }
+        // written at the same time as the posted messages.
+        for (int i = 0; i < 10; i++) {
+          auto ec = co_await conn->write_websocket("4:" + std::to_string(i));
+          CHECK(!ec);
+        }
+        for (auto &thd : threads) {
+          thd.join();
+        }
+        auto ec = co_await conn->flush_outbound();
+        CHECK(!ec);
+        CHECK(conn->outbound_bytes() == 0);
+        co_await conn->write_websocket("end");
+      });
+  server.async_start();
+
+  coro_http_client client{};
+  async_simple::coro::syncAwait(client.connect("ws://localhost:18091/post"));
+  async_simple::coro::syncAwait(client.write_websocket("start"));
+  int next[5] = {};
+  bool in_order = true;
+  while (true) {
+    auto data = async_simple::coro::syncAwait(client.read_websocket());
+    if (data.net_err || data.resp_body == "end") {
+      CHECK(!data.net_err);
+      break;
+    }
+    std::string body(data.resp_body);
+    auto pos = body.find(':');
+    REQUIRE(pos != std::string::npos);
+    int t = std::stoi(body.substr(0, pos));
+    in_order = in_order && body.substr(pos + 1) == std::to_string(next[t]);
+    next[t]++;
+  }
+  CHECK(in_order);
+  for (int t = 0; t < 4; t++) {
+    CHECK(next[t] == 500);
+  }
+  CHECK(next[4] == 10);
+  server.stop();
+}
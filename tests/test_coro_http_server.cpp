@@ -4,6 +4,8 @@
 #include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -31,11 +33,11 @@ TEST_CASE("test parse ranges") {
   bool is_valid = true;
   auto vec = parse_ranges("200-999", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{200, 999}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{200, 999}});
 
   vec = parse_ranges("-", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{0, 9999}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{0, 9999}});
 
   vec = parse_ranges("-a", 10000, is_valid);
   CHECK(!is_valid);
@@ -52,24 +54,37 @@ TEST_CASE("test parse ranges") {
   is_valid = true;
   vec = parse_ranges("-900", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{9100, 9999}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{9100, 9999}});
 
   vec = parse_ranges("900", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{900, 9999}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{900, 9999}});
 
   vec = parse_ranges("200-999, 2000-2499", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{200, 999}, {2000, 2499}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{200, 999},
+                                                        {2000, 2499}});
 
   vec = parse_ranges("200-999, 2000-2499, 9500-", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{
                    {200, 999}, {2000, 2499}, {9500, 9999}});
 
   vec = parse_ranges("", 10000, is_valid);
   CHECK(is_valid);
-  CHECK(vec == std::vector<std::pair<int, int>>{{0, 9999}});
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{{0, 9999}});
+
+  // the offsets of a file larger than 2GB.
+  int64_t big_size = 5ll * 1024 * 1024 * 1024;
+  vec = parse_ranges("3221225472-3221225999, -100", big_size, is_valid);
+  CHECK(is_valid);
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{
+                   {3221225472, 3221225999}, {big_size - 100, big_size - 1}});
+
+  vec = parse_ranges("4294967296-", big_size, is_valid);
+  CHECK(is_valid);
+  CHECK(vec == std::vector<std::pair<int64_t, int64_t>>{
+                   {4294967296, big_size - 1}});
 }
 
 TEST_CASE("coro_io post") {
@@ -264,6 +279,8 @@ TEST_CASE("test range download") {
   coro_http_server server(1, 19001);
   server.set_static_res_dir("", "");
   server.set_file_resp_format_type(file_resp_format_type::range);
+  // not cached, the files are sent by sendfile.
+  server.set_static_cache_budget(0);
   server.async_start();
   std::this_thread::sleep_for(300ms);
 
@@ -330,6 +347,37 @@ TEST_CASE("test range download") {
   result = async_simple::coro::syncAwait(
       client.async_download(uri, filename, "aaa-200"));
   CHECK(result.status == 416);
+
+  // the body of the whole file, a range and every part of multiple ranges
+  // must be the same as the file.
+  std::string content;
+  for (int i = 0; i < 20000; i++) {
+    content.push_back('a' + i % 26);
+  }
+  {
+    std::ofstream file("range_content.txt", std::ios::binary);
+    file << content;
+  }
+  uri = "http://127.0.0.1:19001/range_content.txt";
+  result = client.get(uri);
+  CHECK(result.status == 200);
+  CHECK(result.resp_body == content);
+
+  result = client.get(uri, {{"Range", "bytes=10000-10009"}});
+  CHECK(result.status == 206);
+  CHECK(result.resp_body == content.substr(10000, 10));
+
+  // the client joins the bodies of the parts.
+  result = client.get(uri, {{"Range", "bytes=1-3, 19990-"}});
+  CHECK(result.status == 206);
+  CHECK(result.resp_body == content.substr(1, 3) + content.substr(19990));
+
+  // the connection is still usable, the content length of multiple ranges
+  // is right.
+  result = client.get(uri, {{"Range", "bytes=0-0"}});
+  CHECK(result.status == 206);
+  CHECK(result.resp_body == "a");
+  fs::remove("range_content.txt", ec);
 }
 
 class my_object {
@@ -434,6 +482,50 @@ TEST_CASE("test server sync_start and stop") {
   CHECK(ec == asio::error::operation_aborted);
 }
 
+TEST_CASE("test reuse port acceptors") {
+  cinatra::coro_http_server server(4, 0);
+  server.set_reuse_port(true);
+  server.set_max_accept_batch(8);
+  std::mutex mtx;
+  std::set<std::thread::id> thread_ids;
+  std::atomic<int> handed_off = 0;
+  server.set_http_handler<GET>(
+      "/reuse_port", [&](coro_http_request &req, coro_http_response &resp) {
+        // the connection runs on the io thread which accepted it.
+        if (req.get_conn()->accept_thread_id() != std::this_thread::get_id()) {
+          handed_off++;
+        }
+        {
+          std::scoped_lock lock(mtx);
+          thread_ids.insert(std::this_thread::get_id());
+        }
+        resp.set_status_and_content(status_type::ok, "ok");
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+  CHECK(server.port() > 0);
+
+  std::string url =
+      "http://127.0.0.1:" + std::to_string(server.port()) + "/reuse_port";
+  for (int i = 0; i < 32; i++) {
+    coro_http_client client{};
+    auto result = client.get(url);
+    CHECK(result.status == 200);
+    CHECK(result.resp_body == "ok");
+  }
+  CHECK(handed_off == 0);
+  // the kernel spreads the connections over the listeners.
+  CHECK(thread_ids.size() > 1);
+
+  // a server without reuse port can't bind the same port.
+  cinatra::coro_http_server server2(1, server.port());
+  auto future2 = server2.async_start();
+  future2.wait();
+  CHECK(future2.value() == asio::error::address_in_use);
+
+  server.stop();
+}
+
 TEST_CASE("get post") {
   cinatra::coro_http_server server(1, 19001);
   server.set_shrink_to_fit(true);
@@ -1166,6 +1258,265 @@ TEST_CASE("check connecton timeout") {
   CHECK(server.connection_count() == 0);
 }
 
+TEST_CASE("test connection count of io threads") {
+  cinatra::coro_http_server server(4, 19003);
+  server.set_http_handler<cinatra::GET>(
+      "/", [](coro_http_request &req, coro_http_response &response) {
+        response.set_status_and_content(status_type::ok, "ok");
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  std::vector<std::unique_ptr<coro_http_client>> clients;
+  for (int i = 0; i < 16; i++) {
+    auto client = std::make_unique<coro_http_client>();
+    auto result = client->get("http://127.0.0.1:19003/");
+    CHECK(result.status == 200);
+    clients.push_back(std::move(client));
+  }
+  CHECK(server.connection_count() == 16);
+
+  clients.resize(6);
+  std::this_thread::sleep_for(200ms);
+  CHECK(server.connection_count() == 6);
+
+  server.stop();
+  CHECK(server.connection_count() == 0);
+}
+
+TEST_CASE("test timing wheel") {
+  asio::io_context ctx;
+  auto guard = asio::make_work_guard(ctx);
+  std::thread thd([&] {
+    ctx.run();
+  });
+
+  std::mutex mtx;
+  std::vector<int> fired;
+  auto record = [&](int id) {
+    return [&, id] {
+      std::scoped_lock lock(mtx);
+      fired.push_back(id);
+    };
+  };
+  coro_io::wheel_timer t1(ctx), t2(ctx), t3(ctx), t4(ctx), t5(ctx);
+  t1.arm(30ms, record(1));
+  t2.arm(10ms, record(2));
+  // beyond the first level of the wheel.
+  t3.arm(200ms, record(3));
+  t4.arm(20ms, record(4));
+  CHECK(t4.cancel());
+  CHECK(!t4.cancel());
+  t5.arm(5ms, record(5));
+  // re-arming replaces the deadline.
+  t5.arm(100ms);
+  CHECK(coro_io::timing_wheel::of(ctx)->size() == 4);
+
+  std::this_thread::sleep_for(400ms);
+  {
+    std::scoped_lock lock(mtx);
+    CHECK(fired == std::vector<int>{2, 1, 5, 3});
+  }
+  CHECK(coro_io::timing_wheel::of(ctx)->size() == 0);
+  CHECK(!t1.cancel());
+
+  guard.reset();
+  ctx.stop();
+  thd.join();
+}
+
+TEST_CASE("check header read deadline") {
+  cinatra::coro_http_server server(1, 19002);
+  http_deadlines deadlines{};
+  deadlines.header_read = 100ms;
+  server.set_deadlines(deadlines);
+  server.set_http_handler<cinatra::GET>(
+      "/", [](coro_http_request &req, coro_http_response &response) {
+        response.set_status_and_content(status_type::ok, "ok");
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  asio::io_context ctx;
+  asio::ip::tcp::socket sock(ctx);
+  sock.connect({asio::ip::make_address("127.0.0.1"), 19002});
+  // a head which never ends is closed by the header read deadline.
+  asio::write(sock, asio::buffer(std::string_view("GET / HTTP/1.1\r\n")));
+  char buf[64];
+  std::error_code ec;
+  auto start = std::chrono::steady_clock::now();
+  sock.read_some(asio::buffer(buf), ec);
+  CHECK(ec);
+  CHECK(std::chrono::steady_clock::now() - start < 2s);
+  std::this_thread::sleep_for(50ms);
+  CHECK(server.connection_count() == 0);
+}
+
+TEST_CASE("check chunked body read deadline") {
+  cinatra::coro_http_server server(1, 19002);
+  server.set_timeout_duration(100ms);
+  std::promise<std::error_code> read_ec;
+  server.set_http_handler<cinatra::POST>(
+      "/chunked",
+      [&](coro_http_request &req,
+          coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        while (true) {
+          auto result = co_await req.get_conn()->read_chunked();
+          if (result.ec || result.eof) {
+            read_ec.set_value(result.ec);
+            break;
+          }
+        }
+        resp.set_status_and_content(status_type::ok, "ok");
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  asio::io_context ctx;
+  asio::ip::tcp::socket sock(ctx);
+  sock.connect({asio::ip::make_address("127.0.0.1"), 19002});
+  // a chunked upload which stalls after the first chunk.
+  asio::write(sock, asio::buffer(std::string_view(
+                        "POST /chunked HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                        "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n")));
+  auto future = read_ec.get_future();
+  REQUIRE(future.wait_for(2s) == std::future_status::ready);
+  CHECK(future.get());
+  char buf[64];
+  std::error_code ec;
+  sock.read_some(asio::buffer(buf), ec);
+  CHECK(ec);
+  server.stop();
+}
+
+TEST_CASE("test buffer pool") {
+  CHECK(buffer_pool::class_size(1) == buffer_pool::min_size);
+  CHECK(buffer_pool::class_size(1000) == 1024);
+  CHECK(buffer_pool::class_size(1024) == 1024);
+
+  auto pool = buffer_pool::local();
+  REQUIRE(pool != nullptr);
+  size_t cached = pool->cached_bytes();
+  void *ptr = buffer_pool::allocate(1000);
+  buffer_pool::deallocate(ptr, 1000);
+  CHECK(pool->cached_bytes() >= 1024);
+  // the buffer of the same class is taken again.
+  CHECK(buffer_pool::allocate(1024) == ptr);
+  buffer_pool::deallocate(ptr, 1024);
+
+  pooled_buffer buf;
+  buf.reserve(10, 0);
+  CHECK(buf.capacity() == buffer_pool::min_size);
+  std::memcpy(buf.data(), "0123456789", 10);
+  buf.reserve(100, 10);
+  CHECK(buf.capacity() == 128);
+  CHECK(std::string_view(buf.data(), 10) == "0123456789");
+  pooled_buffer other = std::move(buf);
+  CHECK(buf.data() == nullptr);
+  CHECK(other.capacity() == 128);
+  other.release();
+  CHECK(other.capacity() == 0);
+  CHECK(pool->cached_bytes() >= cached);
+
+  // larger than the pool, it's not cached.
+  size_t before = pool->cached_bytes();
+  ptr = buffer_pool::allocate(buffer_pool::max_size + 1);
+  buffer_pool::deallocate(ptr, buffer_pool::max_size + 1);
+  CHECK(pool->cached_bytes() == before);
+
+  // the buffers not taken between two trims are freed.
+  pool->trim();
+  ptr = buffer_pool::allocate(256 * 1024);
+  buffer_pool::deallocate(ptr, 256 * 1024);
+  CHECK(pool->cached_bytes() >= 256 * 1024);
+  pool->trim();
+  CHECK(pool->cached_bytes() >= 256 * 1024);
+  pool->trim();
+  CHECK(pool->cached_bytes() == 0);
+}
+
+TEST_CASE("test coroutine frame pool") {
+  using async_simple::coro::detail::FramePool;
+  auto lazy = []() -> async_simple::coro::Lazy<int> {
+    co_return 42;
+  };
+  CHECK(async_simple::coro::syncAwait(lazy()) == 42);
+  // the frame is given back to the pool of this thread.
+  CHECK(FramePool::cachedBytes() > 0);
+
+  void *ptr = FramePool::allocate(100);
+  size_t cached = FramePool::cachedBytes();
+  FramePool::deallocate(ptr, 100);
+  CHECK(FramePool::cachedBytes() == cached + 128);
+  // a frame of the same size class takes it again.
+  CHECK(FramePool::allocate(128) == ptr);
+  FramePool::deallocate(ptr, 128);
+
+  // larger than the pool, it's not cached.
+  cached = FramePool::cachedBytes();
+  ptr = FramePool::allocate(FramePool::MaxFrameSize + 1);
+  FramePool::deallocate(ptr, FramePool::MaxFrameSize + 1);
+  CHECK(FramePool::cachedBytes() == cached);
+}
+
+TEST_CASE("test request body of buffer pool") {
+  cinatra::coro_http_server server(1, 19004);
+  server.set_max_http_body_size(1024 * 1024);
+  server.set_http_handler<cinatra::POST>(
+      "/echo", [](coro_http_request &req, coro_http_response &resp) {
+        resp.set_status_and_content(status_type::ok,
+                                    std::string(req.get_body()));
+      });
+  server.set_http_handler<cinatra::POST>(
+      "/chunked",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        std::string content;
+        while (true) {
+          auto result = co_await req.get_conn()->read_chunked();
+          if (result.ec) {
+            co_return;
+          }
+          if (result.eof) {
+            break;
+          }
+          content.append(result.data);
+        }
+        resp.set_status_and_content(status_type::ok, std::move(content));
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  // small and large bodies on the same connection.
+  coro_http_client client{};
+  for (size_t size : {5, 300 * 1024, 7, 900 * 1024, 3}) {
+    std::string body(size, 'a' + size % 26);
+    auto result = client.post("http://127.0.0.1:19004/echo", body,
+                              req_content_type::text);
+    CHECK(result.status == 200);
+    CHECK(result.resp_body == body);
+  }
+
+  auto ss = std::make_shared<std::stringstream>();
+  *ss << std::string(1000, 'c');
+  auto result = async_simple::coro::syncAwait(client.async_upload_chunked(
+      "http://127.0.0.1:19004/chunked"sv, http_method::POST, ss));
+  CHECK(result.status == 200);
+  CHECK(result.resp_body == std::string(1000, 'c'));
+
+  // a chunk larger than the max body size closes the connection.
+  asio::io_context ctx;
+  asio::ip::tcp::socket sock(ctx);
+  sock.connect({asio::ip::make_address("127.0.0.1"), 19004});
+  asio::write(sock, asio::buffer(std::string_view(
+                        "POST /chunked HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                        "Transfer-Encoding: chunked\r\n\r\n200000\r\n")));
+  char buf[64];
+  std::error_code ec;
+  sock.read_some(asio::buffer(buf), ec);
+  CHECK(ec);
+}
+
 TEST_CASE("test websocket with different message size") {
   cinatra::coro_http_server server(1, 9008);
   server.set_http_handler<cinatra::GET>(
@@ -1254,6 +1605,63 @@ TEST_CASE("test ssl server") {
   CHECK(result.resp_body == "ssl");
   std::cout << "ssl ok\n";
 }
+
+TEST_CASE("test ssl session resumption") {
+  auto check_resumption = [](unsigned short port, bool use_ticket) {
+    cinatra::coro_http_server server(1, port);
+    server.init_ssl("../../include/cinatra/server.crt",
+                    "../../include/cinatra/server.key", "test");
+    if (!use_ticket) {
+      server.set_ssl_ticket_key_rotation(0s);
+    }
+    server.set_http_handler<GET>(
+        "/ssl", [](coro_http_request &req, coro_http_response &resp) {
+          resp.set_status_and_content(status_type::ok, "ssl");
+        });
+    server.async_start();
+    std::this_thread::sleep_for(200ms);
+    REQUIRE(server.ssl_context() != nullptr);
+
+    asio::io_context ioc;
+    asio::ssl::context ctx(asio::ssl::context::sslv23);
+    ctx.set_verify_mode(asio::ssl::verify_none);
+    SSL_SESSION *session = nullptr;
+    auto request_once = [&] {
+      asio::ssl::stream<asio::ip::tcp::socket> stream(ioc, ctx);
+      asio::ip::tcp::resolver resolver(ioc);
+      asio::connect(stream.next_layer(),
+                    resolver.resolve("127.0.0.1", std::to_string(port)));
+      if (session) {
+        SSL_set_session(stream.native_handle(), session);
+      }
+      stream.handshake(asio::ssl::stream_base::client);
+      bool reused = SSL_session_reused(stream.native_handle());
+
+      std::string req = "GET /ssl HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+      asio::write(stream, asio::buffer(req));
+      asio::streambuf buf;
+      asio::read_until(stream, buf, TWO_CRCF);
+      // the session is not resumable if the ssl stream is not shutdown.
+      std::error_code ec;
+      stream.shutdown(ec);
+
+      if (session) {
+        SSL_SESSION_free(session);
+      }
+      session = SSL_get1_session(stream.native_handle());
+      return reused;
+    };
+
+    CHECK(!request_once());
+    CHECK(request_once());
+    CHECK(request_once());
+    SSL_SESSION_free(session);
+    server.stop();
+  };
+
+  check_resumption(19002, true);
+  check_resumption(19003, false);
+}
 #endif
 
 TEST_CASE("test http download server") {
@@ -1336,6 +1744,34 @@ TEST_CASE("test restful api") {
   CHECK(result.status == 200);
 }
 
+TEST_CASE("test regex alternation of routes") {
+  cinatra::coro_http_server server(1, 19001);
+  server.set_http_handler<cinatra::GET>(
+      R"(/alt/(x)|GET /alt2/(y))",
+      [](coro_http_request &req, coro_http_response &response) {
+        response.set_status_and_content(status_type::ok, "alternation ok");
+      });
+  server.set_http_handler<cinatra::GET>(
+      R"(/opt/?(z))",
+      [](coro_http_request &req, coro_http_response &response) {
+        response.set_status_and_content(status_type::ok, "optional ok");
+      });
+
+  server.async_start();
+
+  coro_http_client client;
+  auto result = client.get("http://127.0.0.1:19001/alt/x");
+  CHECK(result.resp_body == "alternation ok");
+  result = client.get("http://127.0.0.1:19001/alt2/y");
+  CHECK(result.resp_body == "alternation ok");
+  result = client.get("http://127.0.0.1:19001/alt2/x");
+  CHECK(result.status == 404);
+  result = client.get("http://127.0.0.1:19001/opt/z");
+  CHECK(result.resp_body == "optional ok");
+  result = client.get("http://127.0.0.1:19001/optz");
+  CHECK(result.resp_body == "optional ok");
+}
+
 TEST_CASE("test response standalone") {
   coro_http_response resp(nullptr);
   resp.set_status_and_content(status_type::ok, "ok");
@@ -1378,6 +1814,58 @@ TEST_CASE("test response standalone") {
   resp.set_content_type<4>();
   resp.build_resp_head(buffers);
   CHECK(buffers.size() == 13);
+  resp.clear();
+  str.clear();
+
+  // more headers than the inline capacity, the same cookie is replaced.
+  for (int i = 0; i < 10; i++) {
+    resp.add_header("X-Header-" + std::to_string(i), std::to_string(i));
+  }
+  resp.add_cookie(cookie("name", "first"));
+  resp.add_cookie(cookie("name", "second"));
+  resp.add_cookie(cookie("other", "value"));
+  resp.set_content_type<4>();
+  resp.set_status_and_content(status_type::ok, "hello");
+  resp.build_resp_str(str);
+  CHECK(str.find("X-Header-0: 0\r\n") != std::string::npos);
+  CHECK(str.find("X-Header-9: 9\r\n") != std::string::npos);
+  CHECK(str.find("Set-Cookie: name=second\r\n") != std::string::npos);
+  CHECK(str.find("name=first") == std::string::npos);
+  CHECK(str.find("Set-Cookie: other=value\r\n") != std::string::npos);
+  CHECK(str.find(get_content_type<4>()) != std::string::npos);
+  resp.clear();
+  str.clear();
+
+  resp.set_status_and_content(status_type::ok, "hello");
+  resp.build_resp_str(str);
+  CHECK(str.find("X-Header") == std::string::npos);
+  CHECK(str.find("Set-Cookie") == std::string::npos);
+}
+
+TEST_CASE("test arena") {
+  arena pool(64);
+  auto hello = pool.copy("hello");
+  std::string big(100, 'a');
+  auto big_view = pool.copy(big);
+  CHECK(hello == "hello");
+  CHECK(big_view == big);
+  CHECK(pool.capacity() == 164);
+
+  // the oversized block is released, the first block is reused.
+  pool.reset();
+  CHECK(pool.capacity() == 64);
+  CHECK(pool.copy("world").data() == hello.data());
+
+  small_vector<int, 2> vec;
+  for (int i = 0; i < 5; i++) {
+    vec.push_back(i);
+  }
+  CHECK(vec.size() == 5);
+  CHECK(vec[4] == 4);
+  vec.clear();
+  vec.push_back(7);
+  CHECK(vec.size() == 1);
+  CHECK(*vec.begin() == 7);
 }
 
 TEST_CASE("test radix tree restful api") {
@@ -1391,6 +1879,8 @@ TEST_CASE("test radix tree restful api") {
   server.set_http_handler<cinatra::GET, cinatra::POST>(
       "/user/:id", [](coro_http_request &req, coro_http_response &response) {
         CHECK(req.params_["id"] == "cinatra");
+        CHECK(req.get_path_param("id") == "cinatra");
+        CHECK(req.get_path_param("name").empty());
         response.set_status_and_content(status_type::ok, "ok");
       });
 
@@ -1437,6 +1927,120 @@ TEST_CASE("test radix tree restful api") {
               req_content_type::string);
 }
 
+TEST_CASE("test unified router") {
+  coro_http_router router;
+  auto handler = [](coro_http_request &req, coro_http_response &resp) {};
+  router.set_http_handler<GET>("/user/:id", handler);
+  router.set_http_handler<POST>("/user/:name", handler);
+  router.set_http_handler<GET>("/user/:id/profile", handler);
+  router.set_http_handler<GET>("/user/admin/:id", handler);
+  router.set_http_handler<GET>("/user/{}/files/{}", handler);
+  router.set_http_handler<GET>("/static/:dir/*path", handler);
+  router.set_http_handler<GET>(R"(/numbers/(\d+))", handler);
+  router.set_http_handler<GET>(R"(/fruit/(?:apple|pear)/(\d+))", handler);
+  router.set_http_handler<GET>("/mix/{}/:id", handler);
+  router.set_http_handler<GET>("/item/:id", handler);
+  // the same wildcard entry as "/item/:id", the first route is kept.
+  router.set_http_handler<GET>("/item/{}", handler);
+  router.set_http_handler<GET>("/item/:name", handler);
+  router.set_http_handler<GET>("/mix/{}/:id", handler);
+  router.set_http_handler<GET>(
+      "/coro/:id",
+      [](coro_http_request &req,
+         coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        co_return;
+      });
+  for (int i = 0; i < 1000; i++) {
+    router.set_http_handler<GET>("/api/v" + std::to_string(i) + "/:id",
+                                 handler);
+  }
+
+  route_params params;
+  route_matches matches;
+  auto match = [&](std::string_view key) {
+    return router.match(key, params, matches);
+  };
+  auto param = [&](size_t i) {
+    return i < params.size ? params.values[i] : std::string_view{};
+  };
+
+  auto route = match("GET /user/42");
+  REQUIRE(route != nullptr);
+  CHECK(route->param_names[0] == "id");
+  CHECK(param(0) == "42");
+  CHECK(params["id"] == "42");
+  CHECK(params["name"].empty());
+
+  route = match("POST /user/tom");
+  REQUIRE(route != nullptr);
+  CHECK(route->param_names[0] == "name");
+  CHECK(param(0) == "tom");
+
+  route = match("GET /user/42/profile");
+  REQUIRE(route != nullptr);
+  CHECK(route->param_names.size() == 1);
+  CHECK(param(0) == "42");
+
+  // literal segment is preferred, fallback to the wildcard if not matched.
+  route = match("GET /user/admin/7");
+  REQUIRE(route != nullptr);
+  CHECK(params.size == 1);
+  CHECK(param(0) == "7");
+  route = match("GET /user/admin");
+  REQUIRE(route != nullptr);
+  CHECK(param(0) == "admin");
+
+  route = match("GET /user/1/files/2");
+  REQUIRE(route != nullptr);
+  CHECK(param(0) == "1");
+  CHECK(param(1) == "2");
+  CHECK(matches.str(1) == "1");
+  CHECK(matches.str(2) == "2");
+
+  route = match("GET /static/css/a/b.css");
+  REQUIRE(route != nullptr);
+  CHECK(param(0) == "css");
+  CHECK(param(1) == "a/b.css");
+
+  route = match("GET /numbers/100");
+  REQUIRE(route != nullptr);
+  CHECK(matches.str(1) == "100");
+  CHECK(match("GET /numbers/abc") == nullptr);
+
+  route = match("GET /fruit/pear/3");
+  REQUIRE(route != nullptr);
+  CHECK(route->param_names.empty());
+  CHECK(matches.str(1) == "3");
+  CHECK(match("GET /fruit/plum/3") == nullptr);
+
+  route = match("GET /item/9");
+  REQUIRE(route != nullptr);
+  CHECK(!route->regex);
+  REQUIRE(route->param_names.size() == 1);
+  CHECK(route->param_names[0] == "id");
+  CHECK(params["id"] == "9");
+
+  route = match("GET /mix/a/b");
+  REQUIRE(route != nullptr);
+  CHECK(params["id"] == "b");
+  CHECK(matches.size() == 2);
+  CHECK(matches.str(1) == "a");
+
+  route = match("GET /coro/1");
+  REQUIRE(route != nullptr);
+  CHECK(!route->handler);
+  CHECK(route->coro_handler);
+
+  route = match("GET /api/v999/5");
+  REQUIRE(route != nullptr);
+  CHECK(param(0) == "5");
+
+  CHECK(match("GET /user") == nullptr);
+  CHECK(match("GET /user/") == nullptr);
+  CHECK(match("PUT /user/42") == nullptr);
+  CHECK(match("GET /nothing/1") == nullptr);
+}
+
 TEST_CASE("test coro radix tree restful api") {
   cinatra::coro_http_server server(1, 19001);
 
@@ -1828,6 +2432,542 @@ TEST_CASE("test static res dir dynamic file detection") {
   fs::remove_all(dir);
 }
 
+TEST_CASE("test static res dir rejects cached file out of the dir") {
+  namespace fs = std::filesystem;
+  fs::path dir = "test_static_jail";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  {
+    std::ofstream f("test_static_secret.txt");
+    f << "secret";
+  }
+
+  coro_http_server server(1, 19005);
+  server.set_static_res_dir("", dir.string());
+  server.set_http_handler<GET>(
+      "/secret",
+      [&server](coro_http_request &req,
+                coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        co_await server.serve_static_file_("test_static_secret.txt", req,
+                                           resp);
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  // the file out of the static dir is cached by serve_static_file_.
+  coro_http_client client;
+  auto res = client.get("http://127.0.0.1:19005/secret");
+  CHECK(res.status == 200);
+  CHECK(res.resp_body == "secret");
+
+  // the same key through the static route.
+  asio::io_context ctx;
+  asio::ip::tcp::socket sock(ctx);
+  sock.connect({asio::ip::make_address("127.0.0.1"), 19005});
+  asio::write(sock, asio::buffer(std::string_view(
+                        "GET /../test_static_secret.txt HTTP/1.1\r\n"
+                        "Host: 127.0.0.1\r\n\r\n")));
+  std::string resp;
+  char buf[1024];
+  std::error_code ec;
+  while (resp.find("\r\n\r\n") == std::string::npos) {
+    size_t n = sock.read_some(asio::buffer(buf), ec);
+    if (ec) {
+      break;
+    }
+    resp.append(buf, n);
+  }
+  CHECK(resp.starts_with("HTTP/1.1 400"));
+  CHECK(resp.find("secret") == std::string::npos);
+
+  server.stop();
+  fs::remove_all(dir);
+  fs::remove("test_static_secret.txt");
+}
+
+TEST_CASE("test static cached file out of the dir is refreshed") {
+  namespace fs = std::filesystem;
+  fs::path dir = "test_static_watched";
+  // with a watched static dir and without a static dir.
+  for (bool has_dir : {true, false}) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::ofstream("test_static_outside.txt") << "hello";
+
+    coro_http_server server(1, 19005);
+    if (has_dir) {
+      server.set_static_res_dir("", dir.string());
+    }
+    server.set_cache_refresh_interval(50ms);
+    server.set_http_handler<GET>(
+        "/outside",
+        [&server](coro_http_request &req, coro_http_response &resp)
+            -> async_simple::coro::Lazy<void> {
+          co_await server.serve_static_file_("test_static_outside.txt", req,
+                                             resp);
+        });
+    server.async_start();
+    std::this_thread::sleep_for(200ms);
+
+    coro_http_client client;
+    auto res = client.get("http://127.0.0.1:19005/outside");
+    CHECK(res.resp_body == "hello");
+    CHECK(server.get_static_cache_stats().entries == 1);
+
+    std::ofstream("test_static_outside.txt") << "hello cinatra";
+    std::this_thread::sleep_for(300ms);
+    res = client.get("http://127.0.0.1:19005/outside");
+    CHECK(res.resp_body == "hello cinatra");
+    CHECK(server.get_static_cache_stats().invalidations >= 1);
+
+    server.stop();
+  }
+  fs::remove_all(dir);
+  fs::remove("test_static_outside.txt");
+}
+
+TEST_CASE("test static file cache") {
+  auto make_entry = [](size_t size) {
+    auto entry = std::make_shared<static_file_entry>();
+    entry->body.assign(size, 'a');
+    entry->file_size = size;
+    return entry;
+  };
+  static_file_cache cache(300);
+  CHECK(cache.insert("a", make_entry(100), cache.generation()));
+  CHECK(cache.insert("b", make_entry(100), cache.generation()));
+  CHECK(cache.insert("c", make_entry(100), cache.generation()));
+  // larger than the budget.
+  CHECK(!cache.insert("d", make_entry(400), cache.generation()));
+
+  // "a" and "b" are used, CLOCK evicts "c".
+  CHECK(cache.find("a") != nullptr);
+  CHECK(cache.find("b") != nullptr);
+  cache.insert("e", make_entry(100), cache.generation());
+  CHECK(cache.find("c") == nullptr);
+  CHECK(cache.find("a") != nullptr);
+  CHECK(cache.find("e") != nullptr);
+
+  auto stats = cache.stats();
+  CHECK(stats.entries == 3);
+  CHECK(stats.bytes == 300);
+  CHECK(stats.evictions == 1);
+  CHECK(stats.hits == 4);
+  CHECK(stats.misses == 1);
+
+  // a file changed while loading it is not cached.
+  uint64_t generation = cache.generation();
+  cache.erase("a");
+  CHECK(!cache.insert("a", make_entry(100), generation));
+  CHECK(cache.stats().invalidations == 1);
+
+  auto key = static_file_cache::make_key("www/css/./style.css");
+  CHECK(key == static_file_cache::make_key("www/js/../css/style.css"));
+  cache.insert(key, make_entry(10), cache.generation());
+  cache.erase_dir(static_file_cache::make_key("www/css"));
+  CHECK(cache.find(key) == nullptr);
+
+  cache.set_budget(100);
+  CHECK(cache.stats().bytes <= 100);
+
+  // without inotify, the stat of the cached files are checked.
+  std::ofstream("cache_stat.txt") << "hello";
+  auto entry = make_entry(5);
+  file_validator validator;
+  REQUIRE(stat_file("cache_stat.txt", validator));
+  entry->path = "cache_stat.txt";
+  entry->etag = validator.etag;
+  cache.insert("cache_stat.txt", entry, cache.generation());
+  cache.check_stat();
+  CHECK(cache.find("cache_stat.txt") != nullptr);
+  std::ofstream("cache_stat.txt") << "hello cinatra";
+  cache.check_stat();
+  CHECK(cache.find("cache_stat.txt") == nullptr);
+  fs::remove("cache_stat.txt");
+}
+
+TEST_CASE("test static file cache invalidation") {
+  namespace fs = std::filesystem;
+  fs::path dir = "test_cache_www";
+  fs::remove_all(dir);
+  fs::create_directories(dir / "sub");
+  std::ofstream(dir / "a.txt") << "hello";
+  std::ofstream(dir / "sub" / "b.txt") << "world";
+
+  coro_http_server server(1, 19001);
+  server.set_static_res_dir("", dir.string());
+  server.set_cache_refresh_interval(50ms);
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  coro_http_client client{};
+  auto res = client.get("http://127.0.0.1:19001/a.txt");
+  CHECK(res.resp_body == "hello");
+  res = client.get("http://127.0.0.1:19001/a.txt");
+  CHECK(res.resp_body == "hello");
+  res = client.get("http://127.0.0.1:19001/sub/b.txt");
+  CHECK(res.resp_body == "world");
+  auto stats = server.get_static_cache_stats();
+  CHECK(stats.entries == 2);
+  CHECK(stats.hits == 1);
+  CHECK(stats.misses == 2);
+
+  // a range request is not served by the cache.
+  res = client.get("http://127.0.0.1:19001/a.txt", {{"Range", "bytes=1-2"}});
+  CHECK(res.resp_body == "el");
+
+  std::ofstream(dir / "a.txt") << "hello cinatra";
+  std::ofstream(dir / "sub" / "b.txt") << "world cinatra";
+  std::this_thread::sleep_for(300ms);
+  res = client.get("http://127.0.0.1:19001/a.txt");
+  CHECK(res.resp_body == "hello cinatra");
+  res = client.get("http://127.0.0.1:19001/sub/b.txt");
+  CHECK(res.resp_body == "world cinatra");
+  CHECK(server.get_static_cache_stats().invalidations >= 2);
+
+  fs::remove(dir / "a.txt");
+  std::this_thread::sleep_for(300ms);
+  res = client.get("http://127.0.0.1:19001/a.txt");
+  CHECK(res.status == 404);
+
+  server.stop();
+  fs::remove_all(dir);
+}
+
+TEST_CASE("test conditional requests") {
+  namespace fs = std::filesystem;
+  fs::path dir = "test_conditional_www";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::ofstream(dir / "small.txt") << "hello";
+  std::ofstream(dir / "big.txt") << std::string(2000, 'a');
+
+  file_validator validator;
+  REQUIRE(stat_file((dir / "small.txt").string(), validator));
+  CHECK(validator.size == 5);
+  CHECK(validator.etag.front() == '"');
+  CHECK(get_timestamp(validator.last_modified).second == validator.mtime);
+
+  CHECK(is_not_modified(validator.etag, "", validator.etag, validator.mtime));
+  CHECK(is_not_modified("\"x\", W/" + validator.etag, "", validator.etag,
+                        validator.mtime));
+  CHECK(is_not_modified("*", "", validator.etag, validator.mtime));
+  CHECK(!is_not_modified("\"x\"", validator.last_modified, validator.etag,
+                         validator.mtime));
+  CHECK(is_not_modified("", validator.last_modified, validator.etag,
+                        validator.mtime));
+  CHECK(!is_not_modified("", "Thu, 01 Jan 1970 00:00:00 GMT", validator.etag,
+                         validator.mtime));
+  CHECK(if_range_matches("", validator.etag, validator.mtime));
+  CHECK(if_range_matches(validator.etag, validator.etag, validator.mtime));
+  CHECK(!if_range_matches("W/" + validator.etag, validator.etag,
+                          validator.mtime));
+  CHECK(if_range_matches(validator.last_modified, validator.etag,
+                         validator.mtime));
+
+  coro_http_server server(1, 19001);
+  server.set_static_res_dir("", dir.string());
+  // big.txt is not cached.
+  server.set_max_size_of_cache_files(1000);
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  coro_http_client client{};
+  for (std::string name : {"small.txt", "big.txt"}) {
+    std::string uri = "http://127.0.0.1:19001/" + name;
+    auto res = client.get(uri);
+    CHECK(res.status == 200);
+    std::string etag, last_modified;
+    for (auto [k, v] : res.resp_headers) {
+      if (k == "ETag") {
+        etag = v;
+      }
+      else if (k == "Last-Modified") {
+        last_modified = v;
+      }
+    }
+    CHECK(!etag.empty());
+    CHECK(!last_modified.empty());
+
+    res = client.get(uri, {{"If-None-Match", etag}});
+    CHECK(res.status == 304);
+    CHECK(res.resp_body.empty());
+    res = client.get(uri, {{"If-Modified-Since", last_modified}});
+    CHECK(res.status == 304);
+    res = client.get(uri, {{"If-None-Match", "\"other\""}});
+    CHECK(res.status == 200);
+
+    // the range is ignored when If-Range doesn't match.
+    res = client.get(uri, {{"Range", "bytes=0-1"}, {"If-Range", etag}});
+    CHECK(res.status == 206);
+    CHECK(res.resp_body.size() == 2);
+    res = client.get(uri, {{"Range", "bytes=0-1"}, {"If-Range", "\"old\""}});
+    CHECK(res.status == 200);
+    CHECK(res.resp_body.size() == fs::file_size(dir / name));
+  }
+
+  server.stop();
+  fs::remove_all(dir);
+}
+
+#ifdef CINATRA_ENABLE_GZIP
+TEST_CASE("test accepts encoding") {
+  CHECK(accepts_encoding("gzip, br", "br"));
+  CHECK(!accepts_encoding("gzip, br", "zstd"));
+  CHECK(accepts_encoding("GZIP", "gzip"));
+  CHECK(accepts_encoding("gzip;q=0.5", "gzip"));
+  CHECK(!accepts_encoding("gzip;q=0", "gzip"));
+  CHECK(!accepts_encoding("gzip; q=0.000", "gzip"));
+  CHECK(accepts_encoding("*", "br"));
+  // the listed coding takes precedence over "*".
+  CHECK(accepts_encoding("*;q=0, gzip", "gzip"));
+  CHECK(!accepts_encoding("*;q=0, gzip", "br"));
+  CHECK(!accepts_encoding("gzip;q=0, *", "gzip"));
+  CHECK(accepts_encoding("gzip;q=0, *", "br"));
+  CHECK(!accepts_encoding("", "gzip"));
+}
+
+TEST_CASE("test precompressed static files") {
+  namespace fs = std::filesystem;
+  fs::path dir = "test_precompressed_www";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::string content;
+  for (int i = 0; i < 100; i++) {
+    content.append("hello cinatra ").append(std::to_string(i)).append("\n");
+  }
+  std::ofstream(dir / "a.txt") << content;
+  std::ofstream(dir / "b.txt") << content;
+  std::ofstream(dir / "c.jpg") << content;
+  std::string compressed;
+  REQUIRE(gzip_codec::compress(content, compressed));
+  std::ofstream(dir / "a.txt.gz", std::ios::binary) << compressed;
+
+  auto get_headers = [](auto &res) {
+    std::string encoding, vary;
+    for (auto [k, v] : res.resp_headers) {
+      if (k == "Content-Encoding") {
+        encoding = v;
+      }
+      else if (k == "Vary") {
+        vary = v;
+      }
+    }
+    return std::make_pair(encoding, vary);
+  };
+
+  for (bool cached : {false, true}) {
+    coro_http_server server(1, 19001);
+    server.set_static_res_dir("", dir.string());
+    if (!cached) {
+      server.set_static_cache_budget(0);
+    }
+    server.set_precompressed_files(true);
+    server.async_start();
+    std::this_thread::sleep_for(200ms);
+
+    coro_http_client client{};
+    std::string uri = "http://127.0.0.1:19001/a.txt";
+    // the client decodes the gzip body.
+    for (int i = 0; i < 2; i++) {
+      auto res = client.get(uri, {{"Accept-Encoding", "br, gzip"}});
+      CHECK(res.status == 200);
+      CHECK(res.resp_body == content);
+      CHECK(get_headers(res) ==
+            std::make_pair(std::string("gzip"),
+                           std::string("Accept-Encoding")));
+    }
+    for (int i = 0; i < 2; i++) {
+      auto res = client.get(uri, {{"Accept-Encoding", "gzip;q=0"}});
+      CHECK(res.resp_body == content);
+      CHECK(get_headers(res).first.empty());
+      CHECK(get_headers(res).second == "Accept-Encoding");
+    }
+
+    // the ranges are served from the original file.
+    auto res = client.get(
+        uri, {{"Accept-Encoding", "gzip"}, {"Range", "bytes=0-4"}});
+    CHECK(res.status == 206);
+    CHECK(res.resp_body == "hello");
+    CHECK(get_headers(res).first.empty());
+    if (cached) {
+      // the original file and its gzip variant.
+      CHECK(server.get_static_cache_stats().entries == 2);
+    }
+    server.stop();
+  }
+
+  // a stale sidecar is ignored, the missing sidecars of the compressible
+  // files are generated.
+  std::ofstream(dir / "a.txt") << content << "new";
+  fs::last_write_time(dir / "a.txt.gz",
+                      fs::last_write_time(dir / "a.txt") - 10s);
+  coro_http_server server(1, 19001);
+  server.set_static_res_dir("", dir.string());
+  server.set_precompressed_files(true);
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+  coro_http_client client{};
+  auto res = client.get("http://127.0.0.1:19001/a.txt",
+                        {{"Accept-Encoding", "gzip"}});
+  CHECK(res.resp_body == content + "new");
+  CHECK(get_headers(res).first.empty());
+
+  CHECK(async_simple::coro::syncAwait(server.generate_precompressed_files()) ==
+        2);
+  CHECK(fs::exists(dir / "b.txt.gz"));
+  CHECK(!fs::exists(dir / "c.jpg.gz"));
+  res = client.get("http://127.0.0.1:19001/a.txt",
+                   {{"Accept-Encoding", "gzip"}});
+  CHECK(res.resp_body == content + "new");
+  CHECK(get_headers(res).first == "gzip");
+  res = client.get("http://127.0.0.1:19001/b.txt",
+                   {{"Accept-Encoding", "gzip"}});
+  CHECK(res.resp_body == content);
+  CHECK(get_headers(res).first == "gzip");
+  CHECK(async_simple::coro::syncAwait(server.generate_precompressed_files()) ==
+        0);
+
+  server.stop();
+  fs::remove_all(dir);
+}
+#endif
+
+#ifdef CINATRA_ENABLE_GZIP
+TEST_CASE("test stream compressor") {
+  std::string content;
+  for (int i = 0; i < 1000; i++) {
+    content.append("hello cinatra ").append(std::to_string(i)).append("\n");
+  }
+
+  for (auto encoding : {content_encoding::gzip, content_encoding::deflate}) {
+    // the pooled state is reused by the second round.
+    for (int round = 0; round < 2; round++) {
+      stream_compressor compressor;
+      REQUIRE(compressor.init(encoding));
+      std::string compressed;
+      for (size_t pos = 0; pos < content.size(); pos += 1000) {
+        size_t size = compressed.size();
+        CHECK(compressor.compress(content.substr(pos, 1000), compressed,
+                                  false));
+        // every piece is flushed.
+        CHECK(compressed.size() > size);
+      }
+      CHECK(compressor.compress("", compressed, true));
+      compressor.reset();
+      CHECK(!compressor.active());
+      CHECK(compressed.size() < content.size());
+
+      std::string uncompressed;
+      if (encoding == content_encoding::gzip) {
+        CHECK(gzip_codec::uncompress(compressed, uncompressed));
+      }
+      else {
+        CHECK(gzip_codec::inflate(compressed, uncompressed));
+      }
+      CHECK(uncompressed == content);
+    }
+  }
+
+  std::string compressed, uncompressed;
+  CHECK(compress_data(content_encoding::gzip, content, compressed));
+  CHECK(gzip_codec::uncompress(compressed, uncompressed));
+  CHECK(uncompressed == content);
+  CHECK(negotiate_encoding("deflate, gzip;q=0.5") == content_encoding::gzip);
+  CHECK(negotiate_encoding("deflate, gzip;q=0") == content_encoding::deflate);
+  CHECK(negotiate_encoding("") == content_encoding::none);
+  CHECK(is_compressible_mime("application/json; charset=UTF-8"));
+  CHECK(!is_compressible_mime("image/png"));
+}
+
+TEST_CASE("test auto compression") {
+  std::string content;
+  for (int i = 0; i < 100; i++) {
+    content.append("hello cinatra ").append(std::to_string(i)).append("\n");
+  }
+
+  coro_http_server server(1, 9001);
+  server.set_auto_compression(true, 100);
+  server.set_http_handler<GET>(
+      "/text", [&](coro_http_request &, coro_http_response &resp) {
+        resp.add_header("Content-Type", "text/plain");
+        resp.set_status_and_content(status_type::ok, content);
+      });
+  server.set_http_handler<GET>(
+      "/small", [](coro_http_request &, coro_http_response &resp) {
+        resp.add_header("Content-Type", "text/plain");
+        resp.set_status_and_content(status_type::ok, "hello");
+      });
+  server.set_http_handler<GET>(
+      "/binary", [&](coro_http_request &, coro_http_response &resp) {
+        resp.add_header("Content-Type", "application/octet-stream");
+        resp.set_status_and_content(status_type::ok, content);
+      });
+  server.set_http_handler<GET>(
+      "/chunked",
+      [&](coro_http_request &req,
+          coro_http_response &resp) -> async_simple::coro::Lazy<void> {
+        resp.set_format_type(format_type::chunked);
+        resp.add_header("Content-Type", "text/plain");
+        auto conn = req.get_conn();
+        if (!co_await conn->begin_chunked()) {
+          co_return;
+        }
+        for (size_t pos = 0; pos < content.size(); pos += 500) {
+          if (!co_await conn->write_chunked(content.substr(pos, 500))) {
+            co_return;
+          }
+        }
+        co_await conn->end_chunked();
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  auto get_encoding = [](auto &res) {
+    for (auto [k, v] : res.resp_headers) {
+      if (k == "Content-Encoding") {
+        return std::string(v);
+      }
+    }
+    return std::string();
+  };
+
+  coro_http_client client{};
+  std::string uri = "http://127.0.0.1:9001/";
+  // the client decodes the gzip body.
+  auto res = client.get(uri + "text", {{"Accept-Encoding", "gzip"}});
+  CHECK(get_encoding(res) == "gzip");
+  CHECK(res.resp_body == content);
+  res = client.get(uri + "text", {{"Accept-Encoding", "identity"}});
+  CHECK(get_encoding(res).empty());
+  CHECK(res.resp_body == content);
+  res = client.get(uri + "small", {{"Accept-Encoding", "gzip"}});
+  CHECK(get_encoding(res).empty());
+  CHECK(res.resp_body == "hello");
+  res = client.get(uri + "binary", {{"Accept-Encoding", "gzip"}});
+  CHECK(get_encoding(res).empty());
+  CHECK(res.resp_body == content);
+
+  for (std::string accept : {"gzip", "deflate"}) {
+    res = client.get(uri + "chunked", {{"Accept-Encoding", accept}});
+    CHECK(res.status == 200);
+    CHECK(get_encoding(res) == accept);
+    std::string body;
+    if (accept == "gzip") {
+      CHECK(gzip_codec::uncompress(res.resp_body, body));
+    }
+    else {
+      CHECK(gzip_codec::inflate(res.resp_body, body));
+    }
+    CHECK(body == content);
+  }
+  res = client.get(uri + "chunked");
+  CHECK(get_encoding(res).empty());
+  CHECK(res.resp_body == content);
+  server.stop();
+}
+#endif
+
 TEST_CASE("test static res dir with uri suffix") {
   namespace fs = std::filesystem;
 
@@ -2040,3 +3180,37 @@ TEST_CASE("test max http header size") {
 
   server.stop();
 }
+
+TEST_CASE("test http header split across reads") {
+  cinatra::coro_http_server server(1, 19004);
+  server.set_http_handler<cinatra::GET>(
+      "/split", [](coro_http_request &req, coro_http_response &resp) {
+        resp.set_status_and_content(status_type::ok,
+                                    std::string(req.get_header_value("name")));
+      });
+  server.async_start();
+  std::this_thread::sleep_for(200ms);
+
+  asio::io_context ioc;
+  asio::ip::tcp::socket socket(ioc);
+  asio::ip::tcp::resolver resolver(ioc);
+  asio::connect(socket, resolver.resolve("127.0.0.1", "19004"));
+
+  std::string req =
+      "GET /split HTTP/1.1\r\nHost: 127.0.0.1\r\nname: tom\r\n\r\n";
+  // send the header byte by byte, and the last "\r\n" in two parts.
+  for (size_t i = 0; i < req.size(); i++) {
+    asio::write(socket, asio::buffer(req.data() + i, 1));
+    if (i % 8 == 0 || i == req.size() - 2) {
+      std::this_thread::sleep_for(5ms);
+    }
+  }
+
+  asio::streambuf buf;
+  auto size = asio::read_until(socket, buf, "tom");
+  std::string_view resp(asio::buffer_cast<const char *>(buf.data()), size);
+  CHECK(resp.starts_with("HTTP/1.1 200"));
+  CHECK(resp.ends_with("tom"));
+
+  server.stop();
+}
@@ -99,6 +99,125 @@ TEST_CASE("http_parser test") {
   CHECK(ret < 0);
 }
 
+TEST_CASE("http_parser incremental parse") {
+  http_parser parser{};
+  size_t last_len = 0;
+  int ret = -2;
+  int head_len = (int)REQ.size() - 1;
+  for (size_t len = 7; len < (size_t)head_len; len += 7) {
+    ret = parser.parse_request(REQ.data(), len, last_len);
+    CHECK(ret == -2);
+    last_len = len;
+  }
+  ret = parser.parse_request(REQ.data(), REQ.size(), last_len);
+  CHECK(ret == head_len);
+  CHECK(parser.method() == "R(GET");
+  CHECK(parser.get_header_value("host") == "www.kittyhell.com");
+  CHECK(parser.has_connection());
+
+  std::string pipeline_str{REQ.substr(0, REQ.size() - 1)};
+  pipeline_str.append("GET /next HTTP/1.1\r\n");
+  parser = {};
+  ret = parser.parse_request(pipeline_str.data(), pipeline_str.size(), 0);
+  CHECK(ret == head_len);
+}
+
+TEST_CASE("http_parser header index") {
+  std::string_view str =
+      "POST /upload HTTP/1.1\r\n"
+      "HOST: cinatra\r\n"
+      "content-TYPE: application/x-www-form-urlencoded\r\n"
+      "Content-Length: 3\r\n"
+      "Connection: keep-alive, Upgrade\r\n"
+      "X-Custom: first\r\n"
+      "x-custom: second\r\n"
+      "Range: bytes=0-1\r\n"
+      "Range: bytes=2-3\r\n"
+      "\r\n"
+      "a=b";
+  http_parser parser{};
+  int ret = parser.parse_request(str.data(), str.size(), 0);
+  REQUIRE(ret == (int)str.size() - 3);
+  CHECK(parser.get_header_value(http_header_id::host) == "cinatra");
+  CHECK(parser.get_header_value("Host") == "cinatra");
+  CHECK(parser.get_header_value(http_header_id::range) == "bytes=0-1");
+  CHECK(parser.get_header_value("X-CUSTOM") == "first");
+  CHECK(parser.get_header_value(http_header_id::cookie).empty());
+  CHECK(parser.body_len() == 3);
+  CHECK(parser.get_content_type() == content_type::urlencoded);
+  CHECK(parser.has_upgrade());
+  CHECK(!parser.has_close());
+  CHECK(to_header_id("Sec-WebSocket-Key") == http_header_id::sec_websocket_key);
+  CHECK(to_header_id("X-Custom") == http_header_id::unknown);
+
+  // the index is rebuilt for the next request.
+  std::string_view next =
+      "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+      "Connection: close\r\n\r\n";
+  ret = parser.parse_request(next.data(), next.size(), 0);
+  REQUIRE(ret == (int)next.size());
+  CHECK(parser.get_header_value(http_header_id::host).empty());
+  CHECK(parser.get_content_type() == content_type::chunked);
+  CHECK(parser.has_close());
+  CHECK(!parser.has_upgrade());
+}
+
+#ifdef CINATRA_SIMD_DISPATCH
+TEST_CASE("picohttpparser simd kernels") {
+  using detail::phr_kernel;
+  auto parse = [](std::string_view str, std::vector<http_header> &headers) {
+    const char *method, *path;
+    size_t method_len, path_len, num_headers = 16;
+    int minor_version;
+    bool has_connection{}, has_close{}, has_upgrade{}, has_query{};
+    headers.resize(num_headers);
+    int ret = detail::phr_parse_request(
+        str.data(), str.size(), &method, &method_len, &path, &path_len,
+        &minor_version, headers.data(), &num_headers, 0, has_connection,
+        has_close, has_upgrade, has_query);
+    headers.resize(ret > 0 ? num_headers : 0);
+    return has_query ? -ret : ret;
+  };
+
+  // the names and values cover the full blocks and the tails of every kernel.
+  std::vector<std::string> reqs;
+  for (size_t len = 1; len < 140; len++) {
+    std::string req = "GET /" + std::string(len, 'p') +
+                      (len % 2 ? "?a=1" : "") + " HTTP/1.1\r\n";
+    req.append("X-" + std::string(len, 'n') + ": " + std::string(len, 'v'));
+    req.append("\r\nHost: cinatra\r\n\r\n");
+    reqs.push_back(req);
+
+    std::string bad = req;
+    bad[req.find(": ") + 2 + len / 2] = '\x01';
+    reqs.push_back(bad);
+  }
+  reqs.push_back(std::string(REQ.substr(0, REQ.size() - 1)));
+
+  auto origin = detail::current_phr_kernel();
+  for (auto kernel :
+       {phr_kernel::sse42, phr_kernel::avx2, phr_kernel::avx512}) {
+    if (!detail::set_phr_kernel(kernel)) {
+      continue;
+    }
+    for (auto &req : reqs) {
+      std::vector<http_header> expected, headers;
+      detail::set_phr_kernel(phr_kernel::scalar);
+      int expected_ret = parse(req, expected);
+      detail::set_phr_kernel(kernel);
+      int ret = parse(req, headers);
+      CHECK(ret == expected_ret);
+      REQUIRE(headers.size() == expected.size());
+      for (size_t i = 0; i < headers.size(); i++) {
+        CHECK(headers[i].name == expected[i].name);
+        CHECK(headers[i].value == expected[i].value);
+      }
+    }
+  }
+  detail::set_phr_kernel(origin);
+}
+#endif
+
 std::string_view req_str =
     "R(GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg "
     "HTTP/1.1\r\n"